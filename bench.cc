@@ -0,0 +1,497 @@
+// native benchmarks of the capture-to-JS path, without N-API. packets come
+// from a simulated backend (see simulatedbackend.h), so the numbers do not
+// depend on the audio device and the benchmark runs on any platform.
+//
+//   capture-bench [--packets N] [--repeat R] [--seconds S]
+//
+// prints one JSON object to stdout:
+//   packetCost: cost per packet and per frame of each way packets leave the
+//     client, for a range of packet sizes. "backend" is the cost of producing
+//     the packets alone, included in every other path; "pipeline" is what the
+//     capture thread does per packet plus the readFrames() copy. each is the
+//     best of R runs of N packets.
+//   converter: cost of SampleConverter per sample for int16 and int24, with
+//     and without dither, on the scalar reference and each vector kernel the
+//     CPU runs, and the speedup over scalar. best of R runs of N 10 ms packets.
+//   resampler: cost of Resampler per input and per output frame for each
+//     quality preset and common rate pair. best of R runs of N 10 ms packets.
+//   latency: age of the newest frame when it reaches the reader, in
+//     percentiles, by packet size and polling interval, S seconds each.
+//     getBuffer polls the backend on the reader thread; readFrames reads the
+//     capture thread's ring.
+// bench.js runs this and merges the result into its own.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "captureclient.h"
+#include "resampler.h"
+#include "sampleconvert.h"
+#include "simd.h"
+#include "simulatedbackend.h"
+
+static const unsigned int benchSampleRate = 48000;
+static const unsigned int benchChannels = 2;
+static const double packetSizesMs[] = { 1.0, 3.0, 10.0, 20.0, 100.0 };
+static const double latencyPacketsMs[] = { 3.0, 10.0, 20.0 };
+static const unsigned int pollIntervalsMs[] = { 1, 5, 10, 20 };
+
+typedef std::chrono::steady_clock Clock;
+
+// same time base as the simulated backend's timestamps (and, on Windows, as
+// the performance counter times WASAPI reports), in 100 ns units
+static double now100ns() {
+  return (double)(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count() / 100);
+}
+
+static double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// digital zero costs the least to generate, so the backend share of each
+// measurement stays small. the packets are not flagged silent.
+static SignalBackend* createBackend(double packetMs, bool realtime) {
+  SignalBackend* backend = new SignalBackend();
+  backend->setSignal(SIGNAL_ZERO, 0.0, 0.0f, benchChannels, benchSampleRate);
+  SimulationOptions options;
+  options.realtime = realtime;
+  options.packetMs = packetMs;
+  backend->setOptions(options);
+  return backend;
+}
+
+static void* createClient(double packetMs, bool realtime) {
+  void* client = createCaptureClient();
+  setCaptureBackend(client, createBackend(packetMs, realtime));
+  if (!startCapture(client)) {
+    fprintf(stderr, "capture-bench: could not start capture\n");
+    exit(1);
+  }
+  return client;
+}
+
+static void deleteClient(void* client) {
+  stopCapture(client);
+  delete (AudioCaptureClient*)client;
+}
+
+typedef struct PacketCost {
+  const char* path;
+  double packetMs;
+  uint64_t packets;
+  uint64_t frames;
+  double seconds;
+  unsigned int bytesPerFrame;
+} PacketCost;
+
+static void printPacketCost(const PacketCost& cost, bool last) {
+  printf("    {\"path\": \"%s\", \"packetMs\": %g, \"packets\": %llu, \"frames\": %llu, "
+    "\"nsPerPacket\": %.1f, \"nsPerFrame\": %.3f, \"bytesPerFrame\": %u}%s\n",
+    cost.path, cost.packetMs, (unsigned long long)cost.packets, (unsigned long long)cost.frames,
+    cost.seconds * 1e9 / (double)cost.packets, cost.seconds * 1e9 / (double)cost.frames,
+    cost.bytesPerFrame, last ? "" : ",");
+}
+
+// the backend alone: acquire and release, nothing copied
+static PacketCost measureBackend(double packetMs, uint64_t packets) {
+  SignalBackend* backend = createBackend(packetMs, false);
+  backend->open();
+  PacketCost cost = { "backend", packetMs, 0, 0, 0.0, 0 };
+  Clock::time_point start = Clock::now();
+  while (cost.packets < packets) {
+    if (backend->getNextPacketSize() == 0) {
+      continue;
+    }
+    const char* data;
+    uint32_t flags;
+    uint64_t devicePosition;
+    uint64_t timestamp;
+    uint32_t frames = backend->acquirePacket(&data, &flags, &devicePosition, &timestamp);
+    backend->releasePacket(frames);
+    cost.frames += frames;
+    cost.packets++;
+  }
+  cost.seconds = secondsSince(start);
+  backend->close();
+  delete backend;
+  return cost;
+}
+
+// the polling path: one getNextPacketSize() / getBuffer() pair per packet,
+// copying the packet into the caller's buffer
+static PacketCost measureGetBuffer(double packetMs, uint64_t packets) {
+  void* client = createClient(packetMs, false);
+  AudioCaptureFormat format = getAudioFormat(client);
+  uint32_t capacity = benchSampleRate;
+  std::vector<char> out((size_t)capacity * format.frameSize);
+  PacketCost cost = { "getBuffer", packetMs, 0, 0, 0.0, format.frameSize };
+  Clock::time_point start = Clock::now();
+  while (cost.packets < packets) {
+    uint32_t expected = getNextPacketSize(client);
+    if (expected == 0) {
+      continue;
+    }
+    cost.frames += getBuffer(client, expected, capacity, out.data());
+    cost.packets++;
+  }
+  cost.seconds = secondsSince(start);
+  deleteClient(client);
+  return cost;
+}
+
+// the polling path, every ready packet in one call
+static PacketCost measureDrainInto(double packetMs, uint64_t packets) {
+  void* client = createClient(packetMs, false);
+  AudioCaptureFormat format = getAudioFormat(client);
+  uint32_t capacity = benchSampleRate;
+  std::vector<char> out((size_t)capacity * format.frameSize);
+  PacketCost cost = { "drainInto", packetMs, 0, 0, 0.0, format.frameSize };
+  Clock::time_point start = Clock::now();
+  while (getPacketCounters(client).packets < packets) {
+    uint32_t flags;
+    cost.frames += drainInto(client, out.data(), capacity, &flags);
+  }
+  cost.seconds = secondsSince(start);
+  cost.packets = getPacketCounters(client).packets;
+  deleteClient(client);
+  return cost;
+}
+
+// the work of the capture thread per packet, on one thread so the reader
+// never falls behind: the pipeline converts the packet into a ring and
+// readFrames() copies it out again
+static PacketCost measurePipeline(double packetMs, uint64_t packets) {
+  SignalBackend* backend = createBackend(packetMs, false);
+  backend->open();
+  CaptureFormat format = backend->getFormat();
+  CapturePipeline pipeline;
+  pipeline.setInputFormat(format.frameSize, format.numChannels, format.sampleRate, format.sampleType);
+  pipeline.prepare();
+  RingBuffer ring;
+  ring.allocate((size_t)benchSampleRate * pipeline.getOutputFrameSize());
+  std::vector<char> out((size_t)benchSampleRate * pipeline.getOutputFrameSize());
+  PacketCost cost = { "pipeline", packetMs, 0, 0, 0.0, pipeline.getOutputFrameSize() };
+  Clock::time_point start = Clock::now();
+  while (cost.packets < packets) {
+    if (backend->getNextPacketSize() == 0) {
+      continue;
+    }
+    const char* data;
+    uint32_t flags;
+    uint64_t devicePosition;
+    uint64_t timestamp;
+    uint32_t frames = backend->acquirePacket(&data, &flags, &devicePosition, &timestamp);
+    uint32_t written;
+    pipeline.processPacket(data, frames, flags, &ring, &written);
+    backend->releasePacket(frames);
+    ring.read(out.data(), ring.readAvailable());
+    cost.frames += written;
+    cost.packets++;
+  }
+  cost.seconds = secondsSince(start);
+  backend->close();
+  delete backend;
+  return cost;
+}
+
+typedef PacketCost (*CostMeasure)(double packetMs, uint64_t packets);
+static const CostMeasure costMeasures[] = { measureBackend, measureGetBuffer, measureDrainInto, measurePipeline };
+
+// a 10 ms packet of a stereo sine at half scale, so no sample clips
+static std::vector<float> makeSinePacket(unsigned int sampleRate) {
+  std::vector<float> samples((size_t)(sampleRate / 100) * benchChannels);
+  for (size_t i = 0; i < samples.size(); i++) {
+    samples[i] = 0.5f * (float)sin(0.0613 * (double)(i / benchChannels) + (double)(i % benchChannels));
+  }
+  return samples;
+}
+
+typedef struct ConverterPath {
+  const char* name;
+  bool simd;
+  bool avx2;
+} ConverterPath;
+
+// the scalar reference first, then the vector kernels this CPU can run
+static std::vector<ConverterPath> getConverterPaths() {
+  std::vector<ConverterPath> paths;
+  paths.push_back({ "scalar", false, false });
+#if defined(CAPTURE_SIMD_X86)
+  paths.push_back({ "sse2", true, false });
+  if (cpuSupportsAvx2()) {
+    paths.push_back({ "avx2", true, true });
+  }
+#elif defined(CAPTURE_SIMD_NEON)
+  paths.push_back({ "neon", true, false });
+#endif
+  return paths;
+}
+
+typedef struct ConverterCost {
+  const char* path;
+  SampleFormat format;
+  bool dither;
+  uint64_t samples;
+  double seconds;
+  double scalarSeconds;
+} ConverterCost;
+
+static ConverterCost measureConverter(const ConverterPath& path, SampleFormat format, bool dither, uint64_t packets) {
+  std::vector<float> in = makeSinePacket(benchSampleRate);
+  std::vector<char> out(in.size() * getSampleFormatBytes(format));
+  SampleConverter converter;
+  converter.setFormat(format, dither);
+  converter.setSimdEnabled(path.simd);
+  converter.setAvx2Enabled(path.avx2);
+  ConverterCost cost = { path.name, format, dither, 0, 0.0, 0.0 };
+  Clock::time_point start = Clock::now();
+  for (uint64_t i = 0; i < packets; i++) {
+    converter.convert(in.data(), in.size(), out.data());
+  }
+  cost.seconds = secondsSince(start);
+  cost.samples = packets * in.size();
+  return cost;
+}
+
+static void printConverterCost(const ConverterCost& cost, bool last) {
+  printf("    {\"path\": \"%s\", \"format\": \"%s\", \"dither\": %s, \"samples\": %llu, "
+    "\"nsPerSample\": %.3f, \"nsPerFrame\": %.3f, \"speedup\": %.2f}%s\n",
+    cost.path, cost.format == SAMPLE_FORMAT_INT16 ? "int16" : "int24", cost.dither ? "true" : "false",
+    (unsigned long long)cost.samples, cost.seconds * 1e9 / (double)cost.samples,
+    cost.seconds * 1e9 * benchChannels / (double)cost.samples, cost.scalarSeconds / cost.seconds,
+    last ? "" : ",");
+}
+
+typedef struct ResamplerRates {
+  unsigned int inputRate;
+  unsigned int outputRate;
+} ResamplerRates;
+
+static const ResamplerRates resamplerRates[] = { { 48000, 16000 }, { 44100, 48000 }, { 48000, 44100 } };
+static const ResamplerQuality resamplerQualities[] = { RESAMPLER_QUALITY_LOW, RESAMPLER_QUALITY_MEDIUM, RESAMPLER_QUALITY_HIGH };
+
+typedef struct ResamplerCost {
+  ResamplerRates rates;
+  ResamplerQuality quality;
+  uint64_t inputFrames;
+  uint64_t outputFrames;
+  double seconds;
+} ResamplerCost;
+
+static ResamplerCost measureResampler(ResamplerRates rates, ResamplerQuality quality, uint64_t packets) {
+  std::vector<float> in = makeSinePacket(rates.inputRate);
+  size_t packetFrames = in.size() / benchChannels;
+  Resampler resampler;
+  resampler.configure(rates.inputRate, rates.outputRate, benchChannels, quality);
+  resampler.reserve(packetFrames);
+  std::vector<float> out(resampler.getMaxOutputFrames(packetFrames) * benchChannels);
+  ResamplerCost cost = { rates, quality, 0, 0, 0.0 };
+  Clock::time_point start = Clock::now();
+  for (uint64_t i = 0; i < packets; i++) {
+    cost.outputFrames += resampler.process(in.data(), packetFrames, out.data());
+  }
+  cost.seconds = secondsSince(start);
+  cost.inputFrames = packets * packetFrames;
+  return cost;
+}
+
+static void printResamplerCost(const ResamplerCost& cost, bool last) {
+  static const char* qualityNames[] = { "low", "medium", "high" };
+  printf("    {\"inputRate\": %u, \"outputRate\": %u, \"quality\": \"%s\", \"inputFrames\": %llu, "
+    "\"outputFrames\": %llu, \"nsPerInputFrame\": %.3f, \"nsPerOutputFrame\": %.3f}%s\n",
+    cost.rates.inputRate, cost.rates.outputRate, qualityNames[cost.quality],
+    (unsigned long long)cost.inputFrames, (unsigned long long)cost.outputFrames,
+    cost.seconds * 1e9 / (double)cost.inputFrames, cost.seconds * 1e9 / (double)cost.outputFrames,
+    last ? "" : ",");
+}
+
+typedef struct LatencyResult {
+  const char* path;
+  double packetMs;
+  unsigned int pollMs;
+  std::vector<double> samplesMs;
+} LatencyResult;
+
+static double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  size_t rank = (size_t)(p / 100.0 * (double)(sorted.size() - 1) + 0.5);
+  return sorted[rank];
+}
+
+static void printLatency(LatencyResult& result, bool last) {
+  std::sort(result.samplesMs.begin(), result.samplesMs.end());
+  const std::vector<double>& s = result.samplesMs;
+  printf("    {\"path\": \"%s\", \"packetMs\": %g, \"pollMs\": %u, \"samples\": %zu, "
+    "\"p50Ms\": %.3f, \"p90Ms\": %.3f, \"p99Ms\": %.3f, \"maxMs\": %.3f}%s\n",
+    result.path, result.packetMs, result.pollMs, s.size(),
+    percentile(s, 50.0), percentile(s, 90.0), percentile(s, 99.0), s.empty() ? 0.0 : s.back(),
+    last ? "" : ",");
+}
+
+// age of the last frame of a chunk whose first frame was captured at timestamp
+static double frameAgeMs(uint64_t timestamp, uint32_t frames, unsigned int sampleRate) {
+  double newest = (double)timestamp + (frames - 1) * 10000000.0 / sampleRate;
+  return (now100ns() - newest) / 10000.0;
+}
+
+static LatencyResult measureGetBufferLatency(double packetMs, unsigned int pollMs, double seconds) {
+  void* client = createClient(packetMs, true);
+  AudioCaptureFormat format = getAudioFormat(client);
+  uint32_t capacity = benchSampleRate;
+  std::vector<char> out((size_t)capacity * format.frameSize);
+  LatencyResult result = { "getBuffer", packetMs, pollMs, std::vector<double>() };
+  Clock::time_point start = Clock::now();
+  while (secondsSince(start) < seconds) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(pollMs));
+    for (;;) {
+      uint32_t expected = getNextPacketSize(client);
+      if (expected == 0) {
+        break;
+      }
+      uint32_t frames = getBuffer(client, expected, capacity, out.data());
+      ChunkTiming timing;
+      if (frames > 0 && getChunkTiming(client, &timing) && timing.timestamp != 0) {
+        result.samplesMs.push_back(frameAgeMs(timing.timestamp, frames, format.samplesPerSec));
+      }
+    }
+  }
+  deleteClient(client);
+  return result;
+}
+
+static LatencyResult measureReadFramesLatency(double packetMs, unsigned int pollMs, double seconds) {
+  void* client = createClient(packetMs, true);
+  AudioCaptureFormat format = getOutputFormat(client);
+  uint32_t capacity = benchSampleRate;
+  std::vector<char> out((size_t)capacity * format.frameSize);
+  LatencyResult result = { "readFrames", packetMs, pollMs, std::vector<double>() };
+  startCaptureThread(client, 4 * benchSampleRate);
+  Clock::time_point start = Clock::now();
+  while (secondsSince(start) < seconds) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(pollMs));
+    uint32_t frames = readFrames(client, out.data(), capacity);
+    ChunkTiming timing;
+    if (frames > 0 && getChunkTiming(client, &timing) && timing.timestamp != 0) {
+      result.samplesMs.push_back(frameAgeMs(timing.timestamp, frames, format.samplesPerSec));
+    }
+  }
+  stopCaptureThread(client);
+  deleteClient(client);
+  return result;
+}
+
+int main(int argc, char** argv) {
+  uint64_t packets = 20000;
+  unsigned int repeat = 5;
+  double seconds = 1.0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--packets") == 0 && i + 1 < argc) {
+      packets = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = (unsigned int)atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: capture-bench [--packets N] [--repeat R] [--seconds S]\n");
+      return 2;
+    }
+  }
+  if (packets == 0 || repeat == 0 || seconds <= 0.0) {
+    fprintf(stderr, "capture-bench: --packets, --repeat and --seconds must be positive\n");
+    return 2;
+  }
+
+  std::vector<PacketCost> costs;
+  for (size_t i = 0; i < sizeof(packetSizesMs) / sizeof(packetSizesMs[0]); i++) {
+    for (size_t j = 0; j < sizeof(costMeasures) / sizeof(costMeasures[0]); j++) {
+      // a short first run takes the page faults and cache misses; of the
+      // runs after it the fastest is kept, being the least disturbed
+      costMeasures[j](packetSizesMs[i], packets / 10 + 1);
+      PacketCost best = costMeasures[j](packetSizesMs[i], packets);
+      for (unsigned int k = 1; k < repeat; k++) {
+        PacketCost cost = costMeasures[j](packetSizesMs[i], packets);
+        if (cost.seconds / cost.packets < best.seconds / best.packets) {
+          best = cost;
+        }
+      }
+      costs.push_back(best);
+    }
+  }
+
+  // a warm-up run, then the best of repeat, as above
+  std::vector<ConverterCost> converterCosts;
+  std::vector<ConverterPath> paths = getConverterPaths();
+  const SampleFormat formats[] = { SAMPLE_FORMAT_INT16, SAMPLE_FORMAT_INT24 };
+  for (SampleFormat format : formats) {
+    for (int dither = 0; dither < 2; dither++) {
+      double scalarSeconds = 0.0;
+      for (size_t i = 0; i < paths.size(); i++) {
+        measureConverter(paths[i], format, dither != 0, packets / 10 + 1);
+        ConverterCost best = measureConverter(paths[i], format, dither != 0, packets);
+        for (unsigned int k = 1; k < repeat; k++) {
+          ConverterCost cost = measureConverter(paths[i], format, dither != 0, packets);
+          if (cost.seconds < best.seconds) {
+            best = cost;
+          }
+        }
+        if (i == 0) {
+          scalarSeconds = best.seconds;
+        }
+        best.scalarSeconds = scalarSeconds;
+        converterCosts.push_back(best);
+      }
+    }
+  }
+
+  std::vector<ResamplerCost> resamplerCosts;
+  for (const ResamplerRates& rates : resamplerRates) {
+    for (ResamplerQuality quality : resamplerQualities) {
+      measureResampler(rates, quality, packets / 10 + 1);
+      ResamplerCost best = measureResampler(rates, quality, packets);
+      for (unsigned int k = 1; k < repeat; k++) {
+        ResamplerCost cost = measureResampler(rates, quality, packets);
+        if (cost.seconds < best.seconds) {
+          best = cost;
+        }
+      }
+      resamplerCosts.push_back(best);
+    }
+  }
+
+  std::vector<LatencyResult> latencies;
+  for (size_t i = 0; i < sizeof(latencyPacketsMs) / sizeof(latencyPacketsMs[0]); i++) {
+    for (size_t j = 0; j < sizeof(pollIntervalsMs) / sizeof(pollIntervalsMs[0]); j++) {
+      latencies.push_back(measureGetBufferLatency(latencyPacketsMs[i], pollIntervalsMs[j], seconds));
+      latencies.push_back(measureReadFramesLatency(latencyPacketsMs[i], pollIntervalsMs[j], seconds));
+    }
+  }
+
+  printf("{\n  \"suite\": \"native\",\n  \"sampleRate\": %u,\n  \"channels\": %u,\n", benchSampleRate, benchChannels);
+  printf("  \"packetCost\": [\n");
+  for (size_t i = 0; i < costs.size(); i++) {
+    printPacketCost(costs[i], i + 1 == costs.size());
+  }
+  printf("  ],\n  \"converter\": [\n");
+  for (size_t i = 0; i < converterCosts.size(); i++) {
+    printConverterCost(converterCosts[i], i + 1 == converterCosts.size());
+  }
+  printf("  ],\n  \"resampler\": [\n");
+  for (size_t i = 0; i < resamplerCosts.size(); i++) {
+    printResamplerCost(resamplerCosts[i], i + 1 == resamplerCosts.size());
+  }
+  printf("  ],\n  \"latency\": [\n");
+  for (size_t i = 0; i < latencies.size(); i++) {
+    printLatency(latencies[i], i + 1 == latencies.size());
+  }
+  printf("  ]\n}\n");
+  return 0;
+}
@@ -0,0 +1,493 @@
+// benchmarks of the capture-to-JS path as JS sees it, with machine-readable
+// results for comparing builds.
+//
+//   node --expose-gc bench.js [--device] [--low-latency] [--seconds S]
+//       [--packets N] [--out file]
+//
+// packets come from the simulated signal backend, so the numbers do not depend
+// on the audio device. --device measures latency on the default render
+// endpoint instead; everything else always uses the simulated backend.
+// --low-latency runs the latency measurements with the shortest period the
+// source supports (SetBufferOptions lowLatency).
+//
+// results:
+//   crossing: cost of one N-API call. GetPacketFlags does no native work,
+//     GetNextPacketSize asks the backend.
+//   packetCost: GetNextPacketSize + GetBuffer per packet by packet size, next
+//     to the native cost of the same calls (capture-bench) and the difference,
+//     the cost of crossing into native code and back.
+//   gc: garbage collections, pause time and bytes allocated per frame for
+//     each way of getting audio into JS, over the same amount of audio.
+//   streaming: StartStreaming callbacks per second, frames per callback and
+//     how busy the JS thread was (event loop utilization), by packet size and
+//     batchFrames / batchMs, over --seconds of real-time audio.
+//   latency: age of the newest frame when it reaches JS, in percentiles, by
+//     packet size and polling interval, next to the native latency histogram
+//     (GetLatencyHistogram) and the buffer settings the stream got.
+//   native: the output of build/Release/capture-bench, if it was built,
+//     including the sample converter cost of each vector kernel and the
+//     resampler cost of each quality preset.
+
+const addon = require('./build/Release/windows-audio-capture');
+const childProcess = require('child_process');
+const fs = require('fs');
+const path = require('path');
+const { PerformanceObserver, performance } = require('perf_hooks');
+
+const sampleRate = 48000;
+const packetSizesMs = [1, 3, 10, 20, 100];
+const latencyPacketsMs = [3, 10, 20];
+const pollIntervalsMs = [1, 5, 10, 20];
+const streamingPacketsMs = [1, 3, 10];
+// batch by frames alone, by time alone, and not at all (a callback per
+// packet). a large budget on the other side keeps it out of the way.
+const streamingBatches = [
+    { batchFrames: 0, batchMs: 0 },
+    { batchFrames: 240, batchMs: 1000 },
+    { batchFrames: 960, batchMs: 1000 },
+    { batchFrames: 4800, batchMs: 1000 },
+    { batchFrames: 10 * sampleRate, batchMs: 5 },
+    { batchFrames: 10 * sampleRate, batchMs: 20 },
+    { batchFrames: 10 * sampleRate, batchMs: 100 },
+];
+
+let options = {
+    device: false,
+    lowLatency: false,
+    seconds: 1,
+    packets: 20000,
+    repeat: 5,
+    out: null,
+};
+
+let parseArguments = (args) => {
+    for(let i = 0; i < args.length; i++) {
+        if(args[i] == '--device') {
+            options.device = true;
+        } else if(args[i] == '--low-latency') {
+            options.lowLatency = true;
+        } else if(args[i] == '--seconds' && i + 1 < args.length) {
+            options.seconds = Number(args[++i]);
+        } else if(args[i] == '--packets' && i + 1 < args.length) {
+            options.packets = Number(args[++i]);
+        } else if(args[i] == '--out' && i + 1 < args.length) {
+            options.out = args[++i];
+        } else {
+            throw new Error(`unknown argument ${args[i]}`);
+        }
+    }
+    if(!(options.seconds > 0) || !(options.packets > 0)) {
+        throw new Error('--seconds and --packets must be positive');
+    }
+}
+
+// same time base as the capture timestamps: the performance counter on
+// Windows, the monotonic clock elsewhere, in 100 ns units
+let now100ns = () => Number(process.hrtime.bigint() / 100n);
+
+let sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+// packetMs null opens the audio device. bufferOptions, if given, are passed
+// to SetBufferOptions.
+let createClient = (packetMs, realtime, bufferOptions) => {
+    const c = addon.CreateCaptureClient();
+    if(packetMs == null) {
+        addon.InitializeCom(c);
+    } else {
+        // digital zero is the cheapest signal to generate, so the backend
+        // adds little to what is measured
+        addon.SetCaptureBackend(c, {
+            type: 'signal',
+            waveform: 'zero',
+            channels: 2,
+            sampleRate: sampleRate,
+            packetMs: packetMs,
+            realtime: realtime,
+        });
+    }
+    if(bufferOptions != null && !addon.SetBufferOptions(c, bufferOptions)) {
+        throw new Error('could not set buffer options');
+    }
+    if(!addon.StartCapture(c)) {
+        throw new Error('could not start capture');
+    }
+    return c;
+}
+
+let percentile = (sorted, p) => {
+    if(sorted.length == 0) {
+        return 0;
+    }
+    return sorted[Math.round(p / 100 * (sorted.length - 1))];
+}
+
+let measureCrossing = (iterations) => {
+    const c = createClient(10, false);
+    const calls = {
+        GetPacketFlags: () => addon.GetPacketFlags(c),
+        GetNextPacketSize: () => addon.GetNextPacketSize(c),
+    };
+    let results = [];
+    for(const name in calls) {
+        const call = calls[name];
+        // let the JIT settle first
+        for(let i = 0; i < iterations / 10; i++) {
+            call();
+        }
+        const start = process.hrtime.bigint();
+        for(let i = 0; i < iterations; i++) {
+            call();
+        }
+        const ns = Number(process.hrtime.bigint() - start);
+        results.push({ call: name, calls: iterations, nsPerCall: ns / iterations });
+    }
+    addon.StopCapture(c);
+    return results;
+}
+
+let measureGetBuffer = (packetMs, packets) => {
+    const c = createClient(packetMs, false);
+    const frameSize = addon.GetAudioFormat(c)[1];
+    const maximumFrames = sampleRate;
+    const buffer = new ArrayBuffer(maximumFrames * frameSize);
+    let frames = 0;
+    let count = 0;
+    const start = process.hrtime.bigint();
+    while(count < packets) {
+        const expected = addon.GetNextPacketSize(c);
+        if(expected == 0) {
+            continue;
+        }
+        frames += addon.GetBuffer(c, expected, maximumFrames, buffer);
+        count++;
+    }
+    const ns = Number(process.hrtime.bigint() - start);
+    addon.StopCapture(c);
+    return {
+        path: 'GetBuffer',
+        packetMs: packetMs,
+        packets: count,
+        frames: frames,
+        nsPerPacket: ns / count,
+        nsPerFrame: ns / frames,
+        bytesPerFrame: frameSize,
+    };
+}
+
+// best of options.repeat runs after a short warm-up, like capture-bench
+let measurePacketCost = (native) => {
+    let results = [];
+    for(const packetMs of packetSizesMs) {
+        measureGetBuffer(packetMs, Math.ceil(options.packets / 10));
+        let best = null;
+        for(let i = 0; i < options.repeat; i++) {
+            const result = measureGetBuffer(packetMs, options.packets);
+            if(best == null || result.nsPerPacket < best.nsPerPacket) {
+                best = result;
+            }
+        }
+        const nativeResult = native == null ? null : native.packetCost.find(
+            (r) => r.path == 'getBuffer' && r.packetMs == packetMs);
+        if(nativeResult != null) {
+            best.nativeNsPerPacket = nativeResult.nsPerPacket;
+            best.crossingNsPerPacket = best.nsPerPacket - nativeResult.nsPerPacket;
+        }
+        results.push(best);
+    }
+    return results;
+}
+
+// ways of getting audio into JS. each reads frames frames and returns the
+// bytes it allocated on the JS side.
+const deliveryPatterns = {
+    // polling into one ArrayBuffer allocated up front
+    'GetBuffer-reuse': (c, frames) => {
+        const frameSize = addon.GetAudioFormat(c)[1];
+        const buffer = new ArrayBuffer(sampleRate * frameSize);
+        let read = 0;
+        while(read < frames) {
+            const expected = addon.GetNextPacketSize(c);
+            if(expected > 0) {
+                read += addon.GetBuffer(c, expected, sampleRate, buffer);
+            }
+        }
+        return buffer.byteLength;
+    },
+    // polling into a new ArrayBuffer per packet
+    'GetBuffer-allocate': (c, frames) => {
+        const frameSize = addon.GetAudioFormat(c)[1];
+        let allocated = 0;
+        let read = 0;
+        while(read < frames) {
+            const expected = addon.GetNextPacketSize(c);
+            if(expected > 0) {
+                const buffer = new ArrayBuffer(expected * frameSize);
+                allocated += buffer.byteLength;
+                read += addon.GetBuffer(c, expected, expected, buffer);
+            }
+        }
+        return allocated;
+    },
+    // pooled native memory from the capture thread's ring, handed back at once
+    'ReadFramesPooled-release': (c, frames) => {
+        addon.StartCaptureThread(c, 4 * sampleRate);
+        const frameSize = addon.GetOutputFormat(c)[1];
+        let read = 0;
+        while(read < frames) {
+            const buffer = addon.ReadFramesPooled(c, sampleRate);
+            if(buffer != null) {
+                read += buffer.byteLength / frameSize;
+                addon.ReleasePooledBuffer(buffer);
+            }
+        }
+        addon.StopCaptureThread(c);
+        // the memory went back to the pool, only the ArrayBuffer objects remain
+        return 0;
+    },
+    // the same, but left to the garbage collector
+    'ReadFramesPooled-gc': (c, frames) => {
+        addon.StartCaptureThread(c, 4 * sampleRate);
+        const frameSize = addon.GetOutputFormat(c)[1];
+        let allocated = 0;
+        let read = 0;
+        while(read < frames) {
+            const buffer = addon.ReadFramesPooled(c, sampleRate);
+            if(buffer != null) {
+                read += buffer.byteLength / frameSize;
+                allocated += buffer.byteLength;
+            }
+        }
+        addon.StopCaptureThread(c);
+        return allocated;
+    },
+};
+
+let measureGc = async () => {
+    // ten minutes of 10 ms packets, enough for the young generation to fill
+    // up a few times when every packet allocates
+    const frames = 600 * sampleRate;
+    let gcEvents = [];
+    const observer = new PerformanceObserver((list) => {
+        gcEvents.push(...list.getEntries());
+    });
+    observer.observe({ entryTypes: ['gc'] });
+
+    let results = [];
+    for(const name in deliveryPatterns) {
+        const c = createClient(10, false);
+        if(global.gc) {
+            global.gc();
+        }
+        // gc entries arrive asynchronously
+        await sleep(10);
+        gcEvents = [];
+        const before = process.memoryUsage();
+        const start = process.hrtime.bigint();
+        const allocated = deliveryPatterns[name](c, frames);
+        const ns = Number(process.hrtime.bigint() - start);
+        const after = process.memoryUsage();
+        await sleep(10);
+        addon.StopCapture(c);
+        results.push({
+            pattern: name,
+            frames: frames,
+            nsPerFrame: ns / frames,
+            gcCount: gcEvents.length,
+            gcPauseMs: gcEvents.reduce((sum, e) => sum + e.duration, 0),
+            allocatedBytesPerFrame: allocated / frames,
+            heapGrowthBytes: after.heapUsed - before.heapUsed,
+            arrayBufferGrowthBytes: after.arrayBuffers - before.arrayBuffers,
+        });
+    }
+    observer.disconnect();
+    return results;
+}
+
+// one StartStreaming run at real-time pace; the pooled buffers go straight
+// back to the pool so only the callbacks are measured
+let measureStreamingBatch = async (packetMs, batch) => {
+    const c = createClient(packetMs, true);
+    const frameSize = addon.GetOutputFormat(c)[1];
+    let callbacks = 0;
+    let frames = 0;
+    const callback = (buffer) => {
+        callbacks++;
+        frames += buffer.byteLength / frameSize;
+        addon.ReleasePooledBuffer(buffer);
+    };
+    if(!addon.StartStreaming(c, callback, batch)) {
+        throw new Error('could not start streaming');
+    }
+    const startUtilization = performance.eventLoopUtilization();
+    const start = process.hrtime.bigint();
+    await sleep(options.seconds * 1000);
+    const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+    const utilization = performance.eventLoopUtilization(startUtilization);
+    addon.StopStreaming(c);
+    addon.StopCapture(c);
+    return {
+        packetMs: packetMs,
+        batchFrames: batch.batchFrames,
+        batchMs: batch.batchMs,
+        seconds: seconds,
+        callbacks: callbacks,
+        callbacksPerSecond: callbacks / seconds,
+        packetsPerSecond: 1000 / packetMs,
+        framesPerCallback: callbacks == 0 ? 0 : frames / callbacks,
+        eventLoopUtilization: utilization.utilization,
+    };
+}
+
+let measureStreaming = async () => {
+    let results = [];
+    for(const packetMs of streamingPacketsMs) {
+        for(const batch of streamingBatches) {
+            results.push(await measureStreamingBatch(packetMs, batch));
+        }
+    }
+    return results;
+}
+
+// age of the last frame of a chunk whose first frame was captured at timestamp
+let frameAgeMs = (timestamp, frames, rate) => {
+    const newest = timestamp + (frames - 1) * 10000000 / rate;
+    return (now100ns() - newest) / 10000;
+}
+
+let summarizeLatency = (result, samples) => {
+    samples.sort((a, b) => a - b);
+    result.samples = samples.length;
+    result.p50Ms = percentile(samples, 50);
+    result.p90Ms = percentile(samples, 90);
+    result.p99Ms = percentile(samples, 99);
+    result.maxMs = samples.length == 0 ? 0 : samples[samples.length - 1];
+    return result;
+}
+
+let latencyBufferOptions = () => options.lowLatency ? { lowLatency: true } : null;
+
+// adds the buffer settings of the running stream and the native latency
+// histogram of the run to result
+let describeNativeLatency = (c, result) => {
+    const bufferInfo = addon.GetBufferInfo(c);
+    result.periodFrames = bufferInfo[1];
+    result.bufferFrames = bufferInfo[0];
+    result.lowLatency = bufferInfo[5];
+    const histogram = addon.GetLatencyHistogram(c);
+    result.native = {
+        chunks: histogram[0],
+        meanMs: histogram[2],
+        p50Ms: histogram[4],
+        p90Ms: histogram[5],
+        p99Ms: histogram[6],
+        maxMs: histogram[3],
+    };
+    return result;
+}
+
+// polling the backend from a timer, no capture thread
+let measureGetBufferLatency = async (packetMs, pollMs) => {
+    const c = createClient(packetMs, true, latencyBufferOptions());
+    const format = addon.GetAudioFormat(c);
+    const buffer = new ArrayBuffer(sampleRate * format[1]);
+    let samples = [];
+    const end = Date.now() + options.seconds * 1000;
+    while(Date.now() < end) {
+        await sleep(pollMs);
+        for(;;) {
+            const expected = addon.GetNextPacketSize(c);
+            if(expected == 0) {
+                break;
+            }
+            const frames = addon.GetBuffer(c, expected, sampleRate, buffer);
+            const timing = addon.GetChunkTiming(c);
+            if(frames > 0 && timing != null && timing[1] != 0) {
+                samples.push(frameAgeMs(timing[1], frames, format[4]));
+            }
+        }
+    }
+    const result = describeNativeLatency(c, { path: 'GetBuffer', packetMs: packetMs, pollMs: pollMs });
+    addon.StopCapture(c);
+    return summarizeLatency(result, samples);
+}
+
+// reading the capture thread's ring from a timer
+let measureReadFramesLatency = async (packetMs, pollMs) => {
+    const c = createClient(packetMs, true, latencyBufferOptions());
+    addon.StartCaptureThread(c);
+    const format = addon.GetOutputFormat(c);
+    const buffer = new ArrayBuffer(sampleRate * format[1]);
+    let samples = [];
+    const end = Date.now() + options.seconds * 1000;
+    while(Date.now() < end) {
+        await sleep(pollMs);
+        const frames = addon.ReadFrames(c, buffer);
+        const timing = addon.GetChunkTiming(c);
+        if(frames > 0 && timing != null && timing[1] != 0) {
+            samples.push(frameAgeMs(timing[1], frames, format[4]));
+        }
+    }
+    addon.StopCaptureThread(c);
+    const result = describeNativeLatency(c, { path: 'ReadFrames', packetMs: packetMs, pollMs: pollMs });
+    addon.StopCapture(c);
+    return summarizeLatency(result, samples);
+}
+
+let measureLatency = async () => {
+    // the device decides its own packet size
+    const packetSizes = options.device ? [null] : latencyPacketsMs;
+    let results = [];
+    for(const packetMs of packetSizes) {
+        for(const pollMs of pollIntervalsMs) {
+            results.push(await measureGetBufferLatency(packetMs, pollMs));
+            results.push(await measureReadFramesLatency(packetMs, pollMs));
+        }
+    }
+    return results;
+}
+
+let runNative = () => {
+    const executable = path.join(__dirname, 'build', 'Release',
+        process.platform == 'win32' ? 'capture-bench.exe' : 'capture-bench');
+    if(!fs.existsSync(executable)) {
+        console.error(`${executable} not found, skipping the native benchmark`);
+        return null;
+    }
+    const output = childProcess.execFileSync(executable, [
+        '--packets', String(options.packets),
+        '--repeat', String(options.repeat),
+        '--seconds', String(options.seconds),
+    ], { encoding: 'utf8', maxBuffer: 16 * 1024 * 1024 });
+    return JSON.parse(output);
+}
+
+let main = async () => {
+    parseArguments(process.argv.slice(2));
+    if(!global.gc) {
+        console.error('run with --expose-gc for comparable gc results');
+    }
+    const native = runNative();
+    let results = {
+        suite: 'node',
+        node: process.version,
+        platform: process.platform,
+        arch: process.arch,
+        source: options.device ? 'device' : 'signal',
+        lowLatency: options.lowLatency,
+        sampleRate: sampleRate,
+        crossing: measureCrossing(options.packets * 10),
+        packetCost: measurePacketCost(native),
+        gc: await measureGc(),
+        streaming: await measureStreaming(),
+        latency: await measureLatency(),
+        native: native,
+    };
+    const json = JSON.stringify(results, null, 2);
+    if(options.out != null) {
+        fs.writeFileSync(options.out, json + '\n');
+    } else {
+        console.log(json);
+    }
+}
+
+main();
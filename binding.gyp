@@ -1,8 +1,82 @@
 {
+  "variables": {
+    "capture_sources": [
+      "captureclient.cc",
+      "capturethread.cc",
+      "capturepipeline.cc",
+      "capturestats.cc",
+      "broadcastring.cc",
+      "devicemixer.cc",
+      "fft.cc",
+      "featureextractor.cc",
+      "frameblocker.cc",
+      "packettiming.cc",
+      "sampleconvert.cc",
+      "sampledecode.cc",
+      "resampler.cc",
+      "channelmixer.cc",
+      "levelmeter.cc",
+      "voicegate.cc",
+      "recorder.cc",
+      "wakeevent.cc",
+      "flacencoder.cc",
+      "rtpsender.cc",
+      "bufferpool.cc",
+      "simulatedbackend.cc"
+    ]
+  },
   "targets": [
     {
       "target_name": "windows-audio-capture",
-      "sources": [ "capture_napi.cc", "captureclient.cc" ],
+      "sources": [
+        "capture_napi.cc",
+        "<@(capture_sources)"
+      ],
+      "conditions": [
+        [ "OS=='win'", {
+          "sources": [ "wasapibackend.cc" ],
+          "libraries": [ "avrt.lib", "ws2_32.lib" ]
+        } ]
+      ],
+    },
+    {
+      # native benchmarks, see bench.cc. run by bench.js.
+      "target_name": "capture-bench",
+      "type": "executable",
+      "win_delay_load_hook": "false",
+      "sources": [
+        "bench.cc",
+        "<@(capture_sources)"
+      ],
+      "conditions": [
+        [ "OS=='win'", {
+          "sources": [ "wasapibackend.cc" ],
+          "libraries": [ "avrt.lib", "ws2_32.lib" ]
+        } ]
+      ],
+    },
+    {
+      # native unit tests, see test.cc. build/Release/capture-test [filter]
+      "target_name": "capture-test",
+      "type": "executable",
+      "win_delay_load_hook": "false",
+      "sources": [
+        "test.cc",
+        "testbroadcastring.cc",
+        "testcapturepipeline.cc",
+        "testcapturethread.cc",
+        "testdevicemixer.cc",
+        "testflac.cc",
+        "testsampleconvert.cc",
+        "testvoicegate.cc",
+        "<@(capture_sources)"
+      ],
+      "conditions": [
+        [ "OS=='win'", {
+          "sources": [ "wasapibackend.cc" ],
+          "libraries": [ "avrt.lib", "ws2_32.lib" ]
+        } ]
+      ],
     }
   ]
-} 
+}
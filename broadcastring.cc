@@ -0,0 +1,298 @@
+#include "broadcastring.h"
+
+#include <string.h>
+
+// frames a subscriber converts per pass, which bounds its buffers
+static const size_t subscriberChunkFrames = 1024;
+
+void BroadcastRing::allocate(size_t capacityFrames, unsigned int numChannels) {
+  storage.assign(capacityFrames * numChannels, 0.0f);
+  this->capacityFrames = capacityFrames;
+  this->numChannels = numChannels;
+  generation++;
+  writeIndex.store(0);
+  reserveIndex.store(0);
+  blockedFrames.store(0);
+  for (unsigned int i = 0; i < maxReaders; i++) {
+    readers[i].cursor.store(0);
+    readers[i].droppedFrames.store(0);
+  }
+}
+
+size_t BroadcastRing::getCapacity() {
+  return capacityFrames;
+}
+
+unsigned int BroadcastRing::getNumChannels() {
+  return numChannels;
+}
+
+uint32_t BroadcastRing::getGeneration() {
+  return generation;
+}
+
+bool BroadcastRing::hasReaders() {
+  return activeReaders.load(std::memory_order_relaxed) > 0;
+}
+
+size_t BroadcastRing::write(const float* frames, size_t nFrames) {
+  if (capacityFrames == 0 || nFrames == 0) {
+    return 0;
+  }
+  uint64_t w = writeIndex.load(std::memory_order_relaxed);
+
+  // only protected readers hold the writer back
+  size_t space = capacityFrames;
+  for (unsigned int i = 0; i < maxReaders; i++) {
+    if (readers[i].protect.load(std::memory_order_acquire)) {
+      uint64_t lag = w - readers[i].cursor.load(std::memory_order_acquire);
+      size_t free = lag < capacityFrames ? capacityFrames - (size_t)lag : 0;
+      if (free < space) {
+        space = free;
+      }
+    }
+  }
+  size_t count = nFrames < space ? nFrames : space;
+  if (count < nFrames) {
+    blockedFrames.fetch_add(nFrames - count, std::memory_order_relaxed);
+  }
+  if (count == 0) {
+    return 0;
+  }
+
+  // announce the span before touching it, see read()
+  reserveIndex.store(w + count, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  size_t offset = (size_t)(w % capacityFrames);
+  size_t firstFrames = capacityFrames - offset;
+  if (firstFrames > count) {
+    firstFrames = count;
+  }
+  memcpy(storage.data() + offset * numChannels, frames, firstFrames * numChannels * sizeof(float));
+  if (count > firstFrames) {
+    memcpy(storage.data(), frames + firstFrames * numChannels, (count - firstFrames) * numChannels * sizeof(float));
+  }
+
+  writeIndex.store(w + count, std::memory_order_release);
+  return count;
+}
+
+uint64_t BroadcastRing::getBlockedFrames() {
+  return blockedFrames.load(std::memory_order_relaxed);
+}
+
+int BroadcastRing::addReader(OverflowPolicy policy) {
+  std::lock_guard<std::mutex> lock(readersMutex);
+  for (unsigned int i = 0; i < maxReaders; i++) {
+    Reader& reader = readers[i];
+    if (reader.active.load()) {
+      continue;
+    }
+    reader.policy = policy;
+    reader.droppedFrames.store(0);
+    reader.cursor.store(writeIndex.load(std::memory_order_acquire));
+    reader.protect.store(policy == OVERFLOW_PROTECT);
+    reader.active.store(true);
+    activeReaders.fetch_add(1);
+    return (int)i;
+  }
+  return -1;
+}
+
+void BroadcastRing::removeReader(int reader) {
+  std::lock_guard<std::mutex> lock(readersMutex);
+  if (reader < 0 || reader >= (int)maxReaders || !readers[reader].active.load()) {
+    return;
+  }
+  readers[reader].protect.store(false);
+  readers[reader].active.store(false);
+  activeReaders.fetch_sub(1);
+}
+
+size_t BroadcastRing::getAvailable(int reader) {
+  uint64_t lag = writeIndex.load(std::memory_order_acquire) - readers[reader].cursor.load(std::memory_order_relaxed);
+  return (size_t)(lag < capacityFrames ? lag : capacityFrames);
+}
+
+void BroadcastRing::copyOut(uint64_t index, size_t frames, float* out) {
+  size_t offset = (size_t)(index % capacityFrames);
+  size_t firstFrames = capacityFrames - offset;
+  if (firstFrames > frames) {
+    firstFrames = frames;
+  }
+  memcpy(out, storage.data() + offset * numChannels, firstFrames * numChannels * sizeof(float));
+  if (frames > firstFrames) {
+    memcpy(out + firstFrames * numChannels, storage.data(), (frames - firstFrames) * numChannels * sizeof(float));
+  }
+}
+
+size_t BroadcastRing::read(int id, float* out, size_t maxFrames) {
+  Reader& reader = readers[id];
+  if (capacityFrames == 0) {
+    return 0;
+  }
+  uint64_t w = writeIndex.load(std::memory_order_acquire);
+  uint64_t cursor = reader.cursor.load(std::memory_order_relaxed);
+  uint64_t dropped = 0;
+
+  if (w - cursor > capacityFrames) {
+    // overrun: the frames at the cursor are gone
+    uint64_t next = reader.policy == OVERFLOW_SKIP_TO_LIVE ? w : w - capacityFrames;
+    dropped += next - cursor;
+    cursor = next;
+  }
+
+  size_t count = (size_t)(w - cursor);
+  if (count > maxFrames) {
+    count = maxFrames;
+  }
+  copyOut(cursor, count, out);
+
+  // anything below reserveIndex - capacity may have been overwritten while
+  // it was being copied
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  uint64_t reserved = reserveIndex.load(std::memory_order_relaxed);
+  if (count > 0 && reserved > capacityFrames && cursor < reserved - capacityFrames) {
+    uint64_t torn = reserved - capacityFrames - cursor;
+    size_t lost = torn < count ? (size_t)torn : count;
+    memmove(out, out + lost * numChannels, (count - lost) * numChannels * sizeof(float));
+    count -= lost;
+    cursor += lost;
+    dropped += lost;
+  }
+
+  if (dropped > 0) {
+    reader.droppedFrames.fetch_add(dropped, std::memory_order_relaxed);
+  }
+  reader.cursor.store(cursor + count, std::memory_order_release);
+  return count;
+}
+
+uint64_t BroadcastRing::getDroppedFrames(int reader) {
+  return readers[reader].droppedFrames.load(std::memory_order_relaxed);
+}
+
+BroadcastSubscriber::~BroadcastSubscriber() {
+  close();
+}
+
+bool BroadcastSubscriber::open(BroadcastRing* ring, OverflowPolicy policy, SampleFormat sampleFormat, bool dither, unsigned int channels, const float* matrix, unsigned int inputChannels) {
+  close();
+  reader = ring->addReader(policy);
+  if (reader < 0) {
+    return false;
+  }
+  this->ring = ring;
+  this->sampleFormat = sampleFormat;
+  converter.setFormat(sampleFormat, dither);
+  outputChannels = channels;
+  outputMatrix.clear();
+  matrixInputChannels = 0;
+  if (channels != 0 && matrix != NULL) {
+    outputMatrix.assign(matrix, matrix + (size_t)channels * inputChannels);
+    matrixInputChannels = inputChannels;
+  }
+  configure();
+  return true;
+}
+
+void BroadcastSubscriber::close() {
+  if (ring != NULL) {
+    ring->removeReader(reader);
+    ring = NULL;
+    reader = -1;
+  }
+}
+
+void BroadcastSubscriber::configure() {
+  configured = true;
+  configuredGeneration = ring->getGeneration();
+  unsigned int streamChannels = ring->getNumChannels();
+  valid = streamChannels != 0;
+  mixing = valid && outputChannels != 0
+    && (outputChannels != streamChannels || !outputMatrix.empty());
+  if (mixing) {
+    valid = outputMatrix.empty()
+      ? mixer.configureDownmix(streamChannels, outputChannels)
+      : matrixInputChannels == streamChannels
+        && mixer.configureMatrix(streamChannels, outputChannels, outputMatrix.data());
+  }
+  bool converting = valid && (mixing || sampleFormat != SAMPLE_FORMAT_FLOAT32);
+  readBuffer.assign(converting ? subscriberChunkFrames * streamChannels : 0, 0.0f);
+  mixBuffer.assign(converting && mixing ? subscriberChunkFrames * outputChannels : 0, 0.0f);
+}
+
+SampleFormat BroadcastSubscriber::getSampleFormat() {
+  return sampleFormat;
+}
+
+unsigned int BroadcastSubscriber::getNumChannels() {
+  if (ring == NULL) {
+    return 0;
+  }
+  if (outputChannels != 0) {
+    return outputChannels;
+  }
+  return ring->getNumChannels();
+}
+
+unsigned int BroadcastSubscriber::getFrameSize() {
+  return getNumChannels() * getSampleFormatBytes(sampleFormat);
+}
+
+size_t BroadcastSubscriber::getAvailableFrames() {
+  if (ring == NULL) {
+    return 0;
+  }
+  return ring->getAvailable(reader);
+}
+
+size_t BroadcastSubscriber::read(char* out, size_t maxFrames) {
+  if (ring == NULL) {
+    return 0;
+  }
+  if (!configured || configuredGeneration != ring->getGeneration()) {
+    configure();
+  }
+  if (!valid) {
+    return 0;
+  }
+
+  // same format as the stream: copy straight into out
+  if (!mixing && sampleFormat == SAMPLE_FORMAT_FLOAT32) {
+    return ring->read(reader, (float*)out, maxFrames);
+  }
+
+  // through the buffers configure() sized, a chunk at a time
+  size_t channels = getNumChannels();
+  size_t frameSize = getFrameSize();
+  size_t total = 0;
+  while (total < maxFrames) {
+    size_t wanted = maxFrames - total < subscriberChunkFrames ? maxFrames - total : subscriberChunkFrames;
+    size_t frames = ring->read(reader, readBuffer.data(), wanted);
+    const float* samples = readBuffer.data();
+    if (mixing) {
+      mixer.process(samples, frames, mixBuffer.data());
+      samples = mixBuffer.data();
+    }
+    char* chunkOut = out + total * frameSize;
+    if (sampleFormat == SAMPLE_FORMAT_FLOAT32) {
+      memcpy(chunkOut, samples, frames * channels * sizeof(float));
+    } else {
+      converter.convert(samples, frames * channels, chunkOut);
+    }
+    total += frames;
+    if (frames < wanted) {
+      break;
+    }
+  }
+  return total;
+}
+
+uint64_t BroadcastSubscriber::getDroppedFrames() {
+  if (ring == NULL) {
+    return 0;
+  }
+  return ring->getDroppedFrames(reader);
+}
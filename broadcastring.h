@@ -0,0 +1,143 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "channelmixer.h"
+#include "sampleconvert.h"
+
+// what a reader of a BroadcastRing loses when it falls a whole ring behind.
+typedef enum OverflowPolicy {
+  // the oldest unread frames; the reader goes on with the oldest frames left
+  OVERFLOW_DROP_OLDEST = 0,
+  // everything unread; the reader jumps to the newest frame
+  OVERFLOW_SKIP_TO_LIVE = 1,
+  // nothing: the writer never overwrites frames this reader has not read, and
+  // frames that do not fit are dropped for every reader
+  OVERFLOW_PROTECT = 2,
+} OverflowPolicy;
+
+// single-producer / multi-consumer ring of interleaved float32 frames. the
+// capture thread writes each frame once; every reader has its own cursor and
+// copies straight out of the shared storage, so adding a reader costs no work
+// on the capture thread.
+//
+// the writer does not wait for readers (except OVERFLOW_PROTECT ones), so it
+// may overwrite frames a reader is copying. it announces the span it is about
+// to write before writing, and the reader checks that announcement after its
+// copy and discards whatever may have been overwritten, like a seqlock.
+//
+// indices count frames monotonically from allocate(). readers can be added
+// and removed while the writer runs.
+class BroadcastRing {
+public:
+  static const unsigned int maxReaders = 32;
+
+private:
+  typedef struct Reader {
+    alignas(64) std::atomic<uint64_t> cursor{0};
+    std::atomic<uint64_t> droppedFrames{0};
+    std::atomic<bool> active{false};
+    std::atomic<bool> protect{false};
+    OverflowPolicy policy = OVERFLOW_DROP_OLDEST;
+  } Reader;
+
+  std::vector<float> storage;
+  size_t capacityFrames = 0;
+  unsigned int numChannels = 0;
+  uint32_t generation = 0;
+
+  alignas(64) std::atomic<uint64_t> writeIndex{0};
+  // end of the span the writer is about to write, ahead of writeIndex while
+  // the copy is in progress
+  std::atomic<uint64_t> reserveIndex{0};
+  std::atomic<uint64_t> blockedFrames{0};
+  std::atomic<unsigned int> activeReaders{0};
+
+  Reader readers[maxReaders];
+  // serializes addReader() / removeReader(); never taken by the writer
+  std::mutex readersMutex;
+
+  void copyOut(uint64_t index, size_t frames, float* out);
+
+public:
+  // must not be called while the writer is active. existing readers are kept
+  // and start over at frame 0.
+  void allocate(size_t capacityFrames, unsigned int numChannels);
+
+  size_t getCapacity();
+  unsigned int getNumChannels();
+  // changes each time allocate() is called, so readers can tell when the
+  // stream format may have changed
+  uint32_t getGeneration();
+  bool hasReaders();
+
+  // writer side. returns the number of frames written, less than nFrames
+  // only if an OVERFLOW_PROTECT reader is a whole ring behind.
+  size_t write(const float* frames, size_t nFrames);
+  // frames write() could not store because of OVERFLOW_PROTECT readers
+  uint64_t getBlockedFrames();
+
+  // returns the reader id, or -1 if all slots are taken. the reader starts at
+  // the newest frame.
+  int addReader(OverflowPolicy policy);
+  void removeReader(int reader);
+
+  // reader side. each reader may be used from one thread at a time.
+  size_t getAvailable(int reader);
+  // copies up to maxFrames frames to out and returns how many were copied.
+  size_t read(int reader, float* out, size_t maxFrames);
+  // frames the reader lost to overflow
+  uint64_t getDroppedFrames(int reader);
+};
+
+// one consumer of a BroadcastRing with its own output format: sample format,
+// dither and channel mix are applied as it reads, on the reading thread.
+// readers that keep the stream format copy straight into the caller's buffer.
+class BroadcastSubscriber {
+private:
+  BroadcastRing* ring = NULL;
+  int reader = -1;
+
+  SampleFormat sampleFormat = SAMPLE_FORMAT_FLOAT32;
+  // 0 keeps the stream channels. an empty matrix means the standard downmix.
+  unsigned int outputChannels = 0;
+  std::vector<float> outputMatrix;
+  unsigned int matrixInputChannels = 0;
+
+  // set up by open() and again on the first read of each ring generation,
+  // which also sizes the buffers, so reads do not allocate
+  uint32_t configuredGeneration = 0;
+  bool configured = false;
+  bool valid = false;
+  bool mixing = false;
+  ChannelMixer mixer;
+  SampleConverter converter;
+  // stream frames, then mixed frames, of one pass of read()
+  std::vector<float> readBuffer;
+  std::vector<float> mixBuffer;
+
+  void configure();
+
+public:
+  ~BroadcastSubscriber();
+
+  // channels of 0 keeps the stream channels. matrix has channels rows of
+  // inputChannels coefficients, or is NULL for the standard downmix; reads
+  // fail if the stream does not have inputChannels channels.
+  bool open(BroadcastRing* ring, OverflowPolicy policy, SampleFormat sampleFormat, bool dither, unsigned int channels, const float* matrix, unsigned int inputChannels);
+  void close();
+
+  SampleFormat getSampleFormat();
+  // 0 until the stream format is known, i.e. before the capture thread starts
+  unsigned int getNumChannels();
+  unsigned int getFrameSize();
+
+  size_t getAvailableFrames();
+  // out must hold maxFrames * getFrameSize() bytes. returns frames written.
+  size_t read(char* out, size_t maxFrames);
+  uint64_t getDroppedFrames();
+};
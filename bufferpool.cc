@@ -0,0 +1,64 @@
+#include "bufferpool.h"
+
+#include <stdlib.h>
+
+BufferPool::BufferPool(size_t maxCachedPerClass) : maxCachedPerClass(maxCachedPerClass) {
+}
+
+BufferPool::~BufferPool() {
+  for (unsigned int i = 0; i < numClasses; i++) {
+    for (size_t j = 0; j < freeBlocks[i].size(); j++) {
+      free(freeBlocks[i][j]);
+    }
+  }
+}
+
+unsigned int BufferPool::getSizeClass(size_t bytes) {
+  unsigned int sizeClass = 0;
+  while (sizeClass < numClasses && ((size_t)1 << (minClassBits + sizeClass)) < bytes) {
+    sizeClass++;
+  }
+  return sizeClass;
+}
+
+char* BufferPool::acquire(size_t bytes, size_t* capacity) {
+  unsigned int sizeClass = getSizeClass(bytes);
+  if (sizeClass >= numClasses) {
+    return NULL;
+  }
+  *capacity = (size_t)1 << (minClassBits + sizeClass);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!freeBlocks[sizeClass].empty()) {
+      char* block = freeBlocks[sizeClass].back();
+      freeBlocks[sizeClass].pop_back();
+      reuses++;
+      return block;
+    }
+    allocations++;
+  }
+  return (char*)malloc(*capacity);
+}
+
+void BufferPool::release(char* block, size_t capacity) {
+  unsigned int sizeClass = getSizeClass(capacity);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (sizeClass < numClasses && freeBlocks[sizeClass].size() < maxCachedPerClass) {
+      freeBlocks[sizeClass].push_back(block);
+      return;
+    }
+  }
+  free(block);
+}
+
+uint64_t BufferPool::getAllocationCount() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return allocations;
+}
+
+uint64_t BufferPool::getReuseCount() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return reuses;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+// recycles the native memory behind ArrayBuffers handed to JS, so delivering a
+// packet does not allocate a fresh buffer that the GC later has to collect.
+//
+// blocks are grouped in power-of-two size classes. acquire() returns a block of
+// at least the requested size; release() puts it back on the free list of its
+// class, or frees it if that list already holds maxCachedPerClass blocks.
+// acquire() and release() may be called from any thread.
+class BufferPool {
+private:
+  static const unsigned int minClassBits = 12; // 4 KB
+  static const unsigned int numClasses = 20;   // up to 2 GB
+
+  std::mutex mutex;
+  std::vector<char*> freeBlocks[numClasses];
+  size_t maxCachedPerClass;
+
+  uint64_t allocations = 0;
+  uint64_t reuses = 0;
+
+  static unsigned int getSizeClass(size_t bytes);
+
+public:
+  BufferPool(size_t maxCachedPerClass = 16);
+  ~BufferPool();
+
+  // returns NULL if bytes is larger than the largest size class or allocation
+  // fails. *capacity receives the usable size of the block.
+  char* acquire(size_t bytes, size_t* capacity);
+  void release(char* block, size_t capacity);
+
+  uint64_t getAllocationCount();
+  uint64_t getReuseCount();
+};
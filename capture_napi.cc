@@ -1,12 +1,35 @@
 #include <node_api.h>
 #include <inttypes.h> 
+#include <string.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "bufferpool.h"
 #include "captureclient.h"
+#include "simulatedbackend.h"
 
 namespace CaptureClientAddon {
 
+void stopStreaming(void* clientPointer);
+void releaseLevelsArray(napi_env env, void* clientPointer);
+void releaseSharedRingArray(napi_env env, void* clientPointer);
+void detachSubscriptions(void* clientPointer);
+void detachMixers(void* clientPointer);
+std::string describeCaptureError(const char* caller, CaptureError error);
+
 void finalizeCaptureClient(napi_env env, void* finalize_data, void* finalize_hint) {
   //std::cerr << "C++ in finalizeCaptureClient" << std::endl;
+  // the client deletes its subscribers; their handles must not reach them
+  detachSubscriptions(finalize_data);
+  // mixers read the client's ring on their own thread
+  detachMixers(finalize_data);
   delete (AudioCaptureClient*) finalize_data;
+  // the capture thread is gone, so the arrays it wrote to can go too
+  releaseLevelsArray(env, finalize_data);
+  releaseSharedRingArray(env, finalize_data);
   //std::cerr << "C++ in finalizeCaptureClient FINISHED destroy" << std::endl;
 }
 
@@ -35,7 +58,8 @@ napi_value CreateCaptureClient(napi_env env, napi_callback_info info) {
 
 // NOTE: do not call InitializeCom from electron app because electron already
 // initializes COM by itself. only call InitializeCom when testing in a
-// standalone node.js app.
+// standalone node.js app. returns false if this thread's COM apartment could
+// not be joined.
 // https://github.com/electron/electron/issues/37212
 napi_value InitializeCom(napi_env env, napi_callback_info info) {
   size_t argc = 1;
@@ -62,8 +86,19 @@ napi_value InitializeCom(napi_env env, napi_callback_info info) {
     return nullptr;
   }
 
-  initializeCom(clientPointer);
+  bool initialized = initializeCom(clientPointer);
+  if (!initialized) {
+    std::cerr << "C++ error in " << describeCaptureError("InitializeCom", getLastError(clientPointer)) << std::endl;
+  }
+
+  napi_value result;
+  status = napi_get_boolean(env, initialized, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in InitializeCom: could not create result" << std::endl;
+    return nullptr;
+  }
   //std::cerr << "C++ success in InitializeCom" << std::endl;
+  return result;
 }
 
 // NOTE: do not call UninitializeCom from electron app because electron already
@@ -100,6 +135,29 @@ napi_value UninitializeCom(napi_env env, napi_callback_info info) {
 }
 
 
+// "<caller>: <step> failed (HRESULT 0x...)"
+std::string describeCaptureError(const char* caller, CaptureError error) {
+  char text[256];
+  if (error.step == NULL) {
+    snprintf(text, sizeof(text), "%s failed", caller);
+  } else if (error.code != 0) {
+    snprintf(text, sizeof(text), "%s: %s failed (HRESULT 0x%08" PRIX32 ")", caller, error.step, (uint32_t)error.code);
+  } else {
+    snprintf(text, sizeof(text), "%s: %s failed", caller, error.step);
+  }
+  return text;
+}
+
+// call after the client refused a call that needs StartCapture first: prints
+// the error it recorded and returns true if that was the reason
+bool reportNotCapturing(void* clientPointer, const char* caller) {
+  if (isCapturing(clientPointer)) {
+    return false;
+  }
+  std::cerr << "C++ error in " << describeCaptureError(caller, getLastError(clientPointer)) << std::endl;
+  return true;
+}
+
 napi_value StartCapture(napi_env env, napi_callback_info info) {
   size_t argc = 1;
   napi_value args[1];
@@ -125,43 +183,28 @@ napi_value StartCapture(napi_env env, napi_callback_info info) {
     return nullptr;
   }
 
-  startCapture(clientPointer);
-  //std::cerr << "C++ success in StartCapture" << std::endl;
-}
-
-napi_value GetAudioFormat(napi_env env, napi_callback_info info) {
-  size_t argc = 1;
-  napi_value args[1];
-  napi_status status;
-
-  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
-  if (status != napi_ok) {
-    std::cerr << "C++ error in GetAudioFormat: could not get args" << std::endl;
-    return nullptr;
-  }
-
-  napi_valuetype value_type;
-  status = napi_typeof(env, args[0], &value_type);
-  if (status != napi_ok || value_type != napi_external) {
-    std::cerr << "C++ error in GetAudioFormat: could not get args[0]" << std::endl;
-    return nullptr;
+  bool started = startCapture(clientPointer);
+  if (!started) {
+    std::cerr << "C++ error in " << describeCaptureError("StartCapture", getLastError(clientPointer)) << std::endl;
   }
 
-  void* clientPointer;
-  status = napi_get_value_external(env, args[0], &clientPointer);
+  napi_value result;
+  status = napi_get_boolean(env, started, &result);
   if (status != napi_ok) {
-    std::cerr << "C++ error in GetAudioFormat: could not get client pointer value" << std::endl;
+    std::cerr << "C++ error in StartCapture: could not create result" << std::endl;
     return nullptr;
   }
+  //std::cerr << "C++ success in StartCapture" << std::endl;
+  return result;
+}
 
-  AudioCaptureFormat captureFormat = getAudioFormat(clientPointer);
-  // std::cerr << "framesize " << captureFormat.frameSize << std::endl;
-  // std::cerr << "C++ in GetAudioFormat: got captureFormat";
-
+// [formatIsValid, frameSize, numChannels, bitsPerSample, samplesPerSec]
+napi_value createAudioFormatArray(napi_env env, AudioCaptureFormat captureFormat, const char* caller) {
+  napi_status status;
   napi_value js_array;
   status = napi_create_array(env, &js_array);
   if (status != napi_ok) {
-    std::cerr << "C++ error in GetAudioFormat: cannot create array" << std::endl;
+    std::cerr << "C++ error in " << caller << ": cannot create array" << std::endl;
     return nullptr;
   }
 
@@ -169,67 +212,101 @@ napi_value GetAudioFormat(napi_env env, napi_callback_info info) {
   napi_value entry;
   status = napi_create_int32(env, captureFormat.formatisValid ? 1:0, &entry);
   if (status != napi_ok) {
-    std::cerr << "C++ error in GetAudioFormat: cannot create entry for formatisValid" << std::endl;
+    std::cerr << "C++ error in " << caller << ": cannot create entry for formatisValid" << std::endl;
     return nullptr;
   }
   status = napi_set_element(env, js_array, iEntry, entry);
   if (status != napi_ok) {
-    std::cerr << "C++ error in GetAudioFormat: cannot set entry for formatisValid" << std::endl;
+    std::cerr << "C++ error in " << caller << ": cannot set entry for formatisValid" << std::endl;
     return nullptr;
   }
 
   iEntry++;
   status = napi_create_int32(env, captureFormat.frameSize, &entry);
   if (status != napi_ok) {
-    std::cerr << "C++ error in GetAudioFormat: cannot create entry for frameSize" << std::endl;
+    std::cerr << "C++ error in " << caller << ": cannot create entry for frameSize" << std::endl;
     return nullptr;
   }
   status = napi_set_element(env, js_array, iEntry, entry);
   if (status != napi_ok) {
-    std::cerr << "C++ error in GetAudioFormat: cannot set entry for frameSize" << std::endl;
+    std::cerr << "C++ error in " << caller << ": cannot set entry for frameSize" << std::endl;
     return nullptr;
   }
 
   iEntry++;
   status = napi_create_int32(env, captureFormat.numChannels, &entry);
   if (status != napi_ok) {
-    std::cerr << "C++ error in GetAudioFormat: cannot create entry for numChannels" << std::endl;
+    std::cerr << "C++ error in " << caller << ": cannot create entry for numChannels" << std::endl;
     return nullptr;
   }
   status = napi_set_element(env, js_array, iEntry, entry);
   if (status != napi_ok) {
-    std::cerr << "C++ error in GetAudioFormat: cannot set entry for numChannels" << std::endl;
+    std::cerr << "C++ error in " << caller << ": cannot set entry for numChannels" << std::endl;
     return nullptr;
   }
 
   iEntry++;
   status = napi_create_int32(env, captureFormat.bitsPerSample, &entry);
   if (status != napi_ok) {
-    std::cerr << "C++ error in GetAudioFormat: cannot create entry for bitsPerSample" << std::endl;
+    std::cerr << "C++ error in " << caller << ": cannot create entry for bitsPerSample" << std::endl;
     return nullptr;
   }
   status = napi_set_element(env, js_array, iEntry, entry);
   if (status != napi_ok) {
-    std::cerr << "C++ error in GetAudioFormat: cannot set entry for bitsPerSample" << std::endl;
+    std::cerr << "C++ error in " << caller << ": cannot set entry for bitsPerSample" << std::endl;
     return nullptr;
   }
 
   iEntry++;
   status = napi_create_int32(env, captureFormat.samplesPerSec, &entry);
   if (status != napi_ok) {
-    std::cerr << "C++ error in GetAudioFormat: cannot create entry for samplesPerSec" << std::endl;
+    std::cerr << "C++ error in " << caller << ": cannot create entry for samplesPerSec" << std::endl;
     return nullptr;
   }
   status = napi_set_element(env, js_array, iEntry, entry);
   if (status != napi_ok) {
-    std::cerr << "C++ error in GetAudioFormat: cannot set entry for samplesPerSec" << std::endl;
+    std::cerr << "C++ error in " << caller << ": cannot set entry for samplesPerSec" << std::endl;
     return nullptr;
   }
 
-  //std::cerr << "C++ success in GetAudioFormat" << std::endl;
   return js_array;
 }
 
+napi_value GetAudioFormat(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetAudioFormat: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetAudioFormat: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetAudioFormat: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  AudioCaptureFormat captureFormat = getAudioFormat(clientPointer);
+  if (reportNotCapturing(clientPointer, "GetAudioFormat")) {
+    return nullptr;
+  }
+  // std::cerr << "framesize " << captureFormat.frameSize << std::endl;
+  // std::cerr << "C++ in GetAudioFormat: got captureFormat";
+
+  return createAudioFormatArray(env, captureFormat, "GetAudioFormat");
+}
+
 napi_value GetNextPacketSize(napi_env env, napi_callback_info info) {
   size_t argc = 1;
   napi_value args[1];
@@ -255,8 +332,13 @@ napi_value GetNextPacketSize(napi_env env, napi_callback_info info) {
     return nullptr;
   }
 
+  uint32_t packetSize = getNextPacketSize(clientPointer);
+  if (reportNotCapturing(clientPointer, "GetNextPacketSize")) {
+    return nullptr;
+  }
+
   napi_value result;
-  status = napi_create_int32(env, getNextPacketSize(clientPointer), &result);
+  status = napi_create_int32(env, packetSize, &result);
   if (status != napi_ok) {
     std::cerr << "C++ error in GetNextPacketSize: could not create result" << std::endl;
     return nullptr;
@@ -339,6 +421,9 @@ napi_value GetBuffer(napi_env env, napi_callback_info info) {
   }
 
   uint32_t nFrames = getBuffer(clientPointer, expectedFrameCount, maximumFrameCount, (char *)abData);
+  if (reportNotCapturing(clientPointer, "GetBuffer")) {
+    return nullptr;
+  }
 
   napi_value result;
   status = napi_create_int32(env, nFrames, &result);
@@ -350,6 +435,93 @@ napi_value GetBuffer(napi_env env, napi_callback_info info) {
 }
 
 
+// DrainInto(client, arrayBuffer)
+// copies every packet the backend has ready into arrayBuffer, packed contiguously.
+// whatever does not fit is kept natively and delivered first by the next call.
+// returns [framesWritten, flags, carriedFrames, devicePosition, timestamp]
+// where flags are the AUDCLNT_BUFFERFLAGS_xxx of all drained packets or'ed
+// together, carried frames keeping those of the packet they came from, and devicePosition / timestamp belong to the first frame written
+// (see GetChunkTiming).
+napi_value DrainInto(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in DrainInto: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in DrainInto: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in DrainInto: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  bool isArrayBuffer;
+  status = napi_is_arraybuffer(env, args[1], &isArrayBuffer);
+  if (status != napi_ok || isArrayBuffer != true) {
+    std::cerr << "C++ error in DrainInto: args[1] is not arraybuffer" << std::endl;
+    return nullptr;
+  }
+
+  size_t abLength;
+  char* abData;
+  status = napi_get_arraybuffer_info(env, args[1], (void **)&abData, &abLength);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in DrainInto: could not get arraybuffer info of args[1]" << std::endl;
+    return nullptr;
+  }
+
+  uint32_t frameSize = getAudioFormat(clientPointer).frameSize;
+  if (reportNotCapturing(clientPointer, "DrainInto")) {
+    return nullptr;
+  }
+  uint32_t flags;
+  uint32_t nFrames = drainInto(clientPointer, abData, (uint32_t)(abLength / frameSize), &flags);
+  ChunkTiming timing = {};
+  if (nFrames > 0) {
+    getChunkTiming(clientPointer, &timing);
+  }
+  int64_t values[5] = {
+    nFrames,
+    (int64_t)flags,
+    getCarriedFrames(clientPointer),
+    (int64_t)timing.devicePosition,
+    (int64_t)timing.timestamp
+  };
+
+  napi_value js_array;
+  status = napi_create_array_with_length(env, 5, &js_array);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in DrainInto: cannot create array" << std::endl;
+    return nullptr;
+  }
+  for (uint32_t i = 0; i < 5; i++) {
+    napi_value entry;
+    status = napi_create_int64(env, values[i], &entry);
+    if (status != napi_ok) {
+      std::cerr << "C++ error in DrainInto: cannot create entry " << i << std::endl;
+      return nullptr;
+    }
+    status = napi_set_element(env, js_array, i, entry);
+    if (status != napi_ok) {
+      std::cerr << "C++ error in DrainInto: cannot set entry " << i << std::endl;
+      return nullptr;
+    }
+  }
+  return js_array;
+}
+
 napi_value StopCapture(napi_env env, napi_callback_info info) {
   size_t argc = 1;
   napi_value args[1];
@@ -375,52 +547,4884 @@ napi_value StopCapture(napi_env env, napi_callback_info info) {
     return nullptr;
   }
 
+  stopStreaming(clientPointer);
   stopCapture(clientPointer);
   return nullptr;
 }
 
-napi_value init(napi_env env, napi_value exports) {
+napi_value StartCaptureThread(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
   napi_status status;
-  napi_value fn;
 
-  status = napi_create_function(env, nullptr, 0, CreateCaptureClient, nullptr, &fn);
-  if (status != napi_ok) return nullptr;
-  status = napi_set_named_property(env, exports, "CreateCaptureClient", fn);
-  if (status != napi_ok) return nullptr;
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartCaptureThread: could not get args" << std::endl;
+    return nullptr;
+  }
 
-  status = napi_create_function(env, nullptr, 0, InitializeCom, nullptr, &fn);
-  if (status != napi_ok) return nullptr;
-  status = napi_set_named_property(env, exports, "InitializeCom", fn);
-  if (status != napi_ok) return nullptr;
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in StartCaptureThread: could not get args[0]" << std::endl;
+    return nullptr;
+  }
 
-  status = napi_create_function(env, nullptr, 0, UninitializeCom, nullptr, &fn);
-  if (status != napi_ok) return nullptr;
-  status = napi_set_named_property(env, exports, "UninitializeCom", fn);
-  if (status != napi_ok) return nullptr;
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartCaptureThread: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
 
-  status = napi_create_function(env, nullptr, 0, StartCapture, nullptr, &fn);
-  if (status != napi_ok) return nullptr;
-  status = napi_set_named_property(env, exports, "StartCapture", fn);
-  if (status != napi_ok) return nullptr;
+  // ring size in frames. defaults to 2 seconds of audio.
+  int32_t ringFrames = getOutputFormat(clientPointer).samplesPerSec * 2;
+  if (argc > 1) {
+    status = napi_typeof(env, args[1], &value_type);
+    if (status != napi_ok || (value_type != napi_number && value_type != napi_undefined)) {
+      std::cerr << "C++ error in StartCaptureThread: could not get args[1]" << std::endl;
+      return nullptr;
+    }
+    if (value_type == napi_number) {
+      status = napi_get_value_int32(env, args[1], &ringFrames);
+      if (status != napi_ok || ringFrames <= 0) {
+        std::cerr << "C++ error in StartCaptureThread: invalid ring size in args[1]" << std::endl;
+        return nullptr;
+      }
+    }
+  }
 
-  status = napi_create_function(env, nullptr, 0, GetAudioFormat, nullptr, &fn);
-  if (status != napi_ok) return nullptr;
-  status = napi_set_named_property(env, exports, "GetAudioFormat", fn);
-  if (status != napi_ok) return nullptr;
+  bool started = startCaptureThread(clientPointer, ringFrames);
+  if (!started) {
+    reportNotCapturing(clientPointer, "StartCaptureThread");
+  }
 
-  status = napi_create_function(env, nullptr, 0, GetNextPacketSize, nullptr, &fn);
-  if (status != napi_ok) return nullptr;
-  status = napi_set_named_property(env, exports, "GetNextPacketSize", fn);
-  if (status != napi_ok) return nullptr;
+  napi_value result;
+  status = napi_get_boolean(env, started, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartCaptureThread: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
 
-  status = napi_create_function(env, nullptr, 0, GetBuffer, nullptr, &fn);
-  if (status != napi_ok) return nullptr;
-  status = napi_set_named_property(env, exports, "GetBuffer", fn);
-  if (status != napi_ok) return nullptr;
+napi_value StopCaptureThread(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
 
-  status = napi_create_function(env, nullptr, 0, StopCapture, nullptr, &fn);
-  if (status != napi_ok) return nullptr;
-  status = napi_set_named_property(env, exports, "StopCapture", fn);
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopCaptureThread: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in StopCaptureThread: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopCaptureThread: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  stopCaptureThread(clientPointer);
+  return nullptr;
+}
+
+napi_value GetAvailableFrames(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetAvailableFrames: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetAvailableFrames: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetAvailableFrames: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  napi_value result;
+  status = napi_create_uint32(env, getAvailableFrames(clientPointer), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetAvailableFrames: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// copies as many whole frames as fit into args[1] (an ArrayBuffer) out of the
+// capture thread's ring and returns the number of frames copied.
+napi_value ReadFrames(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadFrames: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in ReadFrames: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadFrames: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  bool isArrayBuffer;
+  status = napi_is_arraybuffer(env, args[1], &isArrayBuffer);
+  if (status != napi_ok || isArrayBuffer != true) {
+    std::cerr << "C++ error in ReadFrames: args[1] is not arraybuffer" << std::endl;
+    return nullptr;
+  }
+
+  size_t abLength;
+  char* abData;
+  status = napi_get_arraybuffer_info(env, args[1], (void **)&abData, &abLength);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadFrames: could not get arraybuffer info of args[1]" << std::endl;
+    return nullptr;
+  }
+
+  uint32_t frameSize = getOutputFormat(clientPointer).frameSize;
+  // frameSize is 0 until the capture thread has started
+  uint32_t nFrames = frameSize == 0 ? 0 : readFrames(clientPointer, abData, (uint32_t)(abLength / frameSize));
+
+  napi_value result;
+  status = napi_create_uint32(env, nFrames, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadFrames: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+napi_value GetOverflowFrames(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetOverflowFrames: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetOverflowFrames: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetOverflowFrames: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  napi_value result;
+  status = napi_create_int64(env, (int64_t)getOverflowFrames(clientPointer), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetOverflowFrames: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// reads an optional integer property from an options object. leaves *value
+// unchanged if the property is missing or undefined. returns false if the
+// property exists but is not a number.
+bool getOptionalInt32Property(napi_env env, napi_value object, const char* name, int32_t* value) {
+  napi_status status;
+  bool hasProperty;
+  status = napi_has_named_property(env, object, name, &hasProperty);
+  if (status != napi_ok) return false;
+  if (!hasProperty) return true;
+
+  napi_value property;
+  status = napi_get_named_property(env, object, name, &property);
+  if (status != napi_ok) return false;
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, property, &value_type);
+  if (status != napi_ok) return false;
+  if (value_type == napi_undefined) return true;
+  if (value_type != napi_number) return false;
+
+  status = napi_get_value_int32(env, property, value);
+  return status == napi_ok;
+}
+
+bool getOptionalDoubleProperty(napi_env env, napi_value object, const char* name, double* value) {
+  napi_status status;
+  bool hasProperty;
+  status = napi_has_named_property(env, object, name, &hasProperty);
+  if (status != napi_ok) return false;
+  if (!hasProperty) return true;
+
+  napi_value property;
+  status = napi_get_named_property(env, object, name, &property);
+  if (status != napi_ok) return false;
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, property, &value_type);
+  if (status != napi_ok) return false;
+  if (value_type == napi_undefined) return true;
+  if (value_type != napi_number) return false;
+
+  status = napi_get_value_double(env, property, value);
+  return status == napi_ok;
+}
+
+bool getOptionalBoolProperty(napi_env env, napi_value object, const char* name, bool* value) {
+  napi_status status;
+  bool hasProperty;
+  status = napi_has_named_property(env, object, name, &hasProperty);
+  if (status != napi_ok) return false;
+  if (!hasProperty) return true;
+
+  napi_value property;
+  status = napi_get_named_property(env, object, name, &property);
+  if (status != napi_ok) return false;
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, property, &value_type);
+  if (status != napi_ok) return false;
+  if (value_type == napi_undefined) return true;
+  if (value_type != napi_boolean) return false;
+
+  status = napi_get_value_bool(env, property, value);
+  return status == napi_ok;
+}
+
+// value receives at most valueSize - 1 characters plus a terminating zero.
+bool getOptionalStringProperty(napi_env env, napi_value object, const char* name, char* value, size_t valueSize) {
+  napi_status status;
+  bool hasProperty;
+  status = napi_has_named_property(env, object, name, &hasProperty);
+  if (status != napi_ok) return false;
+  if (!hasProperty) return true;
+
+  napi_value property;
+  status = napi_get_named_property(env, object, name, &property);
+  if (status != napi_ok) return false;
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, property, &value_type);
+  if (status != napi_ok) return false;
+  if (value_type == napi_undefined) return true;
+  if (value_type != napi_string) return false;
+
+  size_t length;
+  status = napi_get_value_string_utf8(env, property, value, valueSize, &length);
+  return status == napi_ok;
+}
+
+// reads an optional array of rows of numbers, each row holding rowLength
+// numbers, into a flat row-major vector. leaves value empty if missing.
+bool getOptionalMatrixProperty(napi_env env, napi_value object, const char* name, uint32_t rowLength, std::vector<float>* value) {
+  napi_status status;
+  bool hasProperty;
+  status = napi_has_named_property(env, object, name, &hasProperty);
+  if (status != napi_ok) return false;
+  if (!hasProperty) return true;
+
+  napi_value rows;
+  status = napi_get_named_property(env, object, name, &rows);
+  if (status != napi_ok) return false;
+  bool isArray;
+  status = napi_is_array(env, rows, &isArray);
+  if (status != napi_ok || !isArray) return false;
+  uint32_t rowCount;
+  status = napi_get_array_length(env, rows, &rowCount);
+  if (status != napi_ok || rowCount == 0) return false;
+
+  value->clear();
+  for (uint32_t r = 0; r < rowCount; r++) {
+    napi_value row;
+    status = napi_get_element(env, rows, r, &row);
+    if (status != napi_ok) return false;
+    status = napi_is_array(env, row, &isArray);
+    if (status != napi_ok || !isArray) return false;
+    uint32_t length;
+    status = napi_get_array_length(env, row, &length);
+    if (status != napi_ok || length != rowLength) return false;
+    for (uint32_t i = 0; i < length; i++) {
+      napi_value element;
+      double gain;
+      status = napi_get_element(env, row, i, &element);
+      if (status != napi_ok) return false;
+      status = napi_get_value_double(env, element, &gain);
+      if (status != napi_ok) return false;
+      value->push_back((float)gain);
+    }
+  }
+  return true;
+}
+
+// reads an optional array of length numbers. leaves value empty if missing.
+bool getOptionalNumberArrayProperty(napi_env env, napi_value object, const char* name, uint32_t length, std::vector<float>* value) {
+  napi_status status;
+  bool hasProperty;
+  status = napi_has_named_property(env, object, name, &hasProperty);
+  if (status != napi_ok) return false;
+  if (!hasProperty) return true;
+
+  napi_value array;
+  status = napi_get_named_property(env, object, name, &array);
+  if (status != napi_ok) return false;
+  bool isArray;
+  status = napi_is_array(env, array, &isArray);
+  if (status != napi_ok || !isArray) return false;
+  uint32_t arrayLength;
+  status = napi_get_array_length(env, array, &arrayLength);
+  if (status != napi_ok || arrayLength != length) return false;
+
+  value->clear();
+  for (uint32_t i = 0; i < length; i++) {
+    napi_value element;
+    double number;
+    status = napi_get_element(env, array, i, &element);
+    if (status != napi_ok) return false;
+    status = napi_get_value_double(env, element, &number);
+    if (status != napi_ok) return false;
+    value->push_back((float)number);
+  }
+  return true;
+}
+
+// SetOutputFormat(client, options)
+// selects the format the capture thread delivers. must be called after
+// StartCapture and before StartCaptureThread / StartStreaming. options left out
+// go back to their defaults:
+//   sampleFormat: 'float32' (default), 'int16' or 'int24' (packed 3 bytes)
+//   dither: add TPDF dither when converting to integer samples
+//   sampleRate: resample to this rate (default: device rate)
+//   quality: resampler quality, 'low', 'medium' (default) or 'high'
+//   channels: output channel count (default: device channels). without a
+//     matrix, 1 or 2 channels get a standard downmix (LFE dropped)
+//   matrix: array of rows, one per output channel, each with one gain per
+//     device channel
+// returns false if the capture thread is running.
+napi_value SetOutputFormat(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetOutputFormat: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in SetOutputFormat: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetOutputFormat: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  status = napi_typeof(env, args[1], &value_type);
+  if (status != napi_ok || value_type != napi_object) {
+    std::cerr << "C++ error in SetOutputFormat: args[1] is not an object" << std::endl;
+    return nullptr;
+  }
+
+  char sampleFormatName[16] = "float32";
+  bool dither = false;
+  int32_t sampleRate = 0;
+  char qualityName[16] = "medium";
+  if (!getOptionalStringProperty(env, args[1], "sampleFormat", sampleFormatName, sizeof(sampleFormatName))
+    || !getOptionalBoolProperty(env, args[1], "dither", &dither)
+    || !getOptionalInt32Property(env, args[1], "sampleRate", &sampleRate)
+    || !getOptionalStringProperty(env, args[1], "quality", qualityName, sizeof(qualityName))) {
+    std::cerr << "C++ error in SetOutputFormat: invalid options in args[1]" << std::endl;
+    return nullptr;
+  }
+
+  SampleFormat sampleFormat;
+  if (strcmp(sampleFormatName, "float32") == 0) {
+    sampleFormat = SAMPLE_FORMAT_FLOAT32;
+  } else if (strcmp(sampleFormatName, "int16") == 0) {
+    sampleFormat = SAMPLE_FORMAT_INT16;
+  } else if (strcmp(sampleFormatName, "int24") == 0) {
+    sampleFormat = SAMPLE_FORMAT_INT24;
+  } else {
+    std::cerr << "C++ error in SetOutputFormat: unknown sampleFormat " << sampleFormatName << std::endl;
+    return nullptr;
+  }
+
+  ResamplerQuality quality;
+  if (strcmp(qualityName, "low") == 0) {
+    quality = RESAMPLER_QUALITY_LOW;
+  } else if (strcmp(qualityName, "medium") == 0) {
+    quality = RESAMPLER_QUALITY_MEDIUM;
+  } else if (strcmp(qualityName, "high") == 0) {
+    quality = RESAMPLER_QUALITY_HIGH;
+  } else {
+    std::cerr << "C++ error in SetOutputFormat: unknown quality " << qualityName << std::endl;
+    return nullptr;
+  }
+
+  if (sampleRate < 0) {
+    std::cerr << "C++ error in SetOutputFormat: invalid sampleRate" << std::endl;
+    return nullptr;
+  }
+
+  uint32_t inputChannels = getAudioFormat(clientPointer).numChannels;
+  std::vector<float> matrix;
+  if (!getOptionalMatrixProperty(env, args[1], "matrix", inputChannels, &matrix)) {
+    std::cerr << "C++ error in SetOutputFormat: invalid matrix, expected rows of " << inputChannels << " gains" << std::endl;
+    return nullptr;
+  }
+  int32_t channels = matrix.empty() ? 0 : (int32_t)(matrix.size() / inputChannels);
+  if (!getOptionalInt32Property(env, args[1], "channels", &channels)) {
+    std::cerr << "C++ error in SetOutputFormat: invalid options in args[1]" << std::endl;
+    return nullptr;
+  }
+  if (channels < 0 || (!matrix.empty() && (size_t)channels * inputChannels != matrix.size())
+    || (matrix.empty() && channels > 2 && (uint32_t)channels != inputChannels)) {
+    std::cerr << "C++ error in SetOutputFormat: invalid channels" << std::endl;
+    return nullptr;
+  }
+
+  bool accepted = setOutputSampleFormat(clientPointer, sampleFormat, dither)
+    && setOutputSampleRate(clientPointer, sampleRate, quality)
+    && setOutputChannels(clientPointer, channels, matrix.empty() ? NULL : matrix.data());
+
+  napi_value result;
+  status = napi_get_boolean(env, accepted, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetOutputFormat: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// GetOutputFormat(client)
+// format of the data delivered by ReadFrames / ReadFramesPooled / StartStreaming,
+// in the same layout as GetAudioFormat.
+napi_value GetOutputFormat(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetOutputFormat: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetOutputFormat: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetOutputFormat: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  return createAudioFormatArray(env, getOutputFormat(clientPointer), "GetOutputFormat");
+}
+
+// ---------------------------------------------
+// level meters. the capture thread measures peak, RMS and true peak per
+// channel; JS either asks for a copy with GetLevels or reads a shared
+// Float32Array that native code keeps up to date, costing no call at all.
+
+// shared level arrays by client. the reference keeps the ArrayBuffer alive for
+// as long as the capture thread may write to it.
+std::unordered_map<void*, napi_ref> levelArrays;
+
+void releaseLevelsArray(napi_env env, void* clientPointer) {
+  std::unordered_map<void*, napi_ref>::iterator it = levelArrays.find(clientPointer);
+  if (it != levelArrays.end()) {
+    napi_delete_reference(env, it->second);
+    levelArrays.erase(it);
+  }
+}
+
+// SetLevelMeter(client, options)
+// call before StartCaptureThread / StartStreaming. options:
+//   windowMs: measurement window (default 50), 0 turns metering off
+//   truePeak: also measure 4x oversampled true peak (default true)
+// returns false if the capture thread is running.
+napi_value SetLevelMeter(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetLevelMeter: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in SetLevelMeter: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetLevelMeter: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  int32_t windowMs = 50;
+  bool truePeak = true;
+  if (argc > 1) {
+    status = napi_typeof(env, args[1], &value_type);
+    if (status != napi_ok || value_type != napi_object
+      || !getOptionalInt32Property(env, args[1], "windowMs", &windowMs)
+      || !getOptionalBoolProperty(env, args[1], "truePeak", &truePeak)) {
+      std::cerr << "C++ error in SetLevelMeter: invalid options in args[1]" << std::endl;
+      return nullptr;
+    }
+  }
+  if (windowMs < 0) {
+    std::cerr << "C++ error in SetLevelMeter: invalid windowMs" << std::endl;
+    return nullptr;
+  }
+
+  napi_value result;
+  status = napi_get_boolean(env, setLevelMeter(clientPointer, windowMs, truePeak), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetLevelMeter: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// GetLevels(client)
+// returns a Float32Array with peak, rms and truePeak (linear, 1.0 = full
+// scale) of each output channel over the last completed window, or null
+// before metering has started.
+napi_value GetLevels(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetLevels: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetLevels: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetLevels: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  float levels[3 * 64];
+  uint32_t count = getLevels(clientPointer, levels, 3 * 64);
+
+  napi_value result;
+  if (count == 0) {
+    napi_get_null(env, &result);
+    return result;
+  }
+
+  void* data;
+  napi_value arrayBuffer;
+  status = napi_create_arraybuffer(env, count * sizeof(float), &data, &arrayBuffer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetLevels: could not create arraybuffer" << std::endl;
+    return nullptr;
+  }
+  memcpy(data, levels, count * sizeof(float));
+  status = napi_create_typedarray(env, napi_float32_array, count, arrayBuffer, 0, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetLevels: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// GetLevelsArray(client)
+// returns a Float32Array that the capture thread rewrites at the end of every
+// window: peak, rms and truePeak per output channel followed by a window
+// counter, so a UI can poll it each frame without calling into native code.
+// sized for the current output channels; call after SetOutputFormat and
+// before StartCaptureThread / StartStreaming.
+napi_value GetLevelsArray(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetLevelsArray: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetLevelsArray: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetLevelsArray: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  size_t length = getOutputFormat(clientPointer).numChannels * 3 + 1;
+
+  // hand out the existing array while it still fits the output format
+  napi_value result;
+  std::unordered_map<void*, napi_ref>::iterator it = levelArrays.find(clientPointer);
+  if (it != levelArrays.end()) {
+    napi_typedarray_type type;
+    size_t existingLength;
+    status = napi_get_reference_value(env, it->second, &result);
+    if (status == napi_ok
+      && napi_get_typedarray_info(env, result, &type, &existingLength, NULL, NULL, NULL) == napi_ok
+      && existingLength == length) {
+      return result;
+    }
+  }
+
+  void* data;
+  napi_value arrayBuffer;
+  status = napi_create_arraybuffer(env, length * sizeof(float), &data, &arrayBuffer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetLevelsArray: could not create arraybuffer" << std::endl;
+    return nullptr;
+  }
+  memset(data, 0, length * sizeof(float));
+  status = napi_create_typedarray(env, napi_float32_array, length, arrayBuffer, 0, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetLevelsArray: could not create result" << std::endl;
+    return nullptr;
+  }
+
+  if (!setLevelsTarget(clientPointer, (float*)data, (uint32_t)length)) {
+    std::cerr << "C++ error in GetLevelsArray: capture thread is running" << std::endl;
+    return nullptr;
+  }
+  releaseLevelsArray(env, clientPointer);
+  napi_ref reference;
+  status = napi_create_reference(env, result, 1, &reference);
+  if (status != napi_ok) {
+    setLevelsTarget(clientPointer, NULL, 0);
+    std::cerr << "C++ error in GetLevelsArray: could not create reference" << std::endl;
+    return nullptr;
+  }
+  levelArrays[clientPointer] = reference;
+  return result;
+}
+
+// ---------------------------------------------
+// silence / voice activity gating and packet flags
+
+// SetGate(client, options)
+// drops silent or inactive spans on the capture thread so they never reach
+// ReadFrames / StartStreaming. the native recording is not gated. call before
+// StartCaptureThread / StartStreaming. options:
+//   mode: 'off' (default), 'silence' or 'voice'
+//   thresholdDb: level in dBFS below which a span is dropped (default -90 for
+//     'silence', -50 for 'voice')
+//   hangoverMs: keep passing audio this long after the last active span
+//     (default 300)
+// returns false if the capture thread is running.
+napi_value SetGate(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetGate: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in SetGate: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetGate: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  status = napi_typeof(env, args[1], &value_type);
+  if (status != napi_ok || value_type != napi_object) {
+    std::cerr << "C++ error in SetGate: args[1] is not an object" << std::endl;
+    return nullptr;
+  }
+
+  char modeName[16] = "off";
+  int32_t hangoverMs = 300;
+  if (!getOptionalStringProperty(env, args[1], "mode", modeName, sizeof(modeName))
+    || !getOptionalInt32Property(env, args[1], "hangoverMs", &hangoverMs)) {
+    std::cerr << "C++ error in SetGate: invalid options in args[1]" << std::endl;
+    return nullptr;
+  }
+
+  GateMode mode;
+  if (strcmp(modeName, "off") == 0) {
+    mode = GATE_MODE_OFF;
+  } else if (strcmp(modeName, "silence") == 0) {
+    mode = GATE_MODE_SILENCE;
+  } else if (strcmp(modeName, "voice") == 0) {
+    mode = GATE_MODE_VOICE;
+  } else {
+    std::cerr << "C++ error in SetGate: unknown mode " << modeName << std::endl;
+    return nullptr;
+  }
+
+  double thresholdDb = getGateDefaultThreshold(mode);
+  bool hasThreshold;
+  status = napi_has_named_property(env, args[1], "thresholdDb", &hasThreshold);
+  if (status == napi_ok && hasThreshold) {
+    napi_value property;
+    status = napi_get_named_property(env, args[1], "thresholdDb", &property);
+    if (status != napi_ok || napi_get_value_double(env, property, &thresholdDb) != napi_ok) {
+      std::cerr << "C++ error in SetGate: thresholdDb is not a number" << std::endl;
+      return nullptr;
+    }
+  }
+  if (hangoverMs < 0) {
+    std::cerr << "C++ error in SetGate: invalid hangoverMs" << std::endl;
+    return nullptr;
+  }
+
+  napi_value result;
+  status = napi_get_boolean(env, setGate(clientPointer, mode, (float)thresholdDb, hangoverMs), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetGate: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// GetGateState(client)
+// returns [open, gatedFrames]: whether the gate currently passes audio and
+// how many output frames it has dropped since the capture thread started.
+napi_value GetGateState(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetGateState: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetGateState: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetGateState: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  GateState state = getGateState(clientPointer);
+
+  napi_value result;
+  napi_value open;
+  napi_value gatedFrames;
+  if (napi_create_array_with_length(env, 2, &result) != napi_ok
+    || napi_get_boolean(env, state.open, &open) != napi_ok
+    || napi_create_int64(env, (int64_t)state.gatedFrames, &gatedFrames) != napi_ok
+    || napi_set_element(env, result, 0, open) != napi_ok
+    || napi_set_element(env, result, 1, gatedFrames) != napi_ok) {
+    std::cerr << "C++ error in GetGateState: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// SetFeatures(client, options)
+// computes spectral features of the capture thread output natively: every
+// hopSize frames, the power spectrum of the last fftSize frames mixed to mono.
+// read them with ReadFeatures. call before StartCaptureThread / StartStreaming;
+// null disables them. needs a float32 device format. options:
+//   fftSize: power of two from 16 to 65536 (default 512)
+//   hopSize: frames between analysis windows (default fftSize / 2)
+//   window: 'hann' (default), 'hamming' or 'rectangular'
+//   melBands: sum the power into this many mel bands (default 0: deliver the
+//     fftSize / 2 + 1 linear bins)
+//   minFrequency, maxFrequency: range of the mel bands in Hz (default 0 and
+//     Nyquist)
+//   scale: 'power' (default), 'log' (natural log) or 'db'
+//   floor: power floor before log compression (default 1e-10)
+//   ringFrames: feature frames buffered (default 1 s worth)
+//   audio: whether ReadFrames and StartStreaming still get audio (default
+//     true). subscribers and the native recording get it either way.
+// returns false if the capture thread is running.
+napi_value SetFeatures(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetFeatures: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in SetFeatures: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetFeatures: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  status = napi_typeof(env, args[1], &value_type);
+  if (status != napi_ok || (value_type != napi_object && value_type != napi_null && value_type != napi_undefined)) {
+    std::cerr << "C++ error in SetFeatures: args[1] is not an object or null" << std::endl;
+    return nullptr;
+  }
+
+  napi_value result;
+  if (value_type != napi_object) {
+    status = napi_get_boolean(env, setFeatures(clientPointer, NULL, true), &result);
+    if (status != napi_ok) {
+      std::cerr << "C++ error in SetFeatures: could not create result" << std::endl;
+      return nullptr;
+    }
+    return result;
+  }
+
+  int32_t fftSize = 512;
+  int32_t hopSize = 0;
+  char windowName[16] = "hann";
+  int32_t melBands = 0;
+  double minFrequency = 0.0;
+  double maxFrequency = 0.0;
+  char scaleName[16] = "power";
+  double floor = 1e-10;
+  int32_t ringFrames = 0;
+  bool audio = true;
+  if (!getOptionalInt32Property(env, args[1], "fftSize", &fftSize)
+    || !getOptionalInt32Property(env, args[1], "hopSize", &hopSize)
+    || !getOptionalStringProperty(env, args[1], "window", windowName, sizeof(windowName))
+    || !getOptionalInt32Property(env, args[1], "melBands", &melBands)
+    || !getOptionalDoubleProperty(env, args[1], "minFrequency", &minFrequency)
+    || !getOptionalDoubleProperty(env, args[1], "maxFrequency", &maxFrequency)
+    || !getOptionalStringProperty(env, args[1], "scale", scaleName, sizeof(scaleName))
+    || !getOptionalDoubleProperty(env, args[1], "floor", &floor)
+    || !getOptionalInt32Property(env, args[1], "ringFrames", &ringFrames)
+    || !getOptionalBoolProperty(env, args[1], "audio", &audio)) {
+    std::cerr << "C++ error in SetFeatures: invalid options in args[1]" << std::endl;
+    return nullptr;
+  }
+
+  FeatureOptions options;
+  if (strcmp(windowName, "hann") == 0) {
+    options.window = FEATURE_WINDOW_HANN;
+  } else if (strcmp(windowName, "hamming") == 0) {
+    options.window = FEATURE_WINDOW_HAMMING;
+  } else if (strcmp(windowName, "rectangular") == 0) {
+    options.window = FEATURE_WINDOW_RECTANGULAR;
+  } else {
+    std::cerr << "C++ error in SetFeatures: unknown window " << windowName << std::endl;
+    return nullptr;
+  }
+  if (strcmp(scaleName, "power") == 0) {
+    options.scale = FEATURE_SCALE_POWER;
+  } else if (strcmp(scaleName, "log") == 0) {
+    options.scale = FEATURE_SCALE_LOG;
+  } else if (strcmp(scaleName, "db") == 0) {
+    options.scale = FEATURE_SCALE_DB;
+  } else {
+    std::cerr << "C++ error in SetFeatures: unknown scale " << scaleName << std::endl;
+    return nullptr;
+  }
+  if (fftSize < 16 || fftSize > 65536 || (fftSize & (fftSize - 1)) != 0) {
+    std::cerr << "C++ error in SetFeatures: fftSize must be a power of two from 16 to 65536" << std::endl;
+    return nullptr;
+  }
+  if (hopSize < 0 || melBands < 0 || melBands > fftSize / 2 + 1 || ringFrames < 0
+    || minFrequency < 0.0 || maxFrequency < 0.0 || !(floor > 0.0)) {
+    std::cerr << "C++ error in SetFeatures: invalid hopSize, melBands, frequencies, floor or ringFrames" << std::endl;
+    return nullptr;
+  }
+  options.fftSize = (unsigned int)fftSize;
+  options.hopSize = hopSize != 0 ? (unsigned int)hopSize : (unsigned int)fftSize / 2;
+  options.melBands = (unsigned int)melBands;
+  options.minFrequency = (float)minFrequency;
+  options.maxFrequency = (float)maxFrequency;
+  options.floor = (float)floor;
+  options.ringFrames = (unsigned int)ringFrames;
+
+  status = napi_get_boolean(env, setFeatures(clientPointer, &options, audio), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetFeatures: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// GetFeatureFormat(client)
+// returns [numBins, fftSize, hopSize, sampleRate] of the feature frames, or
+// null if the capture thread was not started with features. feature frame f
+// is the window starting at output frame f * hopSize of the run, for as long
+// as GetFeatureStats shows no overflow.
+napi_value GetFeatureFormat(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetFeatureFormat: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetFeatureFormat: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetFeatureFormat: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  FeatureFormat format = getFeatureFormat(clientPointer);
+  napi_value result;
+  if (!format.valid) {
+    napi_get_null(env, &result);
+    return result;
+  }
+  uint32_t values[4] = { format.numBins, format.fftSize, format.hopSize, format.sampleRate };
+  status = napi_create_array_with_length(env, 4, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetFeatureFormat: cannot create array" << std::endl;
+    return nullptr;
+  }
+  for (uint32_t i = 0; i < 4; i++) {
+    napi_value entry;
+    if (napi_create_uint32(env, values[i], &entry) != napi_ok
+      || napi_set_element(env, result, i, entry) != napi_ok) {
+      std::cerr << "C++ error in GetFeatureFormat: cannot set entry " << i << std::endl;
+      return nullptr;
+    }
+  }
+  return result;
+}
+
+// GetFeatureStats(client)
+// returns [availableFrames, producedFrames, overflowFrames]: feature frames
+// ready for ReadFeatures, computed since StartCaptureThread, and dropped
+// because they were not read in time.
+napi_value GetFeatureStats(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetFeatureStats: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetFeatureStats: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetFeatureStats: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  FeatureStats stats = getFeatureStats(clientPointer);
+  uint64_t values[3] = { stats.availableFrames, stats.producedFrames, stats.overflowFrames };
+  napi_value result;
+  status = napi_create_array_with_length(env, 3, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetFeatureStats: cannot create array" << std::endl;
+    return nullptr;
+  }
+  for (uint32_t i = 0; i < 3; i++) {
+    napi_value entry;
+    if (napi_create_int64(env, (int64_t)values[i], &entry) != napi_ok
+      || napi_set_element(env, result, i, entry) != napi_ok) {
+      std::cerr << "C++ error in GetFeatureStats: cannot set entry " << i << std::endl;
+      return nullptr;
+    }
+  }
+  return result;
+}
+
+// ReadFeatures(client, buffer)
+// copies as many whole feature frames as fit into buffer (an ArrayBuffer) and
+// returns the number copied. each frame is numBins float32 values.
+napi_value ReadFeatures(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadFeatures: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in ReadFeatures: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadFeatures: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  bool isArrayBuffer;
+  status = napi_is_arraybuffer(env, args[1], &isArrayBuffer);
+  if (status != napi_ok || isArrayBuffer != true) {
+    std::cerr << "C++ error in ReadFeatures: args[1] is not arraybuffer" << std::endl;
+    return nullptr;
+  }
+
+  size_t abLength;
+  char* abData;
+  status = napi_get_arraybuffer_info(env, args[1], (void **)&abData, &abLength);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadFeatures: could not get arraybuffer info of args[1]" << std::endl;
+    return nullptr;
+  }
+
+  uint32_t nFrames = 0;
+  FeatureFormat format = getFeatureFormat(clientPointer);
+  if (format.valid) {
+    size_t frameBytes = format.numBins * sizeof(float);
+    nFrames = readFeatures(clientPointer, (float*)abData, (uint32_t)(abLength / frameBytes));
+  }
+
+  napi_value result;
+  status = napi_create_uint32(env, nFrames, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadFeatures: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// GetPacketFlags(client)
+// returns the AUDCLNT_BUFFERFLAGS_xxx of every packet read since the previous
+// call, or'ed together: 1 = data discontinuity, 2 = silent (delivered as
+// zeros), 4 = timestamp error.
+napi_value GetPacketFlags(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetPacketFlags: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetPacketFlags: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetPacketFlags: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  napi_value result;
+  status = napi_create_uint32(env, (uint32_t)takePacketFlags(clientPointer), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetPacketFlags: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// [devicePosition, timestamp, flags]
+napi_value createChunkTimingArray(napi_env env, ChunkTiming timing, const char* caller) {
+  napi_value result;
+  napi_value devicePosition;
+  napi_value timestamp;
+  napi_value flags;
+  if (napi_create_array_with_length(env, 3, &result) != napi_ok
+    || napi_create_int64(env, (int64_t)timing.devicePosition, &devicePosition) != napi_ok
+    || napi_create_int64(env, (int64_t)timing.timestamp, &timestamp) != napi_ok
+    || napi_create_uint32(env, timing.flags, &flags) != napi_ok
+    || napi_set_element(env, result, 0, devicePosition) != napi_ok
+    || napi_set_element(env, result, 1, timestamp) != napi_ok
+    || napi_set_element(env, result, 2, flags) != napi_ok) {
+    std::cerr << "C++ error in " << caller << ": could not create timing array" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// GetChunkTiming(client)
+// returns [devicePosition, timestamp, flags] of the chunk last returned by
+// GetBuffer, DrainInto, ReadFrames, ReadFramesPooled or ReadFramesPlanar:
+// the device position of its first frame, the performance counter time that
+// frame was captured in 100 ns units, and the AUDCLNT_BUFFERFLAGS_xxx of the
+// packets starting in it. returns null before the first chunk. frames
+// written to a shared ring (see AttachSharedRing) have no timing.
+napi_value GetChunkTiming(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetChunkTiming: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetChunkTiming: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetChunkTiming: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  ChunkTiming timing;
+  if (!getChunkTiming(clientPointer, &timing)) {
+    napi_value null;
+    napi_get_null(env, &null);
+    return null;
+  }
+  return createChunkTimingArray(env, timing, "GetChunkTiming");
+}
+
+// GetGlitchStats(client)
+// returns [packets, discontinuities, timestampErrors, silentPackets,
+// gapFrames, truncatedFrames, overflowFrames] since StartCapture: packets
+// flagged discontinuous or with a timestamp error, silent packets, device
+// frames skipped between packets, frames GetBuffer discarded because
+// maximumFrameCount was too small, and frames the capture thread dropped
+// because the ring was full.
+napi_value GetGlitchStats(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetGlitchStats: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetGlitchStats: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetGlitchStats: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  PacketCounters counters = getPacketCounters(clientPointer);
+  uint64_t values[7] = {
+    counters.packets,
+    counters.discontinuities,
+    counters.timestampErrors,
+    counters.silentPackets,
+    counters.gapFrames,
+    counters.truncatedFrames,
+    getOverflowFrames(clientPointer)
+  };
+
+  napi_value result;
+  status = napi_create_array_with_length(env, 7, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetGlitchStats: cannot create array" << std::endl;
+    return nullptr;
+  }
+  for (uint32_t i = 0; i < 7; i++) {
+    napi_value entry;
+    if (napi_create_int64(env, (int64_t)values[i], &entry) != napi_ok
+      || napi_set_element(env, result, i, entry) != napi_ok) {
+      std::cerr << "C++ error in GetGlitchStats: cannot set entry " << i << std::endl;
+      return nullptr;
+    }
+  }
+  return result;
+}
+
+// GetLatencyHistogram(client, reset)
+// how long chunks waited between capture of their newest frame and being
+// returned by GetBuffer, DrainInto or the ReadFrames calls, since
+// StartCapture or the last reset. returns [count, minMs, meanMs, maxMs,
+// p50Ms, p90Ms, p99Ms, buckets], buckets being [upperMs, count] of every
+// non-empty bucket; the last bucket is unbounded (upperMs Infinity). reset
+// clears the histogram after reading it.
+napi_value GetLatencyHistogram(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetLatencyHistogram: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetLatencyHistogram: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetLatencyHistogram: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  bool reset = false;
+  if (argc >= 2) {
+    status = napi_typeof(env, args[1], &value_type);
+    if (status == napi_ok && value_type == napi_boolean) {
+      status = napi_get_value_bool(env, args[1], &reset);
+    }
+    if (status != napi_ok) {
+      std::cerr << "C++ error in GetLatencyHistogram: could not get args[1]" << std::endl;
+      return nullptr;
+    }
+  }
+
+  LatencyStats stats = getLatencyStats(clientPointer);
+  double values[7] = {
+    (double)stats.count,
+    stats.minMs,
+    stats.meanMs,
+    stats.maxMs,
+    getLatencyPercentile(clientPointer, 50.0),
+    getLatencyPercentile(clientPointer, 90.0),
+    getLatencyPercentile(clientPointer, 99.0)
+  };
+  uint64_t counts[LatencyHistogram::bucketCount];
+  getLatencyCounts(clientPointer, counts);
+  if (reset) {
+    resetLatency(clientPointer);
+  }
+
+  napi_value result;
+  napi_value buckets;
+  status = napi_create_array_with_length(env, 8, &result);
+  if (status == napi_ok) status = napi_create_array(env, &buckets);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetLatencyHistogram: cannot create array" << std::endl;
+    return nullptr;
+  }
+  for (uint32_t i = 0; i < 7; i++) {
+    napi_value entry;
+    if (napi_create_double(env, values[i], &entry) != napi_ok
+      || napi_set_element(env, result, i, entry) != napi_ok) {
+      std::cerr << "C++ error in GetLatencyHistogram: cannot set entry " << i << std::endl;
+      return nullptr;
+    }
+  }
+  uint32_t bucketIndex = 0;
+  for (unsigned int i = 0; i < LatencyHistogram::bucketCount; i++) {
+    if (counts[i] == 0) {
+      continue;
+    }
+    napi_value bucket, upper, count;
+    status = napi_create_array_with_length(env, 2, &bucket);
+    if (status == napi_ok) status = napi_create_double(env, LatencyHistogram::getBucketLimitMs(i), &upper);
+    if (status == napi_ok) status = napi_create_int64(env, (int64_t)counts[i], &count);
+    if (status == napi_ok) status = napi_set_element(env, bucket, 0, upper);
+    if (status == napi_ok) status = napi_set_element(env, bucket, 1, count);
+    if (status == napi_ok) status = napi_set_element(env, buckets, bucketIndex++, bucket);
+    if (status != napi_ok) {
+      std::cerr << "C++ error in GetLatencyHistogram: cannot set bucket " << i << std::endl;
+      return nullptr;
+    }
+  }
+  status = napi_set_element(env, result, 7, buckets);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetLatencyHistogram: cannot set buckets" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// GetStats(client)
+// returns [packets, frames, bytesCopied, getBufferMeanUs, getBufferMaxUs,
+// processMeanUs, processMaxUs, ringHighWaterFrames, overflowFrames,
+// latencyP50Ms, latencyP90Ms, latencyP99Ms, traceEvents, droppedTraceEvents]
+// since StartCapture. getBuffer is the time spent getting packets from the
+// device, process the capture thread's pipeline and ring write per packet;
+// the latency percentiles are those of GetLatencyHistogram.
+napi_value GetStats(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetStats: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetStats: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetStats: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  CaptureStats stats = getStats(clientPointer);
+  double values[14] = {
+    (double)stats.packets,
+    (double)stats.frames,
+    (double)stats.bytesCopied,
+    stats.acquire.meanUs,
+    stats.acquire.maxUs,
+    stats.process.meanUs,
+    stats.process.maxUs,
+    (double)stats.ringHighWaterFrames,
+    (double)getOverflowFrames(clientPointer),
+    getLatencyPercentile(clientPointer, 50.0),
+    getLatencyPercentile(clientPointer, 90.0),
+    getLatencyPercentile(clientPointer, 99.0),
+    (double)stats.traceEvents,
+    (double)stats.droppedTraceEvents
+  };
+
+  napi_value result;
+  status = napi_create_array_with_length(env, 14, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetStats: cannot create array" << std::endl;
+    return nullptr;
+  }
+  for (uint32_t i = 0; i < 14; i++) {
+    napi_value entry;
+    if (napi_create_double(env, values[i], &entry) != napi_ok
+      || napi_set_element(env, result, i, entry) != napi_ok) {
+      std::cerr << "C++ error in GetStats: cannot set entry " << i << std::endl;
+      return nullptr;
+    }
+  }
+  return result;
+}
+
+// StartTrace(client, maxEvents)
+// records every step of every packet (wait, GetBuffer, process, consumers,
+// notify, or copy without the capture thread) into a native buffer of
+// maxEvents events, a few per packet. returns false while the capture thread
+// runs. StopTrace(client) stops recording and keeps the events.
+napi_value StartTrace(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok || argc < 2) {
+    std::cerr << "C++ error in StartTrace: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in StartTrace: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartTrace: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  int32_t maxEvents;
+  status = napi_get_value_int32(env, args[1], &maxEvents);
+  if (status != napi_ok || maxEvents <= 0 || maxEvents > 16 * 1024 * 1024) {
+    std::cerr << "C++ error in StartTrace: args[1] is not an event count" << std::endl;
+    return nullptr;
+  }
+
+  napi_value result;
+  status = napi_get_boolean(env, startTrace(clientPointer, (uint32_t)maxEvents), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartTrace: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+napi_value StopTrace(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopTrace: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in StopTrace: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopTrace: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  stopTrace(clientPointer);
+  return nullptr;
+}
+
+// GetTrace(client)
+// returns the events recorded so far as a Chrome trace event JSON string, for
+// chrome://tracing or ui.perfetto.dev. can be called while recording.
+napi_value GetTrace(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetTrace: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetTrace: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetTrace: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  std::string json;
+  getTrace(clientPointer, &json);
+
+  napi_value result;
+  status = napi_create_string_utf8(env, json.c_str(), json.size(), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetTrace: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// ---------------------------------------------
+// subscribers: several consumers share one client, so the device is opened
+// and drained once. each subscription reads the capture thread output through
+// its own cursor, in its own sample format and channel layout.
+
+typedef struct Subscription {
+  void* clientPointer; // NULL once the client is gone
+  void* subscriber;
+} Subscription;
+
+// live subscriptions by client, so they can be detached when the client is
+// finalized before them
+std::map<void*, std::vector<Subscription*>> subscriptions;
+
+void detachSubscriptions(void* clientPointer) {
+  std::map<void*, std::vector<Subscription*>>::iterator it = subscriptions.find(clientPointer);
+  if (it == subscriptions.end()) {
+    return;
+  }
+  for (size_t i = 0; i < it->second.size(); i++) {
+    it->second[i]->clientPointer = NULL;
+    it->second[i]->subscriber = NULL;
+  }
+  subscriptions.erase(it);
+}
+
+void closeSubscription(Subscription* subscription) {
+  if (subscription->clientPointer == NULL) {
+    return;
+  }
+  std::vector<Subscription*>& list = subscriptions[subscription->clientPointer];
+  for (size_t i = 0; i < list.size(); i++) {
+    if (list[i] == subscription) {
+      list.erase(list.begin() + i);
+      break;
+    }
+  }
+  if (list.empty()) {
+    subscriptions.erase(subscription->clientPointer);
+  }
+  unsubscribe(subscription->clientPointer, subscription->subscriber);
+  subscription->clientPointer = NULL;
+  subscription->subscriber = NULL;
+}
+
+void finalizeSubscription(napi_env env, void* finalize_data, void* finalize_hint) {
+  Subscription* subscription = (Subscription*)finalize_data;
+  closeSubscription(subscription);
+  delete subscription;
+}
+
+// gets the Subscription behind args[0]. returns NULL, after logging, if it is
+// not one or has been closed.
+Subscription* getSubscriptionArg(napi_env env, napi_value arg, const char* caller) {
+  napi_valuetype value_type;
+  napi_status status = napi_typeof(env, arg, &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in " << caller << ": could not get args[0]" << std::endl;
+    return NULL;
+  }
+  void* pointer;
+  status = napi_get_value_external(env, arg, &pointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in " << caller << ": could not get subscription pointer value" << std::endl;
+    return NULL;
+  }
+  Subscription* subscription = (Subscription*)pointer;
+  if (subscription->subscriber == NULL) {
+    std::cerr << "C++ error in " << caller << ": subscription is closed" << std::endl;
+    return NULL;
+  }
+  return subscription;
+}
+
+// Subscribe(client, options)
+// adds a consumer of the capture thread output and returns its subscription.
+// call after StartCapture; works before or while the capture thread runs and
+// sees the frames captured from then on. the stream is the format set by
+// SetOutputFormat, gated as set by SetGate. options (all optional):
+//   sampleFormat: 'float32' (default), 'int16' or 'int24'
+//   dither: add TPDF dither when converting to integer samples
+//   channels: channel count (default: output channels). without a matrix, 1
+//     or 2 channels get a standard downmix
+//   matrix: array of rows, one per channel, each with one gain per output
+//     channel
+//   overflow: what to lose when the subscriber falls a whole ring behind:
+//     'drop-oldest' (default) its oldest unread frames, 'skip-to-live'
+//     everything unread, or 'protect' nothing, holding back the capture
+//     thread so the newest frames are lost for every subscriber instead
+// returns null if too many subscribers exist.
+napi_value Subscribe(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in Subscribe: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in Subscribe: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in Subscribe: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  status = napi_typeof(env, args[1], &value_type);
+  if (status != napi_ok || value_type != napi_object) {
+    std::cerr << "C++ error in Subscribe: args[1] is not an object" << std::endl;
+    return nullptr;
+  }
+
+  char sampleFormatName[16] = "float32";
+  bool dither = false;
+  char overflowName[16] = "drop-oldest";
+  if (!getOptionalStringProperty(env, args[1], "sampleFormat", sampleFormatName, sizeof(sampleFormatName))
+    || !getOptionalBoolProperty(env, args[1], "dither", &dither)
+    || !getOptionalStringProperty(env, args[1], "overflow", overflowName, sizeof(overflowName))) {
+    std::cerr << "C++ error in Subscribe: invalid options in args[1]" << std::endl;
+    return nullptr;
+  }
+
+  SampleFormat sampleFormat;
+  if (strcmp(sampleFormatName, "float32") == 0) {
+    sampleFormat = SAMPLE_FORMAT_FLOAT32;
+  } else if (strcmp(sampleFormatName, "int16") == 0) {
+    sampleFormat = SAMPLE_FORMAT_INT16;
+  } else if (strcmp(sampleFormatName, "int24") == 0) {
+    sampleFormat = SAMPLE_FORMAT_INT24;
+  } else {
+    std::cerr << "C++ error in Subscribe: unknown sampleFormat " << sampleFormatName << std::endl;
+    return nullptr;
+  }
+
+  OverflowPolicy policy;
+  if (strcmp(overflowName, "drop-oldest") == 0) {
+    policy = OVERFLOW_DROP_OLDEST;
+  } else if (strcmp(overflowName, "skip-to-live") == 0) {
+    policy = OVERFLOW_SKIP_TO_LIVE;
+  } else if (strcmp(overflowName, "protect") == 0) {
+    policy = OVERFLOW_PROTECT;
+  } else {
+    std::cerr << "C++ error in Subscribe: unknown overflow " << overflowName << std::endl;
+    return nullptr;
+  }
+
+  uint32_t inputChannels = getOutputFormat(clientPointer).numChannels;
+  std::vector<float> matrix;
+  if (!getOptionalMatrixProperty(env, args[1], "matrix", inputChannels, &matrix)) {
+    std::cerr << "C++ error in Subscribe: invalid matrix, expected rows of " << inputChannels << " gains" << std::endl;
+    return nullptr;
+  }
+  int32_t channels = matrix.empty() ? 0 : (int32_t)(matrix.size() / inputChannels);
+  if (!getOptionalInt32Property(env, args[1], "channels", &channels)) {
+    std::cerr << "C++ error in Subscribe: invalid options in args[1]" << std::endl;
+    return nullptr;
+  }
+  if (channels < 0 || (!matrix.empty() && (size_t)channels * inputChannels != matrix.size())
+    || (matrix.empty() && channels > 2 && (uint32_t)channels != inputChannels)) {
+    std::cerr << "C++ error in Subscribe: invalid channels" << std::endl;
+    return nullptr;
+  }
+
+  void* subscriber = subscribe(clientPointer, policy, sampleFormat, dither, channels, matrix.empty() ? NULL : matrix.data());
+  if (subscriber == NULL) {
+    reportNotCapturing(clientPointer, "Subscribe");
+    napi_value null;
+    napi_get_null(env, &null);
+    return null;
+  }
+
+  Subscription* subscription = new Subscription();
+  subscription->clientPointer = clientPointer;
+  subscription->subscriber = subscriber;
+  napi_value result;
+  status = napi_create_external(env, subscription, finalizeSubscription, NULL, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in Subscribe: could not create subscription external" << std::endl;
+    unsubscribe(clientPointer, subscriber);
+    delete subscription;
+    return nullptr;
+  }
+  subscriptions[clientPointer].push_back(subscription);
+  return result;
+}
+
+// Unsubscribe(subscription)
+// frees the subscription's cursor. also happens when it is garbage collected.
+napi_value Unsubscribe(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in Unsubscribe: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  Subscription* subscription = getSubscriptionArg(env, args[0], "Unsubscribe");
+  if (subscription == NULL) {
+    return nullptr;
+  }
+  closeSubscription(subscription);
+  return nullptr;
+}
+
+// ReadSubscriber(subscription, arrayBuffer)
+// copies as many whole frames as fit into arrayBuffer and returns the number
+// of frames copied.
+napi_value ReadSubscriber(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadSubscriber: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  Subscription* subscription = getSubscriptionArg(env, args[0], "ReadSubscriber");
+  if (subscription == NULL) {
+    return nullptr;
+  }
+
+  bool isArrayBuffer;
+  status = napi_is_arraybuffer(env, args[1], &isArrayBuffer);
+  if (status != napi_ok || isArrayBuffer != true) {
+    std::cerr << "C++ error in ReadSubscriber: args[1] is not arraybuffer" << std::endl;
+    return nullptr;
+  }
+
+  size_t abLength;
+  char* abData;
+  status = napi_get_arraybuffer_info(env, args[1], (void **)&abData, &abLength);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadSubscriber: could not get arraybuffer info of args[1]" << std::endl;
+    return nullptr;
+  }
+
+  uint32_t frameSize = getSubscriberFormat(subscription->clientPointer, subscription->subscriber).frameSize;
+  uint32_t nFrames = frameSize == 0 ? 0 : readSubscriber(subscription->subscriber, abData, (uint32_t)(abLength / frameSize));
+
+  napi_value result;
+  status = napi_create_uint32(env, nFrames, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadSubscriber: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// GetSubscriberFormat(subscription)
+// format of the frames ReadSubscriber delivers, in the same layout as
+// GetAudioFormat.
+napi_value GetSubscriberFormat(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetSubscriberFormat: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  Subscription* subscription = getSubscriptionArg(env, args[0], "GetSubscriberFormat");
+  if (subscription == NULL) {
+    return nullptr;
+  }
+  return createAudioFormatArray(env, getSubscriberFormat(subscription->clientPointer, subscription->subscriber), "GetSubscriberFormat");
+}
+
+// GetSubscriberStats(subscription)
+// returns [availableFrames, droppedFrames, blockedFrames]: frames ready to
+// read, frames this subscriber lost to its overflow policy, and frames no
+// subscriber got because a 'protect' subscriber was a whole ring behind.
+napi_value GetSubscriberStats(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetSubscriberStats: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  Subscription* subscription = getSubscriptionArg(env, args[0], "GetSubscriberStats");
+  if (subscription == NULL) {
+    return nullptr;
+  }
+
+  napi_value result;
+  napi_value available;
+  napi_value dropped;
+  napi_value blocked;
+  if (napi_create_array_with_length(env, 3, &result) != napi_ok
+    || napi_create_uint32(env, getSubscriberAvailableFrames(subscription->subscriber), &available) != napi_ok
+    || napi_create_int64(env, (int64_t)getSubscriberDroppedFrames(subscription->subscriber), &dropped) != napi_ok
+    || napi_create_int64(env, (int64_t)getBroadcastBlockedFrames(subscription->clientPointer), &blocked) != napi_ok
+    || napi_set_element(env, result, 0, available) != napi_ok
+    || napi_set_element(env, result, 1, dropped) != napi_ok
+    || napi_set_element(env, result, 2, blocked) != napi_ok) {
+    std::cerr << "C++ error in GetSubscriberStats: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// ---------------------------------------------
+// devices: by default StartCapture opens the default render endpoint in
+// loopback mode. any active endpoint can be picked instead, and several
+// clients, one per device, can be combined into one time-aligned stream.
+
+// EnumerateDevices()
+// returns [[id, name, 'render' | 'capture', isDefault], ...] for the active
+// endpoints. render endpoints are captured in loopback mode.
+napi_value EnumerateDevices(napi_env env, napi_callback_info info) {
+  std::vector<AudioDeviceInfo> devices;
+  if (!enumerateAudioDevices(&devices)) {
+    std::cerr << "C++ error in EnumerateDevices: could not enumerate endpoints" << std::endl;
+    return nullptr;
+  }
+
+  napi_value result;
+  if (napi_create_array_with_length(env, devices.size(), &result) != napi_ok) {
+    std::cerr << "C++ error in EnumerateDevices: could not create result" << std::endl;
+    return nullptr;
+  }
+  for (size_t i = 0; i < devices.size(); i++) {
+    napi_value entry;
+    napi_value id;
+    napi_value name;
+    napi_value direction;
+    napi_value isDefault;
+    if (napi_create_array_with_length(env, 4, &entry) != napi_ok
+      || napi_create_string_utf8(env, devices[i].id.c_str(), devices[i].id.size(), &id) != napi_ok
+      || napi_create_string_utf8(env, devices[i].name.c_str(), devices[i].name.size(), &name) != napi_ok
+      || napi_create_string_utf8(env, devices[i].isCapture ? "capture" : "render", NAPI_AUTO_LENGTH, &direction) != napi_ok
+      || napi_get_boolean(env, devices[i].isDefault, &isDefault) != napi_ok
+      || napi_set_element(env, entry, 0, id) != napi_ok
+      || napi_set_element(env, entry, 1, name) != napi_ok
+      || napi_set_element(env, entry, 2, direction) != napi_ok
+      || napi_set_element(env, entry, 3, isDefault) != napi_ok
+      || napi_set_element(env, result, (uint32_t)i, entry) != napi_ok) {
+      std::cerr << "C++ error in EnumerateDevices: cannot set entry " << i << std::endl;
+      return nullptr;
+    }
+  }
+  return result;
+}
+
+// SetCaptureDevice(client, id)
+// selects the endpoint the next StartCapture opens: an id from
+// EnumerateDevices, or null for the default render endpoint. returns false if
+// there is no such endpoint or while capturing.
+napi_value SetCaptureDevice(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetCaptureDevice: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in SetCaptureDevice: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetCaptureDevice: could not get pointer value" << std::endl;
+    return nullptr;
+  }
+
+  std::string id;
+  status = napi_typeof(env, args[1], &value_type);
+  if (status != napi_ok || (value_type != napi_string && value_type != napi_null && value_type != napi_undefined)) {
+    std::cerr << "C++ error in SetCaptureDevice: args[1] is not a string or null" << std::endl;
+    return nullptr;
+  }
+  if (value_type == napi_string) {
+    size_t length;
+    status = napi_get_value_string_utf8(env, args[1], NULL, 0, &length);
+    if (status == napi_ok) {
+      id.resize(length + 1);
+      status = napi_get_value_string_utf8(env, args[1], &id[0], length + 1, &length);
+      id.resize(length);
+    }
+    if (status != napi_ok) {
+      std::cerr << "C++ error in SetCaptureDevice: could not get args[1]" << std::endl;
+      return nullptr;
+    }
+  }
+
+  napi_value result;
+  status = napi_get_boolean(env, setCaptureDevice(clientPointer, id.c_str()), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetCaptureDevice: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// SetCaptureBackend(client, options)
+// selects where the next StartCapture gets its packets from. options.type:
+//   'wasapi': the audio device (default; Windows only)
+//   'signal': test signal, float32. waveform: 'sine' (default), 'square',
+//     'noise' or 'zero'; frequency (440), amplitude (0.5), channels (2),
+//     sampleRate (48000)
+//   'file': replays path, a WAV file or, with sampleRate, channels and
+//     sampleFormat ('float32', 'int16', 'int24' or 'int32'), a raw file.
+//     loop starts over at the end of the file.
+// the simulated types also take:
+//   realtime: deliver packets at the stream rate (default) or as fast as they
+//     are read
+//   packetMs: nominal packet length (default 10)
+//   jitter: packet length varies by this fraction, 0 to 1
+//   discontinuityRate, silentRate, timestampErrorRate: chance per packet of
+//     that glitch. a discontinuity skips gapMs (default 10) of the source.
+//   driftPpm: how much faster than nominal the simulated clock runs
+//   seed: seed of the glitch and jitter generator
+// returns false while capturing or if the backend is not available.
+napi_value SetCaptureBackend(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetCaptureBackend: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in SetCaptureBackend: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetCaptureBackend: could not get pointer value" << std::endl;
+    return nullptr;
+  }
+
+  status = napi_typeof(env, args[1], &value_type);
+  if (status != napi_ok || value_type != napi_object) {
+    std::cerr << "C++ error in SetCaptureBackend: args[1] is not an object" << std::endl;
+    return nullptr;
+  }
+
+  char typeName[16] = "wasapi";
+  bool realtime = true;
+  double packetMs = 10.0;
+  double jitter = 0.0;
+  double discontinuityRate = 0.0;
+  double gapMs = 10.0;
+  double silentRate = 0.0;
+  double timestampErrorRate = 0.0;
+  double driftPpm = 0.0;
+  int32_t seed = 1;
+  char waveformName[16] = "sine";
+  double frequency = 440.0;
+  double amplitude = 0.5;
+  int32_t channels = 2;
+  int32_t sampleRate = 48000;
+  char path[4096] = "";
+  bool loop = false;
+  char sampleFormatName[16] = "";
+  if (!getOptionalStringProperty(env, args[1], "type", typeName, sizeof(typeName))
+    || !getOptionalBoolProperty(env, args[1], "realtime", &realtime)
+    || !getOptionalDoubleProperty(env, args[1], "packetMs", &packetMs)
+    || !getOptionalDoubleProperty(env, args[1], "jitter", &jitter)
+    || !getOptionalDoubleProperty(env, args[1], "discontinuityRate", &discontinuityRate)
+    || !getOptionalDoubleProperty(env, args[1], "gapMs", &gapMs)
+    || !getOptionalDoubleProperty(env, args[1], "silentRate", &silentRate)
+    || !getOptionalDoubleProperty(env, args[1], "timestampErrorRate", &timestampErrorRate)
+    || !getOptionalDoubleProperty(env, args[1], "driftPpm", &driftPpm)
+    || !getOptionalInt32Property(env, args[1], "seed", &seed)
+    || !getOptionalStringProperty(env, args[1], "waveform", waveformName, sizeof(waveformName))
+    || !getOptionalDoubleProperty(env, args[1], "frequency", &frequency)
+    || !getOptionalDoubleProperty(env, args[1], "amplitude", &amplitude)
+    || !getOptionalInt32Property(env, args[1], "channels", &channels)
+    || !getOptionalInt32Property(env, args[1], "sampleRate", &sampleRate)
+    || !getOptionalStringProperty(env, args[1], "path", path, sizeof(path))
+    || !getOptionalBoolProperty(env, args[1], "loop", &loop)
+    || !getOptionalStringProperty(env, args[1], "sampleFormat", sampleFormatName, sizeof(sampleFormatName))) {
+    std::cerr << "C++ error in SetCaptureBackend: invalid options in args[1]" << std::endl;
+    return nullptr;
+  }
+  if (channels <= 0 || sampleRate <= 0 || packetMs <= 0.0 || gapMs < 0.0
+    || jitter < 0.0 || jitter > 1.0 || driftPpm <= -1000000.0) {
+    std::cerr << "C++ error in SetCaptureBackend: invalid options in args[1]" << std::endl;
+    return nullptr;
+  }
+
+  CaptureBackend* backend = NULL;
+  SimulatedBackend* simulated = NULL;
+  if (strcmp(typeName, "wasapi") == 0) {
+    // startCapture() creates it when there is none
+    backend = NULL;
+  } else if (strcmp(typeName, "signal") == 0) {
+    SignalWaveform waveform;
+    if (strcmp(waveformName, "sine") == 0) {
+      waveform = SIGNAL_SINE;
+    } else if (strcmp(waveformName, "square") == 0) {
+      waveform = SIGNAL_SQUARE;
+    } else if (strcmp(waveformName, "noise") == 0) {
+      waveform = SIGNAL_NOISE;
+    } else if (strcmp(waveformName, "zero") == 0) {
+      waveform = SIGNAL_ZERO;
+    } else {
+      std::cerr << "C++ error in SetCaptureBackend: unknown waveform " << waveformName << std::endl;
+      return nullptr;
+    }
+    SignalBackend* signal = new SignalBackend();
+    signal->setSignal(waveform, frequency, (float)amplitude, (unsigned int)channels, (unsigned int)sampleRate);
+    simulated = signal;
+  } else if (strcmp(typeName, "file") == 0) {
+    if (path[0] == '\0') {
+      std::cerr << "C++ error in SetCaptureBackend: missing path" << std::endl;
+      return nullptr;
+    }
+    FileBackend* file = new FileBackend();
+    if (sampleFormatName[0] == '\0') {
+      file->setWavFile(path, loop);
+    } else {
+      CaptureFormat rawFormat = {};
+      bool isFloat = strcmp(sampleFormatName, "float32") == 0;
+      if (isFloat || strcmp(sampleFormatName, "int32") == 0) {
+        rawFormat.bitsPerSample = 32;
+      } else if (strcmp(sampleFormatName, "int16") == 0) {
+        rawFormat.bitsPerSample = 16;
+      } else if (strcmp(sampleFormatName, "int24") == 0) {
+        rawFormat.bitsPerSample = 24;
+      } else {
+        delete file;
+        std::cerr << "C++ error in SetCaptureBackend: unknown sampleFormat " << sampleFormatName << std::endl;
+        return nullptr;
+      }
+      rawFormat.numChannels = (unsigned int)channels;
+      rawFormat.sampleRate = (unsigned int)sampleRate;
+      rawFormat.frameSize = rawFormat.numChannels * rawFormat.bitsPerSample / 8;
+      rawFormat.sampleType = getCaptureSampleType(isFloat, rawFormat.bitsPerSample);
+      file->setRawFile(path, loop, rawFormat);
+    }
+    simulated = file;
+  } else {
+    std::cerr << "C++ error in SetCaptureBackend: unknown type " << typeName << std::endl;
+    return nullptr;
+  }
+
+  if (simulated != NULL) {
+    SimulationOptions options;
+    options.realtime = realtime;
+    options.packetMs = packetMs;
+    options.jitter = jitter;
+    options.discontinuityRate = discontinuityRate;
+    options.gapMs = gapMs;
+    options.silentRate = silentRate;
+    options.timestampErrorRate = timestampErrorRate;
+    options.driftPpm = driftPpm;
+    options.seed = (uint32_t)seed;
+    simulated->setOptions(options);
+    backend = simulated;
+  }
+#ifndef _WIN32
+  else {
+    std::cerr << "C++ error in SetCaptureBackend: wasapi is only available on Windows" << std::endl;
+    return nullptr;
+  }
+#endif
+
+  napi_value result;
+  status = napi_get_boolean(env, setCaptureBackend(clientPointer, backend), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetCaptureBackend: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// SetBufferOptions(client, options)
+// buffer settings of the next StartCapture. options (all optional):
+//   bufferMs: size of the device buffer (default 1000). packets not read
+//     within it are lost.
+//   periodMs: interval between packets. shorter than the default device
+//     period (typically 10 ms) needs Windows 10 or later and is not
+//     available in loopback mode; the stream gets the default period then.
+//   lowLatency: the shortest period the device supports, overrides periodMs
+// returns false while capturing.
+napi_value SetBufferOptions(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetBufferOptions: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in SetBufferOptions: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetBufferOptions: could not get pointer value" << std::endl;
+    return nullptr;
+  }
+
+  status = napi_typeof(env, args[1], &value_type);
+  if (status != napi_ok || value_type != napi_object) {
+    std::cerr << "C++ error in SetBufferOptions: args[1] is not an object" << std::endl;
+    return nullptr;
+  }
+
+  double bufferMs = 0.0;
+  double periodMs = 0.0;
+  bool lowLatency = false;
+  if (!getOptionalDoubleProperty(env, args[1], "bufferMs", &bufferMs)
+    || !getOptionalDoubleProperty(env, args[1], "periodMs", &periodMs)
+    || !getOptionalBoolProperty(env, args[1], "lowLatency", &lowLatency)) {
+    std::cerr << "C++ error in SetBufferOptions: invalid options" << std::endl;
+    return nullptr;
+  }
+  if (bufferMs < 0.0 || bufferMs > 100000.0 || periodMs < 0.0 || periodMs > 100000.0) {
+    std::cerr << "C++ error in SetBufferOptions: bufferMs and periodMs must be between 0 and 100000" << std::endl;
+    return nullptr;
+  }
+
+  CaptureBufferOptions options;
+  options.bufferDuration = (uint32_t)(bufferMs * 10000.0);
+  options.period = (uint32_t)(periodMs * 10000.0);
+  options.lowLatency = lowLatency;
+
+  napi_value result;
+  status = napi_get_boolean(env, setBufferOptions(clientPointer, options), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetBufferOptions: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// GetBufferInfo(client)
+// returns [bufferFrames, periodFrames, defaultPeriodFrames, minPeriodFrames,
+// streamLatencyMs, lowLatency] of the running stream: the period it got, the
+// default and shortest ones the device offers, the latency the device adds
+// before frames reach the buffer, and whether the period is below the
+// default. call after StartCapture.
+napi_value GetBufferInfo(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetBufferInfo: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetBufferInfo: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetBufferInfo: could not get pointer value" << std::endl;
+    return nullptr;
+  }
+
+  CaptureBufferInfo bufferInfo = getBufferInfo(clientPointer);
+  if (reportNotCapturing(clientPointer, "GetBufferInfo")) {
+    return nullptr;
+  }
+
+  napi_value result;
+  napi_value entries[6];
+  status = napi_create_array_with_length(env, 6, &result);
+  if (status == napi_ok) status = napi_create_uint32(env, bufferInfo.bufferFrames, &entries[0]);
+  if (status == napi_ok) status = napi_create_uint32(env, bufferInfo.periodFrames, &entries[1]);
+  if (status == napi_ok) status = napi_create_uint32(env, bufferInfo.defaultPeriodFrames, &entries[2]);
+  if (status == napi_ok) status = napi_create_uint32(env, bufferInfo.minPeriodFrames, &entries[3]);
+  if (status == napi_ok) status = napi_create_double(env, bufferInfo.streamLatency / 10000.0, &entries[4]);
+  if (status == napi_ok) status = napi_get_boolean(env, bufferInfo.lowLatency, &entries[5]);
+  for (uint32_t i = 0; i < 6 && status == napi_ok; i++) {
+    status = napi_set_element(env, result, i, entries[i]);
+  }
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetBufferInfo: cannot create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+typedef struct MixerContext {
+  void* mixer; // NULL once closed or one of its clients is gone
+  std::vector<void*> clients;
+  uint32_t ringFrames;
+} MixerContext;
+
+// live mixers by client, so they can be stopped when one of their clients is
+// finalized before them
+std::map<void*, std::vector<MixerContext*>> mixers;
+
+// stops and deletes the mixer; its clients keep running
+void closeMixer(MixerContext* context) {
+  if (context->mixer == NULL) {
+    return;
+  }
+  for (size_t c = 0; c < context->clients.size(); c++) {
+    std::vector<MixerContext*>& list = mixers[context->clients[c]];
+    for (size_t i = 0; i < list.size(); i++) {
+      if (list[i] == context) {
+        list.erase(list.begin() + i);
+        break;
+      }
+    }
+    if (list.empty()) {
+      mixers.erase(context->clients[c]);
+    }
+  }
+  deleteDeviceMixer(context->mixer);
+  context->mixer = NULL;
+}
+
+void detachMixers(void* clientPointer) {
+  std::map<void*, std::vector<MixerContext*>>::iterator it = mixers.find(clientPointer);
+  if (it == mixers.end()) {
+    return;
+  }
+  // closeMixer() edits the map
+  std::vector<MixerContext*> list = it->second;
+  for (size_t i = 0; i < list.size(); i++) {
+    closeMixer(list[i]);
+  }
+}
+
+void finalizeMixer(napi_env env, void* finalize_data, void* finalize_hint) {
+  MixerContext* context = (MixerContext*)finalize_data;
+  closeMixer(context);
+  delete context;
+}
+
+// gets the MixerContext behind args[0]. returns NULL, after logging, if it is
+// not one or has been closed.
+MixerContext* getMixerArg(napi_env env, napi_value arg, const char* caller) {
+  napi_valuetype value_type;
+  napi_status status = napi_typeof(env, arg, &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in " << caller << ": could not get args[0]" << std::endl;
+    return NULL;
+  }
+  void* pointer;
+  status = napi_get_value_external(env, arg, &pointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in " << caller << ": could not get mixer pointer value" << std::endl;
+    return NULL;
+  }
+  MixerContext* context = (MixerContext*)pointer;
+  if (context->mixer == NULL) {
+    std::cerr << "C++ error in " << caller << ": mixer is closed" << std::endl;
+    return NULL;
+  }
+  return context;
+}
+
+// CreateDeviceMixer(clients, options)
+// combines several clients, typically one per device, into one stream whose
+// sources are aligned by capture time, with the device clock drift of each
+// source against the first one compensated. call after StartCapture and
+// SetOutputFormat on every client; they must deliver float32 at the same
+// sample rate. options (all optional):
+//   mode: 'mix' (default) sums the sources, which need the same channels;
+//     'tracks' puts them side by side, the channels of clients[0] first
+//   gains: one gain per client (default 1)
+//   ringFrames: frames buffered for ReadMixedFrames (default 1 s)
+// returns null if the clients cannot be combined.
+napi_value CreateDeviceMixer(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in CreateDeviceMixer: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  bool isArray;
+  uint32_t numClients;
+  status = napi_is_array(env, args[0], &isArray);
+  if (status != napi_ok || !isArray
+    || napi_get_array_length(env, args[0], &numClients) != napi_ok || numClients == 0) {
+    std::cerr << "C++ error in CreateDeviceMixer: args[0] is not a non-empty array" << std::endl;
+    return nullptr;
+  }
+  std::vector<void*> clients;
+  for (uint32_t i = 0; i < numClients; i++) {
+    napi_value element;
+    napi_valuetype value_type;
+    void* clientPointer;
+    if (napi_get_element(env, args[0], i, &element) != napi_ok
+      || napi_typeof(env, element, &value_type) != napi_ok || value_type != napi_external
+      || napi_get_value_external(env, element, &clientPointer) != napi_ok) {
+      std::cerr << "C++ error in CreateDeviceMixer: args[0][" << i << "] is not a client" << std::endl;
+      return nullptr;
+    }
+    for (size_t j = 0; j < clients.size(); j++) {
+      if (clients[j] == clientPointer) {
+        std::cerr << "C++ error in CreateDeviceMixer: client " << i << " is listed twice" << std::endl;
+        return nullptr;
+      }
+    }
+    clients.push_back(clientPointer);
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[1], &value_type);
+  if (status != napi_ok || value_type != napi_object) {
+    std::cerr << "C++ error in CreateDeviceMixer: args[1] is not an object" << std::endl;
+    return nullptr;
+  }
+
+  char modeName[16] = "mix";
+  int32_t ringFrames = (int32_t)getOutputFormat(clients[0]).samplesPerSec;
+  std::vector<float> gains;
+  if (!getOptionalStringProperty(env, args[1], "mode", modeName, sizeof(modeName))
+    || !getOptionalInt32Property(env, args[1], "ringFrames", &ringFrames)
+    || !getOptionalNumberArrayProperty(env, args[1], "gains", numClients, &gains)) {
+    std::cerr << "C++ error in CreateDeviceMixer: invalid options in args[1]" << std::endl;
+    return nullptr;
+  }
+  if (gains.empty()) {
+    gains.assign(numClients, 1.0f);
+  }
+  if (ringFrames <= 0) {
+    std::cerr << "C++ error in CreateDeviceMixer: invalid ringFrames" << std::endl;
+    return nullptr;
+  }
+
+  MixerMode mode;
+  if (strcmp(modeName, "mix") == 0) {
+    mode = MIXER_MODE_MIX;
+  } else if (strcmp(modeName, "tracks") == 0) {
+    mode = MIXER_MODE_TRACKS;
+  } else {
+    std::cerr << "C++ error in CreateDeviceMixer: unknown mode " << modeName << std::endl;
+    return nullptr;
+  }
+
+  void* mixer = createDeviceMixer(clients.data(), gains.data(), numClients, mode, (uint32_t)ringFrames);
+  if (mixer == NULL) {
+    napi_value null;
+    napi_get_null(env, &null);
+    return null;
+  }
+
+  MixerContext* context = new MixerContext();
+  context->mixer = mixer;
+  context->clients = clients;
+  context->ringFrames = (uint32_t)ringFrames;
+  napi_value result;
+  status = napi_create_external(env, context, finalizeMixer, NULL, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in CreateDeviceMixer: could not create mixer external" << std::endl;
+    deleteDeviceMixer(mixer);
+    delete context;
+    return nullptr;
+  }
+  for (size_t i = 0; i < clients.size(); i++) {
+    mixers[clients[i]].push_back(context);
+  }
+  return result;
+}
+
+// StartDeviceMixer(mixer)
+// starts the capture thread of every client, each with a ring of the mixer's
+// ringFrames, then the mixer thread. the clients' own rings are read by the
+// mixer: do not call ReadFrames / StartStreaming on them, Subscribe instead.
+// returns false if a capture thread was already running or did not start.
+napi_value StartDeviceMixer(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartDeviceMixer: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  MixerContext* context = getMixerArg(env, args[0], "StartDeviceMixer");
+  if (context == NULL) {
+    return nullptr;
+  }
+
+  bool started = true;
+  size_t count = 0;
+  for (; count < context->clients.size(); count++) {
+    if (!startCaptureThread(context->clients[count], context->ringFrames)) {
+      started = false;
+      break;
+    }
+  }
+  if (started) {
+    started = startDeviceMixer(context->mixer);
+  }
+  if (!started) {
+    for (size_t i = 0; i < count; i++) {
+      stopCaptureThread(context->clients[i]);
+    }
+  }
+
+  napi_value result;
+  status = napi_get_boolean(env, started, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartDeviceMixer: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// StopDeviceMixer(mixer)
+// stops the mixer thread and the capture threads of its clients. frames
+// already mixed can still be read.
+napi_value StopDeviceMixer(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopDeviceMixer: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  MixerContext* context = getMixerArg(env, args[0], "StopDeviceMixer");
+  if (context == NULL) {
+    return nullptr;
+  }
+  stopDeviceMixer(context->mixer);
+  for (size_t i = 0; i < context->clients.size(); i++) {
+    stopCaptureThread(context->clients[i]);
+  }
+  return nullptr;
+}
+
+// ReadMixedFrames(mixer, arrayBuffer)
+// copies as many whole float32 frames as fit into arrayBuffer and returns the
+// number of frames copied.
+napi_value ReadMixedFrames(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadMixedFrames: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  MixerContext* context = getMixerArg(env, args[0], "ReadMixedFrames");
+  if (context == NULL) {
+    return nullptr;
+  }
+
+  bool isArrayBuffer;
+  status = napi_is_arraybuffer(env, args[1], &isArrayBuffer);
+  if (status != napi_ok || isArrayBuffer != true) {
+    std::cerr << "C++ error in ReadMixedFrames: args[1] is not arraybuffer" << std::endl;
+    return nullptr;
+  }
+
+  size_t abLength;
+  char* abData;
+  status = napi_get_arraybuffer_info(env, args[1], (void **)&abData, &abLength);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadMixedFrames: could not get arraybuffer info of args[1]" << std::endl;
+    return nullptr;
+  }
+
+  uint32_t frameSize = getMixerFormat(context->mixer).frameSize;
+  uint32_t nFrames = readMixedFrames(context->mixer, (float*)abData, (uint32_t)(abLength / frameSize));
+
+  napi_value result;
+  status = napi_create_uint32(env, nFrames, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadMixedFrames: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// GetMixerFormat(mixer)
+// format of the frames ReadMixedFrames delivers, in the same layout as
+// GetAudioFormat.
+napi_value GetMixerFormat(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetMixerFormat: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  MixerContext* context = getMixerArg(env, args[0], "GetMixerFormat");
+  if (context == NULL) {
+    return nullptr;
+  }
+  return createAudioFormatArray(env, getMixerFormat(context->mixer), "GetMixerFormat");
+}
+
+// GetMixerStats(mixer)
+// returns [availableFrames, overflowFrames, sources], sources holding
+// [driftPpm, offsetMs, stalled, bufferedFrames] per client: how much faster
+// than the first client it is read to follow its device clock, how far its
+// next frame is from the first client's in capture time, whether it is being
+// filled with silence because its device stopped delivering, and how many of
+// its frames wait to be mixed.
+napi_value GetMixerStats(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetMixerStats: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  MixerContext* context = getMixerArg(env, args[0], "GetMixerStats");
+  if (context == NULL) {
+    return nullptr;
+  }
+
+  uint32_t numSources = getMixerSourceCount(context->mixer);
+  napi_value result;
+  napi_value available;
+  napi_value overflow;
+  napi_value sources;
+  if (napi_create_array_with_length(env, 3, &result) != napi_ok
+    || napi_create_uint32(env, getMixedAvailableFrames(context->mixer), &available) != napi_ok
+    || napi_create_int64(env, (int64_t)getMixerOverflowFrames(context->mixer), &overflow) != napi_ok
+    || napi_create_array_with_length(env, numSources, &sources) != napi_ok
+    || napi_set_element(env, result, 0, available) != napi_ok
+    || napi_set_element(env, result, 1, overflow) != napi_ok
+    || napi_set_element(env, result, 2, sources) != napi_ok) {
+    std::cerr << "C++ error in GetMixerStats: could not create result" << std::endl;
+    return nullptr;
+  }
+  for (uint32_t i = 0; i < numSources; i++) {
+    MixerSourceStats stats;
+    getMixerSourceStats(context->mixer, i, &stats);
+    napi_value entry;
+    napi_value driftPpm;
+    napi_value offsetMs;
+    napi_value stalled;
+    napi_value bufferedFrames;
+    if (napi_create_array_with_length(env, 4, &entry) != napi_ok
+      || napi_create_double(env, stats.driftPpm, &driftPpm) != napi_ok
+      || napi_create_double(env, stats.offsetMs, &offsetMs) != napi_ok
+      || napi_get_boolean(env, stats.stalled, &stalled) != napi_ok
+      || napi_create_int64(env, (int64_t)stats.bufferedFrames, &bufferedFrames) != napi_ok
+      || napi_set_element(env, entry, 0, driftPpm) != napi_ok
+      || napi_set_element(env, entry, 1, offsetMs) != napi_ok
+      || napi_set_element(env, entry, 2, stalled) != napi_ok
+      || napi_set_element(env, entry, 3, bufferedFrames) != napi_ok
+      || napi_set_element(env, sources, i, entry) != napi_ok) {
+      std::cerr << "C++ error in GetMixerStats: cannot set entry " << i << std::endl;
+      return nullptr;
+    }
+  }
+  return result;
+}
+
+// ---------------------------------------------
+// native recording. the capture thread hands every packet to a writer thread
+// that fills memory-mapped WAV segments, so recording costs the JS thread
+// nothing. see recorder.h for the file layout.
+
+// StartRecording(client, basePath, options)
+// records the capture thread output to basePath-0000.wav, basePath-0001.wav, ...
+// plus a seek index basePath.idx. call after SetOutputFormat and before
+// StartCaptureThread / StartStreaming. options:
+//   segmentSeconds: length of each segment file (default 3600)
+//   indexIntervalMs: spacing of index entries (default 1000)
+//   bufferMs: audio buffered for the writer thread (default 4000)
+napi_value StartRecording(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value args[3];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartRecording: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in StartRecording: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartRecording: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  status = napi_typeof(env, args[1], &value_type);
+  if (status != napi_ok || value_type != napi_string) {
+    std::cerr << "C++ error in StartRecording: args[1] is not a string" << std::endl;
+    return nullptr;
+  }
+  size_t pathLength;
+  status = napi_get_value_string_utf8(env, args[1], NULL, 0, &pathLength);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartRecording: could not get value of args[1]" << std::endl;
+    return nullptr;
+  }
+  std::vector<char> basePath(pathLength + 1);
+  napi_get_value_string_utf8(env, args[1], basePath.data(), basePath.size(), &pathLength);
+
+  int32_t segmentSeconds = 3600;
+  int32_t indexIntervalMs = 1000;
+  int32_t bufferMs = 4000;
+  if (argc > 2) {
+    status = napi_typeof(env, args[2], &value_type);
+    if (status != napi_ok || value_type != napi_object
+      || !getOptionalInt32Property(env, args[2], "segmentSeconds", &segmentSeconds)
+      || !getOptionalInt32Property(env, args[2], "indexIntervalMs", &indexIntervalMs)
+      || !getOptionalInt32Property(env, args[2], "bufferMs", &bufferMs)) {
+      std::cerr << "C++ error in StartRecording: invalid options in args[2]" << std::endl;
+      return nullptr;
+    }
+  }
+  if (segmentSeconds <= 0 || indexIntervalMs < 0 || bufferMs <= 0) {
+    std::cerr << "C++ error in StartRecording: options out of range" << std::endl;
+    return nullptr;
+  }
+
+  bool started = startRecording(clientPointer, basePath.data(), segmentSeconds, indexIntervalMs, bufferMs);
+  if (!started) {
+    reportNotCapturing(clientPointer, "StartRecording");
+  }
+
+  napi_value result;
+  status = napi_get_boolean(env, started, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartRecording: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// StopRecording(client)
+// flushes and closes the recording. returns false while the capture thread is
+// still running; StopCapture stops the recording as well.
+napi_value StopRecording(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopRecording: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in StopRecording: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopRecording: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  napi_value result;
+  status = napi_get_boolean(env, stopRecording(clientPointer), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopRecording: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// GetRecordingStats(client)
+// returns [recordedFrames, droppedFrames, segmentCount, failed]
+napi_value GetRecordingStats(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetRecordingStats: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetRecordingStats: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetRecordingStats: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  RecordingStats stats = getRecordingStats(clientPointer);
+
+  napi_value result;
+  napi_value recordedFrames;
+  napi_value droppedFrames;
+  napi_value segmentCount;
+  napi_value failed;
+  if (napi_create_array_with_length(env, 4, &result) != napi_ok
+    || napi_create_int64(env, (int64_t)stats.recordedFrames, &recordedFrames) != napi_ok
+    || napi_create_int64(env, (int64_t)stats.droppedFrames, &droppedFrames) != napi_ok
+    || napi_create_uint32(env, stats.segmentCount, &segmentCount) != napi_ok
+    || napi_get_boolean(env, stats.failed, &failed) != napi_ok
+    || napi_set_element(env, result, 0, recordedFrames) != napi_ok
+    || napi_set_element(env, result, 1, droppedFrames) != napi_ok
+    || napi_set_element(env, result, 2, segmentCount) != napi_ok
+    || napi_set_element(env, result, 3, failed) != napi_ok) {
+    std::cerr << "C++ error in GetRecordingStats: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// FindRecordingPosition(indexPath, key)
+// looks up a position in a recording through its .idx file. key is an object
+// with one of frame (frame number in the recording), devicePosition or
+// timestamp (performance counter time in 100 ns units). returns
+// [segment, byteOffset, frame, devicePosition, timestamp], or null if the index
+// cannot be read.
+napi_value FindRecordingPosition(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in FindRecordingPosition: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_string) {
+    std::cerr << "C++ error in FindRecordingPosition: args[0] is not a string" << std::endl;
+    return nullptr;
+  }
+  size_t pathLength;
+  status = napi_get_value_string_utf8(env, args[0], NULL, 0, &pathLength);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in FindRecordingPosition: could not get value of args[0]" << std::endl;
+    return nullptr;
+  }
+  std::vector<char> indexPath(pathLength + 1);
+  napi_get_value_string_utf8(env, args[0], indexPath.data(), indexPath.size(), &pathLength);
+
+  status = napi_typeof(env, args[1], &value_type);
+  if (status != napi_ok || value_type != napi_object) {
+    std::cerr << "C++ error in FindRecordingPosition: args[1] is not an object" << std::endl;
+    return nullptr;
+  }
+
+  static const char* keyNames[] = { "frame", "devicePosition", "timestamp" };
+  int keyType = -1;
+  double key = 0;
+  for (int i = 0; i < 3 && keyType < 0; i++) {
+    bool hasProperty;
+    status = napi_has_named_property(env, args[1], keyNames[i], &hasProperty);
+    if (status != napi_ok || !hasProperty) {
+      continue;
+    }
+    napi_value property;
+    status = napi_get_named_property(env, args[1], keyNames[i], &property);
+    if (status != napi_ok || napi_get_value_double(env, property, &key) != napi_ok || key < 0) {
+      std::cerr << "C++ error in FindRecordingPosition: " << keyNames[i] << " is not a number" << std::endl;
+      return nullptr;
+    }
+    keyType = i;
+  }
+  if (keyType < 0) {
+    std::cerr << "C++ error in FindRecordingPosition: args[1] has no frame, devicePosition or timestamp" << std::endl;
+    return nullptr;
+  }
+
+  napi_value result;
+  RecordingIndexEntry position;
+  if (!findRecordingPosition(indexPath.data(), keyType, (uint64_t)key, &position)) {
+    napi_get_null(env, &result);
+    return result;
+  }
+
+  double values[5] = {
+    (double)position.segment,
+    (double)position.byteOffset,
+    (double)position.frame,
+    (double)position.devicePosition,
+    (double)position.timestamp
+  };
+  status = napi_create_array_with_length(env, 5, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in FindRecordingPosition: could not create result" << std::endl;
+    return nullptr;
+  }
+  for (uint32_t i = 0; i < 5; i++) {
+    napi_value value;
+    status = napi_create_double(env, values[i], &value);
+    if (status != napi_ok || napi_set_element(env, result, i, value) != napi_ok) {
+      std::cerr << "C++ error in FindRecordingPosition: could not create result" << std::endl;
+      return nullptr;
+    }
+  }
+  return result;
+}
+
+// ---------------------------------------------
+// compressed recording. the same as StartRecording, but to a single FLAC file
+// encoded block by block on a pool of threads, see FlacRecorder in recorder.h.
+
+// StartFlacRecording(client, path, options)
+// records the capture thread output to path as FLAC. the output sampleFormat
+// must be 'int16' or 'int24', see SetOutputFormat; FLAC has no float samples.
+// call before StartCaptureThread / StartStreaming.
+// options:
+//   blockFrames: frames per FLAC frame (default 4096)
+//   threads: encoder threads (default 2)
+//   bufferMs: audio buffered for the encoders (default 4000)
+napi_value StartFlacRecording(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value args[3];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartFlacRecording: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in StartFlacRecording: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartFlacRecording: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  status = napi_typeof(env, args[1], &value_type);
+  if (status != napi_ok || value_type != napi_string) {
+    std::cerr << "C++ error in StartFlacRecording: args[1] is not a string" << std::endl;
+    return nullptr;
+  }
+  size_t pathLength;
+  status = napi_get_value_string_utf8(env, args[1], NULL, 0, &pathLength);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartFlacRecording: could not get value of args[1]" << std::endl;
+    return nullptr;
+  }
+  std::vector<char> path(pathLength + 1);
+  napi_get_value_string_utf8(env, args[1], path.data(), path.size(), &pathLength);
+
+  int32_t blockFrames = 4096;
+  int32_t threads = 2;
+  int32_t bufferMs = 4000;
+  if (argc > 2) {
+    status = napi_typeof(env, args[2], &value_type);
+    if (status != napi_ok || value_type != napi_object
+      || !getOptionalInt32Property(env, args[2], "blockFrames", &blockFrames)
+      || !getOptionalInt32Property(env, args[2], "threads", &threads)
+      || !getOptionalInt32Property(env, args[2], "bufferMs", &bufferMs)) {
+      std::cerr << "C++ error in StartFlacRecording: invalid options in args[2]" << std::endl;
+      return nullptr;
+    }
+  }
+  if (blockFrames < 16 || blockFrames > 65535 || threads <= 0 || threads > 64 || bufferMs <= 0) {
+    std::cerr << "C++ error in StartFlacRecording: options out of range" << std::endl;
+    return nullptr;
+  }
+
+  bool started = startFlacRecording(clientPointer, path.data(), blockFrames, threads, bufferMs);
+  if (!started) {
+    reportNotCapturing(clientPointer, "StartFlacRecording");
+  }
+
+  napi_value result;
+  status = napi_get_boolean(env, started, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartFlacRecording: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// StopFlacRecording(client)
+// encodes what is still buffered, writes the totals to the header and closes
+// the file. returns false while the capture thread is still running;
+// StopCapture stops the recording as well.
+napi_value StopFlacRecording(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopFlacRecording: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in StopFlacRecording: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopFlacRecording: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  napi_value result;
+  status = napi_get_boolean(env, stopFlacRecording(clientPointer), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopFlacRecording: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// GetFlacRecordingStats(client)
+// returns [recordedFrames, droppedFrames, inputBytes, outputBytes,
+// compressionRatio, encodeSeconds, encodeMBps, failed]. the ratio is input
+// over output bytes; encodeMBps is input MB per second of encoder thread time,
+// i.e. per thread.
+napi_value GetFlacRecordingStats(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetFlacRecordingStats: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetFlacRecordingStats: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetFlacRecordingStats: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  FlacRecordingStats stats = getFlacRecordingStats(clientPointer);
+  double values[7] = {
+    (double)stats.recordedFrames,
+    (double)stats.droppedFrames,
+    (double)stats.inputBytes,
+    (double)stats.outputBytes,
+    stats.outputBytes > 0 ? (double)stats.inputBytes / stats.outputBytes : 0,
+    stats.encodeSeconds,
+    stats.encodeSeconds > 0 ? stats.inputBytes / 1e6 / stats.encodeSeconds : 0
+  };
+
+  napi_value result;
+  status = napi_create_array_with_length(env, 8, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetFlacRecordingStats: could not create result" << std::endl;
+    return nullptr;
+  }
+  for (uint32_t i = 0; i < 7; i++) {
+    napi_value value;
+    status = napi_create_double(env, values[i], &value);
+    if (status != napi_ok || napi_set_element(env, result, i, value) != napi_ok) {
+      std::cerr << "C++ error in GetFlacRecordingStats: could not create result" << std::endl;
+      return nullptr;
+    }
+  }
+  napi_value failed;
+  if (napi_get_boolean(env, stats.failed, &failed) != napi_ok
+    || napi_set_element(env, result, 7, failed) != napi_ok) {
+    std::cerr << "C++ error in GetFlacRecordingStats: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// ---------------------------------------------
+// network streaming. the capture thread hands every packet to a sender thread
+// that sends it as RTP over UDP, so forwarding audio to a service costs the JS
+// thread nothing. see rtpsender.h.
+
+// StartRtpStream(client, host, port, options)
+// streams the capture thread output to host:port (name, IPv4 or IPv6) as RTP
+// with L16 or L24 payload; the output sampleFormat must be 'int16' or 'int24',
+// see SetOutputFormat. call before StartCaptureThread / StartStreaming.
+// options:
+//   packetMs: audio per packet (default 20)
+//   payloadType: RTP payload type, usually 96 to 127 (default 96)
+//   ssrc: RTP SSRC (default random)
+//   bufferMs: audio buffered for the sender thread (default 2000)
+napi_value StartRtpStream(napi_env env, napi_callback_info info) {
+  size_t argc = 4;
+  napi_value args[4];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok || argc < 3) {
+    std::cerr << "C++ error in StartRtpStream: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in StartRtpStream: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartRtpStream: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  status = napi_typeof(env, args[1], &value_type);
+  if (status != napi_ok || value_type != napi_string) {
+    std::cerr << "C++ error in StartRtpStream: args[1] is not a string" << std::endl;
+    return nullptr;
+  }
+  size_t hostLength;
+  status = napi_get_value_string_utf8(env, args[1], NULL, 0, &hostLength);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartRtpStream: could not get value of args[1]" << std::endl;
+    return nullptr;
+  }
+  std::vector<char> host(hostLength + 1);
+  napi_get_value_string_utf8(env, args[1], host.data(), host.size(), &hostLength);
+
+  int32_t port;
+  status = napi_get_value_int32(env, args[2], &port);
+  if (status != napi_ok || port <= 0 || port > 65535) {
+    std::cerr << "C++ error in StartRtpStream: args[2] is not a port number" << std::endl;
+    return nullptr;
+  }
+
+  int32_t packetMs = 20;
+  int32_t payloadType = 96;
+  double ssrc = 0;
+  int32_t bufferMs = 2000;
+  if (argc > 3) {
+    status = napi_typeof(env, args[3], &value_type);
+    if (status != napi_ok || value_type != napi_object
+      || !getOptionalInt32Property(env, args[3], "packetMs", &packetMs)
+      || !getOptionalInt32Property(env, args[3], "payloadType", &payloadType)
+      || !getOptionalDoubleProperty(env, args[3], "ssrc", &ssrc)
+      || !getOptionalInt32Property(env, args[3], "bufferMs", &bufferMs)) {
+      std::cerr << "C++ error in StartRtpStream: invalid options in args[3]" << std::endl;
+      return nullptr;
+    }
+  }
+  if (packetMs <= 0 || packetMs > 1000 || payloadType < 0 || payloadType > 127
+    || ssrc < 0 || ssrc > 4294967295.0 || bufferMs <= 0) {
+    std::cerr << "C++ error in StartRtpStream: options out of range" << std::endl;
+    return nullptr;
+  }
+
+  bool started = startRtpStream(clientPointer, host.data(), (uint16_t)port, packetMs, (uint8_t)payloadType,
+    (uint32_t)ssrc, bufferMs);
+  if (!started) {
+    reportNotCapturing(clientPointer, "StartRtpStream");
+  }
+
+  napi_value result;
+  status = napi_get_boolean(env, started, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartRtpStream: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// StopRtpStream(client)
+// sends what is still buffered and closes the socket. returns false while the
+// capture thread is still running; StopCapture stops the stream as well.
+napi_value StopRtpStream(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopRtpStream: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in StopRtpStream: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopRtpStream: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  napi_value result;
+  status = napi_get_boolean(env, stopRtpStream(clientPointer), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopRtpStream: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// GetRtpStreamStats(client)
+// returns [packets, bytes, sendCalls, sendErrors, droppedFrames, gapFrames,
+// jitterMs, maxLagMs, ssrc]. packets / sendCalls is the average batch size;
+// jitterMs is the RFC 3550 jitter of the send times, i.e. what the sender adds
+// before the network.
+napi_value GetRtpStreamStats(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetRtpStreamStats: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetRtpStreamStats: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetRtpStreamStats: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  RtpSenderStats stats = getRtpStreamStats(clientPointer);
+  double values[9] = {
+    (double)stats.packets,
+    (double)stats.bytes,
+    (double)stats.sendCalls,
+    (double)stats.sendErrors,
+    (double)stats.droppedFrames,
+    (double)stats.gapFrames,
+    stats.jitterMs,
+    stats.maxLagMs,
+    (double)getRtpStreamSsrc(clientPointer)
+  };
+
+  napi_value result;
+  status = napi_create_array_with_length(env, 9, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetRtpStreamStats: could not create result" << std::endl;
+    return nullptr;
+  }
+  for (uint32_t i = 0; i < 9; i++) {
+    napi_value value;
+    status = napi_create_double(env, values[i], &value);
+    if (status != napi_ok || napi_set_element(env, result, i, value) != napi_ok) {
+      std::cerr << "C++ error in GetRtpStreamStats: could not create result" << std::endl;
+      return nullptr;
+    }
+  }
+  return result;
+}
+
+// SetHistory(client, historyMs)
+// keeps the last historyMs of output in native memory from the next
+// StartCaptureThread on; 0 turns it off. returns false while the capture
+// thread runs.
+napi_value SetHistory(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok || argc < 2) {
+    std::cerr << "C++ error in SetHistory: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in SetHistory: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetHistory: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  int32_t historyMs;
+  status = napi_get_value_int32(env, args[1], &historyMs);
+  if (status != napi_ok || historyMs < 0 || historyMs > 3600000) {
+    std::cerr << "C++ error in SetHistory: args[1] is not a duration" << std::endl;
+    return nullptr;
+  }
+
+  napi_value result;
+  status = napi_get_boolean(env, setHistory(clientPointer, (uint32_t)historyMs), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetHistory: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// reads the optional {fromMs, toMs} of a history snapshot: from fromMs to
+// toMs before the newest frame, by default the whole history.
+bool getHistoryRangeOptions(napi_env env, napi_value options, uint32_t* fromMs, uint32_t* toMs) {
+  int32_t from = INT32_MAX;
+  int32_t to = 0;
+  napi_valuetype value_type;
+  napi_status status = napi_typeof(env, options, &value_type);
+  if (status != napi_ok || value_type != napi_object
+    || !getOptionalInt32Property(env, options, "fromMs", &from)
+    || !getOptionalInt32Property(env, options, "toMs", &to)
+    || to < 0 || from <= to) {
+    return false;
+  }
+  *fromMs = (uint32_t)from;
+  *toMs = (uint32_t)to;
+  return true;
+}
+
+// GetHistorySnapshot(client, {fromMs, toMs})
+// copies a range of the history into a new ArrayBuffer of whole output
+// frames, without pausing the capture thread. the buffer is empty if there is
+// no history (yet).
+napi_value GetHistorySnapshot(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetHistorySnapshot: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in GetHistorySnapshot: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetHistorySnapshot: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  uint32_t fromMs = INT32_MAX;
+  uint32_t toMs = 0;
+  if (argc > 1 && !getHistoryRangeOptions(env, args[1], &fromMs, &toMs)) {
+    std::cerr << "C++ error in GetHistorySnapshot: invalid options in args[1]" << std::endl;
+    return nullptr;
+  }
+
+  // the capture thread keeps writing, so the range copied can end up a few
+  // frames shorter than counted here, never longer
+  unsigned int frameSize = getHistoryFrameSize(clientPointer);
+  uint64_t maximumFrameCount = getHistoryFrameCount(clientPointer, fromMs, toMs);
+  std::vector<char> frames((size_t)(maximumFrameCount * frameSize));
+  uint64_t frameCount = copyHistory(clientPointer, fromMs, toMs, frames.data(), maximumFrameCount);
+
+  napi_value result;
+  void* resultData;
+  size_t bytes = (size_t)(frameCount * frameSize);
+  status = napi_create_arraybuffer(env, bytes, &resultData, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in GetHistorySnapshot: could not create result" << std::endl;
+    return nullptr;
+  }
+  if (bytes > 0) {
+    memcpy(resultData, frames.data(), bytes);
+  }
+  return result;
+}
+
+// SaveHistorySnapshot(client, path, {fromMs, toMs})
+// writes a range of the history to a WAV file in the output format, without
+// pausing the capture thread. returns the number of frames written, or false
+// if the file could not be written.
+napi_value SaveHistorySnapshot(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value args[3];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok || argc < 2) {
+    std::cerr << "C++ error in SaveHistorySnapshot: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in SaveHistorySnapshot: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SaveHistorySnapshot: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  status = napi_typeof(env, args[1], &value_type);
+  if (status != napi_ok || value_type != napi_string) {
+    std::cerr << "C++ error in SaveHistorySnapshot: args[1] is not a string" << std::endl;
+    return nullptr;
+  }
+  size_t pathLength;
+  status = napi_get_value_string_utf8(env, args[1], NULL, 0, &pathLength);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SaveHistorySnapshot: could not get value of args[1]" << std::endl;
+    return nullptr;
+  }
+  std::vector<char> path(pathLength + 1);
+  napi_get_value_string_utf8(env, args[1], path.data(), path.size(), &pathLength);
+
+  uint32_t fromMs = INT32_MAX;
+  uint32_t toMs = 0;
+  if (argc > 2 && !getHistoryRangeOptions(env, args[2], &fromMs, &toMs)) {
+    std::cerr << "C++ error in SaveHistorySnapshot: invalid options in args[2]" << std::endl;
+    return nullptr;
+  }
+
+  uint64_t frameCount = 0;
+  napi_value result;
+  if (saveHistory(clientPointer, path.data(), fromMs, toMs, &frameCount)) {
+    status = napi_create_int64(env, (int64_t)frameCount, &result);
+  } else {
+    status = napi_get_boolean(env, false, &result);
+  }
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SaveHistorySnapshot: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// ---------------------------------------------
+// pooled ArrayBuffers. captured frames are copied once from the ring into a
+// recycled native block, which is handed to JS as an external ArrayBuffer of
+// exactly the delivered length. the block goes back to the pool when JS calls
+// ReleasePooledBuffer or when the ArrayBuffer is garbage collected.
+
+BufferPool bufferPool;
+
+typedef struct PooledBuffer {
+  char* block;
+  size_t capacity;
+  bool released; // returned early by ReleasePooledBuffer
+} PooledBuffer;
+
+// live pooled buffers by data pointer, so ReleasePooledBuffer can find the
+// block behind an ArrayBuffer. finalizers may run for any env, so lock.
+std::mutex pooledBuffersMutex;
+std::unordered_map<void*, PooledBuffer*> pooledBuffers;
+
+void finalizePooledBuffer(napi_env env, void* finalize_data, void* finalize_hint) {
+  PooledBuffer* pooled = (PooledBuffer*)finalize_hint;
+  {
+    std::lock_guard<std::mutex> lock(pooledBuffersMutex);
+    if (!pooled->released) {
+      pooledBuffers.erase(pooled->block);
+      bufferPool.release(pooled->block, pooled->capacity);
+    }
+  }
+  delete pooled;
+}
+
+// wraps bytes bytes of a pooled block in an ArrayBuffer; the block goes back
+// to the pool with the ArrayBuffer. where external ArrayBuffers are not allowed
+// (Electron builds with the V8 sandbox), copies into a regular ArrayBuffer and
+// returns the block right away.
+bool wrapPooledBlock(napi_env env, char* block, size_t capacity, size_t bytes, napi_value* result) {
+  napi_status status;
+
+  PooledBuffer* pooled = new PooledBuffer();
+  pooled->block = block;
+  pooled->capacity = capacity;
+  pooled->released = false;
+  {
+    std::lock_guard<std::mutex> lock(pooledBuffersMutex);
+    pooledBuffers[block] = pooled;
+  }
+
+  status = napi_create_external_arraybuffer(env, block, bytes, finalizePooledBuffer, pooled, result);
+  if (status == napi_ok) {
+    return true;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(pooledBuffersMutex);
+    pooledBuffers.erase(block);
+  }
+  delete pooled;
+
+  void* abData;
+  status = napi_create_arraybuffer(env, bytes, &abData, result);
+  if (status == napi_ok) {
+    memcpy(abData, block, bytes);
+  }
+  bufferPool.release(block, capacity);
+  return status == napi_ok;
+}
+
+// reads nFrames from the capture ring into a new ArrayBuffer of exactly that
+// length.
+bool readFramesToArrayBuffer(napi_env env, void* clientPointer, uint32_t nFrames, napi_value* result) {
+  size_t bytes = (size_t)nFrames * getOutputFormat(clientPointer).frameSize;
+
+  size_t capacity;
+  char* block = bufferPool.acquire(bytes, &capacity);
+  if (block == NULL) {
+    return false;
+  }
+  readFrames(clientPointer, block, nFrames);
+  return wrapPooledBlock(env, block, capacity, bytes, result);
+}
+
+// reads nFrames from the capture ring, deinterleaved, and returns a JS array
+// with one Float32Array per channel. all channels share one pooled ArrayBuffer.
+bool readFramesPlanarToArrays(napi_env env, void* clientPointer, uint32_t nFrames, napi_value* result) {
+  napi_status status;
+  uint32_t numChannels = getOutputFormat(clientPointer).numChannels;
+  size_t bytes = (size_t)nFrames * numChannels * sizeof(float);
+
+  size_t capacity;
+  char* block = bufferPool.acquire(bytes, &capacity);
+  if (block == NULL) {
+    return false;
+  }
+  nFrames = readFramesPlanar(clientPointer, (float*)block, nFrames);
+  bytes = (size_t)nFrames * numChannels * sizeof(float);
+
+  napi_value arrayBuffer;
+  if (!wrapPooledBlock(env, block, capacity, bytes, &arrayBuffer)) {
+    return false;
+  }
+
+  status = napi_create_array_with_length(env, numChannels, result);
+  if (status != napi_ok) return false;
+  for (uint32_t c = 0; c < numChannels; c++) {
+    napi_value channel;
+    status = napi_create_typedarray(env, napi_float32_array, nFrames, arrayBuffer,
+      (size_t)c * nFrames * sizeof(float), &channel);
+    if (status != napi_ok) return false;
+    status = napi_set_element(env, *result, c, channel);
+    if (status != napi_ok) return false;
+  }
+  return true;
+}
+
+// ReadFramesPooled(client, maximumFrameCount)
+// returns an ArrayBuffer holding all frames available in the capture ring (up
+// to maximumFrameCount if given), or null if no frames are available.
+napi_value ReadFramesPooled(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadFramesPooled: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in ReadFramesPooled: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadFramesPooled: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  uint32_t nFrames = getAvailableFrames(clientPointer);
+  if (argc > 1) {
+    status = napi_typeof(env, args[1], &value_type);
+    if (status != napi_ok || (value_type != napi_number && value_type != napi_undefined)) {
+      std::cerr << "C++ error in ReadFramesPooled: could not get args[1]" << std::endl;
+      return nullptr;
+    }
+    if (value_type == napi_number) {
+      uint32_t maximumFrameCount;
+      status = napi_get_value_uint32(env, args[1], &maximumFrameCount);
+      if (status != napi_ok) {
+        std::cerr << "C++ error in ReadFramesPooled: could not get value of args[1]" << std::endl;
+        return nullptr;
+      }
+      if (nFrames > maximumFrameCount) {
+        nFrames = maximumFrameCount;
+      }
+    }
+  }
+
+  napi_value result;
+  if (nFrames == 0) {
+    napi_get_null(env, &result);
+    return result;
+  }
+  if (!readFramesToArrayBuffer(env, clientPointer, nFrames, &result)) {
+    std::cerr << "C++ error in ReadFramesPooled: could not create arraybuffer" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// ReadFramesPlanar(client, maximumFrameCount)
+// like ReadFramesPooled, but returns an array with one Float32Array per
+// channel instead of interleaved frames. requires float32 output. returns null
+// if no frames are available.
+napi_value ReadFramesPlanar(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadFramesPlanar: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in ReadFramesPlanar: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadFramesPlanar: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  AudioCaptureFormat outputFormat = getOutputFormat(clientPointer);
+  if (!outputFormat.formatisValid || outputFormat.bitsPerSample != 32) {
+    std::cerr << "C++ error in ReadFramesPlanar: planar output requires float32 sampleFormat" << std::endl;
+    return nullptr;
+  }
+
+  uint32_t nFrames = getAvailableFrames(clientPointer);
+  if (argc > 1) {
+    status = napi_typeof(env, args[1], &value_type);
+    if (status != napi_ok || (value_type != napi_number && value_type != napi_undefined)) {
+      std::cerr << "C++ error in ReadFramesPlanar: could not get args[1]" << std::endl;
+      return nullptr;
+    }
+    if (value_type == napi_number) {
+      uint32_t maximumFrameCount;
+      status = napi_get_value_uint32(env, args[1], &maximumFrameCount);
+      if (status != napi_ok) {
+        std::cerr << "C++ error in ReadFramesPlanar: could not get value of args[1]" << std::endl;
+        return nullptr;
+      }
+      if (nFrames > maximumFrameCount) {
+        nFrames = maximumFrameCount;
+      }
+    }
+  }
+
+  napi_value result;
+  if (nFrames == 0) {
+    napi_get_null(env, &result);
+    return result;
+  }
+  if (!readFramesPlanarToArrays(env, clientPointer, nFrames, &result)) {
+    std::cerr << "C++ error in ReadFramesPlanar: could not create channel arrays" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// SetBlocking(client, blockFrames, hopFrames)
+// makes ReadBlocks deliver blocks of exactly blockFrames output frames, a new
+// one starting every hopFrames frames (default blockFrames: no overlap), e.g.
+// 320 and 160 for 20 ms windows at a 10 ms hop at 16 kHz. blockFrames of 0
+// turns blocking off. restarts the blocks at the next frame in the ring.
+napi_value SetBlocking(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value args[3];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok || argc < 2) {
+    std::cerr << "C++ error in SetBlocking: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in SetBlocking: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetBlocking: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  uint32_t blockFrames;
+  status = napi_get_value_uint32(env, args[1], &blockFrames);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetBlocking: could not get value of args[1]" << std::endl;
+    return nullptr;
+  }
+  uint32_t hopFrames = 0;
+  if (argc > 2) {
+    status = napi_typeof(env, args[2], &value_type);
+    if (status == napi_ok && value_type != napi_undefined) {
+      status = napi_get_value_uint32(env, args[2], &hopFrames);
+    }
+    if (status != napi_ok) {
+      std::cerr << "C++ error in SetBlocking: could not get value of args[2]" << std::endl;
+      return nullptr;
+    }
+  }
+
+  napi_value result;
+  status = napi_get_boolean(env, setBlocking(clientPointer, blockFrames, hopFrames), &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in SetBlocking: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// ReadBlocks(client, arrayBuffer)
+// copies as many whole blocks (see SetBlocking) as are ready and fit into
+// arrayBuffer, one after another in the output format, and returns the number
+// of blocks copied. overlapping frames are kept natively, so feeding a model
+// needs no concatenation or slicing in JS; reusing the ArrayBuffer makes the
+// read allocation free.
+napi_value ReadBlocks(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadBlocks: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in ReadBlocks: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadBlocks: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  bool isArrayBuffer;
+  status = napi_is_arraybuffer(env, args[1], &isArrayBuffer);
+  if (status != napi_ok || isArrayBuffer != true) {
+    std::cerr << "C++ error in ReadBlocks: args[1] is not arraybuffer" << std::endl;
+    return nullptr;
+  }
+
+  size_t abLength;
+  char* abData;
+  status = napi_get_arraybuffer_info(env, args[1], (void **)&abData, &abLength);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadBlocks: could not get arraybuffer info of args[1]" << std::endl;
+    return nullptr;
+  }
+
+  size_t blockBytes = (size_t)getBlockFrames(clientPointer) * getOutputFormat(clientPointer).frameSize;
+  uint32_t nBlocks = 0;
+  if (blockBytes > 0) {
+    nBlocks = readBlocks(clientPointer, abData, (uint32_t)(abLength / blockBytes));
+  }
+
+  napi_value result;
+  status = napi_create_uint32(env, nBlocks, &result);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReadBlocks: could not create result" << std::endl;
+    return nullptr;
+  }
+  return result;
+}
+
+// ReleasePooledBuffer(arrayBuffer)
+// detaches an ArrayBuffer returned by ReadFramesPooled or StartStreaming and
+// returns its memory to the pool right away instead of waiting for GC. the
+// ArrayBuffer (and any views on it) must not be used afterwards. returns false
+// if the ArrayBuffer is not pooled or could not be detached.
+napi_value ReleasePooledBuffer(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReleasePooledBuffer: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  bool isArrayBuffer;
+  status = napi_is_arraybuffer(env, args[0], &isArrayBuffer);
+  if (status != napi_ok || isArrayBuffer != true) {
+    std::cerr << "C++ error in ReleasePooledBuffer: args[0] is not arraybuffer" << std::endl;
+    return nullptr;
+  }
+
+  void* abData;
+  size_t abLength;
+  status = napi_get_arraybuffer_info(env, args[0], &abData, &abLength);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in ReleasePooledBuffer: could not get arraybuffer info of args[0]" << std::endl;
+    return nullptr;
+  }
+
+  bool released = false;
+  {
+    std::lock_guard<std::mutex> lock(pooledBuffersMutex);
+    std::unordered_map<void*, PooledBuffer*>::iterator it = pooledBuffers.find(abData);
+    if (it != pooledBuffers.end()
+      && napi_detach_arraybuffer(env, args[0]) == napi_ok) {
+      PooledBuffer* pooled = it->second;
+      pooled->released = true;
+      pooledBuffers.erase(it);
+      bufferPool.release(pooled->block, pooled->capacity);
+      released = true;
+    }
+  }
+
+  napi_value result;
+  napi_get_boolean(env, released, &result);
+  return result;
+}
+
+// ---------------------------------------------
+// shared ring. the capture thread writes straight into a SharedArrayBuffer
+// that a worker thread or an AudioWorklet reads with Atomics, so audio never
+// has to pass through the thread that owns the client. see sharedring.h for
+// the layout and sharedring.js for a reader.
+
+std::unordered_map<void*, napi_ref> sharedRingArrays;
+
+void releaseSharedRingArray(napi_env env, void* clientPointer) {
+  std::unordered_map<void*, napi_ref>::iterator it = sharedRingArrays.find(clientPointer);
+  if (it != sharedRingArrays.end()) {
+    napi_delete_reference(env, it->second);
+    sharedRingArrays.erase(it);
+  }
+}
+
+// AttachSharedRing(client, array)
+// array is a typed array over a SharedArrayBuffer (any ArrayBuffer works, but
+// only a shared one can be handed to other threads), the whole of which
+// becomes the ring. call before StartCaptureThread / StartStreaming, which
+// writes the output format into it. while attached, ReadFrames, streaming
+// callbacks and mixers get no audio, and the frames are not timed:
+// GetChunkTiming and GetLatencyHistogram only cover chunks read through the
+// addon. returns false if the capture thread is running or the array is too
+// small.
+napi_value AttachSharedRing(napi_env env, napi_callback_info info) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok || argc < 2) {
+    std::cerr << "C++ error in AttachSharedRing: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in AttachSharedRing: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in AttachSharedRing: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  bool isTypedArray = false;
+  napi_is_typedarray(env, args[1], &isTypedArray);
+  if (!isTypedArray) {
+    std::cerr << "C++ error in AttachSharedRing: args[1] is not a typed array" << std::endl;
+    return nullptr;
+  }
+
+  // napi has no SharedArrayBuffer API, but a typed array over one reports its
+  // data like any other
+  napi_typedarray_type type;
+  size_t length;
+  void* data;
+  status = napi_get_typedarray_info(env, args[1], &type, &length, &data, NULL, NULL);
+  if (status != napi_ok || data == NULL) {
+    std::cerr << "C++ error in AttachSharedRing: could not get array data" << std::endl;
+    return nullptr;
+  }
+  size_t elementSize = 1;
+  switch (type) {
+    case napi_int16_array: case napi_uint16_array: elementSize = 2; break;
+    case napi_int32_array: case napi_uint32_array: case napi_float32_array: elementSize = 4; break;
+    case napi_float64_array: case napi_bigint64_array: case napi_biguint64_array: elementSize = 8; break;
+    default: break;
+  }
+
+  napi_value result;
+  bool attached = attachSharedRing(clientPointer, (char*)data, length * elementSize);
+  if (attached) {
+    releaseSharedRingArray(env, clientPointer);
+    napi_ref reference;
+    status = napi_create_reference(env, args[1], 1, &reference);
+    if (status != napi_ok) {
+      detachSharedRing(clientPointer);
+      std::cerr << "C++ error in AttachSharedRing: could not create reference" << std::endl;
+      return nullptr;
+    }
+    sharedRingArrays[clientPointer] = reference;
+  }
+  napi_get_boolean(env, attached, &result);
+  return result;
+}
+
+// DetachSharedRing(client)
+// the capture thread goes back to the client's own ring. returns false if it
+// is running.
+napi_value DetachSharedRing(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in DetachSharedRing: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in DetachSharedRing: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in DetachSharedRing: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  bool detached = detachSharedRing(clientPointer);
+  if (detached) {
+    releaseSharedRingArray(env, clientPointer);
+  }
+  napi_value result;
+  napi_get_boolean(env, detached, &result);
+  return result;
+}
+
+// ---------------------------------------------
+// push-style streaming. the capture thread calls notifyStreaming() once per
+// batch; that queues one call of the JS callback through a thread-safe function.
+// the JS-thread side then drains everything in the ring into a single
+// ArrayBuffer, so however many packets arrived in the meantime cost one crossing.
+
+typedef struct StreamingContext {
+  void* clientPointer;
+  napi_ref clientRef; // keeps the client alive while the capture thread uses it
+  napi_threadsafe_function tsfn;
+  std::atomic<bool> callPending;
+  bool planar; // deliver one Float32Array per channel
+} StreamingContext;
+
+std::map<void*, StreamingContext*> streamingContexts;
+
+// runs on the capture thread.
+void notifyStreaming(void* context) {
+  StreamingContext* streaming = (StreamingContext*)context;
+  // coalesce: if the JS callback is already queued it will pick up these
+  // frames too, so there is no need to queue another call.
+  if (streaming->callPending.exchange(true)) {
+    return;
+  }
+  napi_call_threadsafe_function(streaming->tsfn, nullptr, napi_tsfn_nonblocking);
+}
+
+// runs on the JS thread.
+void callStreamingCallback(napi_env env, napi_value js_callback, void* context, void* data) {
+  if (env == nullptr) {
+    // thread-safe function is being torn down
+    return;
+  }
+  StreamingContext* streaming = (StreamingContext*)context;
+  // clear before reading so frames that arrive during the read queue a new call
+  streaming->callPending.store(false);
+
+  napi_status status;
+  uint32_t nFrames = getAvailableFrames(streaming->clientPointer);
+  if (nFrames == 0) {
+    return;
+  }
+
+  napi_value arrayBuffer;
+  bool created = streaming->planar
+    ? readFramesPlanarToArrays(env, streaming->clientPointer, nFrames, &arrayBuffer)
+    : readFramesToArrayBuffer(env, streaming->clientPointer, nFrames, &arrayBuffer);
+  if (!created) {
+    std::cerr << "C++ error in callStreamingCallback: could not create arraybuffer" << std::endl;
+    return;
+  }
+
+  napi_value callbackArgs[2] = { arrayBuffer, nullptr };
+  ChunkTiming timing;
+  if (getChunkTiming(streaming->clientPointer, &timing)) {
+    callbackArgs[1] = createChunkTimingArray(env, timing, "callStreamingCallback");
+  }
+  if (callbackArgs[1] == nullptr) {
+    napi_get_null(env, &callbackArgs[1]);
+  }
+
+  napi_value undefined;
+  napi_get_undefined(env, &undefined);
+  status = napi_call_function(env, undefined, js_callback, 2, callbackArgs, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in callStreamingCallback: callback failed" << std::endl;
+  }
+}
+
+void finalizeStreaming(napi_env env, void* finalize_data, void* finalize_hint) {
+  StreamingContext* streaming = (StreamingContext*)finalize_data;
+  napi_delete_reference(env, streaming->clientRef);
+  delete streaming;
+}
+
+void stopStreaming(void* clientPointer) {
+  std::map<void*, StreamingContext*>::iterator it = streamingContexts.find(clientPointer);
+  if (it == streamingContexts.end()) {
+    return;
+  }
+  StreamingContext* streaming = it->second;
+  streamingContexts.erase(it);
+
+  // join the capture thread before releasing, so nothing calls the
+  // thread-safe function after it has been released.
+  stopCaptureThread(clientPointer);
+  setCaptureNotify(clientPointer, NULL, NULL, 0, 0);
+  napi_release_threadsafe_function(streaming->tsfn, napi_tsfn_release);
+}
+
+// StartStreaming(client, callback, options)
+// starts the capture thread and calls callback(arrayBuffer, timing) on the JS
+// thread with all frames captured since the previous call. timing is
+// [devicePosition, timestamp, flags] of the first frame (see GetChunkTiming)
+// and arrayBuffer is pooled (see ReleasePooledBuffer). options (all optional):
+//   batchFrames: deliver once at least this many frames are buffered
+//   batchMs: deliver at most this many ms after the oldest buffered frame
+//   ringFrames: capacity of the native ring in frames
+//   planar: pass an array of Float32Array, one per channel (float32 output only)
+napi_value StartStreaming(napi_env env, napi_callback_info info) {
+  size_t argc = 3;
+  napi_value args[3];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartStreaming: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in StartStreaming: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartStreaming: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  status = napi_typeof(env, args[1], &value_type);
+  if (status != napi_ok || value_type != napi_function) {
+    std::cerr << "C++ error in StartStreaming: args[1] is not a function" << std::endl;
+    return nullptr;
+  }
+
+  AudioCaptureFormat captureFormat = getOutputFormat(clientPointer);
+  int32_t batchFrames = captureFormat.samplesPerSec / 100; // 10 ms
+  int32_t batchMs = 20;
+  int32_t ringFrames = captureFormat.samplesPerSec * 2;
+  bool planar = false;
+
+  if (argc > 2) {
+    status = napi_typeof(env, args[2], &value_type);
+    if (status != napi_ok || (value_type != napi_object && value_type != napi_undefined)) {
+      std::cerr << "C++ error in StartStreaming: args[2] is not an object" << std::endl;
+      return nullptr;
+    }
+    if (value_type == napi_object) {
+      if (!getOptionalInt32Property(env, args[2], "batchFrames", &batchFrames)
+        || !getOptionalInt32Property(env, args[2], "batchMs", &batchMs)
+        || !getOptionalInt32Property(env, args[2], "ringFrames", &ringFrames)
+        || !getOptionalBoolProperty(env, args[2], "planar", &planar)) {
+        std::cerr << "C++ error in StartStreaming: invalid options in args[2]" << std::endl;
+        return nullptr;
+      }
+    }
+  }
+  if (batchFrames < 0 || batchMs < 0 || ringFrames <= 0) {
+    std::cerr << "C++ error in StartStreaming: options out of range" << std::endl;
+    return nullptr;
+  }
+  if (planar && (!captureFormat.formatisValid || captureFormat.bitsPerSample != 32)) {
+    std::cerr << "C++ error in StartStreaming: planar output requires float32 sampleFormat" << std::endl;
+    return nullptr;
+  }
+
+  napi_value result;
+  if (streamingContexts.find(clientPointer) != streamingContexts.end()) {
+    napi_get_boolean(env, false, &result);
+    return result;
+  }
+
+  StreamingContext* streaming = new StreamingContext();
+  streaming->clientPointer = clientPointer;
+  streaming->callPending.store(false);
+  streaming->planar = planar;
+
+  status = napi_create_reference(env, args[0], 1, &streaming->clientRef);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartStreaming: could not create client reference" << std::endl;
+    delete streaming;
+    return nullptr;
+  }
+
+  napi_value resourceName;
+  napi_create_string_utf8(env, "AudioCaptureStreaming", NAPI_AUTO_LENGTH, &resourceName);
+  status = napi_create_threadsafe_function(env, args[1], nullptr, resourceName,
+    0, 1, streaming, finalizeStreaming, streaming, callStreamingCallback, &streaming->tsfn);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StartStreaming: could not create threadsafe function" << std::endl;
+    napi_delete_reference(env, streaming->clientRef);
+    delete streaming;
+    return nullptr;
+  }
+
+  setCaptureNotify(clientPointer, notifyStreaming, streaming, batchFrames, batchMs);
+  bool started = startCaptureThread(clientPointer, ringFrames);
+  if (!started) {
+    // capture thread was already started with StartCaptureThread, or capture
+    // was not
+    reportNotCapturing(clientPointer, "StartStreaming");
+    setCaptureNotify(clientPointer, NULL, NULL, 0, 0);
+    napi_release_threadsafe_function(streaming->tsfn, napi_tsfn_release);
+  } else {
+    streamingContexts[clientPointer] = streaming;
+  }
+
+  napi_get_boolean(env, started, &result);
+  return result;
+}
+
+napi_value StopStreaming(napi_env env, napi_callback_info info) {
+  size_t argc = 1;
+  napi_value args[1];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopStreaming: could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in StopStreaming: could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in StopStreaming: could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  stopStreaming(clientPointer);
+  return nullptr;
+}
+
+// ---------------------------------------------
+// asynchronous start and stop. activating the device and initializing the
+// stream can take tens of milliseconds, more right after a device change, so
+// these run on the libuv threadpool and return a Promise. the client must not
+// be used otherwise until the promise settles.
+
+typedef enum CaptureTask {
+  CAPTURE_TASK_PREPARE,
+  CAPTURE_TASK_START,
+  CAPTURE_TASK_STOP,
+} CaptureTask;
+
+typedef struct CaptureTaskContext {
+  void* clientPointer;
+  napi_ref clientRef; // keeps the client alive while the worker uses it
+  napi_async_work work;
+  napi_deferred deferred;
+  CaptureTask task;
+  const char* caller;
+  bool succeeded;
+  CaptureError error;
+} CaptureTaskContext;
+
+// clients with a task in flight
+std::map<void*, CaptureTaskContext*> captureTasks;
+
+// runs on a threadpool thread
+void executeCaptureTask(napi_env env, void* data) {
+  CaptureTaskContext* context = (CaptureTaskContext*)data;
+  bool leave = enterWorkerThread();
+  switch (context->task) {
+    case CAPTURE_TASK_PREPARE: context->succeeded = prepareCapture(context->clientPointer); break;
+    case CAPTURE_TASK_START: context->succeeded = startCapture(context->clientPointer); break;
+    case CAPTURE_TASK_STOP: stopCapture(context->clientPointer); context->succeeded = true; break;
+  }
+  if (!context->succeeded) {
+    context->error = getLastError(context->clientPointer);
+  }
+  if (leave) {
+    leaveWorkerThread();
+  }
+}
+
+// Error with the message of describeCaptureError() and hresult / step
+// properties. hresult is 0 if the failure has no system error code.
+napi_value createCaptureError(napi_env env, const char* caller, CaptureError error) {
+  napi_value message, result, value;
+  std::string text = describeCaptureError(caller, error);
+  if (napi_create_string_utf8(env, text.c_str(), NAPI_AUTO_LENGTH, &message) != napi_ok
+    || napi_create_error(env, nullptr, message, &result) != napi_ok) {
+    return nullptr;
+  }
+  napi_create_uint32(env, (uint32_t)error.code, &value);
+  napi_set_named_property(env, result, "hresult", value);
+  if (error.step != NULL) {
+    napi_create_string_utf8(env, error.step, NAPI_AUTO_LENGTH, &value);
+  } else {
+    napi_get_null(env, &value);
+  }
+  napi_set_named_property(env, result, "step", value);
+  return result;
+}
+
+// runs on the JS thread
+void completeCaptureTask(napi_env env, napi_status status, void* data) {
+  CaptureTaskContext* context = (CaptureTaskContext*)data;
+  captureTasks.erase(context->clientPointer);
+
+  if (status == napi_ok && context->succeeded) {
+    napi_value result;
+    napi_get_boolean(env, true, &result);
+    napi_resolve_deferred(env, context->deferred, result);
+  } else {
+    CaptureError error = context->error;
+    if (status != napi_ok) {
+      error.code = 0;
+      error.step = "async work";
+    }
+    napi_value result = createCaptureError(env, context->caller, error);
+    if (result == nullptr) {
+      napi_get_undefined(env, &result);
+    }
+    napi_reject_deferred(env, context->deferred, result);
+  }
+  napi_delete_async_work(env, context->work);
+  napi_delete_reference(env, context->clientRef);
+  delete context;
+}
+
+// shared by StartCaptureAsync, PrepareCaptureAsync and StopCaptureAsync:
+// (client, options) with options { keepWarm } for the first two
+napi_value queueCaptureTask(napi_env env, napi_callback_info info, CaptureTask task, const char* caller) {
+  size_t argc = 2;
+  napi_value args[2];
+  napi_status status;
+
+  status = napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in " << caller << ": could not get args" << std::endl;
+    return nullptr;
+  }
+
+  napi_valuetype value_type;
+  status = napi_typeof(env, args[0], &value_type);
+  if (status != napi_ok || value_type != napi_external) {
+    std::cerr << "C++ error in " << caller << ": could not get args[0]" << std::endl;
+    return nullptr;
+  }
+
+  void* clientPointer;
+  status = napi_get_value_external(env, args[0], &clientPointer);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in " << caller << ": could not get client pointer value" << std::endl;
+    return nullptr;
+  }
+
+  bool hasKeepWarm = false;
+  bool keepWarm = false;
+  if (argc > 1 && task != CAPTURE_TASK_STOP) {
+    status = napi_typeof(env, args[1], &value_type);
+    if (status != napi_ok || (value_type != napi_object && value_type != napi_undefined)) {
+      std::cerr << "C++ error in " << caller << ": args[1] is not an object" << std::endl;
+      return nullptr;
+    }
+    if (value_type == napi_object) {
+      if (napi_has_named_property(env, args[1], "keepWarm", &hasKeepWarm) != napi_ok
+        || !getOptionalBoolProperty(env, args[1], "keepWarm", &keepWarm)) {
+        std::cerr << "C++ error in " << caller << ": invalid options in args[1]" << std::endl;
+        return nullptr;
+      }
+    }
+  }
+
+  napi_value promise;
+  CaptureTaskContext* context = new CaptureTaskContext();
+  status = napi_create_promise(env, &context->deferred, &promise);
+  if (status != napi_ok) {
+    std::cerr << "C++ error in " << caller << ": could not create promise" << std::endl;
+    delete context;
+    return nullptr;
+  }
+  context->clientPointer = clientPointer;
+  context->task = task;
+  context->caller = caller;
+  context->succeeded = false;
+  context->error.code = 0;
+  context->error.step = NULL;
+
+  if (captureTasks.find(clientPointer) != captureTasks.end()) {
+    std::string text = std::string(caller) + ": another start or stop is still pending";
+    napi_value message, error;
+    napi_create_string_utf8(env, text.c_str(), NAPI_AUTO_LENGTH, &message);
+    napi_create_error(env, nullptr, message, &error);
+    napi_reject_deferred(env, context->deferred, error);
+    delete context;
+    return promise;
+  }
+
+  if (hasKeepWarm) {
+    setKeepWarm(clientPointer, keepWarm);
+  }
+  if (task == CAPTURE_TASK_STOP) {
+    // the streaming callback lives on this thread
+    stopStreaming(clientPointer);
+  }
+
+  napi_value resourceName;
+  napi_create_string_utf8(env, caller, NAPI_AUTO_LENGTH, &resourceName);
+  if (napi_create_reference(env, args[0], 1, &context->clientRef) != napi_ok) {
+    std::cerr << "C++ error in " << caller << ": could not create client reference" << std::endl;
+    delete context;
+    return nullptr;
+  }
+  status = napi_create_async_work(env, nullptr, resourceName, executeCaptureTask, completeCaptureTask, context, &context->work);
+  if (status == napi_ok) {
+    status = napi_queue_async_work(env, context->work);
+    if (status != napi_ok) {
+      napi_delete_async_work(env, context->work);
+    }
+  }
+  if (status != napi_ok) {
+    std::cerr << "C++ error in " << caller << ": could not queue work" << std::endl;
+    napi_delete_reference(env, context->clientRef);
+    delete context;
+    return nullptr;
+  }
+  captureTasks[clientPointer] = context;
+  return promise;
+}
+
+// StartCaptureAsync(client, options) -> Promise
+// StartCapture on a threadpool thread, which initializes COM by itself.
+// resolves with true, or rejects with an Error whose hresult and step tell
+// what failed, e.g. "StartCapture: Activate(IAudioClient) failed (HRESULT
+// 0x88890004)". options (optional):
+//   keepWarm: keep the stream initialized after StopCapture, so the next start
+//     only has to start it. a warm stream stays on the endpoint and buffer
+//     options it was set up with until SetCaptureDevice / SetBufferOptions.
+napi_value StartCaptureAsync(napi_env env, napi_callback_info info) {
+  return queueCaptureTask(env, info, CAPTURE_TASK_START, "StartCapture");
+}
+
+// PrepareCaptureAsync(client, options) -> Promise
+// activates and initializes the stream ahead of StartCapture(Async), e.g. at
+// application start, so the start itself is quick. same options and errors
+// as StartCaptureAsync.
+napi_value PrepareCaptureAsync(napi_env env, napi_callback_info info) {
+  return queueCaptureTask(env, info, CAPTURE_TASK_PREPARE, "PrepareCapture");
+}
+
+// StopCaptureAsync(client) -> Promise
+// StopCapture with the stream stopped on a threadpool thread. resolves with
+// true.
+napi_value StopCaptureAsync(napi_env env, napi_callback_info info) {
+  return queueCaptureTask(env, info, CAPTURE_TASK_STOP, "StopCapture");
+}
+
+napi_value init(napi_env env, napi_value exports) {
+  napi_status status;
+  napi_value fn;
+
+  status = napi_create_function(env, nullptr, 0, CreateCaptureClient, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "CreateCaptureClient", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, InitializeCom, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "InitializeCom", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, UninitializeCom, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "UninitializeCom", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StartCapture, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StartCapture", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StartCaptureAsync, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StartCaptureAsync", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, PrepareCaptureAsync, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "PrepareCaptureAsync", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetAudioFormat, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetAudioFormat", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetNextPacketSize, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetNextPacketSize", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetBuffer, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetBuffer", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, DrainInto, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "DrainInto", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StopCapture, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StopCapture", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StopCaptureAsync, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StopCaptureAsync", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StartCaptureThread, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StartCaptureThread", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StopCaptureThread, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StopCaptureThread", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetAvailableFrames, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetAvailableFrames", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, ReadFrames, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "ReadFrames", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetOverflowFrames, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetOverflowFrames", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StartStreaming, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StartStreaming", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StopStreaming, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StopStreaming", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, AttachSharedRing, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "AttachSharedRing", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, DetachSharedRing, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "DetachSharedRing", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, ReadFramesPooled, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "ReadFramesPooled", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, ReleasePooledBuffer, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "ReleasePooledBuffer", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, SetOutputFormat, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "SetOutputFormat", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetOutputFormat, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetOutputFormat", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, ReadFramesPlanar, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "ReadFramesPlanar", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, SetBlocking, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "SetBlocking", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, ReadBlocks, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "ReadBlocks", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StartRecording, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StartRecording", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StopRecording, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StopRecording", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetRecordingStats, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetRecordingStats", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, FindRecordingPosition, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "FindRecordingPosition", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StartFlacRecording, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StartFlacRecording", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StopFlacRecording, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StopFlacRecording", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetFlacRecordingStats, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetFlacRecordingStats", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StartRtpStream, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StartRtpStream", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StopRtpStream, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StopRtpStream", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetRtpStreamStats, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetRtpStreamStats", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, SetHistory, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "SetHistory", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetHistorySnapshot, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetHistorySnapshot", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, SaveHistorySnapshot, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "SaveHistorySnapshot", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, SetLevelMeter, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "SetLevelMeter", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetLevels, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetLevels", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetLevelsArray, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetLevelsArray", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, SetGate, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "SetGate", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetGateState, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetGateState", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, SetFeatures, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "SetFeatures", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetFeatureFormat, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetFeatureFormat", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetFeatureStats, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetFeatureStats", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, ReadFeatures, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "ReadFeatures", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetPacketFlags, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetPacketFlags", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetChunkTiming, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetChunkTiming", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetGlitchStats, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetGlitchStats", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetLatencyHistogram, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetLatencyHistogram", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetStats, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetStats", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StartTrace, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StartTrace", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StopTrace, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StopTrace", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetTrace, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetTrace", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, Subscribe, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "Subscribe", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, Unsubscribe, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "Unsubscribe", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, ReadSubscriber, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "ReadSubscriber", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetSubscriberFormat, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetSubscriberFormat", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetSubscriberStats, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetSubscriberStats", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, EnumerateDevices, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "EnumerateDevices", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, SetCaptureDevice, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "SetCaptureDevice", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, SetCaptureBackend, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "SetCaptureBackend", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, SetBufferOptions, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "SetBufferOptions", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetBufferInfo, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetBufferInfo", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, CreateDeviceMixer, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "CreateDeviceMixer", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StartDeviceMixer, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StartDeviceMixer", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, StopDeviceMixer, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "StopDeviceMixer", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, ReadMixedFrames, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "ReadMixedFrames", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetMixerFormat, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetMixerFormat", fn);
+  if (status != napi_ok) return nullptr;
+
+  status = napi_create_function(env, nullptr, 0, GetMixerStats, nullptr, &fn);
+  if (status != napi_ok) return nullptr;
+  status = napi_set_named_property(env, exports, "GetMixerStats", fn);
   if (status != napi_ok) return nullptr;
 
   return exports;
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "capturesource.h"
+#include "sampledecode.h"
+
+// format of the packets a backend delivers.
+typedef struct CaptureFormat {
+  unsigned int frameSize;
+  unsigned int numChannels;
+  unsigned int bitsPerSample;
+  unsigned int sampleRate;
+  // the pipeline decodes every known type to float32. unknown samples are
+  // passed through as raw bytes.
+  CaptureSampleType sampleType;
+} CaptureFormat;
+
+typedef struct AudioDeviceInfo {
+  // endpoint id string, UTF-8
+  std::string id;
+  std::string name;
+  // capture endpoints (microphones) are recorded directly, render endpoints
+  // (speakers) in loopback mode
+  bool isCapture;
+  // default console endpoint of its direction
+  bool isDefault;
+} AudioDeviceInfo;
+
+// stream buffer settings applied by the next open(). durations are in 100 ns
+// units; 0 picks the backend default.
+typedef struct CaptureBufferOptions {
+  // size of the buffer the device writes into. packets not read within it are
+  // lost.
+  uint32_t bufferDuration;
+  // interval between packets. a period below the default needs a backend that
+  // supports it (IAudioClient3 on Windows 10 and later).
+  uint32_t period;
+  // smallest period the device supports, overrides period
+  bool lowLatency;
+} CaptureBufferOptions;
+
+// stream buffer settings in effect, valid between open() and close()
+typedef struct CaptureBufferInfo {
+  uint32_t bufferFrames;
+  // period the stream runs with, and the range it could have used
+  uint32_t periodFrames;
+  uint32_t defaultPeriodFrames;
+  uint32_t minPeriodFrames;
+  // latency the device adds before a frame reaches the buffer, 100 ns units
+  uint64_t streamLatency;
+  // whether the stream runs with a period below the default
+  bool lowLatency;
+} CaptureBufferInfo;
+
+// why a backend call failed
+typedef struct CaptureError {
+  // HRESULT for WASAPI, 0 if there is no system error code
+  int32_t code;
+  // the step that failed, a static string. NULL if nothing failed.
+  const char* step;
+} CaptureError;
+
+// where an AudioCaptureClient gets its packets from: the audio device (see
+// wasapibackend.h), or a simulated source for tests and benchmarks on any
+// platform (see simulatedbackend.h).
+//
+// open() starts the stream, after which the CaptureSource side delivers
+// packets, either to the capture thread or to the polling calls of the client.
+// close() ends it; a backend can be opened again afterwards.
+//
+// prepare() and open() may run on a worker thread, but never at the same time
+// as any other call.
+class CaptureBackend : public CaptureSource {
+protected:
+  CaptureError lastError = {};
+
+  void setError(int32_t code, const char* step) {
+    lastError.code = code;
+    lastError.step = step;
+  }
+
+public:
+  virtual ~CaptureBackend() {}
+
+  // endpoint to open, NULL or "" for the default. returns false if the
+  // backend has no such endpoint.
+  virtual bool setDevice(const char* id) {
+    return id == NULL || id[0] == '\0';
+  }
+
+  // does the slow part of open() (finding and activating the endpoint) ahead
+  // of time, so open() only has to start the stream. open() prepares by
+  // itself if this was not called.
+  virtual bool prepare() {
+    return true;
+  }
+  virtual bool open() = 0;
+  virtual void close() = 0;
+  // keep the stream prepared after close(), so the next open() is fast
+  virtual void setKeepWarm(bool /*keepWarm*/) {}
+
+  // why the last prepare(), open() or packet call failed
+  CaptureError getLastError() {
+    return lastError;
+  }
+
+  // applied by the next open(). returns false if the backend cannot honor
+  // them at all; a period it cannot reach is rounded to the closest one.
+  virtual bool setBufferOptions(const CaptureBufferOptions& options) {
+    return options.bufferDuration == 0 && options.period == 0 && !options.lowLatency;
+  }
+
+  // valid between open() and close()
+  virtual CaptureFormat getFormat() = 0;
+  virtual CaptureBufferInfo getBufferInfo() {
+    CaptureBufferInfo info = {};
+    return info;
+  }
+
+  // current time on the clock of the packet timestamps, 100 ns units
+  virtual uint64_t getCurrentTimestamp() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count() / 100;
+  }
+};
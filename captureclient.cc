@@ -2,165 +2,992 @@
 #include <stdio.h>
 #include <inttypes.h> 
 
-// see https://learn.microsoft.com/en-us/windows/win32/coreaudio/capturing-a-stream
-// https://github.com/microsoft/Windows-classic-samples/blob/main/Samples/ApplicationLoopback/cpp/LoopbackCapture.cpp
-// https://learn.microsoft.com/en-us/answers/questions/786447/recording-desktop-audio?orderBy=Helpful
-// https://github.com/microsoft/windows-classic-samples/tree/main/Samples/ApplicationLoopback#application-loopback-api-capture-sample
+#ifdef _WIN32
+#include "wasapibackend.h"
+#endif
 
-void AudioCaptureClient::initializeCom() {
-    hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
-    assert(SUCCEEDED(hr));
+static CaptureBackend* createDefaultBackend() {
+#ifdef _WIN32
+  return new WasapiBackend();
+#else
+  return NULL;
+#endif
+}
+
+bool enumerateAudioDevices(std::vector<AudioDeviceInfo>* devices) {
+#ifdef _WIN32
+  return WasapiBackend::enumerateDevices(devices);
+#else
+  devices->clear();
+  return true;
+#endif
+}
+
+bool enterWorkerThread() {
+#ifdef _WIN32
+  // the libuv threadpool threads don't initialize COM. S_FALSE if another
+  // call on this thread already did, which must be balanced all the same.
+  return SUCCEEDED(CoInitializeEx(NULL, COINIT_MULTITHREADED));
+#else
+  return false;
+#endif
+}
+
+void leaveWorkerThread() {
+#ifdef _WIN32
+  CoUninitialize();
+#endif
+}
+
+AudioCaptureClient::~AudioCaptureClient() {
+  // the capture thread uses this object as its CaptureSource, so it must be
+  // gone before the object is.
+  captureThread.stop();
+  for (size_t i = 0; i < subscribers.size(); i++) {
+    delete subscribers[i];
+  }
+  delete backend;
+}
+
+bool AudioCaptureClient::initializeCom() {
+#ifdef _WIN32
+  HRESULT hr = WasapiBackend::initializeCom();
+  if (FAILED(hr)) {
+    clientError.code = hr;
+    clientError.step = "CoInitializeEx";
+    return false;
+  }
+#endif
+  return true;
 }
 
 void AudioCaptureClient::uninitializeCom() {
-    CoUninitialize();
-    //std::cerr << "C++ uninitialized COM" << std::endl;
-}
-
-/* for debugging
-
-std::string ToString(GUID *guid) {
-    char guid_string[37]; // 32 hex chars + 4 hyphens + null terminator
-    snprintf(
-          guid_string, sizeof(guid_string),
-          "%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x",
-          guid->Data1, guid->Data2, guid->Data3,
-          guid->Data4[0], guid->Data4[1], guid->Data4[2],
-          guid->Data4[3], guid->Data4[4], guid->Data4[5],
-          guid->Data4[6], guid->Data4[7]);
-    return guid_string;
-}
-*/
-
-void AudioCaptureClient::startCapture() {
-
-
-    // see https://stackoverflow.com/questions/12844431/linking-wasapi-in-vs-2010
-    // for some reason using CLSID_MMDeviceEnumerator and IID_IMMDeviceEnumerator
-    // leads to link error when compiling with MS visual studio. instead we have to
-    // use __uuidof(xxx) as below to fix the link eror.
-    hr = CoCreateInstance(
-        __uuidof(MMDeviceEnumerator), /* CLSID_MMDeviceEnumerator, */
-        NULL,
-        CLSCTX_ALL,
-        __uuidof(IMMDeviceEnumerator), /* IID_IMMDeviceEnumerator, */
-        (void**)&enumerator
-    );
-
-    assert(SUCCEEDED(hr));
-
-    hr = enumerator->GetDefaultAudioEndpoint(eRender, eConsole, &recorder);
-    assert(SUCCEEDED(hr));
-
-    hr = enumerator->Release();
-    assert(SUCCEEDED(hr));
-
-    hr = recorder->Activate(
-        __uuidof(IAudioClient), /* IID_IAudioClient, */
-        CLSCTX_ALL, NULL, (void**)&recorderClient);
-    assert(SUCCEEDED(hr));
-
-    hr = recorderClient->GetMixFormat(&format);
-    assert(SUCCEEDED(hr));
-
-    /*
-    printf("Mix format:\n");
-    printf("  Frame size     : %d\n", format->nBlockAlign);
-    printf("  Channels       : %d\n", format->nChannels);
-    printf("  Bits per second: %d\n", format->wBitsPerSample);
-    printf("  Sample rate:   : %d\n", format->nSamplesPerSec);
-    printf("  wFormatTag:   : %d\n", format->wFormatTag);
-    printf("  cbSize:   : %d\n", format->cbSize);
-    */
-
-    // NOTE: for audio capture, format seems to be WAVE_FORMAT_EXTENSIBLE
-    // and WAVEFORMATEXTENSIBLE.SubType is expected to be KSDATAFORMAT_SUBTYPE_IEEE_FLOAT
-    // see https://stackoverflow.com/questions/41876857/interpreting-waveformatextensible-from-iaudioclientgetmixformat
-    // https://learn.microsoft.com/en-us/windows/win32/api/mmreg/ns-mmreg-waveformatextensible?redirectedfrom=MSDN
-    // https://stackoverflow.com/questions/30692623/wasapi-loopback-save-wave-file
-
-    hr = recorderClient->Initialize(AUDCLNT_SHAREMODE_SHARED,  
-      AUDCLNT_STREAMFLAGS_LOOPBACK, 
-      10000000, 
-      0, 
-      format, 
-      NULL);
-    assert(SUCCEEDED(hr));
-
-    hr = recorderClient->GetService(
-        __uuidof(IAudioCaptureClient), /* IID_IAudioCaptureClient, */
-        (void**)&captureService);
-    assert(SUCCEEDED(hr));
-
-    hr = recorderClient->Start();
-    assert(SUCCEEDED(hr));
+#ifdef _WIN32
+  WasapiBackend::uninitializeCom();
+#endif
+}
+
+bool AudioCaptureClient::setCaptureDevice(const char* id) {
+  // the backend would keep a warm stream of the old endpoint
+  if (capturing) {
+    return false;
+  }
+  if (backend == NULL) {
+    backend = createDefaultBackend();
+  }
+  if (backend == NULL) {
+    return id == NULL || id[0] == '\0';
+  }
+  return backend->setDevice(id);
+}
+
+bool AudioCaptureClient::setBackend(CaptureBackend* backend) {
+  if (capturing) {
+    return false;
+  }
+  delete this->backend;
+  this->backend = backend;
+  return true;
+}
+
+bool AudioCaptureClient::setBufferOptions(const CaptureBufferOptions& options) {
+  if (capturing) {
+    return false;
+  }
+  if (backend == NULL) {
+    backend = createDefaultBackend();
+  }
+  if (backend == NULL) {
+    return false;
+  }
+  return backend->setBufferOptions(options);
+}
+
+bool AudioCaptureClient::prepareCapture() {
+  if (capturing) {
+    return false;
+  }
+  clientError = {};
+  if (backend == NULL) {
+    backend = createDefaultBackend();
+  }
+  return backend != NULL && backend->prepare();
+}
+
+void AudioCaptureClient::setKeepWarm(bool keepWarm) {
+  if (backend == NULL) {
+    backend = createDefaultBackend();
+  }
+  if (backend != NULL) {
+    backend->setKeepWarm(keepWarm);
+  }
+}
+
+CaptureError AudioCaptureClient::getLastError() {
+  if (clientError.step != NULL) {
+    return clientError;
+  }
+  if (backend == NULL) {
+    // no default backend on this platform
+    CaptureError error = { 0, "create backend" };
+    return error;
+  }
+  return backend->getLastError();
+}
+
+bool AudioCaptureClient::startCapture() {
+  if (capturing) {
+    return false;
+  }
+  clientError = {};
+  if (backend == NULL) {
+    backend = createDefaultBackend();
+  }
+  if (backend == NULL || !backend->open()) {
+    return false;
+  }
+  format = backend->getFormat();
+  capturing = true;
+
+  pipeline.setInputFormat(format.frameSize, format.numChannels, format.sampleRate, format.sampleType);
 
   locked=0;
+  carryBuffer.clear();
+  carryOffset = 0;
+  carryTiming = {};
+  packetAccounting.reset();
+  counters.reset();
+  hasChunkTiming = false;
+  latency.reset();
+  return true;
+}
+
+bool AudioCaptureClient::requireCapturing() {
+  if (!capturing) {
+    clientError.code = 0;
+    clientError.step = "check capture started";
+  }
+  return capturing;
+}
+
+bool AudioCaptureClient::isCapturing() {
+  return capturing;
+}
+
+CaptureBufferInfo AudioCaptureClient::getBufferInfo() {
+  if (!requireCapturing()) {
+    CaptureBufferInfo none = {};
+    return none;
+  }
+  return backend->getBufferInfo();
 }
 
 AudioCaptureFormat AudioCaptureClient::getAudioFormat() {
-  assert(format != NULL);
-  // valid format should be WAVE_FORMAT_EXTENSIBLE with subformat KSDATAFORMAT_SUBTYPE_IEEE_FLOAT.
-  // if format is not valid, then assumptions about parsing the data (4 byte floats, etc.) may fail.
-  bool formatIsValid =
-    (format->wFormatTag == WAVE_FORMAT_EXTENSIBLE)
-    && IsEqualGUID(((WAVEFORMATEXTENSIBLE*)format)->SubFormat, KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+  if (!requireCapturing()) {
+    AudioCaptureFormat none = {};
+    return none;
+  }
+  // valid means interleaved float32. if format is not valid, then assumptions
+  // about parsing the data (4 byte floats, etc.) may fail. this is the device
+  // format getBuffer() / drainInto() deliver; the capture thread output (see
+  // getOutputFormat()) is valid for every format the pipeline can decode.
   AudioCaptureFormat returnValue = {
-    formatIsValid,
-    format->nBlockAlign,
-    format->nChannels,
-    format->wBitsPerSample,
-    format->nSamplesPerSec
+    format.sampleType == CAPTURE_SAMPLE_FLOAT32,
+    format.frameSize,
+    format.numChannels,
+    format.bitsPerSample,
+    format.sampleRate
   };
 
   return returnValue;
 }
 
 int AudioCaptureClient::getBytesPerSample() {
-  return format->wBitsPerSample / sizeof(BYTE);
+  return format.bitsPerSample / 8;
 }
 
-UINT32 AudioCaptureClient::getNextPacketSize() {
-  UINT32 framesAvailable;
-  hr = captureService->GetNextPacketSize(&framesAvailable);
-  //printf("C++: %d frames available\n", framesAvailable);
-  assert(SUCCEEDED(hr));
-  return(framesAvailable);
+uint32_t AudioCaptureClient::getNextPacketSize() {
+  if (!requireCapturing()) {
+    return 0;
+  }
+  return backend->getNextPacketSize();
 }
 
-UINT32 AudioCaptureClient::getBuffer(UINT32 expectedFrameCount, UINT32 maximumFrameCount, char *out) {
+uint32_t AudioCaptureClient::getBuffer(uint32_t expectedFrameCount, uint32_t maximumFrameCount, char *out) {
   // expectedFrameCount comes from previous call to getNextPacketSize().
   // frameCount must be known in advance so the caller can allocate the properly-sized
   // buffer for the *out parameter
-  hr = captureService->GetBuffer(&captureBuffer, &nFrames, &flags, NULL, NULL);
-  assert(SUCCEEDED(hr));
+  if (!requireCapturing()) {
+    return 0;
+  }
+  const char* packet;
+  uint32_t flags;
+  uint64_t devicePosition;
+  uint64_t timestamp;
+  uint64_t acquireStart = counters.now();
+  uint32_t nFrames = backend->acquirePacket(&packet, &flags, &devicePosition, &timestamp);
+  counters.addAcquire(acquireStart, nFrames);
   if(expectedFrameCount != nFrames) {
     // printf("C++: expected %d (max %d) and got %d frames\n", expectedFrameCount, maximumFrameCount, nFrames);
   } 
+  packetAccounting.account(flags, devicePosition, nFrames);
 
+  // the whole packet has to be released, whatever was copied
+  uint32_t packetFrames = nFrames;
   if (nFrames > maximumFrameCount) {
       // caller has only allocated buffer to hold up to maximumFrameCount frames.
       // if more data was received, discard the extra data.
+      packetAccounting.addTruncated(nFrames - maximumFrameCount);
       nFrames = maximumFrameCount; 
   }
+  pollFlags |= flags;
+  setChunkTiming(devicePosition, timestamp, flags);
   if(nFrames > 0) {
-    memcpy(out, captureBuffer, nFrames * format->nBlockAlign);
+    uint64_t copyStart = counters.now();
+    if (flags & CAPTURE_PACKET_SILENT) {
+      // the buffer content is undefined for silent packets
+      memset(out, 0, nFrames * format.frameSize);
+    } else {
+      memcpy(out, packet, nFrames * format.frameSize);
+    }
+    counters.addCopy(copyStart, nFrames, (uint64_t)nFrames * format.frameSize);
   }
 
-  hr = captureService->ReleaseBuffer(nFrames);
-  assert(SUCCEEDED(hr));
+  backend->releasePacket(packetFrames);
+  recordLatency(nFrames, format.sampleRate);
 
   return nFrames;
 }
 
+uint32_t AudioCaptureClient::drainInto(char *out, uint32_t maximumFrameCount, uint32_t *flagsOut) {
+  *flagsOut = 0;
+  if (!requireCapturing()) {
+    return 0;
+  }
+  size_t frameSize = format.frameSize;
+  size_t capacity = (size_t)maximumFrameCount * frameSize;
+  size_t written = 0;
+  bool timed = false;
+
+  // frames left over from the previous call come first
+  size_t carried = carryBuffer.size() - carryOffset;
+  if (carried > 0 && capacity > 0) {
+    size_t bytes = carried < capacity ? carried : capacity;
+    uint64_t copyStart = counters.now();
+    memcpy(out, carryBuffer.data() + carryOffset, bytes);
+    counters.addCopy(copyStart, (uint32_t)(bytes / frameSize), bytes);
+    setChunkTiming(carryTiming.devicePosition, carryTiming.timestamp, 0);
+    timed = true;
+    // the packet's flags hold for the frames delivered now, too
+    *flagsOut |= carryTiming.flags;
+    carryOffset += bytes;
+    written += bytes;
+    uint64_t frames = bytes / frameSize;
+    carryTiming.devicePosition += frames;
+    carryTiming.timestamp += frames * 10000000 / format.sampleRate;
+    if (carryOffset == carryBuffer.size()) {
+      carryBuffer.clear();
+      carryOffset = 0;
+    }
+  }
+
+  // stop pulling packets once the caller's buffer is full. packets still in
+  // the backend are picked up by the next call.
+  while (written < capacity && backend->getNextPacketSize() > 0) {
+    const char* packet;
+    uint32_t flags;
+    uint64_t devicePosition;
+    uint64_t timestamp;
+    uint64_t acquireStart = counters.now();
+    uint32_t nFrames = backend->acquirePacket(&packet, &flags, &devicePosition, &timestamp);
+    counters.addAcquire(acquireStart, nFrames);
+    packetAccounting.account(flags, devicePosition, nFrames);
+    *flagsOut |= flags;
+    pollFlags |= flags;
+    if (!timed) {
+      setChunkTiming(devicePosition, timestamp, 0);
+      timed = true;
+    }
+
+    size_t packetBytes = (size_t)nFrames * frameSize;
+    size_t bytes = packetBytes < capacity - written ? packetBytes : capacity - written;
+    bool silent = (flags & CAPTURE_PACKET_SILENT) != 0;
+    uint64_t copyStart = counters.now();
+    if (silent) {
+      memset(out + written, 0, bytes);
+    } else {
+      memcpy(out + written, packet, bytes);
+    }
+    counters.addCopy(copyStart, (uint32_t)(bytes / frameSize), bytes);
+    written += bytes;
+    if (bytes < packetBytes) {
+      uint64_t frames = bytes / frameSize;
+      carryTiming.devicePosition = devicePosition + frames;
+      carryTiming.timestamp = timestamp + frames * 10000000 / format.sampleRate;
+      carryTiming.flags = flags;
+      if (silent) {
+        carryBuffer.insert(carryBuffer.end(), packetBytes - bytes, 0);
+      } else {
+        carryBuffer.insert(carryBuffer.end(), packet + bytes, packet + packetBytes);
+      }
+    }
+
+    backend->releasePacket(nFrames);
+  }
+
+  if (timed) {
+    chunkTiming.flags = *flagsOut;
+    recordLatency((uint32_t)(written / frameSize), format.sampleRate);
+  }
+  return (uint32_t)(written / frameSize);
+}
+
+uint32_t AudioCaptureClient::getCarriedFrames() {
+  return (uint32_t)((carryBuffer.size() - carryOffset) / format.frameSize);
+}
+
 void AudioCaptureClient::stopCapture() {
-    recorderClient->Stop();
-    captureService->Release();
-    recorderClient->Release();
-    recorder->Release();
+    captureThread.stop();
+    sharedRing.stop();
+    stopRecording();
+    stopFlacRecording();
+    stopRtpStream();
+    if (capturing) {
+      backend->close();
+      capturing = false;
+    }
     //std::cerr << "C++ stopped capture" << std::endl;
 }
 
+bool AudioCaptureClient::startCaptureThread(uint32_t ringFrames) {
+  if (!requireCapturing()) {
+    return false;
+  }
+  if (captureThread.isRunning()) {
+    return false;
+  }
+  // a packet never exceeds the device buffer
+  pipeline.setMaxPacketFrames(backend->getBufferInfo().bufferFrames);
+  if (!pipeline.prepare()) {
+    return false;
+  }
+  // ring is sized in whole frames so a frame never wraps around the end.
+  ring.allocate((size_t)ringFrames * pipeline.getOutputFrameSize());
+  planarChannels.resize(pipeline.getOutputChannels());
+  blocker.configure(pipeline.getOutputFrameSize(), blockFrames, hopFrames);
+  // subscribers need float output; for raw device bytes they get nothing
+  if (pipeline.isOutputFormatValid()) {
+    broadcast.allocate(ringFrames, pipeline.getOutputChannels());
+    pipeline.setBroadcast(&broadcast);
+  } else {
+    broadcast.allocate(0, 0);
+    pipeline.setBroadcast(NULL);
+  }
+  if (sharedRing.isAttached()) {
+    int32_t sampleFormat = pipeline.isOutputFormatValid() ? (int32_t)pipeline.getOutputSampleFormat() : -1;
+    if (!sharedRing.start(pipeline.getOutputFrameSize(), pipeline.getOutputChannels(), pipeline.getOutputSampleRate(), sampleFormat)) {
+      return false;
+    }
+    pipeline.setSharedRing(&sharedRing);
+  } else {
+    pipeline.setSharedRing(NULL);
+  }
+  if (historyMs > 0) {
+    // half a second more than asked for, so the capture thread never reaches
+    // what a snapshot is copying
+    uint32_t rate = pipeline.getOutputSampleRate();
+    history.allocate((size_t)((uint64_t)historyMs * rate / 1000 + rate / 2), pipeline.getOutputFrameSize());
+    historyFormat = getRecordingFormat();
+    captureThread.setHistory(&history);
+  } else {
+    captureThread.setHistory(NULL);
+  }
+  captureThread.setCounters(&counters);
+  return captureThread.start(this, &pipeline, &ring, 10);
+}
+
+void AudioCaptureClient::stopCaptureThread() {
+  captureThread.stop();
+  sharedRing.stop();
+}
+
+bool AudioCaptureClient::attachSharedRing(char* memory, size_t bytes) {
+  if (captureThread.isRunning()) {
+    return false;
+  }
+  return sharedRing.attach(memory, bytes);
+}
+
+bool AudioCaptureClient::detachSharedRing() {
+  if (captureThread.isRunning()) {
+    return false;
+  }
+  sharedRing.detach();
+  pipeline.setSharedRing(NULL);
+  return true;
+}
+
+// the current output format, as recordings and snapshots describe it
+RecordingFormat AudioCaptureClient::getRecordingFormat() {
+  AudioCaptureFormat outputFormat = getOutputFormat();
+  RecordingFormat recordingFormat;
+  recordingFormat.formatTag = outputFormat.formatisValid && pipeline.getOutputSampleFormat() == SAMPLE_FORMAT_FLOAT32
+    ? RECORDING_FORMAT_FLOAT : RECORDING_FORMAT_PCM;
+  recordingFormat.numChannels = (uint16_t)outputFormat.numChannels;
+  recordingFormat.bitsPerSample = (uint16_t)outputFormat.bitsPerSample;
+  recordingFormat.frameSize = (uint16_t)outputFormat.frameSize;
+  recordingFormat.sampleRate = outputFormat.samplesPerSec;
+  recordingFormat.deviceSampleRate = format.sampleRate;
+  return recordingFormat;
+}
+
+bool AudioCaptureClient::startRecording(const char* basePath, uint32_t segmentSeconds, uint32_t indexIntervalMs, uint32_t bufferMs) {
+  if (!requireCapturing()) {
+    return false;
+  }
+  if (captureThread.isRunning() || recording.isRecording()) {
+    return false;
+  }
+  RecordingFormat recordingFormat = getRecordingFormat();
+
+  uint32_t rate = recordingFormat.sampleRate;
+  if (!recording.start(basePath, recordingFormat, (uint64_t)segmentSeconds * rate,
+    (uint32_t)((uint64_t)indexIntervalMs * rate / 1000), (uint32_t)((uint64_t)bufferMs * rate / 1000))) {
+    return false;
+  }
+  captureThread.setRecorder(&recording);
+  return true;
+}
+
+bool AudioCaptureClient::stopRecording() {
+  if (captureThread.isRunning()) {
+    return false;
+  }
+  captureThread.setRecorder(NULL);
+  recording.stop();
+  return true;
+}
+
+RecordingStats AudioCaptureClient::getRecordingStats() {
+  RecordingStats returnValue = {
+    recording.getRecordedFrames(),
+    recording.getDroppedFrames(),
+    recording.getSegmentCount(),
+    recording.hasFailed()
+  };
+  return returnValue;
+}
+
+bool AudioCaptureClient::startFlacRecording(const char* path, uint32_t blockFrames, uint32_t threads, uint32_t bufferMs) {
+  if (!requireCapturing()) {
+    return false;
+  }
+  if (captureThread.isRunning() || flacRecording.isRecording()) {
+    return false;
+  }
+  SampleFormat sampleFormat = pipeline.getOutputSampleFormat();
+  if (!pipeline.isOutputFormatValid() || (sampleFormat != SAMPLE_FORMAT_INT16 && sampleFormat != SAMPLE_FORMAT_INT24)) {
+    return false;
+  }
+  AudioCaptureFormat outputFormat = getOutputFormat();
+  uint32_t rate = outputFormat.samplesPerSec;
+  if (!flacRecording.start(path, outputFormat.numChannels, outputFormat.bitsPerSample, rate,
+    blockFrames, threads, (uint32_t)((uint64_t)bufferMs * rate / 1000))) {
+    return false;
+  }
+  captureThread.setFlacRecorder(&flacRecording);
+  return true;
+}
+
+bool AudioCaptureClient::stopFlacRecording() {
+  if (captureThread.isRunning()) {
+    return false;
+  }
+  captureThread.setFlacRecorder(NULL);
+  flacRecording.stop();
+  return true;
+}
+
+FlacRecordingStats AudioCaptureClient::getFlacRecordingStats() {
+  FlacRecordingStats returnValue = {
+    flacRecording.getRecordedFrames(),
+    flacRecording.getDroppedFrames(),
+    flacRecording.getInputBytes(),
+    flacRecording.getOutputBytes(),
+    flacRecording.getEncodeSeconds(),
+    flacRecording.hasFailed()
+  };
+  return returnValue;
+}
+
+bool AudioCaptureClient::startRtpStream(const char* host, uint16_t port, uint32_t packetMs, uint8_t payloadType, uint32_t ssrc, uint32_t bufferMs) {
+  if (!requireCapturing()) {
+    return false;
+  }
+  if (captureThread.isRunning() || rtpStream.isSending()) {
+    return false;
+  }
+  SampleFormat sampleFormat = pipeline.getOutputSampleFormat();
+  if (!pipeline.isOutputFormatValid() || (sampleFormat != SAMPLE_FORMAT_INT16 && sampleFormat != SAMPLE_FORMAT_INT24)) {
+    return false;
+  }
+  AudioCaptureFormat outputFormat = getOutputFormat();
+  uint32_t rate = outputFormat.samplesPerSec;
+  uint32_t packetFrames = (uint32_t)((uint64_t)packetMs * rate / 1000);
+  if (!rtpStream.start(host, port, outputFormat.numChannels, outputFormat.bitsPerSample / 8, rate,
+    packetFrames, payloadType, ssrc, (uint32_t)((uint64_t)bufferMs * rate / 1000))) {
+    return false;
+  }
+  captureThread.setRtpSender(&rtpStream);
+  return true;
+}
+
+bool AudioCaptureClient::stopRtpStream() {
+  if (captureThread.isRunning()) {
+    return false;
+  }
+  captureThread.setRtpSender(NULL);
+  rtpStream.stop();
+  return true;
+}
+
+RtpSenderStats AudioCaptureClient::getRtpStreamStats() {
+  return rtpStream.getStats();
+}
+
+uint32_t AudioCaptureClient::getRtpStreamSsrc() {
+  return rtpStream.getSsrc();
+}
+
+bool AudioCaptureClient::setHistory(uint32_t historyMs) {
+  if (captureThread.isRunning()) {
+    return false;
+  }
+  this->historyMs = historyMs;
+  if (historyMs == 0) {
+    captureThread.setHistory(NULL);
+    history.allocate(0, 0);
+  }
+  return true;
+}
+
+bool AudioCaptureClient::getHistoryRange(uint32_t fromMs, uint32_t toMs, uint64_t* startFrame, uint64_t* endFrame) {
+  uint32_t rate = historyFormat.sampleRate;
+  if (history.capacityFrames() == 0 || rate == 0 || fromMs <= toMs) {
+    return false;
+  }
+  if (fromMs > historyMs) {
+    fromMs = historyMs;
+  }
+  uint64_t newest = history.writtenFrames();
+  uint64_t fromFrames = (uint64_t)fromMs * rate / 1000;
+  uint64_t toFrames = (uint64_t)toMs * rate / 1000;
+  *endFrame = newest > toFrames ? newest - toFrames : 0;
+  *startFrame = newest > fromFrames ? newest - fromFrames : 0;
+  return *startFrame < *endFrame;
+}
+
+uint64_t AudioCaptureClient::getHistoryFrameCount(uint32_t fromMs, uint32_t toMs) {
+  uint64_t startFrame;
+  uint64_t endFrame;
+  if (!getHistoryRange(fromMs, toMs, &startFrame, &endFrame)) {
+    return 0;
+  }
+  return endFrame - startFrame;
+}
+
+uint64_t AudioCaptureClient::copyHistory(uint32_t fromMs, uint32_t toMs, char* out, uint64_t maximumFrameCount) {
+  uint64_t startFrame;
+  uint64_t endFrame;
+  if (!getHistoryRange(fromMs, toMs, &startFrame, &endFrame)) {
+    return 0;
+  }
+  // keep the newest frames if out is too small
+  if (endFrame - startFrame > maximumFrameCount) {
+    startFrame = endFrame - maximumFrameCount;
+  }
+  uint64_t firstFrame;
+  return history.copyFrames(startFrame, endFrame, out, &firstFrame);
+}
+
+bool AudioCaptureClient::saveHistory(const char* path, uint32_t fromMs, uint32_t toMs, uint64_t* frameCount) {
+  unsigned int frameSize = history.getFrameSize();
+  uint64_t maximumFrameCount = getHistoryFrameCount(fromMs, toMs);
+  std::vector<char> frames((size_t)(maximumFrameCount * frameSize));
+  *frameCount = copyHistory(fromMs, toMs, frames.data(), maximumFrameCount);
+  return writeWavFile(path, historyFormat, frames.data(), *frameCount * frameSize);
+}
+
+unsigned int AudioCaptureClient::getHistoryFrameSize() {
+  return history.getFrameSize();
+}
+
+uint32_t AudioCaptureClient::getAvailableFrames() {
+  size_t frameSize = pipeline.getOutputFrameSize();
+  // no output format before the capture thread first started
+  if (frameSize == 0) {
+    return 0;
+  }
+  return (uint32_t)(ring.readAvailable() / frameSize);
+}
+
+uint32_t AudioCaptureClient::readFrames(char *out, uint32_t maximumFrameCount) {
+  size_t frameSize = pipeline.getOutputFrameSize();
+  if (frameSize == 0) {
+    return 0;
+  }
+  uint64_t startFrame = ring.readPosition() / frameSize;
+  size_t bytes = ring.read(out, (size_t)maximumFrameCount * frameSize);
+  updateChunkTiming(startFrame, (uint32_t)(bytes / frameSize));
+  return (uint32_t)(bytes / frameSize);
+}
+
+uint64_t AudioCaptureClient::getOverflowFrames() {
+  return captureThread.getOverflowFrames();
+}
+
+bool AudioCaptureClient::setOutputSampleFormat(SampleFormat sampleFormat, bool dither) {
+  if (captureThread.isRunning() || recording.isRecording() || flacRecording.isRecording()
+    || rtpStream.isSending()) {
+    return false;
+  }
+  pipeline.setOutputSampleFormat(sampleFormat, dither);
+  return true;
+}
+
+bool AudioCaptureClient::setOutputSampleRate(uint32_t sampleRate, ResamplerQuality quality) {
+  if (captureThread.isRunning() || recording.isRecording() || flacRecording.isRecording()
+    || rtpStream.isSending()) {
+    return false;
+  }
+  pipeline.setOutputSampleRate(sampleRate, quality);
+  return true;
+}
+
+bool AudioCaptureClient::setOutputChannels(uint32_t numChannels, const float* matrix) {
+  if (captureThread.isRunning() || recording.isRecording() || flacRecording.isRecording()
+    || rtpStream.isSending()) {
+    return false;
+  }
+  pipeline.setOutputChannels(numChannels, matrix);
+  return true;
+}
+
+uint32_t AudioCaptureClient::readFramesPlanar(float *out, uint32_t maximumFrameCount) {
+  if (!pipeline.isOutputFormatValid() || pipeline.getOutputSampleFormat() != SAMPLE_FORMAT_FLOAT32) {
+    return 0;
+  }
+  size_t frameSize = pipeline.getOutputFrameSize();
+  unsigned int numChannels = pipeline.getOutputChannels();
+  // the channels changed since the ring was filled
+  if (planarChannels.size() != numChannels) {
+    return 0;
+  }
+
+  RingRegions regions;
+  size_t bytes = ring.beginRead((size_t)maximumFrameCount * frameSize, &regions);
+  size_t frameCount = bytes / frameSize;
+  size_t firstFrames = regions.firstBytes / frameSize;
+
+  float** channels = planarChannels.data();
+  for (unsigned int c = 0; c < numChannels; c++) {
+    channels[c] = out + c * frameCount;
+  }
+  deinterleave((const float*)regions.first, firstFrames, numChannels, channels);
+  if (regions.secondBytes > 0) {
+    for (unsigned int c = 0; c < numChannels; c++) {
+      channels[c] += firstFrames;
+    }
+    deinterleave((const float*)regions.second, frameCount - firstFrames, numChannels, channels);
+  }
+  ring.commitRead(bytes);
+  updateChunkTiming(ring.readPosition() / frameSize - frameCount, (uint32_t)frameCount);
+  return (uint32_t)frameCount;
+}
+
+bool AudioCaptureClient::setBlocking(uint32_t blockFrames, uint32_t hopFrames) {
+  if (hopFrames == 0) {
+    hopFrames = blockFrames;
+  }
+  if (!blocker.configure(pipeline.getOutputFrameSize(), blockFrames, hopFrames)) {
+    return false;
+  }
+  this->blockFrames = blockFrames;
+  this->hopFrames = hopFrames;
+  return true;
+}
+
+uint32_t AudioCaptureClient::getBlockFrames() {
+  return blocker.getBlockFrames();
+}
+
+uint32_t AudioCaptureClient::readBlocks(char *out, uint32_t maximumBlocks) {
+  if (pipeline.getOutputFrameSize() == 0) {
+    return 0;
+  }
+  uint64_t startFrame = ring.readPosition() / pipeline.getOutputFrameSize();
+  uint64_t consumedFrames;
+  uint32_t blocks = blocker.read(&ring, out, maximumBlocks, &consumedFrames);
+  // the timing of the frames new in this call; the overlap came earlier
+  updateChunkTiming(startFrame, (uint32_t)consumedFrames);
+  return blocks;
+}
+
+BroadcastSubscriber* AudioCaptureClient::subscribe(OverflowPolicy policy, SampleFormat sampleFormat, bool dither, uint32_t numChannels, const float* matrix) {
+  if (!requireCapturing()) {
+    return NULL;
+  }
+  BroadcastSubscriber* subscriber = new BroadcastSubscriber();
+  if (!subscriber->open(&broadcast, policy, sampleFormat, dither, numChannels, matrix, pipeline.getOutputChannels())) {
+    delete subscriber;
+    return NULL;
+  }
+  subscribers.push_back(subscriber);
+  return subscriber;
+}
+
+void AudioCaptureClient::unsubscribe(BroadcastSubscriber* subscriber) {
+  for (size_t i = 0; i < subscribers.size(); i++) {
+    if (subscribers[i] == subscriber) {
+      subscribers.erase(subscribers.begin() + i);
+      delete subscriber;
+      return;
+    }
+  }
+}
+
+AudioCaptureFormat AudioCaptureClient::getSubscriberFormat(BroadcastSubscriber* subscriber) {
+  // the stream format is only fixed once the capture thread has started
+  uint32_t numChannels = subscriber->getNumChannels();
+  if (numChannels == 0) {
+    numChannels = pipeline.getOutputChannels();
+  }
+  uint32_t sampleBytes = getSampleFormatBytes(subscriber->getSampleFormat());
+  AudioCaptureFormat returnValue = {
+    pipeline.isOutputFormatValid(),
+    numChannels * sampleBytes,
+    numChannels,
+    sampleBytes * 8,
+    pipeline.getOutputSampleRate()
+  };
+  return returnValue;
+}
+
+uint64_t AudioCaptureClient::getBroadcastBlockedFrames() {
+  return broadcast.getBlockedFrames();
+}
+
+bool AudioCaptureClient::setLevelMeter(uint32_t windowMs, bool truePeak) {
+  if (captureThread.isRunning()) {
+    return false;
+  }
+  pipeline.setLevelMeter(windowMs, truePeak);
+  return true;
+}
+
+uint32_t AudioCaptureClient::getLevels(float *out, uint32_t maximumValues) {
+  LevelMeter* meter = pipeline.getLevelMeter();
+  uint32_t count = meter->getNumChannels() * 3;
+  if (count > maximumValues) {
+    return 0;
+  }
+  meter->getLevels(out);
+  return count;
+}
+
+bool AudioCaptureClient::setLevelsTarget(float *target, uint32_t length) {
+  if (captureThread.isRunning()) {
+    return false;
+  }
+  pipeline.getLevelMeter()->setTarget(target, length);
+  return true;
+}
+
+bool AudioCaptureClient::setFeatures(const FeatureOptions* options, bool deliverAudio) {
+  if (captureThread.isRunning()) {
+    return false;
+  }
+  pipeline.setFeatures(options, deliverAudio);
+  return true;
+}
+
+FeatureFormat AudioCaptureClient::getFeatureFormat() {
+  FeatureFormat returnValue = {};
+  FeatureExtractor* features = pipeline.getFeatureExtractor();
+  if (features != NULL) {
+    returnValue.valid = true;
+    returnValue.numBins = features->getNumBins();
+    returnValue.fftSize = features->getOptions().fftSize;
+    returnValue.hopSize = features->getOptions().hopSize;
+    returnValue.sampleRate = pipeline.getOutputSampleRate();
+  }
+  return returnValue;
+}
+
+FeatureStats AudioCaptureClient::getFeatureStats() {
+  FeatureStats returnValue = {};
+  FeatureExtractor* features = pipeline.getFeatureExtractor();
+  if (features != NULL) {
+    returnValue.availableFrames = (uint32_t)features->getAvailableFrames();
+    returnValue.producedFrames = features->getProducedFrames();
+    returnValue.overflowFrames = features->getOverflowFrames();
+  }
+  return returnValue;
+}
+
+uint32_t AudioCaptureClient::readFeatures(float *out, uint32_t maximumFrameCount) {
+  FeatureExtractor* features = pipeline.getFeatureExtractor();
+  if (features == NULL) {
+    return 0;
+  }
+  return (uint32_t)features->read(out, maximumFrameCount);
+}
+
+bool AudioCaptureClient::setGate(GateMode mode, float thresholdDb, uint32_t hangoverMs) {
+  if (captureThread.isRunning()) {
+    return false;
+  }
+  pipeline.setGate(mode, thresholdDb, hangoverMs);
+  return true;
+}
+
+GateState AudioCaptureClient::getGateState() {
+  VoiceGate* gate = pipeline.getGate();
+  GateState returnValue = {
+    gate->isOpen(),
+    gate->getGatedFrames()
+  };
+  return returnValue;
+}
+
+uint32_t AudioCaptureClient::takePacketFlags() {
+  uint32_t returnValue = pollFlags | captureThread.takePacketFlags();
+  pollFlags = 0;
+  return returnValue;
+}
+
+AudioCaptureFormat AudioCaptureClient::getOutputFormat() {
+  AudioCaptureFormat returnValue = {
+    pipeline.isOutputFormatValid(),
+    pipeline.getOutputFrameSize(),
+    pipeline.getOutputChannels(),
+    pipeline.getOutputBitsPerSample(),
+    pipeline.getOutputSampleRate()
+  };
+  return returnValue;
+}
+
+void AudioCaptureClient::setCaptureNotify(CaptureNotifyCallback callback, void* context, uint32_t batchFrames, uint32_t batchMs) {
+  captureThread.setNotify(callback, context, batchFrames, batchMs);
+}
+
+void AudioCaptureClient::onCaptureThreadStart() {
+  backend->onCaptureThreadStart();
+}
+
+void AudioCaptureClient::onCaptureThreadStop() {
+  backend->onCaptureThreadStop();
+}
+
+bool AudioCaptureClient::waitForPacket(unsigned int timeoutMs) {
+  return backend->waitForPacket(timeoutMs);
+}
+
+void AudioCaptureClient::setChunkTiming(uint64_t devicePosition, uint64_t timestamp, uint32_t flags) {
+  chunkTiming.devicePosition = devicePosition;
+  chunkTiming.timestamp = timestamp;
+  chunkTiming.flags = flags;
+  hasChunkTiming = true;
+}
+
+// frameCount frames starting at output frame startFrame were just read from
+// the ring
+void AudioCaptureClient::updateChunkTiming(uint64_t startFrame, uint32_t frameCount) {
+  if (frameCount > 0 && captureThread.getChunkTiming(startFrame, startFrame + frameCount, &chunkTiming)) {
+    hasChunkTiming = true;
+    recordLatency(frameCount, pipeline.getOutputSampleRate());
+  }
+}
+
+// chunkTiming was just set for a chunk of frameCount frames at sampleRate
+void AudioCaptureClient::recordLatency(uint32_t frameCount, unsigned int sampleRate) {
+  if (frameCount == 0 || sampleRate == 0 || chunkTiming.timestamp == 0
+      || (chunkTiming.flags & CAPTURE_PACKET_TIMESTAMP_ERROR)) {
+    return;
+  }
+  // the newest frame of the chunk was captured last, so it decides how long
+  // the chunk waited
+  uint64_t newest = chunkTiming.timestamp + (uint64_t)(frameCount - 1) * 10000000 / sampleRate;
+  latency.record((int64_t)(backend->getCurrentTimestamp() - newest));
+}
+
+bool AudioCaptureClient::getChunkTiming(ChunkTiming* timing) {
+  *timing = chunkTiming;
+  return hasChunkTiming;
+}
+
+PacketCounters AudioCaptureClient::getPacketCounters() {
+  return packetAccounting.getCounters();
+}
+
+LatencyHistogram* AudioCaptureClient::getLatencyHistogram() {
+  return &latency;
+}
+
+CaptureStats AudioCaptureClient::getStats() {
+  return counters.getStats();
+}
+
+bool AudioCaptureClient::startTrace(uint32_t maxEvents) {
+  if (captureThread.isRunning()) {
+    return false;
+  }
+  counters.startTrace(maxEvents);
+  return true;
+}
+
+void AudioCaptureClient::stopTrace() {
+  counters.stopTrace();
+}
+
+void AudioCaptureClient::getTrace(std::string* json) {
+  *json = counters.getTraceJson();
+}
+
+uint32_t AudioCaptureClient::acquirePacket(const char** data, uint32_t* flags, uint64_t* devicePosition, uint64_t* timestamp) {
+  uint64_t acquireStart = counters.now();
+  uint32_t frames = backend->acquirePacket(data, flags, devicePosition, timestamp);
+  counters.addAcquire(acquireStart, frames);
+  packetAccounting.account(*flags, *devicePosition, frames);
+  return frames;
+}
+
+void AudioCaptureClient::releasePacket(uint32_t nFrames) {
+  backend->releasePacket(nFrames);
+}
+
+unsigned int AudioCaptureClient::getFrameSize() {
+  return format.frameSize;
+}
+
+unsigned int AudioCaptureClient::getSourceChannels() {
+  return pipeline.getOutputChannels();
+}
+
+size_t AudioCaptureClient::readSourceFrames(float* out, size_t maxFrames, ChunkTiming* timing) {
+  if (!pipeline.isOutputFormatValid() || pipeline.getOutputSampleFormat() != SAMPLE_FORMAT_FLOAT32) {
+    return 0;
+  }
+  size_t frameSize = pipeline.getOutputFrameSize();
+  uint64_t startFrame = ring.readPosition() / frameSize;
+  size_t frames = ring.read((char*)out, maxFrames * frameSize) / frameSize;
+  if (frames > 0 && captureThread.getChunkTiming(startFrame, startFrame + frames, timing)) {
+    chunkTiming = *timing;
+    hasChunkTiming = true;
+  }
+  return frames;
+}
+
 // ---------------------------------------------
 // C interface
 
@@ -168,30 +995,372 @@ void *createCaptureClient() {
   return new AudioCaptureClient();
 }
 
-void initializeCom(void* client) {
-  ((AudioCaptureClient*)client)->initializeCom();
+bool initializeCom(void* client) {
+  return ((AudioCaptureClient*)client)->initializeCom();
 }
 
 void uninitializeCom(void* client) {
   ((AudioCaptureClient*)client)->uninitializeCom();
 }
 
-void startCapture(void *client) {
-  ((AudioCaptureClient*)client)->startCapture();
+bool setCaptureDevice(void *client, const char* id) {
+  return ((AudioCaptureClient*)client)->setCaptureDevice(id);
+}
+
+bool setCaptureBackend(void *client, CaptureBackend* backend) {
+  if (!((AudioCaptureClient*)client)->setBackend(backend)) {
+    delete backend;
+    return false;
+  }
+  return true;
+}
+
+bool setBufferOptions(void *client, CaptureBufferOptions options) {
+  return ((AudioCaptureClient*)client)->setBufferOptions(options);
+}
+
+bool prepareCapture(void *client) {
+  return ((AudioCaptureClient*)client)->prepareCapture();
+}
+
+void setKeepWarm(void *client, bool keepWarm) {
+  ((AudioCaptureClient*)client)->setKeepWarm(keepWarm);
+}
+
+bool startCapture(void *client) {
+  return ((AudioCaptureClient*)client)->startCapture();
+}
+
+CaptureError getLastError(void *client) {
+  return ((AudioCaptureClient*)client)->getLastError();
+}
+
+bool isCapturing(void *client) {
+  return ((AudioCaptureClient*)client)->isCapturing();
+}
+
+CaptureBufferInfo getBufferInfo(void *client) {
+  return ((AudioCaptureClient*)client)->getBufferInfo();
 }
 
 AudioCaptureFormat getAudioFormat(void *client) {
   return ((AudioCaptureClient*)client)->getAudioFormat();
 }
 
-UINT32 getNextPacketSize(void *client) {
+uint32_t getNextPacketSize(void *client) {
   return ((AudioCaptureClient*)client)->getNextPacketSize();
 }
 
-UINT32 getBuffer(void *client, UINT32 expectedFrameCount, UINT32 maximumFrameCount, char *out) {
+uint32_t getBuffer(void *client, uint32_t expectedFrameCount, uint32_t maximumFrameCount, char *out) {
   return ((AudioCaptureClient*)client)->getBuffer(expectedFrameCount, maximumFrameCount, out);
 }
 
+uint32_t drainInto(void *client, char *out, uint32_t maximumFrameCount, uint32_t *flags) {
+  return ((AudioCaptureClient*)client)->drainInto(out, maximumFrameCount, flags);
+}
+
+uint32_t getCarriedFrames(void *client) {
+  return ((AudioCaptureClient*)client)->getCarriedFrames();
+}
+
 void stopCapture(void *client) {
   ((AudioCaptureClient*)client)->stopCapture();
-}
\ No newline at end of file
+}
+
+bool startCaptureThread(void *client, uint32_t ringFrames) {
+  return ((AudioCaptureClient*)client)->startCaptureThread(ringFrames);
+}
+
+void stopCaptureThread(void *client) {
+  ((AudioCaptureClient*)client)->stopCaptureThread();
+}
+
+bool startRecording(void *client, const char* basePath, uint32_t segmentSeconds, uint32_t indexIntervalMs, uint32_t bufferMs) {
+  return ((AudioCaptureClient*)client)->startRecording(basePath, segmentSeconds, indexIntervalMs, bufferMs);
+}
+
+bool stopRecording(void *client) {
+  return ((AudioCaptureClient*)client)->stopRecording();
+}
+
+RecordingStats getRecordingStats(void *client) {
+  return ((AudioCaptureClient*)client)->getRecordingStats();
+}
+
+bool startFlacRecording(void *client, const char* path, uint32_t blockFrames, uint32_t threads, uint32_t bufferMs) {
+  return ((AudioCaptureClient*)client)->startFlacRecording(path, blockFrames, threads, bufferMs);
+}
+
+bool stopFlacRecording(void *client) {
+  return ((AudioCaptureClient*)client)->stopFlacRecording();
+}
+
+FlacRecordingStats getFlacRecordingStats(void *client) {
+  return ((AudioCaptureClient*)client)->getFlacRecordingStats();
+}
+
+bool startRtpStream(void *client, const char* host, uint16_t port, uint32_t packetMs, uint8_t payloadType, uint32_t ssrc, uint32_t bufferMs) {
+  return ((AudioCaptureClient*)client)->startRtpStream(host, port, packetMs, payloadType, ssrc, bufferMs);
+}
+
+bool stopRtpStream(void *client) {
+  return ((AudioCaptureClient*)client)->stopRtpStream();
+}
+
+RtpSenderStats getRtpStreamStats(void *client) {
+  return ((AudioCaptureClient*)client)->getRtpStreamStats();
+}
+
+uint32_t getRtpStreamSsrc(void *client) {
+  return ((AudioCaptureClient*)client)->getRtpStreamSsrc();
+}
+
+bool setHistory(void *client, uint32_t historyMs) {
+  return ((AudioCaptureClient*)client)->setHistory(historyMs);
+}
+
+uint64_t getHistoryFrameCount(void *client, uint32_t fromMs, uint32_t toMs) {
+  return ((AudioCaptureClient*)client)->getHistoryFrameCount(fromMs, toMs);
+}
+
+uint64_t copyHistory(void *client, uint32_t fromMs, uint32_t toMs, char* out, uint64_t maximumFrameCount) {
+  return ((AudioCaptureClient*)client)->copyHistory(fromMs, toMs, out, maximumFrameCount);
+}
+
+bool saveHistory(void *client, const char* path, uint32_t fromMs, uint32_t toMs, uint64_t* frameCount) {
+  return ((AudioCaptureClient*)client)->saveHistory(path, fromMs, toMs, frameCount);
+}
+
+unsigned int getHistoryFrameSize(void *client) {
+  return ((AudioCaptureClient*)client)->getHistoryFrameSize();
+}
+
+uint32_t getAvailableFrames(void *client) {
+  return ((AudioCaptureClient*)client)->getAvailableFrames();
+}
+
+uint32_t readFrames(void *client, char *out, uint32_t maximumFrameCount) {
+  return ((AudioCaptureClient*)client)->readFrames(out, maximumFrameCount);
+}
+
+uint64_t getOverflowFrames(void *client) {
+  return ((AudioCaptureClient*)client)->getOverflowFrames();
+}
+
+bool attachSharedRing(void *client, char* memory, size_t bytes) {
+  return ((AudioCaptureClient*)client)->attachSharedRing(memory, bytes);
+}
+
+bool detachSharedRing(void *client) {
+  return ((AudioCaptureClient*)client)->detachSharedRing();
+}
+
+void setCaptureNotify(void *client, CaptureNotifyCallback callback, void* context, uint32_t batchFrames, uint32_t batchMs) {
+  ((AudioCaptureClient*)client)->setCaptureNotify(callback, context, batchFrames, batchMs);
+}
+
+bool setOutputSampleFormat(void *client, SampleFormat sampleFormat, bool dither) {
+  return ((AudioCaptureClient*)client)->setOutputSampleFormat(sampleFormat, dither);
+}
+
+bool setOutputSampleRate(void *client, uint32_t sampleRate, ResamplerQuality quality) {
+  return ((AudioCaptureClient*)client)->setOutputSampleRate(sampleRate, quality);
+}
+
+bool setOutputChannels(void *client, uint32_t numChannels, const float* matrix) {
+  return ((AudioCaptureClient*)client)->setOutputChannels(numChannels, matrix);
+}
+
+uint32_t readFramesPlanar(void *client, float *out, uint32_t maximumFrameCount) {
+  return ((AudioCaptureClient*)client)->readFramesPlanar(out, maximumFrameCount);
+}
+
+bool setBlocking(void *client, uint32_t blockFrames, uint32_t hopFrames) {
+  return ((AudioCaptureClient*)client)->setBlocking(blockFrames, hopFrames);
+}
+
+uint32_t getBlockFrames(void *client) {
+  return ((AudioCaptureClient*)client)->getBlockFrames();
+}
+
+uint32_t readBlocks(void *client, char *out, uint32_t maximumBlocks) {
+  return ((AudioCaptureClient*)client)->readBlocks(out, maximumBlocks);
+}
+
+bool setGate(void *client, GateMode mode, float thresholdDb, uint32_t hangoverMs) {
+  return ((AudioCaptureClient*)client)->setGate(mode, thresholdDb, hangoverMs);
+}
+
+bool setFeatures(void *client, const FeatureOptions* options, bool deliverAudio) {
+  return ((AudioCaptureClient*)client)->setFeatures(options, deliverAudio);
+}
+
+FeatureFormat getFeatureFormat(void *client) {
+  return ((AudioCaptureClient*)client)->getFeatureFormat();
+}
+
+FeatureStats getFeatureStats(void *client) {
+  return ((AudioCaptureClient*)client)->getFeatureStats();
+}
+
+uint32_t readFeatures(void *client, float *out, uint32_t maximumFrameCount) {
+  return ((AudioCaptureClient*)client)->readFeatures(out, maximumFrameCount);
+}
+
+GateState getGateState(void *client) {
+  return ((AudioCaptureClient*)client)->getGateState();
+}
+
+uint32_t takePacketFlags(void *client) {
+  return ((AudioCaptureClient*)client)->takePacketFlags();
+}
+
+void* subscribe(void *client, OverflowPolicy policy, SampleFormat sampleFormat, bool dither, uint32_t numChannels, const float* matrix) {
+  return ((AudioCaptureClient*)client)->subscribe(policy, sampleFormat, dither, numChannels, matrix);
+}
+
+void unsubscribe(void *client, void* subscriber) {
+  ((AudioCaptureClient*)client)->unsubscribe((BroadcastSubscriber*)subscriber);
+}
+
+AudioCaptureFormat getSubscriberFormat(void *client, void* subscriber) {
+  return ((AudioCaptureClient*)client)->getSubscriberFormat((BroadcastSubscriber*)subscriber);
+}
+
+uint64_t getBroadcastBlockedFrames(void *client) {
+  return ((AudioCaptureClient*)client)->getBroadcastBlockedFrames();
+}
+
+uint32_t readSubscriber(void *subscriber, char *out, uint32_t maximumFrameCount) {
+  return (uint32_t)((BroadcastSubscriber*)subscriber)->read(out, maximumFrameCount);
+}
+
+uint32_t getSubscriberAvailableFrames(void *subscriber) {
+  return (uint32_t)((BroadcastSubscriber*)subscriber)->getAvailableFrames();
+}
+
+uint64_t getSubscriberDroppedFrames(void *subscriber) {
+  return ((BroadcastSubscriber*)subscriber)->getDroppedFrames();
+}
+
+bool getChunkTiming(void *client, ChunkTiming* timing) {
+  return ((AudioCaptureClient*)client)->getChunkTiming(timing);
+}
+
+PacketCounters getPacketCounters(void *client) {
+  return ((AudioCaptureClient*)client)->getPacketCounters();
+}
+
+CaptureStats getStats(void *client) {
+  return ((AudioCaptureClient*)client)->getStats();
+}
+
+bool startTrace(void *client, uint32_t maxEvents) {
+  return ((AudioCaptureClient*)client)->startTrace(maxEvents);
+}
+
+void stopTrace(void *client) {
+  ((AudioCaptureClient*)client)->stopTrace();
+}
+
+void getTrace(void *client, std::string* json) {
+  ((AudioCaptureClient*)client)->getTrace(json);
+}
+
+LatencyStats getLatencyStats(void *client) {
+  return ((AudioCaptureClient*)client)->getLatencyHistogram()->getStats();
+}
+
+double getLatencyPercentile(void *client, double percentile) {
+  return ((AudioCaptureClient*)client)->getLatencyHistogram()->getPercentileMs(percentile);
+}
+
+void getLatencyCounts(void *client, uint64_t* counts) {
+  ((AudioCaptureClient*)client)->getLatencyHistogram()->getCounts(counts);
+}
+
+void resetLatency(void *client) {
+  ((AudioCaptureClient*)client)->getLatencyHistogram()->reset();
+}
+
+bool setLevelMeter(void *client, uint32_t windowMs, bool truePeak) {
+  return ((AudioCaptureClient*)client)->setLevelMeter(windowMs, truePeak);
+}
+
+uint32_t getLevels(void *client, float *out, uint32_t maximumValues) {
+  return ((AudioCaptureClient*)client)->getLevels(out, maximumValues);
+}
+
+bool setLevelsTarget(void *client, float *target, uint32_t length) {
+  return ((AudioCaptureClient*)client)->setLevelsTarget(target, length);
+}
+
+AudioCaptureFormat getOutputFormat(void *client) {
+  return ((AudioCaptureClient*)client)->getOutputFormat();
+}
+
+void* createDeviceMixer(void** clients, const float* gains, uint32_t numClients, MixerMode mode, uint32_t ringFrames) {
+  std::vector<MixerSource*> sources;
+  uint32_t sampleRate = 0;
+  for (uint32_t i = 0; i < numClients; i++) {
+    AudioCaptureClient* client = (AudioCaptureClient*)clients[i];
+    AudioCaptureFormat outputFormat = client->getOutputFormat();
+    if (!outputFormat.formatisValid || outputFormat.bitsPerSample != 32
+      || (i > 0 && outputFormat.samplesPerSec != sampleRate)) {
+      return NULL;
+    }
+    sampleRate = outputFormat.samplesPerSec;
+    sources.push_back(client);
+  }
+  DeviceMixer* mixer = new DeviceMixer();
+  std::vector<float> sourceGains(gains, gains + numClients);
+  if (!mixer->configure(sources, sourceGains, mode, sampleRate, ringFrames)) {
+    delete mixer;
+    return NULL;
+  }
+  return mixer;
+}
+
+void deleteDeviceMixer(void* mixer) {
+  delete (DeviceMixer*)mixer;
+}
+
+bool startDeviceMixer(void* mixer) {
+  return ((DeviceMixer*)mixer)->start();
+}
+
+void stopDeviceMixer(void* mixer) {
+  ((DeviceMixer*)mixer)->stop();
+}
+
+uint32_t readMixedFrames(void* mixer, float *out, uint32_t maximumFrameCount) {
+  return (uint32_t)((DeviceMixer*)mixer)->readFrames(out, maximumFrameCount);
+}
+
+uint32_t getMixedAvailableFrames(void* mixer) {
+  return (uint32_t)((DeviceMixer*)mixer)->getAvailableFrames();
+}
+
+uint64_t getMixerOverflowFrames(void* mixer) {
+  return ((DeviceMixer*)mixer)->getOverflowFrames();
+}
+
+AudioCaptureFormat getMixerFormat(void* mixer) {
+  uint32_t numChannels = ((DeviceMixer*)mixer)->getOutputChannels();
+  AudioCaptureFormat returnValue = {
+    true,
+    numChannels * (uint32_t)sizeof(float),
+    numChannels,
+    32,
+    ((DeviceMixer*)mixer)->getSampleRate()
+  };
+  return returnValue;
+}
+
+uint32_t getMixerSourceCount(void* mixer) {
+  return ((DeviceMixer*)mixer)->getSourceCount();
+}
+
+bool getMixerSourceStats(void* mixer, uint32_t index, MixerSourceStats* stats) {
+  return ((DeviceMixer*)mixer)->getSourceStats(index, stats);
+}
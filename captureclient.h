@@ -1,14 +1,23 @@
-#include <stdio.h>
-#include <Windows.h>
-extern "C" {
-#include <initguid.h>
-#include <mmdeviceapi.h>
-}
-#include <Audioclient.h>
+#pragma once
 
-#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
 #include <iostream>
 #include <sstream>
+#include <string>
+#include <vector>
+
+#include "broadcastring.h"
+#include "capturebackend.h"
+#include "capturepipeline.h"
+#include "capturesource.h"
+#include "capturethread.h"
+#include "devicemixer.h"
+#include "frameblocker.h"
+#include "packettiming.h"
+#include "recorder.h"
+#include "ringbuffer.h"
+#include "rtpsender.h"
 
 typedef struct AudioCaptureFormat {
     bool formatisValid;
@@ -18,42 +27,429 @@ typedef struct AudioCaptureFormat {
     unsigned int samplesPerSec;
 } AudioCaptureFormat;
 
-class AudioCaptureClient {
+typedef struct GateState {
+    bool open;
+    uint64_t gatedFrames;
+} GateState;
+
+typedef struct FeatureFormat {
+    bool valid;
+    uint32_t numBins;
+    uint32_t fftSize;
+    uint32_t hopSize;
+    uint32_t sampleRate;
+} FeatureFormat;
+
+typedef struct FeatureStats {
+    uint32_t availableFrames;
+    uint64_t producedFrames;
+    uint64_t overflowFrames;
+} FeatureStats;
+
+typedef struct RecordingStats {
+    uint64_t recordedFrames;
+    uint64_t droppedFrames;
+    uint32_t segmentCount;
+    bool failed;
+} RecordingStats;
+
+typedef struct FlacRecordingStats {
+    uint64_t recordedFrames;
+    uint64_t droppedFrames;
+    uint64_t inputBytes;
+    uint64_t outputBytes;
+    double encodeSeconds;
+    bool failed;
+} FlacRecordingStats;
+
+// active render and capture endpoints. COM must be initialized. empty on
+// platforms without WASAPI.
+bool enumerateAudioDevices(std::vector<AudioDeviceInfo>* devices);
+
+// COM for a thread that is not the JS thread, e.g. a libuv threadpool thread
+// running prepareCapture() / startCapture(). leaveWorkerThread() only if
+// enterWorkerThread() returned true.
+bool enterWorkerThread();
+void leaveWorkerThread();
+
+// packets come from a CaptureBackend: WASAPI by default on Windows, anything
+// set with setBackend() elsewhere. everything above it (capture thread,
+// pipeline, rings, recording, subscribers) is the same for every backend.
+class AudioCaptureClient : public CaptureSource, public MixerSource {
 private:
-    HRESULT hr;
-    IMMDeviceEnumerator* enumerator = NULL;
-    IMMDevice* recorder = NULL;
-    IAudioClient* recorderClient = NULL;
-    IAudioCaptureClient* captureService = NULL;
-    WAVEFORMATEX* format = NULL;
+    CaptureBackend* backend = NULL;
+    CaptureFormat format = {};
+    bool capturing = false;
+    // why the last call of the client itself failed, e.g. one that needs
+    // startCapture() first. reported ahead of the backend's error.
+    CaptureError clientError = {};
+    // records clientError and returns false unless capturing
+    bool requireCapturing();
 
-    UINT32 nFrames;
-    DWORD flags;
-    BYTE* captureBuffer;
+    // flags of packets read by getBuffer() / drainInto() since takePacketFlags()
+    uint32_t pollFlags = 0;
 
-    int iSamp=0;
-    float maxval=0;
+    // glitch counters of every packet read, by either path
+    PacketAccounting packetAccounting;
+    // timing of the chunk last returned by getBuffer(), drainInto(),
+    // readFrames() or readFramesPlanar()
+    ChunkTiming chunkTiming = {};
+    bool hasChunkTiming = false;
+    // how old the newest frame of each chunk was when it was returned
+    LatencyHistogram latency;
+    // where the time of every packet read goes, by either path
+    CaptureCounters counters;
 
     int locked=0;
 
+    CapturePipeline pipeline;
+    RingBuffer ring;
+    // per-channel write positions of readFramesPlanar(), one per output
+    // channel, sized when the capture thread starts
+    std::vector<float*> planarChannels;
+    CaptureThread captureThread;
+    CaptureRecorder recording;
+    FlacRecorder flacRecording;
+    RtpSender rtpStream;
+
+    // fan-out of the capture thread output to any number of subscribers,
+    // each with its own cursor, format and overflow policy
+    BroadcastRing broadcast;
+    std::vector<BroadcastSubscriber*> subscribers;
+
+    // caller memory the capture thread writes to instead of ring, see
+    // sharedring.h
+    SharedRing sharedRing;
+
+    // the last historyMs of output, kept from startCaptureThread() on, and
+    // its format at that point
+    HistoryBuffer history;
+    uint32_t historyMs = 0;
+    RecordingFormat historyFormat = {};
+
+    // readBlocks() cuts the ring into blocks of blockFrames every hopFrames
+    FrameBlocker blocker;
+    uint32_t blockFrames = 0;
+    uint32_t hopFrames = 0;
+
+    // frames from the last packet drainInto() could not fit in the caller's
+    // buffer. delivered first on the next call instead of being dropped.
+    std::vector<char> carryBuffer;
+    size_t carryOffset = 0;
+    // device position and timestamp of the first carried frame, and the
+    // flags of the packet it came from
+    ChunkTiming carryTiming = {};
+
+    void setChunkTiming(uint64_t devicePosition, uint64_t timestamp, uint32_t flags);
+    void updateChunkTiming(uint64_t startFrame, uint32_t frameCount);
+    void recordLatency(uint32_t frameCount, unsigned int sampleRate);
+    RecordingFormat getRecordingFormat();
+    bool getHistoryRange(uint32_t fromMs, uint32_t toMs, uint64_t* startFrame, uint64_t* endFrame);
+
 public:
-    void initializeCom();
+    ~AudioCaptureClient();
+    // returns false if COM could not be initialized on this thread, see
+    // getLastError()
+    bool initializeCom();
     void uninitializeCom();
-    void startCapture();
+    // endpoint id from enumerateAudioDevices(), or NULL / "" for the default
+    // render endpoint. applies to the next startCapture(); returns false if
+    // there is no such endpoint or while capturing.
+    bool setCaptureDevice(const char* id);
+    // replaces the backend, which the client then owns; NULL goes back to the
+    // default. returns false while capturing; backend is not taken then.
+    bool setBackend(CaptureBackend* backend);
+    // buffer size and period of the stream, see CaptureBufferOptions. applies
+    // to the next startCapture(); returns false while capturing or if the
+    // backend does not support them.
+    bool setBufferOptions(const CaptureBufferOptions& options);
+    // activates and initializes the stream ahead of startCapture(), which then
+    // only has to start it. optional; returns false while capturing or if the
+    // stream could not be set up, see getLastError().
+    bool prepareCapture();
+    // keep the stream prepared after stopCapture(), for a fast restart. a
+    // warm stream stays on the endpoint and buffer options it was prepared
+    // with until they are changed.
+    void setKeepWarm(bool keepWarm);
+    // returns false if there is no backend or it could not be opened, see
+    // getLastError().
+    bool startCapture();
+    // why initializeCom(), prepareCapture() or startCapture() failed, or a
+    // call that needs a started capture was made without one
+    CaptureError getLastError();
+    bool isCapturing();
+    // buffer settings the stream got. all zero unless capturing.
+    CaptureBufferInfo getBufferInfo();
+    // all zero unless capturing
     AudioCaptureFormat getAudioFormat();
     int getBytesPerSample();
-    UINT32 getNextPacketSize();
-    UINT32 getBuffer(UINT32 expectedFrameCount, UINT32 maximumFrameCount, char *out);
+    uint32_t getNextPacketSize();
+    uint32_t getBuffer(uint32_t expectedFrameCount, uint32_t maximumFrameCount, char *out);
+    // read every available packet into out in one call. returns frames written;
+    // *flags receives the CAPTURE_PACKET_xxx of all packets or'ed together.
+    uint32_t drainInto(char *out, uint32_t maximumFrameCount, uint32_t *flags);
+    uint32_t getCarriedFrames();
     void stopCapture();
+
+    // capture thread: drains the backend into the ring so JS only has to read from it.
+    // while the capture thread runs, getNextPacketSize() / getBuffer() must not be
+    // called from JS because the thread consumes the packets.
+    bool startCaptureThread(uint32_t ringFrames);
+    void stopCaptureThread();
+    uint32_t getAvailableFrames();
+    uint32_t readFrames(char *out, uint32_t maximumFrameCount);
+    uint64_t getOverflowFrames();
+
+    // have the capture thread write its output to memory shared with another
+    // consumer, e.g. a SharedArrayBuffer, laid out as in sharedring.h, instead
+    // of the ring readFrames() and streaming read from. memory is not owned
+    // and must stay valid until detachSharedRing() or the client is deleted.
+    // the format is written to it by startCaptureThread(). both return false
+    // while the thread is running.
+    bool attachSharedRing(char* memory, size_t bytes);
+    bool detachSharedRing();
+
+    // native recording of the capture thread output to WAV segments, see
+    // recorder.h. start before startCaptureThread() and stop after
+    // stopCaptureThread(); both return false while the thread is running. the
+    // output format cannot change while recording.
+    bool startRecording(const char* basePath, uint32_t segmentSeconds, uint32_t indexIntervalMs, uint32_t bufferMs);
+    bool stopRecording();
+    RecordingStats getRecordingStats();
+
+    // the same as one FLAC file, see FlacRecorder. needs int16 or int24
+    // output; FLAC has no float samples. blocks of blockFrames are encoded
+    // by threads encoder threads.
+    bool startFlacRecording(const char* path, uint32_t blockFrames, uint32_t threads, uint32_t bufferMs);
+    bool stopFlacRecording();
+    FlacRecordingStats getFlacRecordingStats();
+
+    // streams the capture thread output to host:port as RTP over UDP, see
+    // rtpsender.h. needs int16 (L16) or int24 (L24) output. start before
+    // startCaptureThread() and stop after stopCaptureThread(); both return
+    // false while the thread is running.
+    bool startRtpStream(const char* host, uint16_t port, uint32_t packetMs, uint8_t payloadType, uint32_t ssrc, uint32_t bufferMs);
+    bool stopRtpStream();
+    RtpSenderStats getRtpStreamStats();
+    uint32_t getRtpStreamSsrc();
+
+    // keep the last historyMs of output in native memory, overwriting the
+    // oldest, see historybuffer.h. 0 disables. takes effect with the next
+    // startCaptureThread(); returns false while the thread is running.
+    bool setHistory(uint32_t historyMs);
+    // the output from fromMs to toMs before the newest frame, any time, also
+    // while the thread runs or after it stopped. copyHistory() copies up to
+    // maximumFrameCount frames to out and returns how many, which is fewer if
+    // the history does not reach back that far; getHistoryFrameCount() is the
+    // number it would copy now. saveHistory() writes them as a WAV file and
+    // returns false if the file cannot be written.
+    uint64_t getHistoryFrameCount(uint32_t fromMs, uint32_t toMs);
+    uint64_t copyHistory(uint32_t fromMs, uint32_t toMs, char* out, uint64_t maximumFrameCount);
+    bool saveHistory(const char* path, uint32_t fromMs, uint32_t toMs, uint64_t* frameCount);
+    unsigned int getHistoryFrameSize();
+
+    // format of the data delivered by the capture thread. must be set before
+    // startCaptureThread(); returns false while the thread is running.
+    bool setOutputSampleFormat(SampleFormat sampleFormat, bool dither);
+    // 0 keeps the device sample rate.
+    bool setOutputSampleRate(uint32_t sampleRate, ResamplerQuality quality);
+    // 0 keeps the device channels. matrix has numChannels rows of device
+    // channel coefficients, or is NULL for the standard downmix.
+    bool setOutputChannels(uint32_t numChannels, const float* matrix);
+    AudioCaptureFormat getOutputFormat();
+    // like readFrames() but deinterleaved: channel c of frame i goes to
+    // out[c * frameCount + i], where frameCount is the return value. only for
+    // float32 output; out must hold channels * maximumFrameCount floats.
+    uint32_t readFramesPlanar(float *out, uint32_t maximumFrameCount);
+    // fixed size blocks for consumers that need exact windows, see
+    // frameblocker.h. blockFrames of 0 disables blocking; hopFrames of 0
+    // means blockFrames, i.e. no overlap. readBlocks() copies up to
+    // maximumBlocks whole blocks of getBlockFrames() frames each in the
+    // output format to out and returns how many; don't mix it with
+    // readFrames(), which would take frames from between the blocks. call
+    // both from the reader thread.
+    bool setBlocking(uint32_t blockFrames, uint32_t hopFrames);
+    uint32_t getBlockFrames();
+    uint32_t readBlocks(char *out, uint32_t maximumBlocks);
+
+    // level metering on the capture thread, see levelmeter.h. windowMs of 0
+    // disables it. must be set before startCaptureThread().
+    bool setLevelMeter(uint32_t windowMs, bool truePeak);
+    // copies up to maximumValues levels (peak, rms, truePeak per output
+    // channel) of the last completed window. returns the number copied.
+    uint32_t getLevels(float *out, uint32_t maximumValues);
+    // array the capture thread updates in place at the end of each window.
+    // returns false while the thread is running.
+    bool setLevelsTarget(float *target, uint32_t length);
+
+    // spectral features of the capture thread output, see featureextractor.h.
+    // NULL disables them. without deliverAudio the ring gets no audio while
+    // features are computed. only for float32 device formats; must be set
+    // before startCaptureThread().
+    bool setFeatures(const FeatureOptions* options, bool deliverAudio);
+    // valid once startCaptureThread() has set up the feature stage
+    FeatureFormat getFeatureFormat();
+    FeatureStats getFeatureStats();
+    // copies up to maximumFrameCount feature frames of getFeatureFormat()
+    // numBins floats each. returns the number copied.
+    uint32_t readFeatures(float *out, uint32_t maximumFrameCount);
+
+    // silence / voice activity gate in front of the ring, see voicegate.h.
+    // the recording is not gated. must be set before startCaptureThread().
+    bool setGate(GateMode mode, float thresholdDb, uint32_t hangoverMs);
+    GateState getGateState();
+
+    // CAPTURE_PACKET_xxx of every packet read since the last call, by the
+    // capture thread or by getBuffer() / drainInto(), or'ed together.
+    uint32_t takePacketFlags();
+
+    // device position of the first frame, its performance counter timestamp
+    // (100 ns units) and the packet flags of the chunk last returned by
+    // getBuffer(), drainInto(), readFrames() or readFramesPlanar(). returns
+    // false if no chunk has been delivered yet.
+    bool getChunkTiming(ChunkTiming* timing);
+    // discontinuities, timestamp errors, device position gaps and frames
+    // getBuffer() had to discard, counted since startCapture().
+    PacketCounters getPacketCounters();
+    // latency from device timestamp to delivery of every chunk returned by
+    // getBuffer(), drainInto(), readFrames() or readFramesPlanar() since
+    // startCapture() or the last reset. chunks without a valid timestamp are
+    // not counted.
+    LatencyHistogram* getLatencyHistogram();
+    // packets, frames and bytes copied, GetBuffer and pipeline durations and
+    // the ring high-water mark since startCapture(), see capturestats.h
+    CaptureStats getStats();
+    // record every step of every packet into a buffer of maxEvents, for
+    // getTrace() as Chrome trace event JSON. startTrace() returns false while
+    // the capture thread runs; stopTrace() keeps the events.
+    bool startTrace(uint32_t maxEvents);
+    void stopTrace();
+    void getTrace(std::string* json);
+
+    // subscribers read the capture thread output through their own cursor, so
+    // several consumers share one device. the output format set above is the
+    // stream they read; each can convert it to another sample format or mix it
+    // to other channels. they can come and go while the thread runs and see
+    // frames captured after they subscribe. channels of 0 keeps the output
+    // channels; matrix has numChannels rows of output channel coefficients, or
+    // is NULL for the standard downmix. returns NULL if there are too many.
+    BroadcastSubscriber* subscribe(OverflowPolicy policy, SampleFormat sampleFormat, bool dither, uint32_t numChannels, const float* matrix);
+    void unsubscribe(BroadcastSubscriber* subscriber);
+    AudioCaptureFormat getSubscriberFormat(BroadcastSubscriber* subscriber);
+    // frames no subscriber got because an OVERFLOW_PROTECT one was a full
+    // ring behind
+    uint64_t getBroadcastBlockedFrames();
+
+    // push-style delivery: callback runs on the capture thread once per batch.
+    // must be set before startCaptureThread().
+    void setCaptureNotify(CaptureNotifyCallback callback, void* context, uint32_t batchFrames, uint32_t batchMs);
+
+    // CaptureSource
+    void onCaptureThreadStart();
+    void onCaptureThreadStop();
+    bool waitForPacket(unsigned int timeoutMs);
+    uint32_t acquirePacket(const char** data, uint32_t* flags, uint64_t* devicePosition, uint64_t* timestamp);
+    void releasePacket(uint32_t nFrames);
+    unsigned int getFrameSize();
+
+    // MixerSource: reads the ring like readFrames(). only float32 output can
+    // be mixed; the capture thread must be running.
+    unsigned int getSourceChannels();
+    size_t readSourceFrames(float* out, size_t maxFrames, ChunkTiming* timing);
 };
 
 extern "C" {
     void *createCaptureClient();
-    void initializeCom(void* client); // must not be called from Electron app because Electron already initializes COM
+    bool initializeCom(void* client); // must not be called from Electron app because Electron already initializes COM
     void uninitializeCom(void* client); // must not be called from Electron app because Electron already uninitializes COM
-    void startCapture(void* client);
+    bool setCaptureDevice(void* client, const char* id);
+    // takes ownership of backend, or deletes it if the client is capturing
+    bool setCaptureBackend(void* client, CaptureBackend* backend);
+    bool setBufferOptions(void* client, CaptureBufferOptions options);
+    bool prepareCapture(void* client);
+    void setKeepWarm(void* client, bool keepWarm);
+    bool startCapture(void* client);
+    CaptureError getLastError(void* client);
+    bool isCapturing(void* client);
+    CaptureBufferInfo getBufferInfo(void* client);
     AudioCaptureFormat getAudioFormat(void* client);
-    UINT32 getNextPacketSize(void* client);
-    UINT32 getBuffer(void* client, UINT32 expectedFrameCount, UINT32 maximumFrameCount, char *out);
+    uint32_t getNextPacketSize(void* client);
+    uint32_t getBuffer(void* client, uint32_t expectedFrameCount, uint32_t maximumFrameCount, char *out);
+    uint32_t drainInto(void* client, char *out, uint32_t maximumFrameCount, uint32_t *flags);
+    uint32_t getCarriedFrames(void* client);
     void stopCapture(void* client);
+    bool startCaptureThread(void* client, uint32_t ringFrames);
+    void stopCaptureThread(void* client);
+    uint32_t getAvailableFrames(void* client);
+    uint32_t readFrames(void* client, char *out, uint32_t maximumFrameCount);
+    uint64_t getOverflowFrames(void* client);
+    bool attachSharedRing(void* client, char* memory, size_t bytes);
+    bool detachSharedRing(void* client);
+    bool startRecording(void* client, const char* basePath, uint32_t segmentSeconds, uint32_t indexIntervalMs, uint32_t bufferMs);
+    bool stopRecording(void* client);
+    RecordingStats getRecordingStats(void* client);
+    bool startFlacRecording(void* client, const char* path, uint32_t blockFrames, uint32_t threads, uint32_t bufferMs);
+    bool stopFlacRecording(void* client);
+    FlacRecordingStats getFlacRecordingStats(void* client);
+    bool startRtpStream(void* client, const char* host, uint16_t port, uint32_t packetMs, uint8_t payloadType, uint32_t ssrc, uint32_t bufferMs);
+    bool stopRtpStream(void* client);
+    RtpSenderStats getRtpStreamStats(void* client);
+    uint32_t getRtpStreamSsrc(void* client);
+    bool setHistory(void* client, uint32_t historyMs);
+    uint64_t getHistoryFrameCount(void* client, uint32_t fromMs, uint32_t toMs);
+    uint64_t copyHistory(void* client, uint32_t fromMs, uint32_t toMs, char* out, uint64_t maximumFrameCount);
+    bool saveHistory(void* client, const char* path, uint32_t fromMs, uint32_t toMs, uint64_t* frameCount);
+    unsigned int getHistoryFrameSize(void* client);
+    bool setOutputSampleFormat(void* client, SampleFormat sampleFormat, bool dither);
+    bool setOutputSampleRate(void* client, uint32_t sampleRate, ResamplerQuality quality);
+    bool setOutputChannels(void* client, uint32_t numChannels, const float* matrix);
+    uint32_t readFramesPlanar(void* client, float *out, uint32_t maximumFrameCount);
+    bool setBlocking(void* client, uint32_t blockFrames, uint32_t hopFrames);
+    uint32_t getBlockFrames(void* client);
+    uint32_t readBlocks(void* client, char *out, uint32_t maximumBlocks);
+    bool setGate(void* client, GateMode mode, float thresholdDb, uint32_t hangoverMs);
+    bool setFeatures(void* client, const FeatureOptions* options, bool deliverAudio);
+    FeatureFormat getFeatureFormat(void* client);
+    FeatureStats getFeatureStats(void* client);
+    uint32_t readFeatures(void* client, float *out, uint32_t maximumFrameCount);
+    GateState getGateState(void* client);
+    uint32_t takePacketFlags(void* client);
+    bool getChunkTiming(void* client, ChunkTiming* timing);
+    PacketCounters getPacketCounters(void* client);
+    LatencyStats getLatencyStats(void* client);
+    double getLatencyPercentile(void* client, double percentile);
+    // counts receives LatencyHistogram::bucketCount values
+    void getLatencyCounts(void* client, uint64_t* counts);
+    void resetLatency(void* client);
+    CaptureStats getStats(void* client);
+    bool startTrace(void* client, uint32_t maxEvents);
+    void stopTrace(void* client);
+    void getTrace(void* client, std::string* json);
+    bool setLevelMeter(void* client, uint32_t windowMs, bool truePeak);
+    uint32_t getLevels(void* client, float *out, uint32_t maximumValues);
+    bool setLevelsTarget(void* client, float *target, uint32_t length);
+    AudioCaptureFormat getOutputFormat(void* client);
+    void setCaptureNotify(void* client, CaptureNotifyCallback callback, void* context, uint32_t batchFrames, uint32_t batchMs);
+    void* subscribe(void* client, OverflowPolicy policy, SampleFormat sampleFormat, bool dither, uint32_t numChannels, const float* matrix);
+    void unsubscribe(void* client, void* subscriber);
+    AudioCaptureFormat getSubscriberFormat(void* client, void* subscriber);
+    uint64_t getBroadcastBlockedFrames(void* client);
+    uint32_t readSubscriber(void* subscriber, char *out, uint32_t maximumFrameCount);
+    uint32_t getSubscriberAvailableFrames(void* subscriber);
+    uint64_t getSubscriberDroppedFrames(void* subscriber);
+
+    // multi-device capture, see devicemixer.h. clients must have been started
+    // with float32 output at one sample rate, and for MIXER_MODE_MIX with the
+    // same channels. returns NULL otherwise. their capture threads must run
+    // while the mixer does, and nothing else may read their rings.
+    void* createDeviceMixer(void** clients, const float* gains, uint32_t numClients, MixerMode mode, uint32_t ringFrames);
+    void deleteDeviceMixer(void* mixer);
+    bool startDeviceMixer(void* mixer);
+    void stopDeviceMixer(void* mixer);
+    uint32_t readMixedFrames(void* mixer, float *out, uint32_t maximumFrameCount);
+    uint32_t getMixedAvailableFrames(void* mixer);
+    uint64_t getMixerOverflowFrames(void* mixer);
+    AudioCaptureFormat getMixerFormat(void* mixer);
+    uint32_t getMixerSourceCount(void* mixer);
+    bool getMixerSourceStats(void* mixer, uint32_t index, MixerSourceStats* stats);
 }
@@ -0,0 +1,312 @@
+#include "capturepipeline.h"
+
+#include <string.h>
+
+void CapturePipeline::setInputFormat(unsigned int frameSize, unsigned int numChannels, unsigned int sampleRate, CaptureSampleType sampleType) {
+  inputFrameSize = frameSize;
+  this->numChannels = numChannels;
+  this->sampleRate = sampleRate;
+  inputSampleType = sampleType;
+  inputDecodable = sampleType != CAPTURE_SAMPLE_UNKNOWN && numChannels != 0
+    && frameSize >= numChannels * getCaptureSampleBytes(sampleType);
+}
+
+void CapturePipeline::setMaxPacketFrames(uint32_t frames) {
+  maxPacketFrames = frames;
+}
+
+void CapturePipeline::setOutputSampleFormat(SampleFormat format, bool dither) {
+  outputSampleFormat = format;
+  converter.setFormat(format, dither);
+}
+
+void CapturePipeline::setOutputSampleRate(unsigned int sampleRate, ResamplerQuality quality) {
+  outputSampleRate = sampleRate;
+  resamplerQuality = quality;
+}
+
+void CapturePipeline::setOutputChannels(unsigned int numChannels, const float* matrix) {
+  outputChannels = numChannels;
+  if (matrix != NULL) {
+    outputMatrix.assign(matrix, matrix + (size_t)numChannels * this->numChannels);
+  } else {
+    outputMatrix.clear();
+  }
+}
+
+void CapturePipeline::setLevelMeter(unsigned int windowMs, bool truePeak) {
+  meterWindowMs = windowMs;
+  meterTruePeak = truePeak;
+}
+
+void CapturePipeline::setFeatures(const FeatureOptions* options, bool deliverAudio) {
+  featuresEnabled = options != NULL;
+  if (options != NULL) {
+    featureOptions = *options;
+  }
+  this->deliverAudio = options == NULL || deliverAudio;
+}
+
+void CapturePipeline::setGate(GateMode mode, float thresholdDb, unsigned int hangoverMs) {
+  gateMode = mode;
+  gateThresholdDb = thresholdDb;
+  gateHangoverMs = hangoverMs;
+}
+
+void CapturePipeline::setBroadcast(BroadcastRing* broadcast) {
+  this->broadcast = broadcast;
+}
+
+void CapturePipeline::setSharedRing(SharedRing* sharedRing) {
+  this->sharedRing = sharedRing;
+}
+
+bool CapturePipeline::hasSharedRing() {
+  return sharedRing != NULL;
+}
+
+bool CapturePipeline::prepare() {
+  packetFrames = maxPacketFrames != 0 ? maxPacketFrames : sampleRate;
+
+  // packed float32 is processed in place
+  decoding = inputDecodable
+    && (inputSampleType != CAPTURE_SAMPLE_FLOAT32 || inputFrameSize != numChannels * sizeof(float));
+  if (decoding && !decoder.configure(inputSampleType, numChannels, inputFrameSize)) {
+    decoding = false;
+    return false;
+  }
+  if (decoding) {
+    decodeBuffer.assign((size_t)packetFrames * numChannels, 0.0f);
+  }
+  // silent packets of undecoded input are replaced by these zeros
+  silenceBuffer.assign(decoding ? 0 : (size_t)packetFrames * inputFrameSize, 0);
+
+  mixing = inputDecodable && outputChannels != 0
+    && (outputChannels != numChannels || !outputMatrix.empty());
+  if (mixing) {
+    bool configured = outputMatrix.empty()
+      ? mixer.configureDownmix(numChannels, outputChannels)
+      : mixer.configureMatrix(numChannels, outputChannels, outputMatrix.data());
+    if (!configured) {
+      mixing = false;
+      return false;
+    }
+    mixBuffer.assign((size_t)packetFrames * outputChannels, 0.0f);
+  }
+
+  // resample after mixing so fewer channels go through the filter
+  resampling = inputDecodable && outputSampleRate != 0 && outputSampleRate != sampleRate;
+  if (resampling && !resampler.configure(sampleRate, outputSampleRate, getOutputChannels(), resamplerQuality)) {
+    resampling = false;
+    return false;
+  }
+  if (resampling) {
+    resampler.reserve(packetFrames);
+    resampleBuffer.assign(resampler.getMaxOutputFrames(packetFrames) * getOutputChannels(), 0.0f);
+  }
+
+  metering = inputDecodable && meterWindowMs != 0;
+  if (metering && !meter.configure(getOutputChannels(), getOutputSampleRate(), meterWindowMs, meterTruePeak)) {
+    metering = false;
+    return false;
+  }
+
+  extracting = inputDecodable && featuresEnabled;
+  if (extracting && !features.configure(featureOptions, getOutputChannels(), getOutputSampleRate())) {
+    extracting = false;
+    return false;
+  }
+
+  gating = inputDecodable && gateMode != GATE_MODE_OFF;
+  if (gating && !gate.configure(gateMode, getOutputChannels(), getOutputSampleRate(), gateThresholdDb, gateHangoverMs)) {
+    gating = false;
+    return false;
+  }
+  if (gating) {
+    size_t gateInputFrames = resampling ? resampler.getMaxOutputFrames(packetFrames) : packetFrames;
+    gateBuffer.assign(gate.getMaxOutputFrames(gateInputFrames) * getOutputChannels(), 0.0f);
+  }
+  return true;
+}
+
+SampleFormat CapturePipeline::getOutputSampleFormat() {
+  return outputSampleFormat;
+}
+
+unsigned int CapturePipeline::getOutputFrameSize() {
+  if (!inputDecodable) {
+    return inputFrameSize;
+  }
+  return getOutputChannels() * getSampleFormatBytes(outputSampleFormat);
+}
+
+unsigned int CapturePipeline::getOutputChannels() {
+  if (inputDecodable && outputChannels != 0) {
+    return outputChannels;
+  }
+  return numChannels;
+}
+
+unsigned int CapturePipeline::getInputSampleRate() {
+  return sampleRate;
+}
+
+unsigned int CapturePipeline::getOutputSampleRate() {
+  if (inputDecodable && outputSampleRate != 0) {
+    return outputSampleRate;
+  }
+  return sampleRate;
+}
+
+unsigned int CapturePipeline::getOutputBitsPerSample() {
+  if (!inputDecodable) {
+    return numChannels > 0 ? inputFrameSize * 8 / numChannels : 0;
+  }
+  return getSampleFormatBytes(outputSampleFormat) * 8;
+}
+
+bool CapturePipeline::isOutputFormatValid() {
+  return inputDecodable;
+}
+
+LevelMeter* CapturePipeline::getLevelMeter() {
+  return &meter;
+}
+
+VoiceGate* CapturePipeline::getGate() {
+  return &gate;
+}
+
+FeatureExtractor* CapturePipeline::getFeatureExtractor() {
+  return extracting ? &features : NULL;
+}
+
+uint32_t CapturePipeline::processPacket(const char* data, uint32_t nFrames, uint32_t flags, RingBuffer* ring, uint32_t* framesWritten) {
+  // the buffers hold packetFrames; growing them here would allocate on the
+  // capture thread. the device never delivers more than its buffer, so this
+  // is a backend error; the caller counts the lost frames as overflow.
+  if (nFrames > packetFrames) {
+    lastCount = 0;
+    *framesWritten = 0;
+    return inputDecodable ? (uint32_t)((uint64_t)nFrames * getOutputSampleRate() / sampleRate) : nFrames;
+  }
+
+  // WASAPI may leave garbage in a silent packet; it must be read as zeros.
+  // decoded input gets float zeros instead, since zero bytes are not silence
+  // for every sample type.
+  bool silent = (flags & CAPTURE_PACKET_SILENT) != 0;
+  if (silent && !decoding) {
+    data = silenceBuffer.data();
+  }
+
+  if (!inputDecodable) {
+    unsigned int frameSize = inputFrameSize;
+    size_t bytes = (size_t)nFrames * frameSize;
+    size_t written = sharedRing != NULL ? sharedRing->write(data, bytes) : ring->write(data, bytes);
+    *framesWritten = (uint32_t)(written / frameSize);
+    if (sharedRing != NULL && *framesWritten < nFrames) {
+      sharedRing->addOverflowFrames(nFrames - *framesWritten);
+    }
+    lastRaw = data;
+    lastCount = nFrames;
+    return nFrames;
+  }
+
+  const float* frames = (const float*)data;
+  size_t count = nFrames;
+
+  if (decoding) {
+    if (silent) {
+      memset(decodeBuffer.data(), 0, count * numChannels * sizeof(float));
+    } else {
+      decoder.decode(data, count, decodeBuffer.data());
+    }
+    frames = decodeBuffer.data();
+  }
+
+  if (mixing) {
+    mixer.process(frames, count, mixBuffer.data());
+    frames = mixBuffer.data();
+  }
+
+  if (resampling) {
+    count = resampler.process(frames, count, resampleBuffer.data());
+    frames = resampleBuffer.data();
+  }
+
+  if (metering) {
+    meter.process(frames, count);
+  }
+  if (extracting) {
+    features.process(frames, count);
+  }
+
+  lastFrames = frames;
+  lastCount = count;
+
+  if (gating) {
+    count = gate.process(frames, count, gateBuffer.data());
+    frames = gateBuffer.data();
+  }
+
+  if (broadcast != NULL && broadcast->hasReaders()) {
+    broadcast->write(frames, count);
+  }
+
+  if (extracting && !deliverAudio) {
+    *framesWritten = 0;
+    return 0;
+  }
+
+  if (sharedRing != NULL) {
+    *framesWritten = writeFrames(frames, count, sharedRing);
+    if (*framesWritten < count) {
+      sharedRing->addOverflowFrames((uint32_t)(count - *framesWritten));
+    }
+    return (uint32_t)count;
+  }
+  *framesWritten = writeFrames(frames, count, ring);
+  return (uint32_t)count;
+}
+
+uint32_t CapturePipeline::writeLastPacket(RingBuffer* ring) {
+  return writeLast(ring);
+}
+
+uint32_t CapturePipeline::writeLastPacket(HistoryBuffer* history) {
+  return writeLast(history);
+}
+
+template <class Ring>
+uint32_t CapturePipeline::writeLast(Ring* ring) {
+  if (!inputDecodable) {
+    size_t written = ring->write(lastRaw, lastCount * inputFrameSize);
+    return (uint32_t)(written / inputFrameSize);
+  }
+  return writeFrames(lastFrames, lastCount, ring);
+}
+
+uint32_t CapturePipeline::getLastPacketFrames() {
+  return (uint32_t)lastCount;
+}
+
+// convert straight into the ring. the ring holds a whole number of output
+// frames, so both regions hold whole frames.
+// Ring is a RingBuffer, a SharedRing or a HistoryBuffer
+template <class Ring>
+uint32_t CapturePipeline::writeFrames(const float* frames, size_t nFrames, Ring* ring) {
+  unsigned int outputFrameSize = getOutputFrameSize();
+  unsigned int outputChannels = getOutputChannels();
+
+  RingRegions regions;
+  size_t bytes = ring->beginWrite(nFrames * outputFrameSize, &regions);
+  size_t firstFrames = regions.firstBytes / outputFrameSize;
+  size_t secondFrames = regions.secondBytes / outputFrameSize;
+  converter.convert(frames, firstFrames * outputChannels, regions.first);
+  if (secondFrames > 0) {
+    converter.convert(frames + firstFrames * outputChannels, secondFrames * outputChannels, regions.second);
+  }
+  ring->commitWrite(bytes);
+
+  return (uint32_t)(firstFrames + secondFrames);
+}
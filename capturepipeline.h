@@ -0,0 +1,166 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "broadcastring.h"
+#include "capturesource.h"
+#include "channelmixer.h"
+#include "featureextractor.h"
+#include "historybuffer.h"
+#include "levelmeter.h"
+#include "resampler.h"
+#include "ringbuffer.h"
+#include "sampleconvert.h"
+#include "sampledecode.h"
+#include "sharedring.h"
+#include "voicegate.h"
+
+// processing the capture thread applies to each packet before it lands in the
+// ring. input is the device mix format; output is whatever the JS side asked
+// for. with the default settings the packet bytes are copied through untouched.
+class CapturePipeline {
+private:
+  unsigned int inputFrameSize = 0;
+  unsigned int numChannels = 0;
+  unsigned int sampleRate = 0;
+  CaptureSampleType inputSampleType = CAPTURE_SAMPLE_UNKNOWN;
+  // largest packet the buffers below are sized for by prepare()
+  uint32_t maxPacketFrames = 0;
+  uint32_t packetFrames = 0;
+  // input of a known sample type; everything below works on its float32
+  // decoding. other input is copied through as raw bytes.
+  bool inputDecodable = false;
+  // input other than packed float32 is decoded into decodeBuffer first
+  bool decoding = false;
+  SampleDecoder decoder;
+  std::vector<float> decodeBuffer;
+
+  SampleFormat outputSampleFormat = SAMPLE_FORMAT_FLOAT32;
+  SampleConverter converter;
+
+  // 0 keeps the device channels. an empty matrix means the standard downmix.
+  unsigned int outputChannels = 0;
+  std::vector<float> outputMatrix;
+  bool mixing = false;
+  ChannelMixer mixer;
+  std::vector<float> mixBuffer;
+
+  // 0 keeps the device rate
+  unsigned int outputSampleRate = 0;
+  ResamplerQuality resamplerQuality = RESAMPLER_QUALITY_MEDIUM;
+  bool resampling = false;
+  Resampler resampler;
+  std::vector<float> resampleBuffer;
+
+  // 0 disables metering
+  unsigned int meterWindowMs = 0;
+  bool meterTruePeak = false;
+  bool metering = false;
+  LevelMeter meter;
+
+  FeatureOptions featureOptions = {};
+  bool featuresEnabled = false;
+  bool extracting = false;
+  // false when only features are wanted: the ring gets no audio
+  bool deliverAudio = true;
+  FeatureExtractor features;
+
+  GateMode gateMode = GATE_MODE_OFF;
+  float gateThresholdDb = 0.0f;
+  unsigned int gateHangoverMs = 0;
+  bool gating = false;
+  VoiceGate gate;
+  std::vector<float> gateBuffer;
+
+  // float output for subscribers, written once per packet
+  BroadcastRing* broadcast = NULL;
+
+  // replaces the ring passed to processPacket() as the audio destination
+  SharedRing* sharedRing = NULL;
+
+  // zeros standing in for packets flagged silent
+  std::vector<char> silenceBuffer;
+
+  // output of the last processPacket() before gating, for writeLastPacket()
+  const char* lastRaw = NULL;
+  const float* lastFrames = NULL;
+  size_t lastCount = 0;
+
+  template <class Ring>
+  uint32_t writeFrames(const float* frames, size_t nFrames, Ring* ring);
+  template <class Ring>
+  uint32_t writeLast(Ring* ring);
+
+public:
+  // packets of any known sample type are decoded to float32 and processed;
+  // packets of CAPTURE_SAMPLE_UNKNOWN samples can only be copied through.
+  void setInputFormat(unsigned int frameSize, unsigned int numChannels, unsigned int sampleRate, CaptureSampleType sampleType);
+  // largest packet processPacket() takes, in input frames: the device buffer
+  // size. 0 means one second of input.
+  void setMaxPacketFrames(uint32_t frames);
+
+  void setOutputSampleFormat(SampleFormat format, bool dither);
+  void setOutputSampleRate(unsigned int sampleRate, ResamplerQuality quality);
+  // matrix: numChannels rows of (device channels) coefficients, or NULL for
+  // the standard downmix to mono or stereo.
+  void setOutputChannels(unsigned int numChannels, const float* matrix);
+  // measure levels of the output, before sample format conversion. 0 disables.
+  void setLevelMeter(unsigned int windowMs, bool truePeak);
+  // compute spectral features of the output, before gating and sample format
+  // conversion. NULL disables. without deliverAudio the ring gets no audio
+  // while features are computed.
+  void setFeatures(const FeatureOptions* options, bool deliverAudio);
+  // suppress silent or inactive spans before they reach the ring.
+  void setGate(GateMode mode, float thresholdDb, unsigned int hangoverMs);
+  // also write the gated float output, before sample format conversion, to
+  // broadcast whenever it has readers. must be allocated with
+  // getOutputChannels() channels. NULL to disable; not while processing.
+  void setBroadcast(BroadcastRing* broadcast);
+  // write the output to sharedRing instead of the ring passed to
+  // processPacket(), which then gets nothing. NULL to disable; not while
+  // processing.
+  void setSharedRing(SharedRing* sharedRing);
+
+  // set up the processing stages for the current input and output formats and
+  // reset their state, and allocate everything processing a packet needs.
+  // call before the first packet of each capture run. returns false if the
+  // requested conversion is not supported.
+  bool prepare();
+
+  unsigned int getInputSampleRate();
+  SampleFormat getOutputSampleFormat();
+  unsigned int getOutputFrameSize();
+  unsigned int getOutputChannels();
+  unsigned int getOutputSampleRate();
+  unsigned int getOutputBitsPerSample();
+  // true if output is float32 or one of the converted integer formats, false
+  // if unsupported input is passed through as raw device bytes.
+  bool isOutputFormatValid();
+  // true while output goes to a shared ring instead of the ring
+  bool hasSharedRing();
+
+  // configured by prepare(); only meters float input.
+  LevelMeter* getLevelMeter();
+  VoiceGate* getGate();
+  // NULL unless prepare() set up feature extraction
+  FeatureExtractor* getFeatureExtractor();
+
+  // process one packet of nFrames input frames and write the result to ring,
+  // or to the shared ring if one is set.
+  // packets flagged CAPTURE_PACKET_SILENT are processed as zeros, whatever
+  // their data. returns the number of output frames that passed the gate;
+  // *framesWritten receives how many of them fit in the ring. a packet larger
+  // than setMaxPacketFrames() is dropped: none of its output frames are
+  // written, and writeLastPacket() writes nothing.
+  uint32_t processPacket(const char* data, uint32_t nFrames, uint32_t flags, RingBuffer* ring, uint32_t* framesWritten);
+
+  // write the output of the last processPacket() to a second ring as well,
+  // without gating. only valid until the packet passed to processPacket() is
+  // released. returns the number of frames that fit.
+  uint32_t writeLastPacket(RingBuffer* ring);
+  // the same into a history, which always takes the whole packet
+  uint32_t writeLastPacket(HistoryBuffer* history);
+  // frames writeLastPacket() tries to write
+  uint32_t getLastPacketFrames();
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+
+// interface between the capture thread and whatever produces audio packets.
+// AudioCaptureClient implements it on top of IAudioCaptureClient; a fake
+// implementation can drive the capture thread on platforms without WASAPI.
+//
+// the calling sequence mirrors IAudioCaptureClient: getNextPacketSize(), then
+// acquirePacket() to get a pointer to the packet data, then releasePacket()
+// once the data has been consumed.
+
+// packet flags, same values as AUDCLNT_BUFFERFLAGS_xxx
+#define CAPTURE_PACKET_DISCONTINUITY 0x1
+#define CAPTURE_PACKET_SILENT 0x2
+#define CAPTURE_PACKET_TIMESTAMP_ERROR 0x4
+
+class CaptureSource {
+public:
+  virtual ~CaptureSource() {}
+
+  // called on the capture thread before the first and after the last packet.
+  virtual void onCaptureThreadStart() {}
+  virtual void onCaptureThreadStop() {}
+
+  // block until the source signals that a packet may be available, or until
+  // timeoutMs has elapsed. returns false on timeout.
+  virtual bool waitForPacket(unsigned int timeoutMs) = 0;
+
+  // number of frames in the next packet, 0 if no packet is available.
+  virtual uint32_t getNextPacketSize() = 0;
+
+  // get the next packet. *data stays valid until releasePacket() is called.
+  // *devicePosition receives the device position of the first frame and
+  // *timestamp the performance counter time it was captured, in 100 ns units.
+  // returns the number of frames in the packet.
+  virtual uint32_t acquirePacket(const char** data, uint32_t* flags, uint64_t* devicePosition, uint64_t* timestamp) = 0;
+
+  virtual void releasePacket(uint32_t nFrames) = 0;
+
+  // size of one frame of packet data in bytes.
+  virtual unsigned int getFrameSize() = 0;
+};
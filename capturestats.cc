@@ -0,0 +1,150 @@
+#include "capturestats.h"
+
+#include <stdio.h>
+
+static const char* traceEventNames[] = { "wait", "GetBuffer", "process", "consumers", "notify", "copy" };
+
+// a single writer, so a plain compare and store is enough
+static void storeMax(std::atomic<uint64_t>* value, uint64_t candidate) {
+  if (candidate > value->load(std::memory_order_relaxed)) {
+    value->store(candidate, std::memory_order_relaxed);
+  }
+}
+
+static DurationStats getDurationStats(uint64_t count, uint64_t totalNs, uint64_t maxNs) {
+  DurationStats returnValue = {
+    count,
+    count > 0 ? (double)totalNs / count / 1000.0 : 0,
+    (double)maxNs / 1000.0
+  };
+  return returnValue;
+}
+
+void CaptureCounters::reset() {
+  packets.store(0);
+  frames.store(0);
+  bytesCopied.store(0);
+  acquireCount.store(0);
+  acquireNs.store(0);
+  acquireMaxNs.store(0);
+  processCount.store(0);
+  processNs.store(0);
+  processMaxNs.store(0);
+  ringHighWaterFrames.store(0);
+}
+
+void CaptureCounters::addEvent(TraceEventType type, uint64_t startNs, uint64_t endNs, uint32_t frames, uint32_t ringFrames) {
+  size_t count = eventCount.load(std::memory_order_relaxed);
+  if (count >= events.size()) {
+    droppedEvents.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  TraceEvent& event = events[count];
+  event.startNs = startNs;
+  event.durationNs = endNs - startNs;
+  event.frames = frames;
+  event.ringFrames = ringFrames;
+  event.type = (uint8_t)type;
+  eventCount.store(count + 1, std::memory_order_release);
+}
+
+void CaptureCounters::addAcquire(uint64_t startNs, uint32_t nFrames) {
+  uint64_t endNs = now();
+  uint64_t duration = endNs - startNs;
+  packets.fetch_add(1, std::memory_order_relaxed);
+  frames.fetch_add(nFrames, std::memory_order_relaxed);
+  acquireCount.fetch_add(1, std::memory_order_relaxed);
+  acquireNs.fetch_add(duration, std::memory_order_relaxed);
+  storeMax(&acquireMaxNs, duration);
+  if (isTracing()) {
+    addEvent(TRACE_ACQUIRE, startNs, endNs, nFrames, 0);
+  }
+}
+
+void CaptureCounters::addProcess(uint64_t startNs, uint32_t nFrames, uint64_t bytes, uint64_t ringFrames) {
+  uint64_t endNs = now();
+  uint64_t duration = endNs - startNs;
+  bytesCopied.fetch_add(bytes, std::memory_order_relaxed);
+  processCount.fetch_add(1, std::memory_order_relaxed);
+  processNs.fetch_add(duration, std::memory_order_relaxed);
+  storeMax(&processMaxNs, duration);
+  storeMax(&ringHighWaterFrames, ringFrames);
+  if (isTracing()) {
+    addEvent(TRACE_PROCESS, startNs, endNs, nFrames, (uint32_t)ringFrames);
+  }
+}
+
+void CaptureCounters::addCopy(uint64_t startNs, uint32_t nFrames, uint64_t bytes) {
+  bytesCopied.fetch_add(bytes, std::memory_order_relaxed);
+  if (isTracing()) {
+    addEvent(TRACE_COPY, startNs, now(), nFrames, 0);
+  }
+}
+
+void CaptureCounters::addStep(TraceEventType type, uint64_t startNs) {
+  if (isTracing()) {
+    addEvent(type, startNs, now(), 0, 0);
+  }
+}
+
+CaptureStats CaptureCounters::getStats() {
+  CaptureStats returnValue = {
+    packets.load(std::memory_order_relaxed),
+    frames.load(std::memory_order_relaxed),
+    bytesCopied.load(std::memory_order_relaxed),
+    getDurationStats(acquireCount.load(std::memory_order_relaxed), acquireNs.load(std::memory_order_relaxed),
+      acquireMaxNs.load(std::memory_order_relaxed)),
+    getDurationStats(processCount.load(std::memory_order_relaxed), processNs.load(std::memory_order_relaxed),
+      processMaxNs.load(std::memory_order_relaxed)),
+    ringHighWaterFrames.load(std::memory_order_relaxed),
+    eventCount.load(std::memory_order_relaxed),
+    droppedEvents.load(std::memory_order_relaxed)
+  };
+  return returnValue;
+}
+
+void CaptureCounters::startTrace(size_t maxEvents) {
+  tracing.store(false);
+  origin = std::chrono::steady_clock::now();
+  events.assign(maxEvents, TraceEvent());
+  eventCount.store(0);
+  droppedEvents.store(0);
+  tracing.store(maxEvents > 0);
+}
+
+void CaptureCounters::stopTrace() {
+  tracing.store(false);
+}
+
+// Chrome's trace event format: complete ("X") events with the frames as
+// arguments, plus a counter ("C") of the ring fill after every packet the
+// capture thread processed. timestamps are in microseconds.
+std::string CaptureCounters::getTraceJson() {
+  size_t count = eventCount.load(std::memory_order_acquire);
+  std::string json;
+  json.reserve(200 + count * 120);
+  json += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"audio capture\"}}";
+  char line[256];
+  for (size_t i = 0; i < count; i++) {
+    const TraceEvent& event = events[i];
+    double ts = event.startNs / 1000.0;
+    snprintf(line, sizeof(line),
+      ",\n{\"name\":\"%s\",\"cat\":\"capture\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f",
+      traceEventNames[event.type], ts, event.durationNs / 1000.0);
+    json += line;
+    if (event.frames > 0) {
+      snprintf(line, sizeof(line), ",\"args\":{\"frames\":%u}", event.frames);
+      json += line;
+    }
+    json += "}";
+    if (event.type == TRACE_PROCESS) {
+      snprintf(line, sizeof(line),
+        ",\n{\"name\":\"ring\",\"cat\":\"capture\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"args\":{\"frames\":%u}}",
+        (event.startNs + event.durationNs) / 1000.0, event.ringFrames);
+      json += line;
+    }
+  }
+  json += "\n]}\n";
+  return json;
+}
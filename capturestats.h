@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+typedef struct DurationStats {
+  uint64_t count;
+  double meanUs;
+  double maxUs;
+} DurationStats;
+
+typedef struct CaptureStats {
+  uint64_t packets;
+  uint64_t frames; // device frames
+  uint64_t bytesCopied; // into the ring, or the caller's buffer without the capture thread
+  DurationStats acquire; // getting a packet from the device (GetBuffer)
+  DurationStats process; // pipeline and ring write, capture thread only
+  uint64_t ringHighWaterFrames; // fullest the capture thread saw the ring
+  uint64_t traceEvents;
+  uint64_t droppedTraceEvents; // recorded while the trace buffer was full
+} CaptureStats;
+
+// where capture time goes, cheap enough to stay on in production: a few
+// relaxed atomics and two clock reads per packet.
+//
+// like PacketAccounting, the add functions are called by whichever thread
+// reads packets (only one at a time) and everything can be read from any
+// thread.
+//
+// with tracing on, every step of every packet also becomes an event in a
+// buffer allocated up front; getTraceJson() turns the events recorded so far
+// into Chrome trace event JSON, for chrome://tracing or Perfetto.
+class CaptureCounters {
+public:
+  typedef enum TraceEventType {
+    TRACE_WAIT,      // capture thread waiting for the device
+    TRACE_ACQUIRE,   // GetBuffer
+    TRACE_PROCESS,   // pipeline and ring write
+    TRACE_CONSUMERS, // recorders, history and network
+    TRACE_NOTIFY,    // the notify callback
+    TRACE_COPY       // copying a packet to the caller, without the capture thread
+  } TraceEventType;
+
+private:
+  typedef struct TraceEvent {
+    uint64_t startNs;
+    uint64_t durationNs;
+    uint32_t frames;
+    uint32_t ringFrames;
+    uint8_t type;
+  } TraceEvent;
+
+  std::atomic<uint64_t> packets{0};
+  std::atomic<uint64_t> frames{0};
+  std::atomic<uint64_t> bytesCopied{0};
+  std::atomic<uint64_t> acquireCount{0};
+  std::atomic<uint64_t> acquireNs{0};
+  std::atomic<uint64_t> acquireMaxNs{0};
+  std::atomic<uint64_t> processCount{0};
+  std::atomic<uint64_t> processNs{0};
+  std::atomic<uint64_t> processMaxNs{0};
+  std::atomic<uint64_t> ringHighWaterFrames{0};
+
+  std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+  std::vector<TraceEvent> events;
+  std::atomic<bool> tracing{false};
+  // events [0, eventCount) are complete
+  std::atomic<size_t> eventCount{0};
+  std::atomic<uint64_t> droppedEvents{0};
+
+  void addEvent(TraceEventType type, uint64_t startNs, uint64_t endNs, uint32_t frames, uint32_t ringFrames);
+
+public:
+  // nanoseconds on the clock all the add functions take
+  uint64_t now() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - origin).count();
+  }
+
+  // counters only; not while a thread reads packets
+  void reset();
+
+  // a packet of nFrames taken from the device, acquisition having started
+  // at startNs
+  void addAcquire(uint64_t startNs, uint32_t nFrames);
+  // nFrames processed from startNs on, leaving ringFrames in the ring
+  void addProcess(uint64_t startNs, uint32_t nFrames, uint64_t bytes, uint64_t ringFrames);
+  // bytes copied to the caller from startNs on
+  void addCopy(uint64_t startNs, uint32_t nFrames, uint64_t bytes);
+  // trace only steps: wait, consumers, notify
+  void addStep(TraceEventType type, uint64_t startNs);
+
+  CaptureStats getStats();
+
+  // allocates room for maxEvents events and starts recording, with the
+  // trace timestamps counting from now; not while a thread reads packets.
+  // stopTrace() may be called any time and keeps the events for
+  // getTraceJson().
+  void startTrace(size_t maxEvents);
+  void stopTrace();
+  bool isTracing() {
+    return tracing.load(std::memory_order_relaxed);
+  }
+  std::string getTraceJson();
+};
@@ -0,0 +1,169 @@
+#include "capturethread.h"
+
+#include <chrono>
+
+// packets the reader may fall behind before timeline entries are dropped,
+// about 40 s of 10 ms packets
+static const size_t timelineCapacity = 4096;
+
+CaptureThread::~CaptureThread() {
+  stop();
+}
+
+bool CaptureThread::start(CaptureSource* source, CapturePipeline* pipeline, RingBuffer* ring, unsigned int waitTimeoutMs) {
+  if (thread.joinable()) {
+    return false;
+  }
+  this->source = source;
+  this->pipeline = pipeline;
+  this->ring = ring;
+  this->waitTimeoutMs = waitTimeoutMs;
+  overflowFrames.store(0);
+  timeline.configure(timelineCapacity, pipeline->getInputSampleRate(), pipeline->getOutputSampleRate());
+  running.store(true);
+  thread = std::thread(&CaptureThread::run, this);
+  return true;
+}
+
+void CaptureThread::stop() {
+  running.store(false);
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+void CaptureThread::setNotify(CaptureNotifyCallback callback, void* context, uint32_t batchFrames, unsigned int batchMs) {
+  notifyCallback = callback;
+  notifyContext = context;
+  this->batchFrames = batchFrames;
+  this->batchMs = batchMs;
+}
+
+void CaptureThread::setRecorder(CaptureRecorder* recorder) {
+  this->recorder = recorder;
+}
+
+void CaptureThread::setFlacRecorder(FlacRecorder* recorder) {
+  flacRecorder = recorder;
+}
+
+void CaptureThread::setRtpSender(RtpSender* sender) {
+  rtpSender = sender;
+}
+
+void CaptureThread::setHistory(HistoryBuffer* history) {
+  this->history = history;
+}
+
+void CaptureThread::setCounters(CaptureCounters* counters) {
+  this->counters = counters;
+}
+
+bool CaptureThread::isRunning() {
+  return running.load();
+}
+
+uint64_t CaptureThread::getOverflowFrames() {
+  return overflowFrames.load(std::memory_order_relaxed);
+}
+
+uint32_t CaptureThread::takePacketFlags() {
+  return packetFlags.exchange(0, std::memory_order_relaxed);
+}
+
+bool CaptureThread::getChunkTiming(uint64_t startFrame, uint64_t endFrame, ChunkTiming* timing) {
+  return timeline.lookup(startFrame, endFrame, timing);
+}
+
+void CaptureThread::run() {
+  source->onCaptureThreadStart();
+
+  uint32_t pendingFrames = 0;
+  std::chrono::steady_clock::time_point batchStart;
+
+  while (running.load(std::memory_order_relaxed)) {
+    uint64_t waitStart = counters != NULL ? counters->now() : 0;
+    source->waitForPacket(waitTimeoutMs);
+    if (counters != NULL) {
+      counters->addStep(CaptureCounters::TRACE_WAIT, waitStart);
+    }
+    uint32_t frames = drainSource();
+
+    if (notifyCallback == NULL) {
+      continue;
+    }
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (pendingFrames == 0 && frames > 0) {
+      batchStart = now;
+    }
+    pendingFrames += frames;
+    if (pendingFrames > 0
+      && (pendingFrames >= batchFrames
+        || now - batchStart >= std::chrono::milliseconds(batchMs))) {
+      uint64_t notifyStart = counters != NULL ? counters->now() : 0;
+      notifyCallback(notifyContext);
+      if (counters != NULL) {
+        counters->addStep(CaptureCounters::TRACE_NOTIFY, notifyStart);
+      }
+      pendingFrames = 0;
+    }
+  }
+
+  source->onCaptureThreadStop();
+}
+
+// returns the number of output frames written to the ring.
+uint32_t CaptureThread::drainSource() {
+  uint32_t framesWritten = 0;
+  while (running.load(std::memory_order_relaxed) && source->getNextPacketSize() > 0) {
+    const char* data;
+    uint32_t flags;
+    uint64_t devicePosition;
+    uint64_t timestamp;
+    uint32_t nFrames = source->acquirePacket(&data, &flags, &devicePosition, &timestamp);
+    if (flags != 0) {
+      packetFlags.fetch_or(flags, std::memory_order_relaxed);
+    }
+    // frames in a shared ring are read from JS, never through the ring whose
+    // positions key the timeline, so they are not timed
+    if (!pipeline->hasSharedRing()) {
+      timeline.push(ring->writePosition() / pipeline->getOutputFrameSize(), devicePosition, timestamp, flags);
+    }
+
+    uint64_t processStart = counters != NULL ? counters->now() : 0;
+    uint32_t written;
+    uint32_t produced = pipeline->processPacket(data, nFrames, flags, ring, &written);
+    if (written < produced) {
+      // the reader has fallen more than a full ring behind. drop the newest
+      // audio rather than blocking the device, and keep count so the reader
+      // can tell there is a gap.
+      overflowFrames.fetch_add(produced - written, std::memory_order_relaxed);
+    }
+    framesWritten += written;
+    uint64_t consumersStart = 0;
+    if (counters != NULL) {
+      unsigned int frameSize = pipeline->getOutputFrameSize();
+      counters->addProcess(processStart, nFrames, (uint64_t)written * frameSize, ring->readAvailable() / frameSize);
+      consumersStart = counters->now();
+    }
+
+    if (recorder != NULL) {
+      recorder->recordPacket(pipeline, flags, devicePosition, timestamp);
+    }
+    if (flacRecorder != NULL) {
+      flacRecorder->recordPacket(pipeline);
+    }
+    if (history != NULL) {
+      pipeline->writeLastPacket(history);
+    }
+    if (rtpSender != NULL) {
+      rtpSender->sendPacket(pipeline, devicePosition, nFrames);
+    }
+    if (counters != NULL) {
+      counters->addStep(CaptureCounters::TRACE_CONSUMERS, consumersStart);
+    }
+
+    source->releasePacket(nFrames);
+  }
+  return framesWritten;
+}
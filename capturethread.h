@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+#include "capturepipeline.h"
+#include "capturesource.h"
+#include "capturestats.h"
+#include "packettiming.h"
+#include "recorder.h"
+#include "rtpsender.h"
+#include "ringbuffer.h"
+
+// called on the capture thread when a batch of frames is ready to deliver.
+typedef void (*CaptureNotifyCallback)(void* context);
+
+// dedicated thread that drains a CaptureSource through a CapturePipeline into a
+// RingBuffer as soon as the source signals data, so delivery latency no longer depends on how often
+// JS polls. the JS side reads from the ring at its own pace.
+class CaptureThread {
+private:
+  std::thread thread;
+  std::atomic<bool> running{false};
+
+  CaptureSource* source = NULL;
+  CapturePipeline* pipeline = NULL;
+  RingBuffer* ring = NULL;
+  unsigned int waitTimeoutMs = 10;
+
+  // output frames that were produced while the ring was full and had to be
+  // discarded.
+  std::atomic<uint64_t> overflowFrames{0};
+
+  // CAPTURE_PACKET_xxx flags of all packets since the last takePacketFlags()
+  std::atomic<uint32_t> packetFlags{0};
+
+  // device position and timestamp of each packet by output frame
+  PacketTimeline timeline;
+
+  // batching of notifications: notify once batchFrames have accumulated or
+  // batchMs after the oldest un-notified frame arrived, whichever comes first.
+  CaptureNotifyCallback notifyCallback = NULL;
+  void* notifyContext = NULL;
+  uint32_t batchFrames = 0;
+  unsigned int batchMs = 0;
+
+  CaptureRecorder* recorder = NULL;
+  FlacRecorder* flacRecorder = NULL;
+  RtpSender* rtpSender = NULL;
+  HistoryBuffer* history = NULL;
+  CaptureCounters* counters = NULL;
+
+  void run();
+  uint32_t drainSource();
+
+public:
+  ~CaptureThread();
+
+  // waitTimeoutMs bounds how long the thread sleeps if the source never
+  // signals (e.g. loopback event callbacks are not delivered before
+  // Windows 10 1703), so the thread degrades to polling at that interval.
+  bool start(CaptureSource* source, CapturePipeline* pipeline, RingBuffer* ring, unsigned int waitTimeoutMs);
+  void stop();
+
+  // must be called before start(). pass NULL to disable notifications.
+  void setNotify(CaptureNotifyCallback callback, void* context, uint32_t batchFrames, unsigned int batchMs);
+
+  // must be called before start(). the recorder gets a copy of every packet
+  // written to the ring. pass NULL to stop recording.
+  void setRecorder(CaptureRecorder* recorder);
+  // the same for the FLAC recorder
+  void setFlacRecorder(FlacRecorder* recorder);
+  // and the network sender
+  void setRtpSender(RtpSender* sender);
+  // and the history, which keeps the last N frames of output
+  void setHistory(HistoryBuffer* history);
+  // and the counters that time every packet, see capturestats.h. the
+  // source times its own acquirePacket().
+  void setCounters(CaptureCounters* counters);
+
+  bool isRunning();
+  uint64_t getOverflowFrames();
+  uint32_t takePacketFlags();
+
+  // timing of the output frames [startFrame, endFrame), counted from the
+  // start of the run like RingBuffer::readPosition() / frame size. call from
+  // the ring's reader only, in order. returns false before the first packet.
+  bool getChunkTiming(uint64_t startFrame, uint64_t endFrame, ChunkTiming* timing);
+};
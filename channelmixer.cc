@@ -0,0 +1,211 @@
+#include "channelmixer.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "simd.h"
+
+// role of each channel in the WAVE channel order, by channel count
+typedef enum ChannelRole {
+  ROLE_LEFT,
+  ROLE_RIGHT,
+  ROLE_CENTER,
+  ROLE_LFE,
+  ROLE_SURROUND_LEFT,
+  ROLE_SURROUND_RIGHT,
+  ROLE_SURROUND_CENTER,
+} ChannelRole;
+
+static ChannelRole getChannelRole(unsigned int numChannels, unsigned int channel) {
+  static const ChannelRole quad[] = { ROLE_LEFT, ROLE_RIGHT, ROLE_SURROUND_LEFT, ROLE_SURROUND_RIGHT };
+  static const ChannelRole fivePointZero[] = { ROLE_LEFT, ROLE_RIGHT, ROLE_CENTER, ROLE_SURROUND_LEFT, ROLE_SURROUND_RIGHT };
+  static const ChannelRole surround[] = { ROLE_LEFT, ROLE_RIGHT, ROLE_CENTER, ROLE_LFE,
+    ROLE_SURROUND_LEFT, ROLE_SURROUND_RIGHT, ROLE_SURROUND_LEFT, ROLE_SURROUND_RIGHT };
+  static const ChannelRole sixPointOne[] = { ROLE_LEFT, ROLE_RIGHT, ROLE_CENTER, ROLE_LFE,
+    ROLE_SURROUND_CENTER, ROLE_SURROUND_LEFT, ROLE_SURROUND_RIGHT };
+
+  switch (numChannels) {
+    case 1: return ROLE_CENTER;
+    case 3: return channel == 2 ? ROLE_CENTER : (ChannelRole)channel;
+    case 4: return quad[channel];
+    case 5: return fivePointZero[channel];
+    case 7: return sixPointOne[channel];
+    case 2:
+    case 6:
+    case 8: return surround[channel];
+    default: return channel % 2 == 0 ? ROLE_LEFT : ROLE_RIGHT;
+  }
+}
+
+bool ChannelMixer::configureDownmix(unsigned int inChannels, unsigned int outChannels) {
+  if (inChannels == 0 || outChannels == 0 || outChannels > 2) {
+    return false;
+  }
+  const float minus3dB = 0.70710678f;
+  std::vector<float> stereo(2 * inChannels, 0.0f);
+  for (unsigned int i = 0; i < inChannels; i++) {
+    float left = 0.0f, right = 0.0f;
+    switch (getChannelRole(inChannels, i)) {
+      case ROLE_LEFT: left = 1.0f; break;
+      case ROLE_RIGHT: right = 1.0f; break;
+      case ROLE_CENTER: left = right = minus3dB; break;
+      case ROLE_LFE: break;
+      case ROLE_SURROUND_LEFT: left = minus3dB; break;
+      case ROLE_SURROUND_RIGHT: right = minus3dB; break;
+      case ROLE_SURROUND_CENTER: left = right = 0.5f; break;
+    }
+    stereo[i] = left;
+    stereo[inChannels + i] = right;
+  }
+
+  std::vector<float> m(outChannels * inChannels);
+  for (unsigned int i = 0; i < inChannels; i++) {
+    if (outChannels == 1) {
+      m[i] = 0.5f * (stereo[i] + stereo[inChannels + i]);
+    } else {
+      m[i] = stereo[i];
+      m[inChannels + i] = stereo[inChannels + i];
+    }
+  }
+  // normalize so no output can exceed full scale
+  for (unsigned int o = 0; o < outChannels; o++) {
+    float sum = 0.0f;
+    for (unsigned int i = 0; i < inChannels; i++) {
+      sum += fabsf(m[o * inChannels + i]);
+    }
+    if (sum > 1.0f) {
+      for (unsigned int i = 0; i < inChannels; i++) {
+        m[o * inChannels + i] /= sum;
+      }
+    }
+  }
+  return configureMatrix(inChannels, outChannels, m.data());
+}
+
+bool ChannelMixer::configureMatrix(unsigned int inChannels, unsigned int outChannels, const float* matrix) {
+  if (inChannels == 0 || outChannels == 0) {
+    return false;
+  }
+  this->inChannels = inChannels;
+  this->outChannels = outChannels;
+  this->matrix.assign(matrix, matrix + (size_t)inChannels * outChannels);
+
+  columns.assign((size_t)inChannels * 4, 0.0f);
+  if (outChannels <= 4) {
+    for (unsigned int i = 0; i < inChannels; i++) {
+      for (unsigned int o = 0; o < outChannels; o++) {
+        columns[i * 4 + o] = matrix[o * inChannels + i];
+      }
+    }
+  }
+  return true;
+}
+
+unsigned int ChannelMixer::getOutputChannels() {
+  return outChannels;
+}
+
+static void mixScalar(const float* in, size_t frames, unsigned int inChannels, unsigned int outChannels,
+  const float* matrix, float* out) {
+  for (size_t f = 0; f < frames; f++) {
+    const float* x = in + f * inChannels;
+    float* y = out + f * outChannels;
+    for (unsigned int o = 0; o < outChannels; o++) {
+      const float* row = matrix + o * inChannels;
+      float sum = 0.0f;
+      for (unsigned int i = 0; i < inChannels; i++) {
+        sum += row[i] * x[i];
+      }
+      y[o] = sum;
+    }
+  }
+}
+
+// returns the number of frames processed; the caller finishes the rest.
+static size_t mixStereoToMonoSimd(const float* in, size_t frames, float left, float right, float* out) {
+  size_t f = 0;
+#if defined(CAPTURE_SIMD_X86)
+  const __m128 l = _mm_set1_ps(left);
+  const __m128 r = _mm_set1_ps(right);
+  for (; f + 4 <= frames; f += 4) {
+    __m128 a = _mm_loadu_ps(in + f * 2);     // L0 R0 L1 R1
+    __m128 b = _mm_loadu_ps(in + f * 2 + 4); // L2 R2 L3 R3
+    __m128 evens = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 odds = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+    _mm_storeu_ps(out + f, _mm_add_ps(_mm_mul_ps(evens, l), _mm_mul_ps(odds, r)));
+  }
+#elif defined(CAPTURE_SIMD_NEON)
+  for (; f + 4 <= frames; f += 4) {
+    float32x4x2_t lr = vld2q_f32(in + f * 2);
+    vst1q_f32(out + f, vfmaq_n_f32(vmulq_n_f32(lr.val[0], left), lr.val[1], right));
+  }
+#endif
+  return f;
+}
+
+// out frame f = sum over i of in[f][i] * column i. each step stores 4 floats,
+// which spill into the following frames when outChannels < 4, so stop while
+// the store still ends inside out; the caller finishes the last frames.
+static size_t mixColumnsSimd(const float* in, size_t frames, unsigned int inChannels, unsigned int outChannels,
+  const float* columns, float* out) {
+  size_t f = 0;
+#if defined(CAPTURE_SIMD_X86)
+  for (; f * outChannels + 4 <= frames * outChannels; f++) {
+    const float* x = in + f * inChannels;
+    __m128 sum = _mm_setzero_ps();
+    for (unsigned int i = 0; i < inChannels; i++) {
+      sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(x[i]), _mm_loadu_ps(columns + i * 4)));
+    }
+    _mm_storeu_ps(out + f * outChannels, sum);
+  }
+#elif defined(CAPTURE_SIMD_NEON)
+  for (; f * outChannels + 4 <= frames * outChannels; f++) {
+    const float* x = in + f * inChannels;
+    float32x4_t sum = vdupq_n_f32(0.0f);
+    for (unsigned int i = 0; i < inChannels; i++) {
+      sum = vfmaq_n_f32(sum, vld1q_f32(columns + i * 4), x[i]);
+    }
+    vst1q_f32(out + f * outChannels, sum);
+  }
+#else
+  (void)in; (void)inChannels; (void)outChannels; (void)columns; (void)out;
+#endif
+  return f;
+}
+
+void ChannelMixer::process(const float* in, size_t frames, float* out) {
+  size_t done = 0;
+  if (inChannels == 2 && outChannels == 1) {
+    done = mixStereoToMonoSimd(in, frames, matrix[0], matrix[1], out);
+  } else if (outChannels <= 4) {
+    done = mixColumnsSimd(in, frames, inChannels, outChannels, columns.data(), out);
+  }
+  mixScalar(in + done * inChannels, frames - done, inChannels, outChannels, matrix.data(), out + done * outChannels);
+}
+
+void deinterleave(const float* in, size_t frames, unsigned int numChannels, float* const* out) {
+  size_t f = 0;
+  if (numChannels == 2) {
+#if defined(CAPTURE_SIMD_X86)
+    for (; f + 4 <= frames; f += 4) {
+      __m128 a = _mm_loadu_ps(in + f * 2);
+      __m128 b = _mm_loadu_ps(in + f * 2 + 4);
+      _mm_storeu_ps(out[0] + f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps(out[1] + f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+#elif defined(CAPTURE_SIMD_NEON)
+    for (; f + 4 <= frames; f += 4) {
+      float32x4x2_t lr = vld2q_f32(in + f * 2);
+      vst1q_f32(out[0] + f, lr.val[0]);
+      vst1q_f32(out[1] + f, lr.val[1]);
+    }
+#endif
+  }
+  for (unsigned int c = 0; c < numChannels; c++) {
+    float* dst = out[c];
+    const float* src = in + c;
+    for (size_t i = f; i < frames; i++) {
+      dst[i] = src[i * numChannels];
+    }
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// mixes interleaved float32 frames of inChannels channels into outChannels
+// channels through a matrix: out[o] = sum over i of matrix[o * inChannels + i] * in[i].
+//
+// stereo -> mono uses a dedicated kernel; other layouts with up to 4 output
+// channels accumulate one broadcast input sample times one matrix column per
+// step (SSE2 / NEON), with a scalar kernel for everything else.
+class ChannelMixer {
+private:
+  unsigned int inChannels = 0;
+  unsigned int outChannels = 0;
+  std::vector<float> matrix;
+  // matrix transposed and padded to 4 lanes per input channel
+  std::vector<float> columns;
+
+public:
+  // standard downmix from the WAVE channel order (FL FR FC LFE BL BR SL SR)
+  // to mono or stereo. LFE is dropped and each output is scaled so a full
+  // scale signal on every input channel does not clip.
+  bool configureDownmix(unsigned int inChannels, unsigned int outChannels);
+
+  // matrix has outChannels rows of inChannels coefficients.
+  bool configureMatrix(unsigned int inChannels, unsigned int outChannels, const float* matrix);
+
+  unsigned int getOutputChannels();
+
+  // in holds frames * inChannels samples, out frames * outChannels samples.
+  void process(const float* in, size_t frames, float* out);
+};
+
+// splits interleaved float32 frames into one contiguous array per channel:
+// out[c][i] = in[i * numChannels + c].
+void deinterleave(const float* in, size_t frames, unsigned int numChannels, float* const* out);
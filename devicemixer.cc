@@ -0,0 +1,346 @@
+#include "devicemixer.h"
+
+#include <math.h>
+#include <string.h>
+#include <chrono>
+
+static const unsigned int periodMs = 5;
+static const size_t pullFrames = 4096;
+static const size_t blockFrames = 512;
+
+// offsets beyond this are corrected at once instead of by the controller
+static const double realignMs = 20.0;
+// a source this far behind the master is treated as stalled
+static const double stallMs = 200.0;
+
+// PI controller on the capture time offset in seconds, critically damped.
+// the offset is low-pass filtered first so timestamp jitter does not turn
+// into pitch wobble.
+static const double maxDrift = 0.002;
+static const double proportionalGain = 0.5;
+static const double integralGain = 0.0625;
+static const double errorFilterSeconds = 0.5;
+
+DeviceMixer::~DeviceMixer() {
+  stop();
+}
+
+bool DeviceMixer::configure(const std::vector<MixerSource*>& sources, const std::vector<float>& gains, MixerMode mode, unsigned int sampleRate, size_t ringFrames) {
+  if (running.load() || sources.empty() || gains.size() != sources.size() || sampleRate == 0) {
+    return false;
+  }
+  unsigned int channels = 0;
+  for (size_t i = 0; i < sources.size(); i++) {
+    unsigned int sourceChannels = sources[i]->getSourceChannels();
+    if (sourceChannels == 0) {
+      return false;
+    }
+    if (mode == MIXER_MODE_MIX) {
+      if (i > 0 && sourceChannels != channels) {
+        return false;
+      }
+      channels = sourceChannels;
+    } else {
+      channels += sourceChannels;
+    }
+  }
+
+  this->mode = mode;
+  this->sampleRate = sampleRate;
+  outputChannels = channels;
+  inputs.clear();
+  for (size_t i = 0; i < sources.size(); i++) {
+    Input* input = new Input();
+    input->source = sources[i];
+    input->numChannels = sources[i]->getSourceChannels();
+    input->gain = gains[i];
+    input->fifoFrame = 0;
+    input->streamFrames = 0;
+    input->headFrame = 0.0;
+    input->chunkFrame = 0;
+    input->chunkTimestamp = 0;
+    input->timed = false;
+    input->aligned = false;
+    input->ratio = 1.0;
+    input->integral = 0.0;
+    input->filteredError = 0.0;
+    input->driftPpm.store(0.0);
+    input->offsetMs.store(0.0);
+    input->stalled.store(false);
+    input->bufferedFrames.store(0);
+    inputs.push_back(std::unique_ptr<Input>(input));
+  }
+  ring.allocate(ringFrames * outputChannels * sizeof(float));
+  overflowFrames.store(0);
+  return true;
+}
+
+bool DeviceMixer::start() {
+  if (thread.joinable() || inputs.empty()) {
+    return false;
+  }
+  running.store(true);
+  thread = std::thread(&DeviceMixer::run, this);
+  return true;
+}
+
+void DeviceMixer::stop() {
+  running.store(false);
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+bool DeviceMixer::isRunning() {
+  return running.load();
+}
+
+void DeviceMixer::run() {
+  while (running.load(std::memory_order_relaxed)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(periodMs));
+    process();
+  }
+}
+
+void DeviceMixer::pull(Input* input) {
+  size_t samples = pullFrames * input->numChannels;
+  if (readBuffer.size() < samples) {
+    readBuffer.resize(samples);
+  }
+  for (;;) {
+    ChunkTiming timing = {};
+    size_t frames = input->source->readSourceFrames(readBuffer.data(), pullFrames, &timing);
+    if (frames == 0) {
+      break;
+    }
+    // untimed chunks are placed by the last timed one
+    if (timing.timestamp != 0) {
+      input->chunkFrame = input->streamFrames;
+      input->chunkTimestamp = timing.timestamp;
+      input->timed = true;
+    }
+    input->fifo.insert(input->fifo.end(), readBuffer.data(), readBuffer.data() + frames * input->numChannels);
+    input->streamFrames += frames;
+    if (frames < pullFrames) {
+      break;
+    }
+  }
+}
+
+// capture time of the next output frame of input, in 100 ns units
+double DeviceMixer::getHeadTimestamp(Input* input) {
+  return (double)input->chunkTimestamp + (input->headFrame - (double)input->chunkFrame) * 10000000.0 / sampleRate;
+}
+
+// move the head of input to the frame captured at timestamp. frames before it
+// are dropped by trim(); if it lies before the buffered frames, silence is
+// inserted instead.
+void DeviceMixer::alignTo(Input* input, double timestamp) {
+  input->headFrame = (double)input->chunkFrame + (timestamp - (double)input->chunkTimestamp) * sampleRate / 10000000.0;
+  // interpolation needs one frame before the head
+  int64_t first = (int64_t)floor(input->headFrame) - 1;
+  if (first < input->fifoFrame) {
+    size_t pad = (size_t)(input->fifoFrame - first);
+    input->fifo.insert(input->fifo.begin(), pad * input->numChannels, 0.0f);
+    input->fifoFrame = first;
+  }
+  input->aligned = true;
+}
+
+// output frames input can produce from what is buffered
+size_t DeviceMixer::getReadyFrames(Input* input) {
+  // the last output frame reads up to two frames past its position
+  double span = (double)input->streamFrames - 3.0 - input->headFrame;
+  if (span < 0.0) {
+    return 0;
+  }
+  return (size_t)(span / input->ratio) + 1;
+}
+
+// cubic (Catmull-Rom) interpolation at headFrame, headFrame + ratio, ...
+void DeviceMixer::interpolate(Input* input, size_t frames, float* out) {
+  unsigned int channels = input->numChannels;
+  const float* fifo = input->fifo.data();
+  for (size_t j = 0; j < frames; j++) {
+    double position = input->headFrame + j * input->ratio;
+    double whole = floor(position);
+    float f = (float)(position - whole);
+    const float* p = fifo + ((int64_t)whole - 1 - input->fifoFrame) * channels;
+    for (unsigned int c = 0; c < channels; c++) {
+      float p0 = p[c];
+      float p1 = p[c + channels];
+      float p2 = p[c + 2 * channels];
+      float p3 = p[c + 3 * channels];
+      out[j * channels + c] = p1 + 0.5f * f * (p2 - p0
+        + f * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3
+        + f * (3.0f * (p1 - p2) + p3 - p0)));
+    }
+  }
+  input->headFrame += frames * input->ratio;
+}
+
+// drop buffered frames the head has passed, keeping one for interpolation
+void DeviceMixer::trim(Input* input) {
+  int64_t keep = (int64_t)floor(input->headFrame) - 1;
+  if (keep <= input->fifoFrame) {
+    return;
+  }
+  size_t buffered = input->fifo.size() / input->numChannels;
+  size_t drop = (size_t)(keep - input->fifoFrame);
+  if (drop > buffered) {
+    drop = buffered;
+  }
+  input->fifo.erase(input->fifo.begin(), input->fifo.begin() + drop * input->numChannels);
+  input->fifoFrame += drop;
+}
+
+size_t DeviceMixer::process() {
+  for (size_t i = 0; i < inputs.size(); i++) {
+    pull(inputs[i].get());
+  }
+
+  Input* master = inputs[0].get();
+  if (!master->timed) {
+    return 0;
+  }
+  if (!master->aligned) {
+    alignTo(master, getHeadTimestamp(master));
+  }
+  double masterTimestamp = getHeadTimestamp(master);
+  size_t frames = getReadyFrames(master);
+
+  size_t stallFrames = (size_t)(sampleRate * stallMs / 1000.0);
+  for (size_t i = 1; i < inputs.size(); i++) {
+    Input* input = inputs[i].get();
+    if (input->timed) {
+      double offset = getHeadTimestamp(input) - masterTimestamp;
+      if (!input->aligned || fabs(offset) > realignMs * 10000.0) {
+        alignTo(input, masterTimestamp);
+      }
+    }
+    size_t ready = input->timed ? getReadyFrames(input) : 0;
+    bool stalled = false;
+    if (ready < frames) {
+      if (frames - ready > stallFrames) {
+        // do not hold up the other sources; realign once data is back
+        stalled = true;
+        input->aligned = false;
+      } else {
+        frames = ready;
+      }
+    }
+    input->stalled.store(stalled, std::memory_order_relaxed);
+  }
+
+  size_t done = 0;
+  while (done < frames) {
+    size_t block = frames - done < blockFrames ? frames - done : blockFrames;
+    outputBuffer.assign(block * outputChannels, 0.0f);
+    unsigned int channelOffset = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+      Input* input = inputs[i].get();
+      unsigned int channels = input->numChannels;
+      if (i == 0 || !input->stalled.load(std::memory_order_relaxed)) {
+        if (sourceBuffer.size() < block * channels) {
+          sourceBuffer.resize(block * channels);
+        }
+        interpolate(input, block, sourceBuffer.data());
+        float gain = input->gain;
+        for (size_t j = 0; j < block; j++) {
+          float* out = outputBuffer.data() + j * outputChannels + channelOffset;
+          const float* in = sourceBuffer.data() + j * channels;
+          for (unsigned int c = 0; c < channels; c++) {
+            out[c] += gain * in[c];
+          }
+        }
+      }
+      if (mode == MIXER_MODE_TRACKS) {
+        channelOffset += channels;
+      }
+    }
+    size_t frameSize = outputChannels * sizeof(float);
+    size_t written = ring.write((const char*)outputBuffer.data(), block * frameSize) / frameSize;
+    if (written < block) {
+      overflowFrames.fetch_add(block - written, std::memory_order_relaxed);
+    }
+    done += block;
+  }
+
+  // steer each source's read rate towards zero offset from the master
+  double dt = (double)frames / sampleRate;
+  masterTimestamp = getHeadTimestamp(master);
+  for (size_t i = 1; i < inputs.size(); i++) {
+    Input* input = inputs[i].get();
+    if (frames > 0 && input->aligned && !input->stalled.load(std::memory_order_relaxed)) {
+      double error = (getHeadTimestamp(input) - masterTimestamp) / 10000000.0;
+      input->filteredError += dt / (errorFilterSeconds + dt) * (error - input->filteredError);
+      input->integral += input->filteredError * dt;
+      double integralLimit = maxDrift / integralGain;
+      if (input->integral > integralLimit) {
+        input->integral = integralLimit;
+      } else if (input->integral < -integralLimit) {
+        input->integral = -integralLimit;
+      }
+      double ratio = 1.0 - (proportionalGain * input->filteredError + integralGain * input->integral);
+      if (ratio > 1.0 + maxDrift) {
+        ratio = 1.0 + maxDrift;
+      } else if (ratio < 1.0 - maxDrift) {
+        ratio = 1.0 - maxDrift;
+      }
+      input->ratio = ratio;
+      input->driftPpm.store((ratio - 1.0) * 1000000.0, std::memory_order_relaxed);
+      input->offsetMs.store(error * 1000.0, std::memory_order_relaxed);
+    }
+  }
+
+  for (size_t i = 0; i < inputs.size(); i++) {
+    Input* input = inputs[i].get();
+    trim(input);
+    double buffered = (double)input->streamFrames - input->headFrame;
+    input->bufferedFrames.store(buffered > 0.0 ? (uint64_t)buffered : 0, std::memory_order_relaxed);
+  }
+  return frames;
+}
+
+unsigned int DeviceMixer::getOutputChannels() {
+  return outputChannels;
+}
+
+unsigned int DeviceMixer::getSampleRate() {
+  return sampleRate;
+}
+
+size_t DeviceMixer::getAvailableFrames() {
+  if (outputChannels == 0) {
+    return 0;
+  }
+  return ring.readAvailable() / (outputChannels * sizeof(float));
+}
+
+size_t DeviceMixer::readFrames(float* out, size_t maxFrames) {
+  if (outputChannels == 0) {
+    return 0;
+  }
+  size_t frameSize = outputChannels * sizeof(float);
+  return ring.read((char*)out, maxFrames * frameSize) / frameSize;
+}
+
+uint64_t DeviceMixer::getOverflowFrames() {
+  return overflowFrames.load(std::memory_order_relaxed);
+}
+
+unsigned int DeviceMixer::getSourceCount() {
+  return (unsigned int)inputs.size();
+}
+
+bool DeviceMixer::getSourceStats(unsigned int index, MixerSourceStats* stats) {
+  if (index >= inputs.size()) {
+    return false;
+  }
+  Input* input = inputs[index].get();
+  stats->driftPpm = input->driftPpm.load(std::memory_order_relaxed);
+  stats->offsetMs = input->offsetMs.load(std::memory_order_relaxed);
+  stats->stalled = input->stalled.load(std::memory_order_relaxed);
+  stats->bufferedFrames = input->bufferedFrames.load(std::memory_order_relaxed);
+  return true;
+}
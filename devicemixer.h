@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "packettiming.h"
+#include "ringbuffer.h"
+
+// one input of a DeviceMixer: interleaved float32 frames at the mixer rate,
+// typically the output ring of a capture thread running for one device.
+class MixerSource {
+public:
+  virtual ~MixerSource() {}
+
+  virtual unsigned int getSourceChannels() = 0;
+
+  // copy up to maxFrames frames to out and return how many were copied. if
+  // any were and their capture time is known, *timing receives the device
+  // position and performance counter time (100 ns units) of the first one;
+  // otherwise it is left alone.
+  virtual size_t readSourceFrames(float* out, size_t maxFrames, ChunkTiming* timing) = 0;
+};
+
+typedef enum MixerMode {
+  // sum all sources into the channel layout they share
+  MIXER_MODE_MIX = 0,
+  // one track per source side by side: the channels of source 0, then those
+  // of source 1, ...
+  MIXER_MODE_TRACKS = 1,
+} MixerMode;
+
+typedef struct MixerSourceStats {
+  // how much faster than the first source this one is consumed, in ppm
+  double driftPpm;
+  // capture time of this source's next frame minus that of the first
+  // source's, in ms
+  double offsetMs;
+  // no data while the first source had plenty; filled with silence
+  bool stalled;
+  // source frames received but not mixed yet. stays bounded while the rate
+  // follows the device clock, and grows or shrinks by the drift otherwise.
+  uint64_t bufferedFrames;
+} MixerSourceStats;
+
+// combines several sources captured by independent devices into one
+// time-aligned stream. the first source is the clock master; every other
+// source is aligned to it by the capture timestamps of its frames.
+//
+// alignment: a source whose next frame was captured more than a few ms away
+// from the master's next frame is realigned at once, by dropping frames or
+// inserting silence. after that its device clock is tracked: the difference
+// between the two capture times drives a PI controller that nudges the rate
+// the source is read at (cubic interpolation, at most +/- 2000 ppm), so the
+// offset stays near zero however far the two crystals disagree.
+//
+// a thread pulls from the sources every few ms and writes the result to a
+// ring; process() runs one round synchronously for tests with fake sources.
+class DeviceMixer {
+private:
+  typedef struct Input {
+    MixerSource* source;
+    unsigned int numChannels;
+    float gain;
+
+    // source frames from stream frame fifoFrame on
+    std::vector<float> fifo;
+    int64_t fifoFrame;
+    int64_t streamFrames;
+    // stream position of the next output frame
+    double headFrame;
+
+    // stream frame chunkFrame was captured at chunkTimestamp
+    int64_t chunkFrame;
+    uint64_t chunkTimestamp;
+    bool timed;
+
+    bool aligned;
+    double ratio;
+    double integral;
+    double filteredError;
+
+    std::atomic<double> driftPpm;
+    std::atomic<double> offsetMs;
+    std::atomic<bool> stalled;
+    std::atomic<uint64_t> bufferedFrames;
+  } Input;
+
+  std::vector<std::unique_ptr<Input> > inputs;
+  MixerMode mode = MIXER_MODE_MIX;
+  unsigned int sampleRate = 0;
+  unsigned int outputChannels = 0;
+
+  std::vector<float> readBuffer;
+  std::vector<float> sourceBuffer;
+  std::vector<float> outputBuffer;
+  RingBuffer ring;
+  std::atomic<uint64_t> overflowFrames{0};
+
+  std::thread thread;
+  std::atomic<bool> running{false};
+
+  void pull(Input* input);
+  double getHeadTimestamp(Input* input);
+  void alignTo(Input* input, double timestamp);
+  size_t getReadyFrames(Input* input);
+  void interpolate(Input* input, size_t frames, float* out);
+  void trim(Input* input);
+  void run();
+
+public:
+  ~DeviceMixer();
+
+  // gains has one entry per source. all sources must deliver sampleRate; in
+  // MIXER_MODE_MIX they must have the same number of channels. must not be
+  // called while running.
+  bool configure(const std::vector<MixerSource*>& sources, const std::vector<float>& gains, MixerMode mode, unsigned int sampleRate, size_t ringFrames);
+
+  bool start();
+  void stop();
+  bool isRunning();
+
+  // one round: pull every source, align, mix what all of them have. returns
+  // the number of output frames written to the ring.
+  size_t process();
+
+  unsigned int getOutputChannels();
+  unsigned int getSampleRate();
+
+  size_t getAvailableFrames();
+  size_t readFrames(float* out, size_t maxFrames);
+  // frames lost because the ring was full
+  uint64_t getOverflowFrames();
+
+  unsigned int getSourceCount();
+  bool getSourceStats(unsigned int index, MixerSourceStats* stats);
+};
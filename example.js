@@ -1,18 +1,23 @@
-const fs=require('fs');
 const addon = require('./build/Release/windows-audio-capture');
 
 let startCapture = (
     continuationObject = { continue: true },
     pollingDelayMs = 250,
-    onAudioCallback = () => {}
+    onAudioCallback = () => {},
+    recordingPath = null
 ) => {
     const c = addon.CreateCaptureClient();
     //console.log(c);
     
     addon.InitializeCom(c);
     addon.StartCapture(c);
-    
-    f = addon.GetAudioFormat(c);
+
+    // have the addon resample natively if the device does not run at 48 kHz
+    // and mix to stereo if it does not have two channels. PCM and float mix
+    // formats of any sample size come out as float32.
+    addon.SetOutputFormat(c, { sampleRate: 48000, channels: 2 });
+
+    f = addon.GetOutputFormat(c);
     //console.log(f);
     formatIsValid = f[0];
     frameSize = f[1];
@@ -30,39 +35,39 @@ let startCapture = (
     ) {
         return false;
     } else {
-        // start the polling with setInterval
-        dataBuffer = new ArrayBuffer(16);
+        // record natively: a background thread writes WAV segments, so the
+        // JS thread never touches the file
+        if(recordingPath != null) {
+            addon.StartRecording(c, recordingPath, { segmentSeconds: 3600 });
+        }
+        // levels are measured natively and written into levels in place
+        addon.SetLevelMeter(c, { windowMs: 50 });
+        levels = addon.GetLevelsArray(c);
+        // the native capture thread drains WASAPI into a ring as soon as data is
+        // ready and calls onAudioCallback with everything captured since the
+        // previous call, no later than pollingDelayMs after the audio arrived.
+        addon.StartStreaming(c, onAudioCallback, {
+            batchFrames: sampleRate, // or once one second of audio is buffered
+            batchMs: pollingDelayMs,
+        });
         interval = setInterval( () => {
-            //console.log('JS start interval');
             if(continuationObject.continue == false) {
                 console.log('JS audio capture loop finished');
+                addon.StopStreaming(c);
+                glitches = addon.GetGlitchStats(c);
+                console.log(`${glitches[0]} packets, ${glitches[1]} discontinuities, ${glitches[2]} timestamp errors, ${glitches[4]} frames lost`);
+                if(recordingPath != null) {
+                    stats = addon.GetRecordingStats(c);
+                    addon.StopRecording(c);
+                    console.log(`recorded ${stats[0]} frames in ${stats[2]} segment(s), ${stats[1]} dropped`);
+                }
                 addon.StopCapture(c);
                 addon.UninitializeCom(c);
                 clearInterval(interval);
             } else {
-                nextPacketSize = addon.GetNextPacketSize(c);
-                maxPacketSize = nextPacketSize * 10;
-                while(nextPacketSize > 0) {
-                    //console.log('JS next packet size: ' + nextPacketSize);
-                    requiredBufferSize = maxPacketSize * frameSize;
-                    if(dataBuffer.byteLength < requiredBufferSize) {
-                        //console.log('JS ' + dataBuffer.byteLength + " dataBuffer is too small, allocating " + requiredBufferSize);
-                        dataBuffer = new ArrayBuffer(requiredBufferSize)
-                    }
-                    
-                    nFrames = addon.GetBuffer(c, nextPacketSize, maxPacketSize, dataBuffer);
-                    //console.log('JS got ' + nFrames + ' frames');
-    
-                    // arrayBuffer is larger than necessary to allow for possible overruns in C++ capture 
-                    // side. extract the slice of the data that was actually received.
-                    const receivedBufferSlice = dataBuffer.slice(0, nFrames * frameSize);
-    
-                    onAudioCallback(receivedBufferSlice);
-    
-                    nextPacketSize = addon.GetNextPacketSize(c);
-                    maxPacketSize = nextPacketSize * 10;
-                }
-                //console.log('JS done one interval ');
+                // peak, rms, truePeak for each channel, then a window counter
+                peakDb = 20 * Math.log10(Math.max(levels[2], levels[5], 1e-6));
+                console.log(`true peak ${peakDb.toFixed(1)} dBFS`);
             }
         }, pollingDelayMs);
     }
@@ -70,21 +75,17 @@ let startCapture = (
 }
 
 let main = async () => {
-    outputFile = 'output.bin';
+    recordingPath = 'output';
+    outputFile = `${recordingPath}-0000.wav`;
     captureDuration = 10000; // ms
     console.log(`testing desktop audio capture for ${captureDuration} ms and writing to ${outputFile}`);
 
-    try {
-        fs.unlinkSync(outputFile);
-    } catch(e) {
-    }
-
-    audioCallback = (dataBuffer) => {
-        const uint8Array = new Uint8Array(dataBuffer);
-        const buffer = Buffer.from(uint8Array);
-        fs.appendFileSync(outputFile, buffer, (err) => {
-          if (err) throw err; 
-        });
+    audioCallback = (dataBuffer, timing) => {
+        // the recording is written natively; live processing of the audio
+        // would go here. timing[1] is the capture time of the first frame in
+        // 100 ns performance counter units, for aligning with video.
+        // hand the native memory back to the pool when done.
+        addon.ReleasePooledBuffer(dataBuffer);
     }
 
     continuationObject = { continue: true };
@@ -93,7 +94,8 @@ let main = async () => {
     result = startCapture(
         continuationObject, // flag to continue or not
         1000, // polling interval
-        audioCallback // callback with audio data in ArrayBuffer
+        audioCallback, // callback with audio data in ArrayBuffer
+        recordingPath // native recording to output-0000.wav and output.idx
     );
     if(result == false) {
         console.log('error starting capture');
@@ -105,9 +107,12 @@ let main = async () => {
 
         // debug message after capture stops to ensure we did not crash on C++ side
         setTimeout( () => {
-            console.log(`JS audio capture finished. raw output written to ${outputFile}.`);
-            console.log('convert to wav file with following command:');
-            console.log(`ffmpeg.exe -f f32le -ac 2 -ar 48000 -i ${outputFile} output.wav`)
+            console.log(`JS audio capture finished. output written to ${outputFile}.`);
+            // the index finds any position without scanning the audio
+            position = addon.FindRecordingPosition(`${recordingPath}.idx`, { frame: 5 * 48000 });
+            if(position != null) {
+                console.log(`5 s into the recording is at byte ${position[1]} of segment ${position[0]}`);
+            }
         }, 11000)
     }
 }
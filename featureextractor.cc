@@ -0,0 +1,230 @@
+#include "featureextractor.h"
+
+#include <math.h>
+#include <string.h>
+
+static const double pi = 3.14159265358979323846;
+
+static double hertzToMel(double hertz) {
+  return 2595.0 * log10(1.0 + hertz / 700.0);
+}
+
+static double melToHertz(double mel) {
+  return 700.0 * (pow(10.0, mel / 2595.0) - 1.0);
+}
+
+bool FeatureExtractor::configure(const FeatureOptions& options, unsigned int numChannels, unsigned int sampleRate) {
+  if (numChannels == 0 || sampleRate == 0 || options.hopSize == 0 || !fft.configure(options.fftSize)) {
+    return false;
+  }
+  unsigned int linearBins = options.fftSize / 2 + 1;
+  float nyquist = sampleRate / 2.0f;
+  float maxFrequency = options.maxFrequency > 0.0f ? options.maxFrequency : nyquist;
+  if (options.melBands > linearBins
+    || options.minFrequency < 0.0f || maxFrequency > nyquist || options.minFrequency >= maxFrequency
+    || (options.scale != FEATURE_SCALE_POWER && !(options.floor > 0.0f))) {
+    return false;
+  }
+  this->options = options;
+  this->options.maxFrequency = maxFrequency;
+  this->numChannels = numChannels;
+  numBins = options.melBands != 0 ? options.melBands : linearBins;
+
+  // periodic windows, so overlapping windows at hop fftSize / 2 add up flat
+  window.resize(options.fftSize);
+  for (unsigned int i = 0; i < options.fftSize; i++) {
+    double phase = 2.0 * pi * i / options.fftSize;
+    switch (options.window) {
+      case FEATURE_WINDOW_HAMMING: window[i] = (float)(0.54 - 0.46 * cos(phase)); break;
+      case FEATURE_WINDOW_RECTANGULAR: window[i] = 1.0f; break;
+      default: window[i] = (float)(0.5 - 0.5 * cos(phase)); break;
+    }
+  }
+
+  history.assign(options.fftSize, 0.0f);
+  windowed.assign(options.fftSize, 0.0f);
+  spectrumRe.assign(linearBins, 0.0f);
+  spectrumIm.assign(linearBins, 0.0f);
+  power.assign(linearBins, 0.0f);
+  features.assign(numBins, 0.0f);
+
+  melStart.clear();
+  melLength.clear();
+  melOffset.clear();
+  melWeights.clear();
+  if (options.melBands != 0) {
+    designMelBands(sampleRate);
+  }
+
+  if (this->options.ringFrames == 0) {
+    this->options.ringFrames = sampleRate / options.hopSize + 1;
+  }
+  ring.allocate((size_t)this->options.ringFrames * numBins * sizeof(float));
+  reset();
+  return true;
+}
+
+// triangular bands with centers evenly spaced on the mel scale, each rising
+// from the center of the band below and falling to the center of the band
+// above, with a peak weight of 1. bands narrower than the bin spacing can end
+// up without any bins and stay 0.
+void FeatureExtractor::designMelBands(unsigned int sampleRate) {
+  unsigned int bands = options.melBands;
+  double minMel = hertzToMel(options.minFrequency);
+  double maxMel = hertzToMel(options.maxFrequency);
+  std::vector<double> edges(bands + 2);
+  for (unsigned int i = 0; i < bands + 2; i++) {
+    edges[i] = melToHertz(minMel + (maxMel - minMel) * i / (bands + 1));
+  }
+
+  double binHertz = (double)sampleRate / options.fftSize;
+  unsigned int linearBins = options.fftSize / 2 + 1;
+  for (unsigned int b = 0; b < bands; b++) {
+    double lower = edges[b];
+    double center = edges[b + 1];
+    double upper = edges[b + 2];
+    uint32_t start = (uint32_t)ceil(lower / binHertz);
+    if (start * binHertz <= lower) {
+      start++;
+    }
+    melStart.push_back(start);
+    melOffset.push_back((uint32_t)melWeights.size());
+    uint32_t length = 0;
+    for (uint32_t k = start; k < linearBins && k * binHertz < upper; k++) {
+      double hertz = k * binHertz;
+      double weight = hertz <= center
+        ? (hertz - lower) / (center - lower)
+        : (upper - hertz) / (upper - center);
+      melWeights.push_back((float)weight);
+      length++;
+    }
+    melLength.push_back(length);
+  }
+}
+
+void FeatureExtractor::reset() {
+  historyFrames = 0;
+  skipFrames = 0;
+  ring.reset();
+  producedFrames.store(0);
+  overflowFrames.store(0);
+}
+
+void FeatureExtractor::process(const float* frames, size_t nFrames) {
+  size_t fftSize = options.fftSize;
+  while (nFrames > 0) {
+    if (skipFrames > 0) {
+      size_t skipped = skipFrames < nFrames ? skipFrames : nFrames;
+      skipFrames -= skipped;
+      frames += skipped * numChannels;
+      nFrames -= skipped;
+      continue;
+    }
+
+    size_t count = fftSize - historyFrames;
+    if (count > nFrames) {
+      count = nFrames;
+    }
+    float* out = history.data() + historyFrames;
+    if (numChannels == 1) {
+      memcpy(out, frames, count * sizeof(float));
+    } else {
+      float scale = 1.0f / numChannels;
+      for (size_t i = 0; i < count; i++) {
+        const float* frame = frames + i * numChannels;
+        float sum = 0.0f;
+        for (unsigned int c = 0; c < numChannels; c++) {
+          sum += frame[c];
+        }
+        out[i] = sum * scale;
+      }
+    }
+    historyFrames += count;
+    frames += count * numChannels;
+    nFrames -= count;
+
+    if (historyFrames == fftSize) {
+      analyze();
+      if (options.hopSize < fftSize) {
+        memmove(history.data(), history.data() + options.hopSize, (fftSize - options.hopSize) * sizeof(float));
+        historyFrames = fftSize - options.hopSize;
+      } else {
+        historyFrames = 0;
+        skipFrames = options.hopSize - fftSize;
+      }
+    }
+  }
+}
+
+void FeatureExtractor::analyze() {
+  unsigned int fftSize = options.fftSize;
+  unsigned int linearBins = fftSize / 2 + 1;
+  for (unsigned int i = 0; i < fftSize; i++) {
+    windowed[i] = history[i] * window[i];
+  }
+  fft.forward(windowed.data(), spectrumRe.data(), spectrumIm.data());
+
+  // linear output is the power itself
+  float* out = options.melBands != 0 ? power.data() : features.data();
+  for (unsigned int k = 0; k < linearBins; k++) {
+    out[k] = spectrumRe[k] * spectrumRe[k] + spectrumIm[k] * spectrumIm[k];
+  }
+  if (options.melBands != 0) {
+    for (unsigned int b = 0; b < numBins; b++) {
+      const float* p = power.data() + melStart[b];
+      const float* w = melWeights.data() + melOffset[b];
+      float sum = 0.0f;
+      for (uint32_t i = 0; i < melLength[b]; i++) {
+        sum += p[i] * w[i];
+      }
+      features[b] = sum;
+    }
+  }
+
+  if (options.scale != FEATURE_SCALE_POWER) {
+    float floor = options.floor;
+    float factor = options.scale == FEATURE_SCALE_DB ? 10.0f / logf(10.0f) : 1.0f;
+    for (unsigned int b = 0; b < numBins; b++) {
+      float value = features[b] > floor ? features[b] : floor;
+      features[b] = factor * logf(value);
+    }
+  }
+
+  producedFrames.fetch_add(1, std::memory_order_relaxed);
+  size_t bytes = numBins * sizeof(float);
+  if (ring.writeAvailable() < bytes) {
+    overflowFrames.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  ring.write((const char*)features.data(), bytes);
+}
+
+const FeatureOptions& FeatureExtractor::getOptions() {
+  return options;
+}
+
+unsigned int FeatureExtractor::getNumBins() {
+  return numBins;
+}
+
+size_t FeatureExtractor::read(float* out, size_t maxFrames) {
+  size_t frameBytes = numBins * sizeof(float);
+  if (frameBytes == 0) {
+    return 0;
+  }
+  size_t bytes = ring.read((char*)out, maxFrames * frameBytes);
+  return bytes / frameBytes;
+}
+
+size_t FeatureExtractor::getAvailableFrames() {
+  size_t frameBytes = numBins * sizeof(float);
+  return frameBytes == 0 ? 0 : ring.readAvailable() / frameBytes;
+}
+
+uint64_t FeatureExtractor::getProducedFrames() {
+  return producedFrames.load(std::memory_order_relaxed);
+}
+
+uint64_t FeatureExtractor::getOverflowFrames() {
+  return overflowFrames.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include "fft.h"
+#include "ringbuffer.h"
+
+typedef enum FeatureWindow {
+  FEATURE_WINDOW_HANN = 0,
+  FEATURE_WINDOW_HAMMING = 1,
+  FEATURE_WINDOW_RECTANGULAR = 2,
+} FeatureWindow;
+
+typedef enum FeatureScale {
+  // power, |X|^2 of the windowed frame
+  FEATURE_SCALE_POWER = 0,
+  // natural log of the power
+  FEATURE_SCALE_LOG = 1,
+  // 10 log10 of the power
+  FEATURE_SCALE_DB = 2,
+} FeatureScale;
+
+typedef struct FeatureOptions {
+  // power of two from 16 to 65536
+  unsigned int fftSize;
+  // frames between the starts of consecutive analysis windows
+  unsigned int hopSize;
+  FeatureWindow window;
+  // 0 delivers the fftSize / 2 + 1 linear bins; otherwise the power is summed
+  // into this many triangular mel bands (HTK mel scale) between minFrequency
+  // and maxFrequency. maxFrequency of 0 means Nyquist.
+  unsigned int melBands;
+  float minFrequency;
+  float maxFrequency;
+  FeatureScale scale;
+  // power floor applied before log compression
+  float floor;
+  // feature frames buffered for the reader, 0 for about one second
+  unsigned int ringFrames;
+} FeatureOptions;
+
+// short-time spectrum of interleaved float32 frames, mixed to mono. every
+// hopSize frames the last fftSize frames are windowed and transformed, and the
+// power spectrum, optionally reduced to mel bands and log compressed, is
+// written to a ring as one feature frame of getNumBins() floats.
+//
+// feature frame f covers input frames [f * hopSize, f * hopSize + fftSize)
+// counted from the last reset(); there is no padding before the first frame.
+//
+// process() runs on the capture thread; read() on one reader thread.
+class FeatureExtractor {
+private:
+  FeatureOptions options = {};
+  unsigned int numChannels = 0;
+  unsigned int numBins = 0;
+
+  RealFft fft;
+  std::vector<float> window;
+  // mono input of the current analysis window
+  std::vector<float> history;
+  size_t historyFrames = 0;
+  // frames to discard before the next window starts, if hopSize > fftSize
+  size_t skipFrames = 0;
+
+  std::vector<float> windowed;
+  std::vector<float> spectrumRe;
+  std::vector<float> spectrumIm;
+  std::vector<float> power;
+  std::vector<float> features;
+
+  // band b sums power[melStart[b] + i] * melWeights[melOffset[b] + i] for
+  // i < melLength[b]
+  std::vector<uint32_t> melStart;
+  std::vector<uint32_t> melLength;
+  std::vector<uint32_t> melOffset;
+  std::vector<float> melWeights;
+
+  RingBuffer ring;
+  std::atomic<uint64_t> producedFrames{0};
+  std::atomic<uint64_t> overflowFrames{0};
+
+  void designMelBands(unsigned int sampleRate);
+  void analyze();
+
+public:
+  // returns false if the options are not supported. must not be called while
+  // process() runs.
+  bool configure(const FeatureOptions& options, unsigned int numChannels, unsigned int sampleRate);
+  void reset();
+
+  void process(const float* frames, size_t nFrames);
+
+  const FeatureOptions& getOptions();
+  // floats per feature frame
+  unsigned int getNumBins();
+
+  // copies up to maxFrames feature frames to out. returns the number copied.
+  size_t read(float* out, size_t maxFrames);
+  size_t getAvailableFrames();
+  // feature frames produced since reset(), and how many of them were dropped
+  // because the ring was full. while nothing is dropped, the frames read are
+  // consecutive from frame 0.
+  uint64_t getProducedFrames();
+  uint64_t getOverflowFrames();
+};
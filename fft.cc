@@ -0,0 +1,193 @@
+#include "fft.h"
+
+#include <math.h>
+
+#include "simd.h"
+
+static const double pi = 3.14159265358979323846;
+
+// ---------------------------------------------
+// butterfly kernels
+//
+// for each j < n, with t = w[j] * x1[j]:
+//   x0[j], x1[j] = x0[j] + t, x0[j] - t
+
+static void butterfliesScalar(float* re0, float* im0, float* re1, float* im1, const float* wr, const float* wi, size_t n) {
+  for (size_t j = 0; j < n; j++) {
+    float tr = re1[j] * wr[j] - im1[j] * wi[j];
+    float ti = re1[j] * wi[j] + im1[j] * wr[j];
+    re1[j] = re0[j] - tr;
+    im1[j] = im0[j] - ti;
+    re0[j] += tr;
+    im0[j] += ti;
+  }
+}
+
+#ifdef CAPTURE_SIMD_X86
+
+static void butterfliesSse2(float* re0, float* im0, float* re1, float* im1, const float* wr, const float* wi, size_t n) {
+  size_t j = 0;
+  for (; j + 4 <= n; j += 4) {
+    __m128 xr = _mm_loadu_ps(re1 + j);
+    __m128 xi = _mm_loadu_ps(im1 + j);
+    __m128 cr = _mm_loadu_ps(wr + j);
+    __m128 ci = _mm_loadu_ps(wi + j);
+    __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, cr), _mm_mul_ps(xi, ci));
+    __m128 ti = _mm_add_ps(_mm_mul_ps(xr, ci), _mm_mul_ps(xi, cr));
+    __m128 ar = _mm_loadu_ps(re0 + j);
+    __m128 ai = _mm_loadu_ps(im0 + j);
+    _mm_storeu_ps(re1 + j, _mm_sub_ps(ar, tr));
+    _mm_storeu_ps(im1 + j, _mm_sub_ps(ai, ti));
+    _mm_storeu_ps(re0 + j, _mm_add_ps(ar, tr));
+    _mm_storeu_ps(im0 + j, _mm_add_ps(ai, ti));
+  }
+  butterfliesScalar(re0 + j, im0 + j, re1 + j, im1 + j, wr + j, wi + j, n - j);
+}
+
+CAPTURE_TARGET_AVX2
+static void butterfliesAvx2(float* re0, float* im0, float* re1, float* im1, const float* wr, const float* wi, size_t n) {
+  size_t j = 0;
+  for (; j + 8 <= n; j += 8) {
+    __m256 xr = _mm256_loadu_ps(re1 + j);
+    __m256 xi = _mm256_loadu_ps(im1 + j);
+    __m256 cr = _mm256_loadu_ps(wr + j);
+    __m256 ci = _mm256_loadu_ps(wi + j);
+    __m256 tr = _mm256_fmsub_ps(xr, cr, _mm256_mul_ps(xi, ci));
+    __m256 ti = _mm256_fmadd_ps(xr, ci, _mm256_mul_ps(xi, cr));
+    __m256 ar = _mm256_loadu_ps(re0 + j);
+    __m256 ai = _mm256_loadu_ps(im0 + j);
+    _mm256_storeu_ps(re1 + j, _mm256_sub_ps(ar, tr));
+    _mm256_storeu_ps(im1 + j, _mm256_sub_ps(ai, ti));
+    _mm256_storeu_ps(re0 + j, _mm256_add_ps(ar, tr));
+    _mm256_storeu_ps(im0 + j, _mm256_add_ps(ai, ti));
+  }
+  butterfliesScalar(re0 + j, im0 + j, re1 + j, im1 + j, wr + j, wi + j, n - j);
+}
+
+#endif
+
+#ifdef CAPTURE_SIMD_NEON
+
+static void butterfliesNeon(float* re0, float* im0, float* re1, float* im1, const float* wr, const float* wi, size_t n) {
+  size_t j = 0;
+  for (; j + 4 <= n; j += 4) {
+    float32x4_t xr = vld1q_f32(re1 + j);
+    float32x4_t xi = vld1q_f32(im1 + j);
+    float32x4_t cr = vld1q_f32(wr + j);
+    float32x4_t ci = vld1q_f32(wi + j);
+    float32x4_t tr = vfmsq_f32(vmulq_f32(xr, cr), xi, ci);
+    float32x4_t ti = vfmaq_f32(vmulq_f32(xr, ci), xi, cr);
+    float32x4_t ar = vld1q_f32(re0 + j);
+    float32x4_t ai = vld1q_f32(im0 + j);
+    vst1q_f32(re1 + j, vsubq_f32(ar, tr));
+    vst1q_f32(im1 + j, vsubq_f32(ai, ti));
+    vst1q_f32(re0 + j, vaddq_f32(ar, tr));
+    vst1q_f32(im0 + j, vaddq_f32(ai, ti));
+  }
+  butterfliesScalar(re0 + j, im0 + j, re1 + j, im1 + j, wr + j, wi + j, n - j);
+}
+
+#endif
+
+// ---------------------------------------------
+
+bool RealFft::configure(unsigned int size) {
+  if (size < 16 || size > 65536 || (size & (size - 1)) != 0) {
+    return false;
+  }
+  this->size = size;
+  halfSize = size / 2;
+
+  unsigned int bits = 0;
+  while ((1u << bits) < halfSize) {
+    bits++;
+  }
+  bitReversed.resize(halfSize);
+  for (unsigned int n = 0; n < halfSize; n++) {
+    unsigned int reversed = 0;
+    for (unsigned int b = 0; b < bits; b++) {
+      reversed |= ((n >> b) & 1) << (bits - 1 - b);
+    }
+    bitReversed[n] = reversed;
+  }
+
+  stageCos.assign(halfSize, 0.0f);
+  stageSin.assign(halfSize, 0.0f);
+  for (unsigned int h = 1; h < halfSize; h *= 2) {
+    for (unsigned int j = 0; j < h; j++) {
+      double angle = -pi * j / h;
+      stageCos[h + j] = (float)cos(angle);
+      stageSin[h + j] = (float)sin(angle);
+    }
+  }
+
+  splitCos.resize(size / 4 + 1);
+  splitSin.resize(size / 4 + 1);
+  for (unsigned int k = 0; k <= size / 4; k++) {
+    double angle = -2.0 * pi * k / size;
+    splitCos[k] = (float)cos(angle);
+    splitSin[k] = (float)sin(angle);
+  }
+
+  workRe.assign(halfSize, 0.0f);
+  workIm.assign(halfSize, 0.0f);
+
+  butterflies = butterfliesScalar;
+#if defined(CAPTURE_SIMD_X86)
+  butterflies = cpuSupportsAvx2() ? butterfliesAvx2 : butterfliesSse2;
+#elif defined(CAPTURE_SIMD_NEON)
+  butterflies = butterfliesNeon;
+#endif
+  return true;
+}
+
+unsigned int RealFft::getSize() {
+  return size;
+}
+
+void RealFft::forward(const float* in, float* re, float* im) {
+  float* zr = workRe.data();
+  float* zi = workIm.data();
+  for (unsigned int n = 0; n < halfSize; n++) {
+    unsigned int r = bitReversed[n];
+    zr[n] = in[2 * r];
+    zi[n] = in[2 * r + 1];
+  }
+
+  // the first stage has no twiddles to multiply
+  for (unsigned int b = 0; b < halfSize; b += 2) {
+    float ar = zr[b], ai = zi[b];
+    zr[b] = ar + zr[b + 1];
+    zi[b] = ai + zi[b + 1];
+    zr[b + 1] = ar - zr[b + 1];
+    zi[b + 1] = ai - zi[b + 1];
+  }
+  for (unsigned int h = 2; h < halfSize; h *= 2) {
+    const float* wr = stageCos.data() + h;
+    const float* wi = stageSin.data() + h;
+    for (unsigned int b = 0; b < halfSize; b += 2 * h) {
+      butterflies(zr + b, zi + b, zr + b + h, zi + b + h, wr, wi, h);
+    }
+  }
+
+  // with Z the packed transform, the transforms of the even and odd samples
+  // are E = (Z[k] + conj(Z[M - k])) / 2 and O = (Z[k] - conj(Z[M - k])) / 2i,
+  // and X[k] = E + W^k O, X[M - k] = conj(E - W^k O)
+  re[0] = zr[0] + zi[0];
+  im[0] = 0.0f;
+  re[halfSize] = zr[0] - zi[0];
+  im[halfSize] = 0.0f;
+  for (unsigned int k = 1; k <= halfSize / 2; k++) {
+    unsigned int m = halfSize - k;
+    float er = 0.5f * (zr[k] + zr[m]);
+    float ei = 0.5f * (zi[k] - zi[m]);
+    float orr = 0.5f * (zi[k] + zi[m]);
+    float oi = -0.5f * (zr[k] - zr[m]);
+    float tr = orr * splitCos[k] - oi * splitSin[k];
+    float ti = orr * splitSin[k] + oi * splitCos[k];
+    re[k] = er + tr;
+    im[k] = ei + ti;
+    re[m] = er - tr;
+    im[m] = -(ei - ti);
+  }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// forward FFT of real float32 input, sizes a power of two.
+//
+// the N real samples are packed into an N/2 point complex FFT (even samples
+// as real parts, odd samples as imaginary parts), which is then split into
+// the N/2 + 1 bins of the real spectrum. the complex FFT is an iterative
+// radix-2 decimation in time on separate real and imaginary arrays, so each
+// butterfly stage runs over contiguous memory with SSE, AVX2/FMA or NEON.
+// bit reversal and all twiddles are planned by configure(); forward() does
+// not allocate.
+class RealFft {
+private:
+  unsigned int size = 0;
+  unsigned int halfSize = 0;
+
+  // input sample pair feeding complex point n after bit reversal
+  std::vector<uint32_t> bitReversed;
+  // twiddles of the stage with half span h at [h, 2h): e^(-2 pi i j / 2h)
+  std::vector<float> stageCos;
+  std::vector<float> stageSin;
+  // e^(-2 pi i k / size) for splitting the packed result, k <= size / 4
+  std::vector<float> splitCos;
+  std::vector<float> splitSin;
+
+  std::vector<float> workRe;
+  std::vector<float> workIm;
+
+  // one stage of radix-2 butterflies over n point pairs
+  void (*butterflies)(float* re0, float* im0, float* re1, float* im1, const float* wr, const float* wi, size_t n) = NULL;
+
+public:
+  // size is a power of two from 16 to 65536. returns false otherwise.
+  bool configure(unsigned int size);
+  unsigned int getSize();
+
+  // transforms size samples. re and im receive size / 2 + 1 bins, from DC to
+  // Nyquist, not normalized.
+  void forward(const float* in, float* re, float* im);
+};
@@ -0,0 +1,676 @@
+#include "flacencoder.h"
+
+#include <math.h>
+#include <string.h>
+
+static const double pi = 3.14159265358979323846;
+
+static const unsigned int maxFixedOrder = 4;
+static const unsigned int maxLpcOrder = 8;
+static const unsigned int maxPartitionOrder = 8;
+
+// ---------------------------------------------
+// MSB-first bit writer and the two frame checksums
+
+class FlacBitWriter {
+private:
+  std::vector<uint8_t>* out;
+  uint64_t accumulator = 0;
+  unsigned int pending = 0;
+
+public:
+  FlacBitWriter(std::vector<uint8_t>* out) : out(out) {}
+
+  // n <= 32
+  inline void write(uint32_t value, unsigned int n) {
+    if (n == 0) {
+      return;
+    }
+    uint64_t mask = ((uint64_t)1 << n) - 1;
+    accumulator = (accumulator << n) | (value & mask);
+    pending += n;
+    while (pending >= 8) {
+      pending -= 8;
+      out->push_back((uint8_t)(accumulator >> pending));
+    }
+    accumulator &= ((uint64_t)1 << pending) - 1;
+  }
+
+  inline void writeSigned(int32_t value, unsigned int n) {
+    write((uint32_t)value, n);
+  }
+
+  inline void writeUnary(uint32_t zeros) {
+    while (zeros >= 32) {
+      write(0, 32);
+      zeros -= 32;
+    }
+    write(1, zeros + 1);
+  }
+
+  inline void writeRice(int32_t value, unsigned int parameter) {
+    // zigzag: 0, -1, 1, -2, ... become 0, 1, 2, 3, ...
+    uint32_t u = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    writeUnary(u >> parameter);
+    write(u, parameter);
+  }
+
+  // the "UTF-8" coding of frame numbers, up to 36 bits
+  void writeUtf8(uint64_t value) {
+    if (value < 0x80) {
+      write((uint32_t)value, 8);
+      return;
+    }
+    unsigned int continuation = 1;
+    while (continuation < 6 && value >= ((uint64_t)1 << (6 + 5 * continuation))) {
+      continuation++;
+    }
+    uint32_t lead = (0xff00u >> (continuation + 1)) & 0xff;
+    write(lead | (uint32_t)(value >> (6 * continuation)), 8);
+    for (unsigned int i = continuation; i > 0; i--) {
+      write(0x80 | (uint32_t)((value >> (6 * (i - 1))) & 0x3f), 8);
+    }
+  }
+
+  void alignToByte() {
+    if (pending > 0) {
+      write(0, 8 - pending);
+    }
+  }
+};
+
+static uint8_t crc8Table[256];
+static uint16_t crc16Table[256];
+
+static bool initCrcTables() {
+  for (unsigned int i = 0; i < 256; i++) {
+    uint8_t crc8 = (uint8_t)i;
+    uint16_t crc16 = (uint16_t)(i << 8);
+    for (int bit = 0; bit < 8; bit++) {
+      crc8 = (uint8_t)((crc8 & 0x80) ? (crc8 << 1) ^ 0x07 : crc8 << 1);
+      crc16 = (uint16_t)((crc16 & 0x8000) ? (crc16 << 1) ^ 0x8005 : crc16 << 1);
+    }
+    crc8Table[i] = crc8;
+    crc16Table[i] = crc16;
+  }
+  return true;
+}
+
+static const bool crcTablesReady = initCrcTables();
+
+static uint8_t crc8(const uint8_t* data, size_t n) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < n; i++) {
+    crc = crc8Table[crc ^ data[i]];
+  }
+  return crc;
+}
+
+static uint16_t crc16(const uint8_t* data, size_t n) {
+  uint16_t crc = 0;
+  for (size_t i = 0; i < n; i++) {
+    crc = (uint16_t)((crc << 8) ^ crc16Table[(crc >> 8) ^ data[i]]);
+  }
+  return crc;
+}
+
+// ---------------------------------------------
+// Rice parameter and cost estimates. the cost of a partition with parameter k
+// is about count * (k + 1) + sum(u) >> k for zigzagged residuals u.
+
+static unsigned int riceParameterFor(uint64_t sum, uint64_t count) {
+  unsigned int k = 0;
+  while (k < 30 && (count << (k + 1)) < sum) {
+    k++;
+  }
+  return k;
+}
+
+static uint64_t riceBitsFor(uint64_t sum, uint64_t count, unsigned int k) {
+  return count * (k + 1) + (sum >> k);
+}
+
+static void computeFixedResidual(const int32_t* x, size_t n, unsigned int order, int32_t* res) {
+  for (size_t i = order; i < n; i++) {
+    switch (order) {
+      case 0: res[i] = x[i]; break;
+      case 1: res[i] = x[i] - x[i - 1]; break;
+      case 2: res[i] = x[i] - 2 * x[i - 1] + x[i - 2]; break;
+      case 3: res[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3]; break;
+      default: res[i] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4]; break;
+    }
+  }
+}
+
+// the 0.5 Tukey window libFLAC uses by default
+static void computeWindow(float* w, size_t n) {
+  const double p = 0.5;
+  double last = (double)(n - 1);
+  double edge = p * last / 2;
+  for (size_t i = 0; i < n; i++) {
+    if (i < edge) {
+      w[i] = (float)(0.5 * (1 - cos(2 * pi * i / (p * last))));
+    } else if (i > last - edge) {
+      w[i] = (float)(0.5 * (1 - cos(2 * pi * (last - i) / (p * last))));
+    } else {
+      w[i] = 1.0f;
+    }
+  }
+}
+
+// ---------------------------------------------
+
+bool FlacEncoder::configure(unsigned int numChannels, unsigned int bitsPerSample, unsigned int sampleRate, unsigned int blockFrames) {
+  if (numChannels < 1 || numChannels > 8 || (bitsPerSample != 16 && bitsPerSample != 24) ||
+      sampleRate == 0 || sampleRate > 655350 || blockFrames < 16 || blockFrames > 65535) {
+    return false;
+  }
+  this->numChannels = numChannels;
+  this->bitsPerSample = bitsPerSample;
+  this->sampleRate = sampleRate;
+  this->blockFrames = blockFrames;
+  size_t channelCount = numChannels == 2 ? 4 : numChannels;
+  for (size_t c = 0; c < 8; c++) {
+    channels[c].assign(c < channelCount ? blockFrames : 0, 0);
+  }
+  residual.assign(blockFrames, 0);
+  bestResidual.assign(blockFrames, 0);
+  partitionSums.assign((size_t)1 << maxPartitionOrder, 0);
+  windowed.assign(blockFrames, 0);
+  window.assign(blockFrames, 0);
+  computeWindow(window.data(), blockFrames);
+  return true;
+}
+
+void FlacEncoder::writeStreamHeader(std::vector<uint8_t>* out, uint64_t totalFrames, uint32_t minFrameBytes, uint32_t maxFrameBytes) {
+  out->clear();
+  FlacBitWriter w(out);
+  w.write('f', 8);
+  w.write('L', 8);
+  w.write('a', 8);
+  w.write('C', 8);
+  // last metadata block, STREAMINFO, 34 bytes
+  w.write(1, 1);
+  w.write(0, 7);
+  w.write(34, 24);
+  w.write(blockFrames, 16);
+  w.write(blockFrames, 16);
+  w.write(minFrameBytes & 0xffffff, 24);
+  w.write(maxFrameBytes & 0xffffff, 24);
+  w.write(sampleRate, 20);
+  w.write(numChannels - 1, 3);
+  w.write(bitsPerSample - 1, 5);
+  w.write((uint32_t)(totalFrames >> 32) & 0xf, 4);
+  w.write((uint32_t)totalFrames, 32);
+  for (int i = 0; i < 4; i++) {
+    w.write(0, 32);
+  }
+}
+
+// order 0 to 4 by the sum of absolute residuals, all summed from sample 4 on
+// so the orders are comparable. returns the estimated subframe bits, at most
+// those of a verbatim subframe.
+uint64_t FlacEncoder::estimateFixedBits(const int32_t* x, size_t n, unsigned int bps, unsigned int* bestOrder) {
+  uint64_t sums[maxFixedOrder + 1] = {0, 0, 0, 0, 0};
+  if (n > maxFixedOrder) {
+    int32_t last0 = x[3];
+    int32_t last1 = x[3] - x[2];
+    int32_t last2 = last1 - (x[2] - x[1]);
+    int32_t last3 = last2 - (x[2] - 2 * x[1] + x[0]);
+    for (size_t i = maxFixedOrder; i < n; i++) {
+      int32_t e0 = x[i];
+      int32_t e1 = e0 - last0;
+      int32_t e2 = e1 - last1;
+      int32_t e3 = e2 - last2;
+      int32_t e4 = e3 - last3;
+      sums[0] += (uint64_t)(e0 < 0 ? -(int64_t)e0 : e0);
+      sums[1] += (uint64_t)(e1 < 0 ? -(int64_t)e1 : e1);
+      sums[2] += (uint64_t)(e2 < 0 ? -(int64_t)e2 : e2);
+      sums[3] += (uint64_t)(e3 < 0 ? -(int64_t)e3 : e3);
+      sums[4] += (uint64_t)(e4 < 0 ? -(int64_t)e4 : e4);
+      last0 = e0;
+      last1 = e1;
+      last2 = e2;
+      last3 = e3;
+    }
+  }
+  unsigned int order = 0;
+  for (unsigned int o = 1; o <= maxFixedOrder; o++) {
+    if (sums[o] < sums[order]) {
+      order = o;
+    }
+  }
+  if (n <= maxFixedOrder) {
+    order = 0;
+  }
+  uint64_t count = n > maxFixedOrder ? n - maxFixedOrder : 1;
+  // zigzag doubles the magnitudes
+  uint64_t sum = sums[order] * 2;
+  *bestOrder = order;
+  uint64_t bits = (uint64_t)order * bps + riceBitsFor(sum, count, riceParameterFor(sum, count)) * (n - order) / count;
+  // noise is stored verbatim
+  uint64_t verbatimBits = (uint64_t)n * bps;
+  return bits < verbatimBits ? bits : verbatimBits;
+}
+
+// picks the partition order and parameters for res[order, n) and returns the
+// bits of the residual section
+uint64_t FlacEncoder::chooseRice(const int32_t* res, size_t n, unsigned int order, Subframe* subframe) {
+  unsigned int maxOrder = 0;
+  while (maxOrder < maxPartitionOrder && (n & (((size_t)1 << (maxOrder + 1)) - 1)) == 0 &&
+         (n >> (maxOrder + 1)) > order) {
+    maxOrder++;
+  }
+
+  uint64_t* sums = partitionSums.data();
+  size_t partitions = (size_t)1 << maxOrder;
+  size_t partitionSize = n >> maxOrder;
+  for (size_t p = 0; p < partitions; p++) {
+    size_t start = p == 0 ? order : p * partitionSize;
+    size_t end = (p + 1) * partitionSize;
+    uint64_t sum = 0;
+    for (size_t i = start; i < end; i++) {
+      int32_t v = res[i];
+      sum += ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+    }
+    sums[p] = sum;
+  }
+
+  uint64_t bestBits = UINT64_MAX;
+  unsigned int parameters[256];
+  for (int level = (int)maxOrder; level >= 0; level--) {
+    size_t count = (size_t)1 << level;
+    size_t size = n >> level;
+    uint64_t bits = 0;
+    unsigned int maxParameter = 0;
+    for (size_t p = 0; p < count; p++) {
+      uint64_t samples = p == 0 ? size - order : size;
+      unsigned int k = riceParameterFor(sums[p], samples);
+      parameters[p] = k;
+      if (k > maxParameter) {
+        maxParameter = k;
+      }
+      bits += riceBitsFor(sums[p], samples, k);
+    }
+    // method (2), partition order (4), a 4- or 5-bit parameter per partition
+    bits += 6 + count * (maxParameter > 14 ? 5 : 4);
+    if (bits < bestBits) {
+      bestBits = bits;
+      subframe->partitionOrder = (unsigned int)level;
+      memcpy(subframe->riceParameters, parameters, count * sizeof(unsigned int));
+    }
+    // merge pairs for the next lower level
+    for (size_t p = 0; p < count / 2; p++) {
+      sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+  }
+  return bestBits;
+}
+
+// picks the cheapest subframe type for samples. the residual of fixed and
+// LPC subframes is left in subframeResidual.
+void FlacEncoder::analyze(const int32_t* x, size_t n, unsigned int bps, Subframe* subframe, std::vector<int32_t>* subframeResidual) {
+  const uint64_t headerBits = 8;
+
+  bool constant = true;
+  for (size_t i = 1; i < n && constant; i++) {
+    constant = x[i] == x[0];
+  }
+  if (constant) {
+    subframe->type = 0;
+    subframe->order = 0;
+    subframe->bits = headerBits + bps;
+    return;
+  }
+
+  subframe->type = 1;
+  subframe->order = 0;
+  subframe->bits = headerBits + (uint64_t)n * bps;
+
+  // fixed predictor
+  Subframe candidate;
+  unsigned int fixedOrder = 0;
+  estimateFixedBits(x, n, bps, &fixedOrder);
+  if (n > fixedOrder) {
+    computeFixedResidual(x, n, fixedOrder, residual.data());
+    candidate.type = 2;
+    candidate.order = fixedOrder;
+    candidate.bits = headerBits + (uint64_t)fixedOrder * bps + chooseRice(residual.data(), n, fixedOrder, &candidate);
+    if (candidate.bits < subframe->bits) {
+      *subframe = candidate;
+      subframeResidual->swap(residual);
+    }
+  }
+
+  // LPC from the windowed autocorrelation
+  if (n <= 4 * maxLpcOrder) {
+    return;
+  }
+  const float* w = window.data();
+  std::vector<float> shortWindow;
+  if (n != blockFrames) {
+    shortWindow.resize(n);
+    computeWindow(shortWindow.data(), n);
+    w = shortWindow.data();
+  }
+  double* wx = windowed.data();
+  for (size_t i = 0; i < n; i++) {
+    wx[i] = x[i] * (double)w[i];
+  }
+  double autoc[maxLpcOrder + 1];
+  for (unsigned int lag = 0; lag <= maxLpcOrder; lag++) {
+    double sum = 0;
+    for (size_t i = lag; i < n; i++) {
+      sum += wx[i] * wx[i - lag];
+    }
+    autoc[lag] = sum;
+  }
+  if (autoc[0] <= 0) {
+    return;
+  }
+
+  // Levinson-Durbin: predictor a[order][j] weights x[i - 1 - j]
+  double a[maxLpcOrder + 1][maxLpcOrder];
+  double error[maxLpcOrder + 1];
+  double current[maxLpcOrder] = {0};
+  double err = autoc[0];
+  unsigned int maxOrder = 0;
+  for (unsigned int i = 0; i < maxLpcOrder; i++) {
+    double acc = autoc[i + 1];
+    for (unsigned int j = 0; j < i; j++) {
+      acc -= current[j] * autoc[i - j];
+    }
+    double k = acc / err;
+    double next[maxLpcOrder];
+    for (unsigned int j = 0; j < i; j++) {
+      next[j] = current[j] - k * current[i - 1 - j];
+    }
+    next[i] = k;
+    memcpy(current, next, (i + 1) * sizeof(double));
+    err *= 1 - k * k;
+    memcpy(a[i + 1], current, (i + 1) * sizeof(double));
+    error[i + 1] = err;
+    maxOrder = i + 1;
+    if (err <= 0) {
+      break;
+    }
+  }
+
+  // order by expected bits per residual sample, as libFLAC estimates it
+  unsigned int precision = n <= 192 ? 7 : n <= 384 ? 8 : n <= 576 ? 9 : n <= 1152 ? 10 : n <= 2304 ? 11 : n <= 4608 ? 12 : 13;
+  unsigned int lpcOrder = 0;
+  double bestEstimate = 0;
+  for (unsigned int order = 1; order <= maxOrder; order++) {
+    double perSample = error[order] > 0 ? 0.5 * log2(0.5 * error[order] / n) : 0;
+    if (perSample < 0) {
+      perSample = 0;
+    }
+    double estimate = perSample * (n - order) + order * (double)(bps + precision);
+    if (lpcOrder == 0 || estimate < bestEstimate) {
+      lpcOrder = order;
+      bestEstimate = estimate;
+    }
+  }
+
+  // up to 17 bits, keep the prediction sum within 32 bits so decoders take
+  // their fast path; wider samples need 64-bit sums anyway
+  unsigned int orderBits = 0;
+  while ((1u << (orderBits + 1)) <= lpcOrder) {
+    orderBits++;
+  }
+  if (bps <= 17 && precision > 32 - bps - orderBits) {
+    precision = 32 - bps - orderBits;
+  }
+  if (precision < 5) {
+    return;
+  }
+
+  // quantize, carrying the rounding error into the next coefficient
+  const double* lp = a[lpcOrder];
+  double cmax = 0;
+  for (unsigned int j = 0; j < lpcOrder; j++) {
+    if (fabs(lp[j]) > cmax) {
+      cmax = fabs(lp[j]);
+    }
+  }
+  if (cmax <= 0) {
+    return;
+  }
+  int log2cmax;
+  frexp(cmax, &log2cmax);
+  log2cmax--;
+  int shift = (int)precision - 1 - log2cmax - 1;
+  if (shift > 15) {
+    shift = 15;
+  }
+  if (shift < 0) {
+    return;
+  }
+  int32_t qmax = (1 << (precision - 1)) - 1;
+  int32_t qmin = -(1 << (precision - 1));
+  double carry = 0;
+  candidate.type = 3;
+  candidate.order = lpcOrder;
+  candidate.precision = precision;
+  candidate.shift = shift;
+  for (unsigned int j = 0; j < lpcOrder; j++) {
+    carry += lp[j] * (double)(1 << shift);
+    long q = lround(carry);
+    if (q > qmax) {
+      q = qmax;
+    } else if (q < qmin) {
+      q = qmin;
+    }
+    carry -= q;
+    candidate.coefficients[j] = (int32_t)q;
+  }
+
+  int32_t* res = residual.data();
+  const int32_t* q = candidate.coefficients;
+  for (size_t i = lpcOrder; i < n; i++) {
+    int64_t sum = 0;
+    for (unsigned int j = 0; j < lpcOrder; j++) {
+      sum += (int64_t)q[j] * x[i - 1 - j];
+    }
+    int64_t e = x[i] - (sum >> shift);
+    // a bad fit can overflow the residual; verbatim / fixed are fine then
+    if (e > INT32_MAX / 2 || e < INT32_MIN / 2) {
+      return;
+    }
+    res[i] = (int32_t)e;
+  }
+  candidate.bits = headerBits + (uint64_t)lpcOrder * (bps + precision) + 9 + chooseRice(res, n, lpcOrder, &candidate);
+  if (candidate.bits < subframe->bits) {
+    *subframe = candidate;
+    subframeResidual->swap(residual);
+  }
+}
+
+void FlacEncoder::writeSubframe(FlacBitWriter& w, const int32_t* x, size_t n, unsigned int bps,
+  const Subframe& subframe, const int32_t* res) {
+  w.write(0, 1);
+  switch (subframe.type) {
+    case 0:
+      w.write(0, 6);
+      w.write(0, 1);
+      w.writeSigned(x[0], bps);
+      return;
+    case 1:
+      w.write(1, 6);
+      w.write(0, 1);
+      for (size_t i = 0; i < n; i++) {
+        w.writeSigned(x[i], bps);
+      }
+      return;
+    case 2:
+      w.write(8 | subframe.order, 6);
+      w.write(0, 1);
+      for (unsigned int i = 0; i < subframe.order; i++) {
+        w.writeSigned(x[i], bps);
+      }
+      break;
+    default:
+      w.write(32 | (subframe.order - 1), 6);
+      w.write(0, 1);
+      for (unsigned int i = 0; i < subframe.order; i++) {
+        w.writeSigned(x[i], bps);
+      }
+      w.write(subframe.precision - 1, 4);
+      w.writeSigned(subframe.shift, 5);
+      for (unsigned int i = 0; i < subframe.order; i++) {
+        w.writeSigned(subframe.coefficients[i], subframe.precision);
+      }
+      break;
+  }
+
+  size_t partitions = (size_t)1 << subframe.partitionOrder;
+  size_t partitionSize = n >> subframe.partitionOrder;
+  unsigned int maxParameter = 0;
+  for (size_t p = 0; p < partitions; p++) {
+    if (subframe.riceParameters[p] > maxParameter) {
+      maxParameter = subframe.riceParameters[p];
+    }
+  }
+  // RICE2 only when a parameter does not fit in 4 bits
+  unsigned int parameterBits = maxParameter > 14 ? 5 : 4;
+  w.write(parameterBits == 5 ? 1 : 0, 2);
+  w.write(subframe.partitionOrder, 4);
+  for (size_t p = 0; p < partitions; p++) {
+    unsigned int k = subframe.riceParameters[p];
+    w.write(k, parameterBits);
+    size_t start = p == 0 ? subframe.order : p * partitionSize;
+    size_t end = (p + 1) * partitionSize;
+    for (size_t i = start; i < end; i++) {
+      w.writeRice(res[i], k);
+    }
+  }
+}
+
+void FlacEncoder::encodeFrame(const char* data, size_t n, uint64_t frameNumber, std::vector<uint8_t>* out) {
+  out->clear();
+  if (n == 0 || n > blockFrames) {
+    return;
+  }
+  const unsigned char* in = (const unsigned char*)data;
+  const unsigned int bps = bitsPerSample;
+  for (unsigned int c = 0; c < numChannels; c++) {
+    int32_t* x = channels[c].data();
+    if (bps == 16) {
+      const unsigned char* p = in + c * 2;
+      for (size_t i = 0; i < n; i++, p += numChannels * 2) {
+        x[i] = (int16_t)(p[0] | (p[1] << 8));
+      }
+    } else {
+      const unsigned char* p = in + c * 3;
+      for (size_t i = 0; i < n; i++, p += numChannels * 3) {
+        x[i] = (int32_t)(((uint32_t)p[0] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8;
+      }
+    }
+  }
+
+  // channel assignment: independent, or for stereo whichever decorrelation
+  // the fixed predictor estimates cheapest
+  unsigned int assignment = numChannels - 1;
+  const int32_t* sources[8];
+  unsigned int sourceBits[8];
+  for (unsigned int c = 0; c < numChannels; c++) {
+    sources[c] = channels[c].data();
+    sourceBits[c] = bps;
+  }
+  if (numChannels == 2) {
+    const int32_t* left = channels[0].data();
+    const int32_t* right = channels[1].data();
+    int32_t* mid = channels[2].data();
+    int32_t* side = channels[3].data();
+    for (size_t i = 0; i < n; i++) {
+      mid[i] = (left[i] + right[i]) >> 1;
+      side[i] = left[i] - right[i];
+    }
+    unsigned int order;
+    uint64_t l = estimateFixedBits(left, n, bps, &order);
+    uint64_t r = estimateFixedBits(right, n, bps, &order);
+    uint64_t m = estimateFixedBits(mid, n, bps, &order);
+    uint64_t s = estimateFixedBits(side, n, bps + 1, &order);
+    uint64_t best = l + r;
+    if (l + s < best) {
+      best = l + s;
+      assignment = 8;
+      sources[1] = side;
+      sourceBits[1] = bps + 1;
+    }
+    if (s + r < best) {
+      best = s + r;
+      assignment = 9;
+      sources[0] = side;
+      sourceBits[0] = bps + 1;
+      sources[1] = right;
+      sourceBits[1] = bps;
+    }
+    if (m + s < best) {
+      assignment = 10;
+      sources[0] = mid;
+      sourceBits[0] = bps;
+      sources[1] = side;
+      sourceBits[1] = bps + 1;
+    }
+  }
+
+  FlacBitWriter w(out);
+  w.write(0xfff8, 16);
+
+  unsigned int blockCode;
+  switch (n) {
+    case 192: blockCode = 1; break;
+    case 576: blockCode = 2; break;
+    case 1152: blockCode = 3; break;
+    case 2304: blockCode = 4; break;
+    case 4608: blockCode = 5; break;
+    case 256: blockCode = 8; break;
+    case 512: blockCode = 9; break;
+    case 1024: blockCode = 10; break;
+    case 2048: blockCode = 11; break;
+    case 4096: blockCode = 12; break;
+    case 8192: blockCode = 13; break;
+    case 16384: blockCode = 14; break;
+    case 32768: blockCode = 15; break;
+    default: blockCode = n <= 256 ? 6 : 7; break;
+  }
+  unsigned int rateCode;
+  switch (sampleRate) {
+    case 88200: rateCode = 1; break;
+    case 176400: rateCode = 2; break;
+    case 192000: rateCode = 3; break;
+    case 8000: rateCode = 4; break;
+    case 16000: rateCode = 5; break;
+    case 22050: rateCode = 6; break;
+    case 24000: rateCode = 7; break;
+    case 32000: rateCode = 8; break;
+    case 44100: rateCode = 9; break;
+    case 48000: rateCode = 10; break;
+    case 96000: rateCode = 11; break;
+    // from STREAMINFO
+    default: rateCode = 0; break;
+  }
+  w.write(blockCode, 4);
+  w.write(rateCode, 4);
+  w.write(assignment, 4);
+  w.write(bps == 16 ? 4 : 6, 3);
+  w.write(0, 1);
+  w.writeUtf8(frameNumber);
+  if (blockCode == 6) {
+    w.write((uint32_t)n - 1, 8);
+  } else if (blockCode == 7) {
+    w.write((uint32_t)n - 1, 16);
+  }
+  w.write(crc8(out->data(), out->size()), 8);
+
+  Subframe subframe;
+  for (unsigned int c = 0; c < numChannels; c++) {
+    analyze(sources[c], n, sourceBits[c], &subframe, &bestResidual);
+    writeSubframe(w, sources[c], n, sourceBits[c], subframe, bestResidual.data());
+  }
+
+  w.alignToByte();
+  uint16_t crc = crc16(out->data(), out->size());
+  w.write(crc, 16);
+}
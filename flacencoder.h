@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class FlacBitWriter;
+
+// FLAC encoder for 16- and 24-bit PCM, without dependencies. any FLAC decoder
+// reads the output and gets the input back bit-exact.
+//
+// each block becomes one independently decodable frame: every channel (or the
+// best of left/side, side/right and mid/side for stereo) is predicted with a
+// fixed polynomial of order 0 to 4 or a quantized LPC of order up to 8,
+// whichever needs the fewest bits, and the residual is Rice coded in up to
+// 256 partitions. silent channels become constant subframes.
+//
+// encodeFrame() only touches the encoder's own buffers, so blocks can be
+// encoded in parallel with one encoder per thread; frames are numbered by the
+// caller and can be written in any order they complete in, as long as the
+// file gets them in frame number order.
+class FlacEncoder {
+private:
+  unsigned int numChannels = 0;
+  unsigned int bitsPerSample = 0;
+  unsigned int sampleRate = 0;
+  unsigned int blockFrames = 0;
+
+  // per channel, and mid / side for stereo
+  std::vector<int32_t> channels[8];
+  std::vector<int32_t> residual;
+  std::vector<int32_t> bestResidual;
+  std::vector<uint64_t> partitionSums;
+  std::vector<double> windowed;
+  std::vector<float> window;
+
+  typedef struct Subframe {
+    // 0 constant, 1 verbatim, 2 fixed, 3 lpc
+    int type;
+    unsigned int order;
+    int32_t coefficients[32];
+    unsigned int precision;
+    int shift;
+    unsigned int partitionOrder;
+    unsigned int riceParameters[256];
+    uint64_t bits;
+  } Subframe;
+
+  uint64_t estimateFixedBits(const int32_t* samples, size_t n, unsigned int bps, unsigned int* bestOrder);
+  void analyze(const int32_t* samples, size_t n, unsigned int bps, Subframe* subframe, std::vector<int32_t>* subframeResidual);
+  uint64_t chooseRice(const int32_t* res, size_t n, unsigned int order, Subframe* subframe);
+  void writeSubframe(FlacBitWriter& writer, const int32_t* samples, size_t n, unsigned int bps,
+    const Subframe& subframe, const int32_t* res);
+
+public:
+  // bitsPerSample 16 or 24, 1 to 8 channels, blockFrames 16 to 65535
+  bool configure(unsigned int numChannels, unsigned int bitsPerSample, unsigned int sampleRate, unsigned int blockFrames);
+
+  // "fLaC" and the STREAMINFO block. totalFrames and the frame sizes may be
+  // 0 for unknown, e.g. while the stream is still being written; md5 is left
+  // 0 (not computed). always 42 bytes, so it can be rewritten in place.
+  void writeStreamHeader(std::vector<uint8_t>* out, uint64_t totalFrames, uint32_t minFrameBytes, uint32_t maxFrameBytes);
+  static const size_t streamHeaderBytes = 42;
+
+  // encodes nFrames (at most blockFrames; less only for the last block)
+  // interleaved little-endian samples of bitsPerSample / 8 bytes each as
+  // frame number frameNumber, replacing the contents of out.
+  void encodeFrame(const char* data, size_t nFrames, uint64_t frameNumber, std::vector<uint8_t>* out);
+};
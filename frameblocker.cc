@@ -0,0 +1,62 @@
+#include "frameblocker.h"
+
+#include <string.h>
+
+bool FrameBlocker::configure(unsigned int frameSize, uint32_t blockFrames, uint32_t hopFrames) {
+  if (blockFrames > 0 && hopFrames == 0) {
+    return false;
+  }
+  this->frameSize = frameSize;
+  this->blockFrames = blockFrames;
+  this->hopFrames = hopFrames;
+  overlap.assign(hopFrames < blockFrames ? (size_t)(blockFrames - hopFrames) * frameSize : 0, 0);
+  reset();
+  return true;
+}
+
+void FrameBlocker::reset() {
+  overlapFrames = 0;
+  skipFrames = 0;
+}
+
+uint32_t FrameBlocker::read(RingBuffer* ring, char* out, uint32_t maximumBlocks, uint64_t* consumedFrames) {
+  *consumedFrames = 0;
+  if (blockFrames == 0 || frameSize == 0) {
+    return 0;
+  }
+  size_t blockBytes = (size_t)blockFrames * frameSize;
+  uint32_t blocks = 0;
+  while (blocks < maximumBlocks) {
+    if (skipFrames > 0) {
+      size_t available = ring->readAvailable() / frameSize;
+      size_t skip = available < skipFrames ? available : (size_t)skipFrames;
+      ring->commitRead(skip * frameSize);
+      skipFrames -= skip;
+      *consumedFrames += skip;
+      if (skipFrames > 0) {
+        break;
+      }
+    }
+
+    size_t overlapBytes = overlapFrames * frameSize;
+    size_t needed = blockBytes - overlapBytes;
+    if (ring->readAvailable() < needed) {
+      break;
+    }
+    char* block = out + blocks * blockBytes;
+    if (overlapBytes > 0) {
+      memcpy(block, overlap.data(), overlapBytes);
+    }
+    ring->read(block + overlapBytes, needed);
+    *consumedFrames += needed / frameSize;
+    blocks++;
+
+    if (hopFrames < blockFrames) {
+      overlapFrames = blockFrames - hopFrames;
+      memcpy(overlap.data(), block + (size_t)hopFrames * frameSize, overlapFrames * frameSize);
+    } else {
+      skipFrames = hopFrames - blockFrames;
+    }
+  }
+  return blocks;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "ringbuffer.h"
+
+// cuts the capture thread output into blocks of exactly blockFrames frames,
+// a new block starting every hopFrames frames, whatever size the device
+// packets had. hopFrames < blockFrames overlaps consecutive blocks by the
+// difference, hopFrames > blockFrames skips the frames in between.
+//
+// block b covers output frames [b * hopFrames, b * hopFrames + blockFrames)
+// counted from the last reset(), like the analysis windows of
+// FeatureExtractor.
+//
+// read() runs on the ring's reader thread and copies straight from the ring
+// into the caller's buffer; the overlap is kept in a buffer allocated by
+// configure(), so reading allocates nothing.
+class FrameBlocker {
+private:
+  unsigned int frameSize = 0;
+  uint32_t blockFrames = 0;
+  uint32_t hopFrames = 0;
+
+  // the last blockFrames - hopFrames frames of the previous block, the start
+  // of the next one
+  std::vector<char> overlap;
+  size_t overlapFrames = 0;
+  // frames to discard before the next block starts, if hopFrames > blockFrames
+  uint64_t skipFrames = 0;
+
+public:
+  // blockFrames of 0 disables blocking. configure again when the frame size
+  // changes; frameSize of 0 (no output format yet) delivers nothing.
+  bool configure(unsigned int frameSize, uint32_t blockFrames, uint32_t hopFrames);
+  // the next block starts at the ring's next frame
+  void reset();
+
+  uint32_t getBlockFrames() {
+    return blockFrames;
+  }
+
+  // copies as many whole blocks as are ready, up to maximumBlocks, to out,
+  // one after another. *consumedFrames receives the frames taken from the
+  // ring, skipped frames included. returns the number of blocks copied.
+  uint32_t read(RingBuffer* ring, char* out, uint32_t maximumBlocks, uint64_t* consumedFrames);
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+
+#include "ringbuffer.h"
+
+// the last N frames of the capture pipeline output, for "save the last 30
+// seconds" without JS holding on to everything it read.
+//
+// the capture thread writes like into a RingBuffer, except that the history
+// is never full: each write overwrites the oldest frames. any other thread
+// can copy a range out while the capture thread keeps writing. that works like
+// a seqlock: the writer announces how far it is about to write before it
+// touches the memory (reserveIndex) and publishes the new end after
+// (writeIndex); a reader copies, then checks the announcement and throws away
+// whatever the writer may have overwritten meanwhile. allocate some frames
+// more than the history the reader asks for and that never happens in
+// practice.
+class HistoryBuffer {
+private:
+  std::vector<char> buffer;
+  size_t capacity = 0;
+  unsigned int frameSize = 0;
+  // bytes ever written / about to be written
+  std::atomic<uint64_t> writeIndex{0};
+  std::atomic<uint64_t> reserveIndex{0};
+
+public:
+  // frames in the history; not while the writer runs
+  void allocate(size_t frames, unsigned int frameSize) {
+    this->frameSize = frameSize;
+    capacity = frames * frameSize;
+    buffer.assign(capacity, 0);
+    writeIndex.store(0);
+    reserveIndex.store(0);
+  }
+
+  size_t capacityFrames() const {
+    return frameSize > 0 ? capacity / frameSize : 0;
+  }
+
+  unsigned int getFrameSize() const {
+    return frameSize;
+  }
+
+  // frames written since allocate()
+  uint64_t writtenFrames() const {
+    return frameSize > 0 ? writeIndex.load(std::memory_order_acquire) / frameSize : 0;
+  }
+
+  // writer side, like RingBuffer::beginWrite() / commitWrite() but always
+  // granting the whole request up to the capacity
+  size_t beginWrite(size_t bytes, RingRegions* regions) {
+    if (bytes > capacity) {
+      bytes = capacity;
+    }
+    uint64_t w = writeIndex.load(std::memory_order_relaxed);
+    reserveIndex.store(w + bytes, std::memory_order_relaxed);
+    // the announcement must be visible before any byte is overwritten
+    std::atomic_thread_fence(std::memory_order_release);
+    size_t offset = (size_t)(w % capacity);
+    size_t firstBytes = capacity - offset;
+    if (firstBytes > bytes) {
+      firstBytes = bytes;
+    }
+    regions->first = buffer.data() + offset;
+    regions->firstBytes = firstBytes;
+    regions->second = buffer.data();
+    regions->secondBytes = bytes - firstBytes;
+    return bytes;
+  }
+
+  void commitWrite(size_t bytes) {
+    writeIndex.store(writeIndex.load(std::memory_order_relaxed) + bytes, std::memory_order_release);
+  }
+
+  size_t write(const char* data, size_t bytes) {
+    if (capacity == 0) {
+      return 0;
+    }
+    RingRegions regions;
+    bytes = beginWrite(bytes, &regions);
+    memcpy(regions.first, data, regions.firstBytes);
+    if (regions.secondBytes > 0) {
+      memcpy(regions.second, data + regions.firstBytes, regions.secondBytes);
+    }
+    commitWrite(bytes);
+    return bytes;
+  }
+
+  // reader side, any thread. copies frames [startFrame, endFrame), counted
+  // like writtenFrames(), to out, clamped to what is still in the history.
+  // returns the number of frames copied to the start of out; *firstFrame
+  // receives the frame number of the first one.
+  size_t copyFrames(uint64_t startFrame, uint64_t endFrame, char* out, uint64_t* firstFrame) {
+    *firstFrame = startFrame;
+    if (capacity == 0) {
+      return 0;
+    }
+    uint64_t w = writeIndex.load(std::memory_order_acquire);
+    uint64_t end = endFrame * frameSize;
+    uint64_t start = startFrame * frameSize;
+    if (end > w) {
+      end = w;
+    }
+    if (w > capacity && start < w - capacity) {
+      start = w - capacity;
+    }
+    if (start >= end) {
+      *firstFrame = end / frameSize;
+      return 0;
+    }
+
+    size_t bytes = (size_t)(end - start);
+    size_t offset = (size_t)(start % capacity);
+    size_t firstBytes = capacity - offset;
+    if (firstBytes > bytes) {
+      firstBytes = bytes;
+    }
+    memcpy(out, buffer.data() + offset, firstBytes);
+    memcpy(out + firstBytes, buffer.data(), bytes - firstBytes);
+
+    // everything below reserveIndex - capacity may have been overwritten
+    // while copying
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t reserved = reserveIndex.load(std::memory_order_relaxed);
+    if (reserved > capacity && start < reserved - capacity) {
+      uint64_t valid = reserved - capacity;
+      if (valid >= end) {
+        *firstFrame = end / frameSize;
+        return 0;
+      }
+      size_t torn = (size_t)(valid - start);
+      memmove(out, out + torn, bytes - torn);
+      bytes -= torn;
+      start = valid;
+    }
+    *firstFrame = start / frameSize;
+    return bytes / frameSize;
+  }
+};
@@ -0,0 +1,346 @@
+#include "levelmeter.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "simd.h"
+
+static const double pi = 3.14159265358979323846;
+
+// 4x oversampling, 12 taps per phase
+static const unsigned int truePeakPhases = 4;
+static const unsigned int truePeakTaps = 12;
+
+// truePeakTaps entries of truePeakPhases coefficients, entry k applying to
+// the sample k steps back. designed once on first use.
+static float truePeakCoeffs[truePeakTaps * truePeakPhases];
+
+static void designTruePeakFilter() {
+  static bool designed = false;
+  if (designed) {
+    return;
+  }
+  // windowed sinc with the cutoff at the original Nyquist frequency
+  const unsigned int length = truePeakTaps * truePeakPhases;
+  double prototype[truePeakTaps * truePeakPhases];
+  double center = (length - 1) / 2.0;
+  for (unsigned int i = 0; i < length; i++) {
+    double t = (i - center) / truePeakPhases;
+    double sinc = t == 0.0 ? 1.0 : sin(pi * t) / (pi * t);
+    double window = 0.5 - 0.5 * cos(2.0 * pi * (i + 0.5) / length);
+    prototype[i] = sinc * window;
+  }
+  for (unsigned int p = 0; p < truePeakPhases; p++) {
+    double sum = 0.0;
+    for (unsigned int k = 0; k < truePeakTaps; k++) {
+      sum += prototype[p + k * truePeakPhases];
+    }
+    for (unsigned int k = 0; k < truePeakTaps; k++) {
+      truePeakCoeffs[k * truePeakPhases + p] = (float)(prototype[p + k * truePeakPhases] / sum);
+    }
+  }
+  designed = true;
+}
+
+// ---------------------------------------------
+// kernels
+
+// peak and sum of squares of interleaved samples. samples starts on a frame.
+static void accumulateScalar(const float* in, size_t samples, unsigned int numChannels, float* peak, float* sumSquares) {
+  for (size_t i = 0; i < samples; i++) {
+    unsigned int c = (unsigned int)(i % numChannels);
+    float x = in[i];
+    float a = fabsf(x);
+    if (a > peak[c]) {
+      peak[c] = a;
+    }
+    sumSquares[c] += x * x;
+  }
+}
+
+// the SIMD kernels step through blocks of lcm(numChannels, 4) samples, so
+// lane l of vector v always holds channel (4 * v + l) % numChannels.
+static const unsigned int maxBlockVectors = 16;
+
+static unsigned int getBlockVectors(unsigned int numChannels) {
+  unsigned int block = numChannels;
+  while (block % 4 != 0) {
+    block += numChannels;
+  }
+  return block / 4;
+}
+
+#ifdef CAPTURE_SIMD_X86
+
+static void accumulateSse2(const float* in, size_t samples, unsigned int numChannels, float* peak, float* sumSquares) {
+  unsigned int vectors = getBlockVectors(numChannels);
+  if (vectors > maxBlockVectors) {
+    accumulateScalar(in, samples, numChannels, peak, sumSquares);
+    return;
+  }
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 maxv[maxBlockVectors];
+  __m128 sumv[maxBlockVectors];
+  for (unsigned int v = 0; v < vectors; v++) {
+    maxv[v] = _mm_setzero_ps();
+    sumv[v] = _mm_setzero_ps();
+  }
+  size_t block = vectors * 4;
+  size_t i = 0;
+  for (; i + block <= samples; i += block) {
+    for (unsigned int v = 0; v < vectors; v++) {
+      __m128 x = _mm_loadu_ps(in + i + v * 4);
+      // NaN in the new sample leaves the running maximum unchanged
+      maxv[v] = _mm_max_ps(_mm_and_ps(x, absMask), maxv[v]);
+      sumv[v] = _mm_add_ps(sumv[v], _mm_mul_ps(x, x));
+    }
+  }
+  for (unsigned int v = 0; v < vectors; v++) {
+    float lanesMax[4], lanesSum[4];
+    _mm_storeu_ps(lanesMax, maxv[v]);
+    _mm_storeu_ps(lanesSum, sumv[v]);
+    for (unsigned int l = 0; l < 4; l++) {
+      unsigned int c = (v * 4 + l) % numChannels;
+      if (lanesMax[l] > peak[c]) {
+        peak[c] = lanesMax[l];
+      }
+      sumSquares[c] += lanesSum[l];
+    }
+  }
+  accumulateScalar(in + i, samples - i, numChannels, peak, sumSquares);
+}
+
+// in has truePeakTaps - 1 samples of history before in[0]
+static float truePeakSse2(const float* in, size_t n, float maximum) {
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 coeffs[truePeakTaps];
+  for (unsigned int k = 0; k < truePeakTaps; k++) {
+    coeffs[k] = _mm_loadu_ps(truePeakCoeffs + k * truePeakPhases);
+  }
+  __m128 maxv = _mm_set1_ps(maximum);
+  for (size_t i = 0; i < n; i++) {
+    __m128 sum = _mm_setzero_ps();
+    for (unsigned int k = 0; k < truePeakTaps; k++) {
+      sum = _mm_add_ps(sum, _mm_mul_ps(coeffs[k], _mm_set1_ps(*(in + i - k))));
+    }
+    maxv = _mm_max_ps(_mm_and_ps(sum, absMask), maxv);
+  }
+  maxv = _mm_max_ps(maxv, _mm_movehl_ps(maxv, maxv));
+  maxv = _mm_max_ss(maxv, _mm_shuffle_ps(maxv, maxv, 1));
+  return _mm_cvtss_f32(maxv);
+}
+
+#endif
+
+#ifdef CAPTURE_SIMD_NEON
+
+static void accumulateNeon(const float* in, size_t samples, unsigned int numChannels, float* peak, float* sumSquares) {
+  unsigned int vectors = getBlockVectors(numChannels);
+  if (vectors > maxBlockVectors) {
+    accumulateScalar(in, samples, numChannels, peak, sumSquares);
+    return;
+  }
+  float32x4_t maxv[maxBlockVectors];
+  float32x4_t sumv[maxBlockVectors];
+  for (unsigned int v = 0; v < vectors; v++) {
+    maxv[v] = vdupq_n_f32(0.0f);
+    sumv[v] = vdupq_n_f32(0.0f);
+  }
+  size_t block = vectors * 4;
+  size_t i = 0;
+  for (; i + block <= samples; i += block) {
+    for (unsigned int v = 0; v < vectors; v++) {
+      float32x4_t x = vld1q_f32(in + i + v * 4);
+      // vmaxnmq ignores NaN
+      maxv[v] = vmaxnmq_f32(maxv[v], vabsq_f32(x));
+      sumv[v] = vfmaq_f32(sumv[v], x, x);
+    }
+  }
+  for (unsigned int v = 0; v < vectors; v++) {
+    float lanesMax[4], lanesSum[4];
+    vst1q_f32(lanesMax, maxv[v]);
+    vst1q_f32(lanesSum, sumv[v]);
+    for (unsigned int l = 0; l < 4; l++) {
+      unsigned int c = (v * 4 + l) % numChannels;
+      if (lanesMax[l] > peak[c]) {
+        peak[c] = lanesMax[l];
+      }
+      sumSquares[c] += lanesSum[l];
+    }
+  }
+  accumulateScalar(in + i, samples - i, numChannels, peak, sumSquares);
+}
+
+static float truePeakNeon(const float* in, size_t n, float maximum) {
+  float32x4_t coeffs[truePeakTaps];
+  for (unsigned int k = 0; k < truePeakTaps; k++) {
+    coeffs[k] = vld1q_f32(truePeakCoeffs + k * truePeakPhases);
+  }
+  float32x4_t maxv = vdupq_n_f32(maximum);
+  for (size_t i = 0; i < n; i++) {
+    float32x4_t sum = vdupq_n_f32(0.0f);
+    for (unsigned int k = 0; k < truePeakTaps; k++) {
+      sum = vfmaq_n_f32(sum, coeffs[k], *(in + i - k));
+    }
+    maxv = vmaxnmq_f32(maxv, vabsq_f32(sum));
+  }
+  return vmaxvq_f32(maxv);
+}
+
+#endif
+
+#if !defined(CAPTURE_SIMD_X86) && !defined(CAPTURE_SIMD_NEON)
+
+// in has truePeakTaps - 1 samples of history before in[0]
+static float truePeakScalar(const float* in, size_t n, float maximum) {
+  for (size_t i = 0; i < n; i++) {
+    for (unsigned int p = 0; p < truePeakPhases; p++) {
+      float sum = 0.0f;
+      for (unsigned int k = 0; k < truePeakTaps; k++) {
+        sum += truePeakCoeffs[k * truePeakPhases + p] * *(in + i - k);
+      }
+      float a = fabsf(sum);
+      if (a > maximum) {
+        maximum = a;
+      }
+    }
+  }
+  return maximum;
+}
+
+#endif
+
+// ---------------------------------------------
+// LevelMeter
+
+bool LevelMeter::configure(unsigned int numChannels, unsigned int sampleRate, unsigned int windowMs, bool truePeak) {
+  if (numChannels == 0 || sampleRate == 0 || windowMs == 0) {
+    return false;
+  }
+  size_t windowFrames = (size_t)sampleRate * windowMs / 1000;
+  this->numChannels = numChannels;
+  this->windowFrames = windowFrames > 0 ? windowFrames : 1;
+  this->truePeak = truePeak;
+
+  peak.assign(numChannels, 0.0f);
+  sumSquares.assign(numChannels, 0.0f);
+  truePeakMax.assign(numChannels, 0.0f);
+  if (truePeak) {
+    designTruePeakFilter();
+    truePeakHistory.assign((size_t)numChannels * (truePeakTaps - 1), 0.0f);
+    truePeakBuffer.assign(truePeakTaps - 1 + this->windowFrames, 0.0f);
+  }
+
+  published.reset(new std::atomic<float>[numChannels * 3]);
+  for (unsigned int i = 0; i < numChannels * 3; i++) {
+    published[i].store(0.0f, std::memory_order_relaxed);
+  }
+  windowCount.store(0);
+  reset();
+  return true;
+}
+
+void LevelMeter::reset() {
+  framesInWindow = 0;
+  for (unsigned int c = 0; c < numChannels; c++) {
+    peak[c] = 0.0f;
+    sumSquares[c] = 0.0f;
+    truePeakMax[c] = 0.0f;
+  }
+  for (size_t i = 0; i < truePeakHistory.size(); i++) {
+    truePeakHistory[i] = 0.0f;
+  }
+}
+
+void LevelMeter::process(const float* frames, size_t nFrames) {
+  while (nFrames > 0) {
+    size_t chunk = windowFrames - framesInWindow;
+    if (chunk > nFrames) {
+      chunk = nFrames;
+    }
+#if defined(CAPTURE_SIMD_X86)
+    accumulateSse2(frames, chunk * numChannels, numChannels, peak.data(), sumSquares.data());
+#elif defined(CAPTURE_SIMD_NEON)
+    accumulateNeon(frames, chunk * numChannels, numChannels, peak.data(), sumSquares.data());
+#else
+    accumulateScalar(frames, chunk * numChannels, numChannels, peak.data(), sumSquares.data());
+#endif
+    if (truePeak) {
+      accumulateTruePeak(frames, chunk);
+    }
+    frames += chunk * numChannels;
+    nFrames -= chunk;
+    framesInWindow += chunk;
+    if (framesInWindow == windowFrames) {
+      publish();
+      framesInWindow = 0;
+    }
+  }
+}
+
+// one channel at a time: history, then the chunk, through the 4 phase filter
+void LevelMeter::accumulateTruePeak(const float* frames, size_t nFrames) {
+  const unsigned int historyLength = truePeakTaps - 1;
+  float* buffer = truePeakBuffer.data();
+  for (unsigned int c = 0; c < numChannels; c++) {
+    float* history = truePeakHistory.data() + (size_t)c * historyLength;
+    memcpy(buffer, history, historyLength * sizeof(float));
+    for (size_t i = 0; i < nFrames; i++) {
+      buffer[historyLength + i] = frames[i * numChannels + c];
+    }
+#if defined(CAPTURE_SIMD_X86)
+    truePeakMax[c] = truePeakSse2(buffer + historyLength, nFrames, truePeakMax[c]);
+#elif defined(CAPTURE_SIMD_NEON)
+    truePeakMax[c] = truePeakNeon(buffer + historyLength, nFrames, truePeakMax[c]);
+#else
+    truePeakMax[c] = truePeakScalar(buffer + historyLength, nFrames, truePeakMax[c]);
+#endif
+    memcpy(history, buffer + nFrames, historyLength * sizeof(float));
+  }
+}
+
+void LevelMeter::publish() {
+  float* shared = target;
+  uint32_t sharedLength = targetLength;
+  for (unsigned int c = 0; c < numChannels; c++) {
+    float rms = sqrtf(sumSquares[c] / (float)framesInWindow);
+    float tp = truePeak ? (truePeakMax[c] > peak[c] ? truePeakMax[c] : peak[c]) : 0.0f;
+    float levels[3] = { peak[c], rms, tp };
+    for (unsigned int i = 0; i < 3; i++) {
+      unsigned int index = c * 3 + i;
+      published[index].store(levels[i], std::memory_order_relaxed);
+      // JS reads the shared array at any time; single aligned float stores
+      // never tear, so a reader sees either the old or the new level
+      if (shared != NULL && index < sharedLength) {
+        shared[index] = levels[i];
+      }
+    }
+    peak[c] = 0.0f;
+    sumSquares[c] = 0.0f;
+    truePeakMax[c] = 0.0f;
+  }
+  uint32_t count = windowCount.load(std::memory_order_relaxed) + 1;
+  windowCount.store(count, std::memory_order_release);
+  if (shared != NULL && numChannels * 3 < sharedLength) {
+    shared[numChannels * 3] = (float)(count & 0xffffff);
+  }
+}
+
+unsigned int LevelMeter::getNumChannels() {
+  return numChannels;
+}
+
+uint32_t LevelMeter::getWindowCount() {
+  return windowCount.load(std::memory_order_acquire);
+}
+
+void LevelMeter::getLevels(float* out) {
+  for (unsigned int i = 0; i < numChannels * 3; i++) {
+    out[i] = published[i].load(std::memory_order_relaxed);
+  }
+}
+
+void LevelMeter::setTarget(float* target, uint32_t length) {
+  this->target = target;
+  targetLength = length;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// per-channel peak, RMS and true-peak levels of interleaved float32 frames,
+// measured over consecutive windows of windowMs.
+//
+// process() runs on the capture thread. at the end of each window the levels
+// are published as linear amplitudes, three per channel (peak, rms, truePeak),
+// both to an internal snapshot that getLevels() reads and, if set, to a shared
+// target array that JS reads without calling into native code.
+//
+// true peak is the maximum of the signal upsampled 4x with a 48 tap
+// interpolation filter, as in ITU-R BS.1770, so inter-sample peaks above the
+// sample peak are caught.
+class LevelMeter {
+private:
+  unsigned int numChannels = 0;
+  size_t windowFrames = 0;
+  size_t framesInWindow = 0;
+  bool truePeak = false;
+
+  // current window, per channel
+  std::vector<float> peak;
+  std::vector<float> sumSquares;
+  std::vector<float> truePeakMax;
+
+  // last 11 samples of each channel for the interpolation filter, and room
+  // for one window of one channel behind them
+  std::vector<float> truePeakHistory;
+  std::vector<float> truePeakBuffer;
+
+  std::unique_ptr<std::atomic<float>[]> published;
+  std::atomic<uint32_t> windowCount{0};
+  float* target = NULL;
+  uint32_t targetLength = 0;
+
+  void accumulateTruePeak(const float* frames, size_t nFrames);
+  void publish();
+
+public:
+  // windowMs of 0 is not allowed. must not be called while process() runs.
+  bool configure(unsigned int numChannels, unsigned int sampleRate, unsigned int windowMs, bool truePeak);
+  void reset();
+
+  void process(const float* frames, size_t nFrames);
+
+  unsigned int getNumChannels();
+  // number of completed windows. goes up by one each time the levels change.
+  uint32_t getWindowCount();
+  // copies the levels of the last completed window, numChannels * 3 values.
+  void getLevels(float* out);
+
+  // array that publish() also writes to: the levels followed by the window
+  // count (as a float, wrapping at 2^24). length is in floats. must not be
+  // called while process() runs, and the array must outlive the next run.
+  void setTarget(float* target, uint32_t length);
+};
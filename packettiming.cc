@@ -0,0 +1,214 @@
+#include "packettiming.h"
+
+#include <math.h>
+
+#include "capturesource.h"
+
+void PacketAccounting::reset() {
+  packets.store(0);
+  discontinuities.store(0);
+  timestampErrors.store(0);
+  silentPackets.store(0);
+  gapFrames.store(0);
+  truncatedFrames.store(0);
+  hasNextPosition = false;
+}
+
+void PacketAccounting::account(uint32_t flags, uint64_t devicePosition, uint32_t nFrames) {
+  packets.fetch_add(1, std::memory_order_relaxed);
+  if (flags & CAPTURE_PACKET_DISCONTINUITY) {
+    discontinuities.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (flags & CAPTURE_PACKET_TIMESTAMP_ERROR) {
+    timestampErrors.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (flags & CAPTURE_PACKET_SILENT) {
+    silentPackets.fetch_add(1, std::memory_order_relaxed);
+  }
+  // a position past the end of the previous packet means the device
+  // produced frames that were never delivered
+  if (hasNextPosition && devicePosition > nextPosition) {
+    gapFrames.fetch_add(devicePosition - nextPosition, std::memory_order_relaxed);
+  }
+  nextPosition = devicePosition + nFrames;
+  hasNextPosition = true;
+}
+
+void PacketAccounting::addTruncated(uint64_t frames) {
+  truncatedFrames.fetch_add(frames, std::memory_order_relaxed);
+}
+
+PacketCounters PacketAccounting::getCounters() {
+  PacketCounters counters;
+  counters.packets = packets.load(std::memory_order_relaxed);
+  counters.discontinuities = discontinuities.load(std::memory_order_relaxed);
+  counters.timestampErrors = timestampErrors.load(std::memory_order_relaxed);
+  counters.silentPackets = silentPackets.load(std::memory_order_relaxed);
+  counters.gapFrames = gapFrames.load(std::memory_order_relaxed);
+  counters.truncatedFrames = truncatedFrames.load(std::memory_order_relaxed);
+  return counters;
+}
+
+// bucket i holds latencies up to 0.25 ms * 2^(i / 4)
+static const double firstBucketLimitMs = 0.25;
+static const double bucketsPerOctave = 4.0;
+
+LatencyHistogram::LatencyHistogram() {
+  reset();
+}
+
+double LatencyHistogram::getBucketLimitMs(unsigned int bucket) {
+  if (bucket + 1 >= bucketCount) {
+    return INFINITY;
+  }
+  return firstBucketLimitMs * pow(2.0, bucket / bucketsPerOctave);
+}
+
+void LatencyHistogram::reset() {
+  for (unsigned int i = 0; i < bucketCount; i++) {
+    counts[i].store(0);
+  }
+  count.store(0);
+  sumTicks.store(0);
+  minTicks.store(0);
+  maxTicks.store(0);
+}
+
+void LatencyHistogram::record(int64_t latencyTicks) {
+  if (latencyTicks < 0) {
+    latencyTicks = 0;
+  }
+  double ms = latencyTicks / 10000.0;
+  unsigned int bucket = 0;
+  if (ms > firstBucketLimitMs) {
+    bucket = (unsigned int)ceil(log2(ms / firstBucketLimitMs) * bucketsPerOctave);
+    if (bucket >= bucketCount) {
+      bucket = bucketCount - 1;
+    }
+  }
+  counts[bucket].fetch_add(1, std::memory_order_relaxed);
+
+  // only one thread records, so plain loads and stores are enough
+  uint64_t n = count.load(std::memory_order_relaxed);
+  if (n == 0 || latencyTicks < minTicks.load(std::memory_order_relaxed)) {
+    minTicks.store(latencyTicks, std::memory_order_relaxed);
+  }
+  if (n == 0 || latencyTicks > maxTicks.load(std::memory_order_relaxed)) {
+    maxTicks.store(latencyTicks, std::memory_order_relaxed);
+  }
+  sumTicks.fetch_add(latencyTicks, std::memory_order_relaxed);
+  count.store(n + 1, std::memory_order_relaxed);
+}
+
+LatencyStats LatencyHistogram::getStats() {
+  LatencyStats stats;
+  stats.count = count.load(std::memory_order_relaxed);
+  stats.minMs = minTicks.load(std::memory_order_relaxed) / 10000.0;
+  stats.maxMs = maxTicks.load(std::memory_order_relaxed) / 10000.0;
+  stats.meanMs = stats.count == 0 ? 0.0 : sumTicks.load(std::memory_order_relaxed) / 10000.0 / stats.count;
+  return stats;
+}
+
+void LatencyHistogram::getCounts(uint64_t* counts) {
+  for (unsigned int i = 0; i < bucketCount; i++) {
+    counts[i] = this->counts[i].load(std::memory_order_relaxed);
+  }
+}
+
+double LatencyHistogram::getPercentileMs(double percentile) {
+  uint64_t snapshot[bucketCount];
+  getCounts(snapshot);
+  uint64_t total = 0;
+  for (unsigned int i = 0; i < bucketCount; i++) {
+    total += snapshot[i];
+  }
+  if (total == 0) {
+    return 0.0;
+  }
+  // the recorded extremes bound the first and last bucket more tightly than
+  // their edges, the open last bucket in particular
+  double minMs = minTicks.load(std::memory_order_relaxed) / 10000.0;
+  double maxMs = maxTicks.load(std::memory_order_relaxed) / 10000.0;
+  double rank = percentile / 100.0 * total;
+  uint64_t below = 0;
+  for (unsigned int i = 0; i < bucketCount; i++) {
+    if (snapshot[i] > 0 && below + snapshot[i] >= rank) {
+      double lower = i == 0 ? 0.0 : getBucketLimitMs(i - 1);
+      double upper = getBucketLimitMs(i);
+      lower = lower > minMs ? lower : minMs;
+      upper = upper < maxMs ? upper : maxMs;
+      if (upper < lower) {
+        return lower;
+      }
+      return lower + (upper - lower) * (rank - below) / snapshot[i];
+    }
+    below += snapshot[i];
+  }
+  return maxMs;
+}
+
+void PacketTimeline::configure(size_t capacity, unsigned int deviceSampleRate, unsigned int outputSampleRate) {
+  entries.assign(capacity, Entry());
+  writeIndex.store(0, std::memory_order_relaxed);
+  readIndex.store(0, std::memory_order_relaxed);
+  droppedFlags = 0;
+  devicePerOutputFrame = (double)deviceSampleRate / outputSampleRate;
+  ticksPerOutputFrame = 10000000.0 / outputSampleRate;
+  hasBase = false;
+}
+
+void PacketTimeline::push(uint64_t frame, uint64_t devicePosition, uint64_t timestamp, uint32_t flags) {
+  uint64_t w = writeIndex.load(std::memory_order_relaxed);
+  if (w - readIndex.load(std::memory_order_acquire) >= entries.size()) {
+    droppedFlags |= flags;
+    return;
+  }
+  Entry& entry = entries[(size_t)(w % entries.size())];
+  entry.frame = frame;
+  entry.timing.devicePosition = devicePosition;
+  entry.timing.timestamp = timestamp;
+  entry.timing.flags = flags | droppedFlags;
+  droppedFlags = 0;
+  writeIndex.store(w + 1, std::memory_order_release);
+}
+
+bool PacketTimeline::lookup(uint64_t startFrame, uint64_t endFrame, ChunkTiming* timing) {
+  uint64_t r = readIndex.load(std::memory_order_relaxed);
+  uint64_t w = writeIndex.load(std::memory_order_acquire);
+
+  // the last packet starting at or before startFrame is the base. flags are
+  // reported once per packet, with the first chunk read at or after its start
+  uint32_t flags = 0;
+  while (r < w) {
+    const Entry& entry = entries[(size_t)(r % entries.size())];
+    if (entry.frame > startFrame) {
+      break;
+    }
+    base = entry;
+    hasBase = true;
+    flags |= entry.timing.flags;
+    r++;
+  }
+  if (!hasBase) {
+    readIndex.store(r, std::memory_order_release);
+    return false;
+  }
+  uint64_t offset = startFrame - base.frame;
+  timing->devicePosition = base.timing.devicePosition + (uint64_t)(offset * devicePerOutputFrame + 0.5);
+  timing->timestamp = base.timing.timestamp + (uint64_t)(offset * ticksPerOutputFrame + 0.5);
+
+  // packets inside the chunk are consumed too; the last of them becomes the
+  // base of the next lookup
+  while (r < w) {
+    const Entry& entry = entries[(size_t)(r % entries.size())];
+    if (entry.frame >= endFrame) {
+      break;
+    }
+    flags |= entry.timing.flags;
+    base = entry;
+    r++;
+  }
+  timing->flags = flags;
+  readIndex.store(r, std::memory_order_release);
+  return true;
+}
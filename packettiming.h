@@ -0,0 +1,130 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+// where a chunk of delivered frames came from: the device position of its
+// first frame, the performance counter time that frame was captured (100 ns
+// units, as reported by IAudioCaptureClient::GetBuffer) and the
+// CAPTURE_PACKET_xxx flags of the packets that start inside the chunk.
+typedef struct ChunkTiming {
+  uint64_t devicePosition;
+  uint64_t timestamp;
+  uint32_t flags;
+} ChunkTiming;
+
+typedef struct PacketCounters {
+  uint64_t packets;
+  uint64_t discontinuities;  // packets flagged CAPTURE_PACKET_DISCONTINUITY
+  uint64_t timestampErrors;  // packets flagged CAPTURE_PACKET_TIMESTAMP_ERROR
+  uint64_t silentPackets;    // packets flagged CAPTURE_PACKET_SILENT
+  uint64_t gapFrames;        // device frames skipped between packets
+  uint64_t truncatedFrames;  // frames discarded because the caller's buffer was full
+} PacketCounters;
+
+// glitch accounting of the packets read from a source. account() is called by
+// whichever thread reads packets (only one at a time); the counters can be
+// read from any thread.
+class PacketAccounting {
+private:
+  std::atomic<uint64_t> packets{0};
+  std::atomic<uint64_t> discontinuities{0};
+  std::atomic<uint64_t> timestampErrors{0};
+  std::atomic<uint64_t> silentPackets{0};
+  std::atomic<uint64_t> gapFrames{0};
+  std::atomic<uint64_t> truncatedFrames{0};
+
+  uint64_t nextPosition = 0;
+  bool hasNextPosition = false;
+
+public:
+  void reset();
+  void account(uint32_t flags, uint64_t devicePosition, uint32_t nFrames);
+  void addTruncated(uint64_t frames);
+  PacketCounters getCounters();
+};
+
+typedef struct LatencyStats {
+  uint64_t count;
+  double minMs;
+  double meanMs;
+  double maxMs;
+} LatencyStats;
+
+// histogram of delivery latency: how long before a chunk was handed to the
+// caller its newest frame was captured. buckets are spaced logarithmically,
+// four per octave from 0.25 ms, so each is about 19% wide at any scale; the
+// last bucket holds everything above 4 s.
+//
+// record() is called by whichever thread delivers chunks (only one at a
+// time); the histogram can be read from any thread.
+class LatencyHistogram {
+public:
+  static const unsigned int bucketCount = 58;
+
+private:
+  std::atomic<uint64_t> counts[bucketCount];
+  std::atomic<uint64_t> count{0};
+  std::atomic<int64_t> sumTicks{0};
+  std::atomic<int64_t> minTicks{0};
+  std::atomic<int64_t> maxTicks{0};
+
+public:
+  LatencyHistogram();
+
+  // upper edge of bucket, in ms. infinite for the last bucket.
+  static double getBucketLimitMs(unsigned int bucket);
+
+  void reset();
+  // latency in 100 ns units. negative values, from clocks that disagree
+  // slightly, count as zero.
+  void record(int64_t latencyTicks);
+
+  LatencyStats getStats();
+  // counts receives bucketCount values
+  void getCounts(uint64_t* counts);
+  // interpolated within the bucket the percentile falls in. 0 if empty.
+  double getPercentileMs(double percentile);
+};
+
+// maps frames of the capture thread's output stream back to device positions
+// and timestamps. the capture thread pushes one entry per packet with the
+// output frame its data starts at; the reader looks up the chunk it has just
+// read. positions inside a packet are extrapolated at the nominal rates, so
+// with resampling or gating they are accurate to a few frames.
+//
+// single producer / single consumer like RingBuffer. if the reader falls more
+// than `capacity` packets behind, new entries are dropped and their flags are
+// merged into the next entry that fits.
+class PacketTimeline {
+private:
+  typedef struct Entry {
+    uint64_t frame;
+    ChunkTiming timing;
+  } Entry;
+
+  std::vector<Entry> entries;
+  alignas(64) std::atomic<uint64_t> writeIndex{0};
+  alignas(64) std::atomic<uint64_t> readIndex{0};
+  uint32_t droppedFlags = 0;
+
+  double devicePerOutputFrame = 1.0;
+  double ticksPerOutputFrame = 0.0;
+
+  // last entry the reader consumed, the base for extrapolation
+  Entry base;
+  bool hasBase = false;
+
+public:
+  // must not be called while a producer or consumer is active.
+  void configure(size_t capacity, unsigned int deviceSampleRate, unsigned int outputSampleRate);
+
+  // producer side
+  void push(uint64_t frame, uint64_t devicePosition, uint64_t timestamp, uint32_t flags);
+
+  // consumer side: timing of the output frames [startFrame, endFrame). reads
+  // must be made in order. returns false if no packet has been seen yet.
+  bool lookup(uint64_t startFrame, uint64_t endFrame, ChunkTiming* timing);
+};
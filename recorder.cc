@@ -0,0 +1,710 @@
+#include "recorder.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "wakeevent.h"
+
+// RIFF header, a JUNK chunk that becomes ds64 if the segment grows past 4 GB,
+// a 16 byte fmt chunk and the data chunk header
+static const uint32_t wavHeaderBytes = 80;
+
+// data is mapped in windows of this size. must be a multiple of the system
+// allocation granularity (64 KB).
+static const uint64_t dataViewSize = 64 * 1024 * 1024;
+static const uint64_t allocationGranularity = 64 * 1024;
+
+static const uint32_t indexRingEntries = 256;
+
+#ifdef _WIN32
+static std::wstring widenPath(const std::string& path) {
+  int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+  if (length <= 0) {
+    return std::wstring();
+  }
+  std::wstring wide(length, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wide[0], length);
+  wide.resize(length - 1);
+  return wide;
+}
+
+static FILE* openFile(const std::string& path, const char* mode) {
+  return _wfopen(widenPath(path).c_str(), widenPath(mode).c_str());
+}
+
+#else
+static FILE* openFile(const std::string& path, const char* mode) {
+  return fopen(path.c_str(), mode);
+}
+#endif
+
+static void putU16(char* p, uint16_t v) {
+  memcpy(p, &v, 2);
+}
+
+static void putU32(char* p, uint32_t v) {
+  memcpy(p, &v, 4);
+}
+
+static void putU64(char* p, uint64_t v) {
+  memcpy(p, &v, 8);
+}
+
+CaptureRecorder::~CaptureRecorder() {
+  stop();
+}
+
+bool CaptureRecorder::start(const char* basePath, const RecordingFormat& format, uint64_t segmentFrames,
+  uint32_t indexIntervalFrames, uint32_t bufferFrames) {
+  if (thread.joinable() || format.frameSize == 0 || segmentFrames == 0 || bufferFrames == 0) {
+    return false;
+  }
+  this->basePath = basePath;
+  this->format = format;
+  this->segmentFrames = segmentFrames;
+  this->indexIntervalFrames = indexIntervalFrames;
+
+  ring.allocate((size_t)bufferFrames * format.frameSize);
+  indexRing.allocate(indexRingEntries * sizeof(RecordingIndexEntry));
+  acceptedFrames = 0;
+  nextIndexFrame = 0;
+  gapPending = false;
+  segmentIndex = 0;
+  writeFailed.store(false);
+  recordedFrames.store(0);
+  droppedFrames.store(0);
+  segmentCount.store(0);
+
+  indexFile = openFile(this->basePath + ".idx", "wb");
+  if (indexFile == NULL) {
+    return false;
+  }
+  RecordingIndexHeader header;
+  memcpy(header.magic, "CAPIDX01", 8);
+  header.format = format;
+  header.headerBytes = wavHeaderBytes;
+  header.segmentFrames = segmentFrames;
+  if (fwrite(&header, sizeof(header), 1, indexFile) != 1 || !openSegment()) {
+    fclose(indexFile);
+    indexFile = NULL;
+    return false;
+  }
+
+  if (wakeEvent == NULL) {
+    wakeEvent = createWakeEvent();
+  }
+  running.store(true);
+  thread = std::thread(&CaptureRecorder::run, this);
+  return true;
+}
+
+void CaptureRecorder::stop() {
+  running.store(false);
+  if (thread.joinable()) {
+    signalWakeEvent(wakeEvent);
+    thread.join();
+  }
+  closeSegment();
+  if (indexFile != NULL) {
+    fclose(indexFile);
+    indexFile = NULL;
+  }
+  if (wakeEvent != NULL) {
+    closeWakeEvent(wakeEvent);
+    wakeEvent = NULL;
+  }
+}
+
+bool CaptureRecorder::isRecording() {
+  return running.load();
+}
+
+uint64_t CaptureRecorder::getRecordedFrames() {
+  return recordedFrames.load(std::memory_order_relaxed);
+}
+
+uint64_t CaptureRecorder::getDroppedFrames() {
+  return droppedFrames.load(std::memory_order_relaxed);
+}
+
+uint32_t CaptureRecorder::getSegmentCount() {
+  return segmentCount.load(std::memory_order_relaxed);
+}
+
+bool CaptureRecorder::hasFailed() {
+  return writeFailed.load();
+}
+
+void CaptureRecorder::recordPacket(CapturePipeline* pipeline, uint32_t flags, uint64_t devicePosition, uint64_t timestamp) {
+  uint32_t produced = pipeline->getLastPacketFrames();
+  if (produced == 0) {
+    return;
+  }
+  uint32_t written = pipeline->writeLastPacket(&ring);
+
+  if (written > 0) {
+    bool discontinuity = (flags & CAPTURE_PACKET_DISCONTINUITY) != 0;
+    if (acceptedFrames == 0 || acceptedFrames >= nextIndexFrame || gapPending || discontinuity) {
+      RecordingIndexEntry entry;
+      entry.frame = acceptedFrames;
+      entry.devicePosition = devicePosition;
+      entry.timestamp = timestamp;
+      entry.byteOffset = 0;
+      entry.segment = 0;
+      entry.flags = (gapPending ? RECORDING_INDEX_GAP : 0) | (discontinuity ? RECORDING_INDEX_DISCONTINUITY : 0);
+      // if the writer is this far behind the entry is lost, but the frames
+      // still line up because entries carry their frame number
+      if (indexRing.writeAvailable() >= sizeof(entry)) {
+        indexRing.write((const char*)&entry, sizeof(entry));
+        nextIndexFrame = acceptedFrames + indexIntervalFrames;
+        gapPending = false;
+      }
+    }
+    acceptedFrames += written;
+  }
+  if (written < produced) {
+    droppedFrames.fetch_add(produced - written, std::memory_order_relaxed);
+    gapPending = true;
+  }
+
+  signalWakeEvent(wakeEvent);
+}
+
+void CaptureRecorder::run() {
+  for (;;) {
+    // read the flag before draining so the last pass sees everything the
+    // capture thread wrote before it stopped
+    bool stopping = !running.load();
+
+    RecordingIndexEntry entry;
+    while (indexRing.readAvailable() >= sizeof(entry)) {
+      indexRing.read((char*)&entry, sizeof(entry));
+      entry.segment = (uint32_t)(entry.frame / segmentFrames);
+      entry.byteOffset = wavHeaderBytes + (entry.frame % segmentFrames) * format.frameSize;
+      if (!writeFailed.load() && fwrite(&entry, sizeof(entry), 1, indexFile) != 1) {
+        writeFailed.store(true);
+      }
+    }
+
+    RingRegions regions;
+    size_t bytes = ring.beginRead(ring.readAvailable(), &regions);
+    if (bytes > 0) {
+      if (writeFailed.load()
+        || !writeFrames(regions.first, regions.firstBytes)
+        || !writeFrames(regions.second, regions.secondBytes)) {
+        writeFailed.store(true);
+        droppedFrames.fetch_add(bytes / format.frameSize, std::memory_order_relaxed);
+      }
+      ring.commitRead(bytes);
+      updateHeader();
+      fflush(indexFile);
+    }
+
+    if (stopping) {
+      break;
+    }
+    waitWakeEvent(wakeEvent, 100);
+  }
+}
+
+// bytes is a whole number of frames
+bool CaptureRecorder::writeFrames(const char* data, size_t bytes) {
+  uint64_t segmentBytes = segmentFrames * format.frameSize;
+  while (bytes > 0) {
+    if (segmentDataBytes == segmentBytes) {
+      closeSegment();
+      segmentIndex++;
+      if (!openSegment()) {
+        return false;
+      }
+    }
+    uint64_t offset = wavHeaderBytes + segmentDataBytes;
+    if (dataView == NULL || offset < dataViewOffset || offset >= dataViewOffset + dataViewBytes) {
+      if (!mapDataView(offset)) {
+        return false;
+      }
+    }
+    uint64_t chunk = std::min<uint64_t>(bytes, segmentBytes - segmentDataBytes);
+    chunk = std::min<uint64_t>(chunk, dataViewOffset + dataViewBytes - offset);
+    memcpy(dataView + (offset - dataViewOffset), data, (size_t)chunk);
+    data += chunk;
+    bytes -= (size_t)chunk;
+    segmentDataBytes += chunk;
+    recordedFrames.store(
+      ((uint64_t)segmentIndex * segmentBytes + segmentDataBytes) / format.frameSize,
+      std::memory_order_relaxed);
+  }
+  return true;
+}
+
+bool CaptureRecorder::openSegment() {
+  char suffix[16];
+  snprintf(suffix, sizeof(suffix), "-%04u.wav", segmentIndex);
+  uint64_t fileBytes = wavHeaderBytes + segmentFrames * format.frameSize;
+
+#ifdef _WIN32
+  std::wstring path = widenPath(basePath + suffix);
+
+  HANDLE file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+    CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  // creating the mapping extends the file to the full segment length up front
+  HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READWRITE,
+    (DWORD)(fileBytes >> 32), (DWORD)fileBytes, NULL);
+  if (mapping == NULL) {
+    CloseHandle(file);
+    return false;
+  }
+  headerView = (char*)MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, wavHeaderBytes);
+  if (headerView == NULL) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+  segmentFile = file;
+  segmentMapping = mapping;
+#else
+  int file = open((basePath + suffix).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (file < 0) {
+    return false;
+  }
+  // the file is extended to the full segment length up front, sparse where
+  // the file system allows
+  void* view = MAP_FAILED;
+  if (ftruncate(file, (off_t)fileBytes) == 0) {
+    view = mmap(NULL, wavHeaderBytes, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+  }
+  if (view == MAP_FAILED) {
+    close(file);
+    return false;
+  }
+  headerView = (char*)view;
+  segmentFile = file;
+#endif
+  segmentDataBytes = 0;
+  dataView = NULL;
+  updateHeader();
+  segmentCount.fetch_add(1);
+  return true;
+}
+
+bool CaptureRecorder::mapDataView(uint64_t offset) {
+  if (dataView != NULL) {
+#ifdef _WIN32
+    UnmapViewOfFile(dataView);
+#else
+    munmap(dataView, (size_t)dataViewBytes);
+#endif
+    dataView = NULL;
+  }
+  uint64_t fileBytes = wavHeaderBytes + segmentFrames * format.frameSize;
+  dataViewOffset = offset - offset % allocationGranularity;
+  dataViewBytes = std::min(dataViewSize, fileBytes - dataViewOffset);
+#ifdef _WIN32
+  dataView = (char*)MapViewOfFile(segmentMapping, FILE_MAP_WRITE,
+    (DWORD)(dataViewOffset >> 32), (DWORD)dataViewOffset, (size_t)dataViewBytes);
+#else
+  void* view = mmap(NULL, (size_t)dataViewBytes, PROT_READ | PROT_WRITE, MAP_SHARED, segmentFile, (off_t)dataViewOffset);
+  dataView = view == MAP_FAILED ? NULL : (char*)view;
+#endif
+  return dataView != NULL;
+}
+
+// wavHeaderBytes of header for dataBytes of audio
+static void buildWavHeader(char* header, const RecordingFormat& format, uint64_t dataBytes) {
+  uint64_t riffBytes = wavHeaderBytes - 8 + dataBytes;
+  bool rf64 = riffBytes > 0xFFFFFFFFull;
+
+  memset(header, 0, wavHeaderBytes);
+  memcpy(header, rf64 ? "RF64" : "RIFF", 4);
+  putU32(header + 4, rf64 ? 0xFFFFFFFF : (uint32_t)riffBytes);
+  memcpy(header + 8, "WAVE", 4);
+  memcpy(header + 12, rf64 ? "ds64" : "JUNK", 4);
+  putU32(header + 16, 28);
+  if (rf64) {
+    putU64(header + 20, riffBytes);
+    putU64(header + 28, dataBytes);
+    putU64(header + 36, dataBytes / format.frameSize);
+    putU32(header + 44, 0);
+  }
+  memcpy(header + 48, "fmt ", 4);
+  putU32(header + 52, 16);
+  putU16(header + 56, format.formatTag);
+  putU16(header + 58, format.numChannels);
+  putU32(header + 60, format.sampleRate);
+  putU32(header + 64, format.sampleRate * format.frameSize);
+  putU16(header + 68, format.frameSize);
+  putU16(header + 70, format.bitsPerSample);
+  memcpy(header + 72, "data", 4);
+  putU32(header + 76, rf64 ? 0xFFFFFFFF : (uint32_t)dataBytes);
+}
+
+void CaptureRecorder::updateHeader() {
+  if (headerView == NULL) {
+    return;
+  }
+  char header[wavHeaderBytes];
+  buildWavHeader(header, format, segmentDataBytes);
+  memcpy(headerView, header, sizeof(header));
+}
+
+bool writeWavFile(const char* path, const RecordingFormat& format, const char* data, uint64_t bytes) {
+  FILE* file = openFile(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+  char header[wavHeaderBytes];
+  buildWavHeader(header, format, bytes);
+  bool written = fwrite(header, sizeof(header), 1, file) == 1
+    && (bytes == 0 || fwrite(data, (size_t)bytes, 1, file) == 1);
+  return fclose(file) == 0 && written;
+}
+
+void CaptureRecorder::closeSegment() {
+#ifdef _WIN32
+  if (segmentFile == NULL) {
+    return;
+  }
+  updateHeader();
+  if (dataView != NULL) {
+    UnmapViewOfFile(dataView);
+    dataView = NULL;
+  }
+  UnmapViewOfFile(headerView);
+  headerView = NULL;
+  CloseHandle(segmentMapping);
+  segmentMapping = NULL;
+
+  // give back the preallocated space that was never written
+  LARGE_INTEGER length;
+  length.QuadPart = (LONGLONG)(wavHeaderBytes + segmentDataBytes);
+  if (!SetFilePointerEx(segmentFile, length, NULL, FILE_BEGIN) || !SetEndOfFile(segmentFile)) {
+    writeFailed.store(true);
+  }
+  CloseHandle(segmentFile);
+  segmentFile = NULL;
+#else
+  if (segmentFile < 0) {
+    return;
+  }
+  updateHeader();
+  if (dataView != NULL) {
+    munmap(dataView, (size_t)dataViewBytes);
+    dataView = NULL;
+  }
+  munmap(headerView, wavHeaderBytes);
+  headerView = NULL;
+
+  // give back the preallocated space that was never written
+  if (ftruncate(segmentFile, (off_t)(wavHeaderBytes + segmentDataBytes)) != 0) {
+    writeFailed.store(true);
+  }
+  close(segmentFile);
+  segmentFile = -1;
+#endif
+}
+
+// ---------------------------------------------
+// index lookup
+
+static uint64_t entryKey(const RecordingIndexEntry& entry, int keyType) {
+  switch (keyType) {
+    case RECORDING_KEY_DEVICE_POSITION: return entry.devicePosition;
+    case RECORDING_KEY_TIMESTAMP: return entry.timestamp;
+    default: return entry.frame;
+  }
+}
+
+bool findRecordingPosition(const char* indexPath, int keyType, uint64_t key, RecordingIndexEntry* result) {
+  FILE* file = openFile(indexPath, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  RecordingIndexHeader header;
+  std::vector<RecordingIndexEntry> entries;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1
+    && memcmp(header.magic, "CAPIDX01", 8) == 0
+    && header.segmentFrames > 0 && header.format.sampleRate > 0;
+  if (valid) {
+    RecordingIndexEntry entry;
+    while (fread(&entry, sizeof(entry), 1, file) == 1) {
+      entries.push_back(entry);
+    }
+  }
+  fclose(file);
+  if (!valid || entries.empty()) {
+    return false;
+  }
+
+  // last entry at or before key. all three keys grow with the frame number.
+  std::vector<RecordingIndexEntry>::iterator next = std::upper_bound(entries.begin(), entries.end(), key,
+    [keyType](uint64_t k, const RecordingIndexEntry& e) { return k < entryKey(e, keyType); });
+  const RecordingIndexEntry& entry = next == entries.begin() ? *next : *(next - 1);
+
+  const RecordingFormat& format = header.format;
+  uint64_t delta = 0;
+  uint64_t base = entryKey(entry, keyType);
+  if (key > base) {
+    delta = key - base;
+    if (keyType == RECORDING_KEY_DEVICE_POSITION && format.deviceSampleRate > 0) {
+      delta = delta * format.sampleRate / format.deviceSampleRate;
+    } else if (keyType == RECORDING_KEY_TIMESTAMP) {
+      delta = (delta * format.sampleRate + 5000000) / 10000000;
+    }
+  }
+  uint64_t frame = entry.frame + delta;
+  // a key inside a gap maps to the first frame after it
+  if (next != entries.end() && next != entries.begin() && frame > next->frame) {
+    frame = next->frame;
+  }
+
+  uint64_t offsetFrames = frame - entry.frame;
+  result->frame = frame;
+  result->devicePosition = entry.devicePosition
+    + (format.sampleRate > 0 ? offsetFrames * format.deviceSampleRate / format.sampleRate : 0);
+  result->timestamp = entry.timestamp + offsetFrames * 10000000 / format.sampleRate;
+  result->segment = (uint32_t)(frame / header.segmentFrames);
+  result->byteOffset = header.headerBytes + (frame % header.segmentFrames) * format.frameSize;
+  result->flags = entry.flags;
+  return true;
+}
+
+// ---------------------------------------------
+
+FlacRecorder::~FlacRecorder() {
+  stop();
+}
+
+bool FlacRecorder::start(const char* path, unsigned int numChannels, unsigned int bitsPerSample, unsigned int sampleRate,
+  unsigned int blockFrames, unsigned int threads, uint32_t bufferFrames) {
+  if (writer.joinable() || threads == 0 || bufferFrames < 2 * (uint64_t)blockFrames
+    || !headerEncoder.configure(numChannels, bitsPerSample, sampleRate, blockFrames)) {
+    return false;
+  }
+  this->numChannels = numChannels;
+  this->bitsPerSample = bitsPerSample;
+  this->sampleRate = sampleRate;
+  this->blockFrames = blockFrames;
+  frameSize = numChannels * bitsPerSample / 8;
+
+  file = openFile(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+  std::vector<uint8_t> header;
+  headerEncoder.writeStreamHeader(&header, 0, 0, 0);
+  if (fwrite(header.data(), 1, header.size(), file) != header.size()) {
+    fclose(file);
+    file = NULL;
+    return false;
+  }
+
+  ring.allocate((size_t)bufferFrames * frameSize);
+  jobs.resize(2 * threads);
+  for (size_t i = 0; i < jobs.size(); i++) {
+    jobs[i].input.resize((size_t)blockFrames * frameSize);
+    jobs[i].done = false;
+  }
+  queuedBlocks = 0;
+  nextEncode = 0;
+  workersExit = false;
+  nextBlock = 0;
+  nextWrite = 0;
+  writtenFrames = 0;
+  minFrameBytes = 0;
+  maxFrameBytes = 0;
+  recordedFrames.store(0);
+  droppedFrames.store(0);
+  inputBytes.store(0);
+  outputBytes.store(header.size());
+  encodeNanoseconds.store(0);
+  writeFailed.store(false);
+
+  if (wakeEvent == NULL) {
+    wakeEvent = createWakeEvent();
+  }
+  running.store(true);
+  for (unsigned int i = 0; i < threads; i++) {
+    workers.push_back(std::thread(&FlacRecorder::encode, this));
+  }
+  writer = std::thread(&FlacRecorder::run, this);
+  return true;
+}
+
+void FlacRecorder::stop() {
+  running.store(false);
+  if (writer.joinable()) {
+    signalWakeEvent(wakeEvent);
+    writer.join();
+  }
+  {
+    std::lock_guard<std::mutex> lock(jobMutex);
+    workersExit = true;
+  }
+  jobQueued.notify_all();
+  for (size_t i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+  workers.clear();
+
+  if (file != NULL) {
+    // the totals are known now. a block size below the nominal one is only
+    // allowed for the last frame, which STREAMINFO does not count.
+    std::vector<uint8_t> header;
+    headerEncoder.writeStreamHeader(&header, writtenFrames, minFrameBytes, maxFrameBytes);
+    if (fseek(file, 0, SEEK_SET) != 0 || fwrite(header.data(), 1, header.size(), file) != header.size()) {
+      writeFailed.store(true);
+    }
+    fclose(file);
+    file = NULL;
+  }
+  if (wakeEvent != NULL) {
+    closeWakeEvent(wakeEvent);
+    wakeEvent = NULL;
+  }
+}
+
+bool FlacRecorder::isRecording() {
+  return running.load();
+}
+
+uint64_t FlacRecorder::getRecordedFrames() {
+  return recordedFrames.load(std::memory_order_relaxed);
+}
+
+uint64_t FlacRecorder::getDroppedFrames() {
+  return droppedFrames.load(std::memory_order_relaxed);
+}
+
+uint64_t FlacRecorder::getInputBytes() {
+  return inputBytes.load(std::memory_order_relaxed);
+}
+
+uint64_t FlacRecorder::getOutputBytes() {
+  return outputBytes.load(std::memory_order_relaxed);
+}
+
+double FlacRecorder::getEncodeSeconds() {
+  return encodeNanoseconds.load(std::memory_order_relaxed) / 1e9;
+}
+
+bool FlacRecorder::hasFailed() {
+  return writeFailed.load();
+}
+
+void FlacRecorder::recordPacket(CapturePipeline* pipeline) {
+  uint32_t produced = pipeline->getLastPacketFrames();
+  if (produced == 0) {
+    return;
+  }
+  uint32_t written = pipeline->writeLastPacket(&ring);
+  if (written < produced) {
+    droppedFrames.fetch_add(produced - written, std::memory_order_relaxed);
+  }
+  signalWakeEvent(wakeEvent);
+}
+
+void FlacRecorder::run() {
+  size_t blockBytes = (size_t)blockFrames * frameSize;
+  for (;;) {
+    bool stopping = !running.load();
+
+    writeEncodedBlocks();
+    while (ring.readAvailable() >= blockBytes && queueBlock(blockBytes)) {
+    }
+    if (stopping) {
+      size_t rest = ring.readAvailable();
+      if (rest > 0 && rest < blockBytes) {
+        queueBlock(rest);
+      }
+      if (ring.readAvailable() == 0 && nextWrite == nextBlock) {
+        break;
+      }
+    }
+    waitWakeEvent(wakeEvent, 100);
+  }
+}
+
+// moves the next bytes of the ring into a free job. false if all jobs are in
+// flight.
+bool FlacRecorder::queueBlock(size_t bytes) {
+  if (nextBlock - nextWrite >= jobs.size()) {
+    return false;
+  }
+  FlacJob& job = jobs[nextBlock % jobs.size()];
+  ring.read(job.input.data(), bytes);
+  job.frames = bytes / frameSize;
+  job.frameNumber = nextBlock;
+  {
+    std::lock_guard<std::mutex> lock(jobMutex);
+    job.done = false;
+    queuedBlocks = ++nextBlock;
+  }
+  jobQueued.notify_one();
+  return true;
+}
+
+void FlacRecorder::writeEncodedBlocks() {
+  bool wrote = false;
+  while (nextWrite < nextBlock) {
+    FlacJob& job = jobs[nextWrite % jobs.size()];
+    {
+      std::lock_guard<std::mutex> lock(jobMutex);
+      if (!job.done) {
+        break;
+      }
+    }
+    if (writeFailed.load() || fwrite(job.output.data(), 1, job.output.size(), file) != job.output.size()) {
+      writeFailed.store(true);
+      droppedFrames.fetch_add(job.frames, std::memory_order_relaxed);
+    } else {
+      uint32_t bytes = (uint32_t)job.output.size();
+      minFrameBytes = minFrameBytes == 0 || bytes < minFrameBytes ? bytes : minFrameBytes;
+      maxFrameBytes = bytes > maxFrameBytes ? bytes : maxFrameBytes;
+      writtenFrames += job.frames;
+      recordedFrames.store(writtenFrames, std::memory_order_relaxed);
+      inputBytes.fetch_add(job.frames * frameSize, std::memory_order_relaxed);
+      outputBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    nextWrite++;
+    wrote = true;
+  }
+  if (wrote) {
+    fflush(file);
+  }
+}
+
+// encoder thread
+void FlacRecorder::encode() {
+  FlacEncoder encoder;
+  encoder.configure(numChannels, bitsPerSample, sampleRate, blockFrames);
+  std::unique_lock<std::mutex> lock(jobMutex);
+  for (;;) {
+    jobQueued.wait(lock, [this] { return workersExit || nextEncode < queuedBlocks; });
+    if (nextEncode == queuedBlocks) {
+      break;
+    }
+    FlacJob& job = jobs[nextEncode % jobs.size()];
+    nextEncode++;
+    lock.unlock();
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    encoder.encodeFrame(job.input.data(), job.frames, job.frameNumber, &job.output);
+    encodeNanoseconds.fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - begin).count(), std::memory_order_relaxed);
+
+    lock.lock();
+    job.done = true;
+    signalWakeEvent(wakeEvent);
+  }
+}
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capturepipeline.h"
+#include "capturesource.h"
+#include "flacencoder.h"
+#include "ringbuffer.h"
+
+// records the capture pipeline output to disk without touching the JS thread.
+//
+// the capture thread copies each packet into a ring owned by the recorder and
+// never waits on the disk. a writer thread drains that ring into segment files
+// <basePath>-0000.wav, <basePath>-0001.wav, ... each preallocated to the full
+// segment length and written through a memory mapping. the header is kept up to
+// date while recording, so a segment is a valid WAV file even if the process
+// dies. segments larger than 4 GB are finalized as RF64.
+//
+// <basePath>.idx is a side index: a RecordingIndexHeader followed by one
+// RecordingIndexEntry every indexIntervalFrames and after every gap, mapping
+// device position and timestamp to a segment and byte offset. see
+// findRecordingPosition().
+
+#define RECORDING_FORMAT_PCM 1
+#define RECORDING_FORMAT_FLOAT 3
+
+typedef struct RecordingFormat {
+  uint16_t formatTag; // RECORDING_FORMAT_xxx
+  uint16_t numChannels;
+  uint16_t bitsPerSample;
+  uint16_t frameSize;
+  uint32_t sampleRate;
+  // rate of the device positions stored in the index
+  uint32_t deviceSampleRate;
+} RecordingFormat;
+
+#pragma pack(push, 1)
+
+typedef struct RecordingIndexHeader {
+  char magic[8]; // "CAPIDX01"
+  RecordingFormat format;
+  uint32_t headerBytes; // bytes before the first frame of each segment
+  uint64_t segmentFrames;
+} RecordingIndexHeader;
+
+typedef struct RecordingIndexEntry {
+  uint64_t frame; // frame number in the recording, counted across segments
+  uint64_t devicePosition; // device position of the packet the frame came from
+  uint64_t timestamp; // performance counter time of that packet, 100 ns units
+  uint64_t byteOffset; // offset of that frame in its segment file
+  uint32_t segment;
+  uint32_t flags; // RECORDING_INDEX_xxx
+} RecordingIndexEntry;
+
+#pragma pack(pop)
+
+// frames before this entry were dropped because the writer fell behind
+#define RECORDING_INDEX_GAP 1
+// the device reported a discontinuity at this entry
+#define RECORDING_INDEX_DISCONTINUITY 2
+
+class CaptureRecorder {
+private:
+  std::thread thread;
+  std::atomic<bool> running{false};
+  // event (Windows) or semaphore (POSIX) the capture thread signals
+  void* wakeEvent = NULL;
+
+  std::string basePath;
+  RecordingFormat format;
+  uint64_t segmentFrames = 0;
+  uint32_t indexIntervalFrames = 0;
+
+  RingBuffer ring;
+  RingBuffer indexRing;
+
+  // capture thread side
+  uint64_t acceptedFrames = 0;
+  uint64_t nextIndexFrame = 0;
+  bool gapPending = false;
+
+  // writer thread side
+  FILE* indexFile = NULL;
+#ifdef _WIN32
+  void* segmentFile = NULL;
+  void* segmentMapping = NULL;
+#else
+  int segmentFile = -1;
+#endif
+  char* headerView = NULL;
+  char* dataView = NULL;
+  uint64_t dataViewOffset = 0;
+  uint64_t dataViewBytes = 0;
+  uint32_t segmentIndex = 0;
+  uint64_t segmentDataBytes = 0;
+  std::atomic<bool> writeFailed{false};
+
+  std::atomic<uint64_t> recordedFrames{0};
+  std::atomic<uint64_t> droppedFrames{0};
+  std::atomic<uint32_t> segmentCount{0};
+
+  void run();
+  bool writeFrames(const char* data, size_t bytes);
+  bool openSegment();
+  bool mapDataView(uint64_t offset);
+  void updateHeader();
+  void closeSegment();
+
+public:
+  ~CaptureRecorder();
+
+  // creates the index file and starts the writer thread. bufferFrames sizes the
+  // ring between the capture thread and the writer.
+  bool start(const char* basePath, const RecordingFormat& format, uint64_t segmentFrames,
+    uint32_t indexIntervalFrames, uint32_t bufferFrames);
+  // writes everything still buffered, finalizes the last segment and closes
+  // the files. the capture thread must not call recordPacket() any more.
+  void stop();
+  bool isRecording();
+
+  // capture thread: record the output of the last pipeline->processPacket().
+  // devicePosition and timestamp are those of the packet. never blocks; frames
+  // that do not fit are dropped and counted.
+  void recordPacket(CapturePipeline* pipeline, uint32_t flags, uint64_t devicePosition, uint64_t timestamp);
+
+  uint64_t getRecordedFrames();
+  uint64_t getDroppedFrames();
+  uint32_t getSegmentCount();
+  // true once a file operation failed; the recording stops growing.
+  bool hasFailed();
+};
+
+// writes bytes of audio as one WAV file with the same header as the
+// recording segments
+bool writeWavFile(const char* path, const RecordingFormat& format, const char* data, uint64_t bytes);
+
+// looks up a position in a finished or ongoing recording without scanning the
+// audio. key is a recording frame, a device position or a timestamp in 100 ns
+// units depending on keyType. *result receives the segment and byte offset of
+// the frame closest to key, interpolated from the nearest preceding entry.
+#define RECORDING_KEY_FRAME 0
+#define RECORDING_KEY_DEVICE_POSITION 1
+#define RECORDING_KEY_TIMESTAMP 2
+bool findRecordingPosition(const char* indexPath, int keyType, uint64_t key, RecordingIndexEntry* result);
+
+// records the capture pipeline output as one FLAC file, for archives where the
+// WAV segments of CaptureRecorder take too much space.
+//
+// the capture thread copies each packet into a ring exactly like
+// CaptureRecorder. a writer thread cuts the ring into blocks of blockFrames
+// and queues them to a pool of encoder threads, one FlacEncoder each; the
+// encoded frames are written in order as they complete. up to twice as many
+// blocks as threads are in flight, so a slow block does not stall the others.
+//
+// the file is readable while it grows: STREAMINFO says "unknown length" until
+// stop() rewrites it with the totals. the MD5 of STREAMINFO is not computed.
+class FlacRecorder {
+private:
+  typedef struct FlacJob {
+    std::vector<char> input;
+    size_t frames;
+    uint64_t frameNumber;
+    std::vector<uint8_t> output;
+    bool done;
+  } FlacJob;
+
+  std::thread writer;
+  std::vector<std::thread> workers;
+  std::atomic<bool> running{false};
+  // event (Windows) or semaphore (POSIX) the capture thread and the encoders
+  // signal
+  void* wakeEvent = NULL;
+
+  FlacEncoder headerEncoder;
+  unsigned int numChannels = 0;
+  unsigned int bitsPerSample = 0;
+  unsigned int frameSize = 0;
+  unsigned int sampleRate = 0;
+  unsigned int blockFrames = 0;
+  RingBuffer ring;
+
+  // jobs[n % jobs.size()] holds block n. blocks below queuedBlocks are ready
+  // for the encoders, which claim them in order through nextEncode.
+  std::vector<FlacJob> jobs;
+  std::mutex jobMutex;
+  std::condition_variable jobQueued;
+  uint64_t queuedBlocks = 0;
+  uint64_t nextEncode = 0;
+  bool workersExit = false;
+
+  // writer thread side
+  FILE* file = NULL;
+  uint64_t nextBlock = 0;
+  uint64_t nextWrite = 0;
+  uint64_t writtenFrames = 0;
+  uint32_t minFrameBytes = 0;
+  uint32_t maxFrameBytes = 0;
+
+  std::atomic<uint64_t> recordedFrames{0};
+  std::atomic<uint64_t> droppedFrames{0};
+  std::atomic<uint64_t> inputBytes{0};
+  std::atomic<uint64_t> outputBytes{0};
+  std::atomic<uint64_t> encodeNanoseconds{0};
+  std::atomic<bool> writeFailed{false};
+
+  void run();
+  void encode();
+  bool queueBlock(size_t bytes);
+  void writeEncodedBlocks();
+
+public:
+  ~FlacRecorder();
+
+  // creates the file and starts the writer and threads encoder threads.
+  // bitsPerSample is 16 or 24 (packed little-endian PCM); bufferFrames sizes
+  // the ring between the capture thread and the writer and must hold at
+  // least two blocks.
+  bool start(const char* path, unsigned int numChannels, unsigned int bitsPerSample, unsigned int sampleRate,
+    unsigned int blockFrames, unsigned int threads, uint32_t bufferFrames);
+  // encodes and writes everything still buffered, including a last partial
+  // block, and finalizes STREAMINFO. the capture thread must not call
+  // recordPacket() any more.
+  void stop();
+  bool isRecording();
+
+  // capture thread: like CaptureRecorder::recordPacket(). never blocks.
+  void recordPacket(CapturePipeline* pipeline);
+
+  uint64_t getRecordedFrames();
+  uint64_t getDroppedFrames();
+  // PCM bytes encoded and FLAC bytes written, frame headers included
+  uint64_t getInputBytes();
+  uint64_t getOutputBytes();
+  // encoder thread time, summed over the threads
+  double getEncodeSeconds();
+  bool hasFailed();
+};
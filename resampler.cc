@@ -0,0 +1,237 @@
+#include "resampler.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "simd.h"
+
+// limits the coefficient table to maxPhases * 64 floats
+static const unsigned int maxPhases = 1024;
+
+static const double pi = 3.14159265358979323846;
+
+// ---------------------------------------------
+// dot product kernels
+
+static float dotProductScalar(const float* a, const float* b, size_t n) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < n; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+#ifdef CAPTURE_SIMD_X86
+
+static float dotProductSse2(const float* a, const float* b, size_t n) {
+  __m128 sum0 = _mm_setzero_ps();
+  __m128 sum1 = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+  __m128 sum = _mm_add_ps(sum0, sum1);
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum) + dotProductScalar(a + i, b + i, n - i);
+}
+
+CAPTURE_TARGET_AVX2
+static float dotProductAvx2(const float* a, const float* b, size_t n) {
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+    sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+  }
+  __m256 sum256 = _mm256_add_ps(sum0, sum1);
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(sum256), _mm256_extractf128_ps(sum256, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+  return _mm_cvtss_f32(sum) + dotProductScalar(a + i, b + i, n - i);
+}
+
+#endif
+
+#ifdef CAPTURE_SIMD_NEON
+
+static float dotProductNeon(const float* a, const float* b, size_t n) {
+  float32x4_t sum0 = vdupq_n_f32(0.0f);
+  float32x4_t sum1 = vdupq_n_f32(0.0f);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    sum0 = vfmaq_f32(sum0, vld1q_f32(a + i), vld1q_f32(b + i));
+    sum1 = vfmaq_f32(sum1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  return vaddvq_f32(vaddq_f32(sum0, sum1)) + dotProductScalar(a + i, b + i, n - i);
+}
+
+#endif
+
+// ---------------------------------------------
+// filter design
+
+static unsigned int greatestCommonDivisor(unsigned int a, unsigned int b) {
+  while (b != 0) {
+    unsigned int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// zeroth order modified Bessel function of the first kind, for the Kaiser window
+static double besselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 50; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12) {
+      break;
+    }
+  }
+  return sum;
+}
+
+bool Resampler::configure(unsigned int inputRate, unsigned int outputRate, unsigned int numChannels, ResamplerQuality quality) {
+  if (inputRate == 0 || outputRate == 0 || numChannels == 0) {
+    return false;
+  }
+  unsigned int divisor = greatestCommonDivisor(inputRate, outputRate);
+  unsigned int up = outputRate / divisor;
+  unsigned int down = inputRate / divisor;
+  if (up > maxPhases) {
+    return false;
+  }
+
+  double beta;
+  double passband;
+  switch (quality) {
+    case RESAMPLER_QUALITY_LOW: taps = 16; beta = 5.0; passband = 0.80; break;
+    case RESAMPLER_QUALITY_HIGH: taps = 64; beta = 9.0; passband = 0.95; break;
+    default: taps = 32; beta = 7.0; passband = 0.90; break;
+  }
+  this->up = up;
+  this->down = down;
+  this->numChannels = numChannels;
+
+  // prototype filter runs at up * inputRate. cutoff is a fraction of the lower
+  // of the two Nyquist frequencies, in cycles per prototype sample.
+  double cutoff = 0.5 * passband / (up > down ? up : down);
+  size_t length = (size_t)taps * up;
+  double center = (length - 1) / 2.0;
+  std::vector<double> prototype(length);
+  for (size_t i = 0; i < length; i++) {
+    double t = i - center;
+    double sinc = t == 0.0 ? 2.0 * cutoff : sin(2.0 * pi * cutoff * t) / (pi * t);
+    double r = 2.0 * i / (length - 1) - 1.0;
+    double window = besselI0(beta * sqrt(1.0 - r * r)) / besselI0(beta);
+    prototype[i] = sinc * window;
+  }
+
+  // phase p uses prototype taps p, p + up, p + 2*up, ... with the largest index
+  // applied to the oldest input frame. normalize each phase to unity DC gain.
+  coeffs.assign(length, 0.0f);
+  for (unsigned int p = 0; p < up; p++) {
+    double sum = 0.0;
+    for (unsigned int k = 0; k < taps; k++) {
+      sum += prototype[p + (size_t)k * up];
+    }
+    for (unsigned int k = 0; k < taps; k++) {
+      coeffs[(size_t)p * taps + (taps - 1 - k)] = (float)(prototype[p + (size_t)k * up] / sum);
+    }
+  }
+
+  dotProduct = dotProductScalar;
+#if defined(CAPTURE_SIMD_X86)
+  dotProduct = cpuSupportsAvx2() ? dotProductAvx2 : dotProductSse2;
+#elif defined(CAPTURE_SIMD_NEON)
+  dotProduct = dotProductNeon;
+#endif
+
+  history.assign(numChannels, std::vector<float>());
+  reset();
+  return true;
+}
+
+void Resampler::reset() {
+  // start with taps - 1 frames of silence so the first output has a full window
+  for (unsigned int c = 0; c < numChannels; c++) {
+    history[c].assign(taps > 0 ? taps - 1 : 0, 0.0f);
+  }
+  historyFrames = taps > 0 ? taps - 1 : 0;
+  historyStart = -(int64_t)historyFrames;
+  outputIndex = 0;
+}
+
+void Resampler::reserve(size_t maxInputFrames) {
+  // process() keeps at most taps - 1 frames between calls
+  for (unsigned int c = 0; c < numChannels; c++) {
+    history[c].reserve((size_t)taps + maxInputFrames);
+  }
+}
+
+size_t Resampler::getMaxOutputFrames(size_t inputFrames) {
+  return (size_t)(((uint64_t)inputFrames * up + down - 1) / down) + 1;
+}
+
+unsigned int Resampler::getLatencyFrames() {
+  return taps / 2;
+}
+
+size_t Resampler::process(const float* in, size_t frames, float* out) {
+  // append the new input, one contiguous array per channel
+  size_t needed = historyFrames + frames;
+  for (unsigned int c = 0; c < numChannels; c++) {
+    std::vector<float>& channel = history[c];
+    if (channel.size() < needed) {
+      channel.resize(needed);
+    }
+    float* dst = channel.data() + historyFrames;
+    const float* src = in + c;
+    for (size_t i = 0; i < frames; i++) {
+      dst[i] = src[i * numChannels];
+    }
+  }
+  historyFrames = needed;
+
+  // output n uses input frames up to floor(n * down / up) with phase
+  // (n * down) mod up
+  int64_t historyEnd = historyStart + (int64_t)historyFrames;
+  size_t produced = 0;
+  for (;;) {
+    uint64_t position = outputIndex * down;
+    int64_t newest = (int64_t)(position / up);
+    if (newest >= historyEnd) {
+      break;
+    }
+    const float* phase = coeffs.data() + (size_t)(position % up) * taps;
+    size_t offset = (size_t)(newest - (taps - 1) - historyStart);
+    float* o = out + produced * numChannels;
+    for (unsigned int c = 0; c < numChannels; c++) {
+      o[c] = dotProduct(phase, history[c].data() + offset, taps);
+    }
+    produced++;
+    outputIndex++;
+  }
+
+  // drop input that no future output will use
+  int64_t keepFrom = (int64_t)((outputIndex * down) / up) - (taps - 1);
+  if (keepFrom > historyStart) {
+    size_t discard = (size_t)(keepFrom - historyStart);
+    if (discard > historyFrames) {
+      discard = historyFrames;
+    }
+    for (unsigned int c = 0; c < numChannels; c++) {
+      float* data = history[c].data();
+      memmove(data, data + discard, (historyFrames - discard) * sizeof(float));
+    }
+    historyFrames -= discard;
+    historyStart += (int64_t)discard;
+  }
+
+  return produced;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+typedef enum ResamplerQuality {
+  RESAMPLER_QUALITY_LOW = 0,    // 16 taps per phase
+  RESAMPLER_QUALITY_MEDIUM = 1, // 32 taps per phase
+  RESAMPLER_QUALITY_HIGH = 2,   // 64 taps per phase
+} ResamplerQuality;
+
+// streaming polyphase resampler for interleaved float32 audio.
+//
+// the rate change is reduced to a ratio up/down (e.g. 48000 -> 16000 is 1/3,
+// 48000 -> 44100 is 147/160) and a Kaiser-windowed sinc lowpass is split into
+// `up` phases of `taps` coefficients. each output frame is one dot product per
+// channel between a phase and the most recent `taps` input frames. input is
+// kept per channel so the dot products run over contiguous memory with SSE,
+// AVX2/FMA or NEON.
+//
+// state carries across process() calls, so packets of any size can be fed in
+// and the output is the same as resampling the whole stream at once.
+class Resampler {
+private:
+  unsigned int numChannels = 0;
+  unsigned int up = 1;
+  unsigned int down = 1;
+  unsigned int taps = 0;
+
+  // up phases of taps coefficients, each stored oldest input sample first
+  std::vector<float> coeffs;
+
+  // per-channel input history. history[c][i] is input frame historyStart + i.
+  std::vector<std::vector<float> > history;
+  size_t historyFrames = 0;
+  int64_t historyStart = 0;
+  uint64_t outputIndex = 0;
+
+  float (*dotProduct)(const float* a, const float* b, size_t n) = NULL;
+
+public:
+  // returns false if the rates are not supported (ratio too fine-grained).
+  bool configure(unsigned int inputRate, unsigned int outputRate, unsigned int numChannels, ResamplerQuality quality);
+  void reset();
+  // make room for packets of up to maxInputFrames, so process() does not
+  // allocate
+  void reserve(size_t maxInputFrames);
+
+  // upper bound of the output frames produced from inputFrames more input.
+  size_t getMaxOutputFrames(size_t inputFrames);
+
+  // delay of the filter in input frames.
+  unsigned int getLatencyFrames();
+
+  // resample `frames` interleaved input frames into out, which must hold
+  // getMaxOutputFrames(frames) frames. returns the number of output frames.
+  size_t process(const float* in, size_t frames, float* out);
+};
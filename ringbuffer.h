@@ -0,0 +1,144 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+
+// single-producer / single-consumer lock-free ring buffer of bytes.
+//
+// the producer (capture thread) only ever advances writeIndex and the consumer
+// (JS thread) only ever advances readIndex, so no locks are needed. both indices
+// count bytes monotonically and are only reduced modulo the capacity when the
+// storage is accessed. the capacity does not need to be a power of two, which
+// lets the caller size the ring as a whole number of audio frames so that a
+// frame never straddles the wrap-around point.
+//
+// storage is allocated once by allocate() and never grows, so the capture thread
+// does not allocate memory while running.
+
+typedef struct RingRegions {
+  char* first;
+  size_t firstBytes;
+  char* second;
+  size_t secondBytes;
+} RingRegions;
+
+class RingBuffer {
+private:
+  std::vector<char> storage;
+  size_t capacityBytes = 0;
+
+  // keep the two indices on separate cache lines so producer and consumer
+  // do not invalidate each other's line on every update.
+  alignas(64) std::atomic<uint64_t> writeIndex{0};
+  alignas(64) std::atomic<uint64_t> readIndex{0};
+
+  void getRegions(uint64_t index, size_t bytes, RingRegions* regions) {
+    size_t offset = (size_t)(index % capacityBytes);
+    size_t firstBytes = capacityBytes - offset;
+    if (firstBytes > bytes) {
+      firstBytes = bytes;
+    }
+    regions->first = storage.data() + offset;
+    regions->firstBytes = firstBytes;
+    regions->second = storage.data();
+    regions->secondBytes = bytes - firstBytes;
+  }
+
+public:
+  // must not be called while a producer or consumer is active.
+  void allocate(size_t bytes) {
+    storage.assign(bytes, 0);
+    capacityBytes = bytes;
+    writeIndex.store(0, std::memory_order_relaxed);
+    readIndex.store(0, std::memory_order_relaxed);
+  }
+
+  // must not be called while a producer or consumer is active.
+  void reset() {
+    writeIndex.store(0, std::memory_order_relaxed);
+    readIndex.store(0, std::memory_order_relaxed);
+  }
+
+  size_t capacity() const {
+    return capacityBytes;
+  }
+
+  // bytes that the consumer can read. safe to call from either side.
+  size_t readAvailable() const {
+    uint64_t w = writeIndex.load(std::memory_order_acquire);
+    uint64_t r = readIndex.load(std::memory_order_acquire);
+    return (size_t)(w - r);
+  }
+
+  // bytes that the producer can write. safe to call from either side.
+  size_t writeAvailable() const {
+    return capacityBytes - readAvailable();
+  }
+
+  // bytes written / read since allocate(), i.e. the stream offset of the next
+  // byte each side will touch. each side may read its own index at any time.
+  uint64_t writePosition() const {
+    return writeIndex.load(std::memory_order_relaxed);
+  }
+
+  uint64_t readPosition() const {
+    return readIndex.load(std::memory_order_relaxed);
+  }
+
+  // producer side: get up to two contiguous spans where the next `bytes` bytes
+  // can be written in place, then call commitWrite() with the number actually
+  // written. `bytes` is clamped to the free space.
+  size_t beginWrite(size_t bytes, RingRegions* regions) {
+    size_t available = writeAvailable();
+    if (bytes > available) {
+      bytes = available;
+    }
+    getRegions(writeIndex.load(std::memory_order_relaxed), bytes, regions);
+    return bytes;
+  }
+
+  void commitWrite(size_t bytes) {
+    writeIndex.store(writeIndex.load(std::memory_order_relaxed) + bytes, std::memory_order_release);
+  }
+
+  // consumer side counterparts of beginWrite() / commitWrite().
+  size_t beginRead(size_t bytes, RingRegions* regions) {
+    size_t available = readAvailable();
+    if (bytes > available) {
+      bytes = available;
+    }
+    getRegions(readIndex.load(std::memory_order_relaxed), bytes, regions);
+    return bytes;
+  }
+
+  void commitRead(size_t bytes) {
+    readIndex.store(readIndex.load(std::memory_order_relaxed) + bytes, std::memory_order_release);
+  }
+
+  // copy up to `bytes` bytes into the ring. returns the number of bytes written,
+  // which is less than requested when the ring is full.
+  size_t write(const char* data, size_t bytes) {
+    RingRegions regions;
+    bytes = beginWrite(bytes, &regions);
+    memcpy(regions.first, data, regions.firstBytes);
+    if (regions.secondBytes > 0) {
+      memcpy(regions.second, data + regions.firstBytes, regions.secondBytes);
+    }
+    commitWrite(bytes);
+    return bytes;
+  }
+
+  // copy up to `bytes` bytes out of the ring. returns the number of bytes read.
+  size_t read(char* out, size_t bytes) {
+    RingRegions regions;
+    bytes = beginRead(bytes, &regions);
+    memcpy(out, regions.first, regions.firstBytes);
+    if (regions.secondBytes > 0) {
+      memcpy(out + regions.firstBytes, regions.second, regions.secondBytes);
+    }
+    commitRead(bytes);
+    return bytes;
+  }
+};
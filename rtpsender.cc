@@ -0,0 +1,397 @@
+#include "rtpsender.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <errno.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "wakeevent.h"
+
+static const size_t rtpHeaderBytes = 12;
+// packets sent per system call at most
+static const size_t maxBatchPackets = 32;
+static const uint32_t gapRingEntries = 64;
+
+#ifdef _WIN32
+static const uintptr_t noSocket = INVALID_SOCKET;
+#else
+static const int noSocket = -1;
+#endif
+
+static double nowMs() {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void putU16BigEndian(char* p, uint16_t v) {
+  p[0] = (char)(v >> 8);
+  p[1] = (char)v;
+}
+
+static void putU32BigEndian(char* p, uint32_t v) {
+  p[0] = (char)(v >> 24);
+  p[1] = (char)(v >> 16);
+  p[2] = (char)(v >> 8);
+  p[3] = (char)v;
+}
+
+// little-endian samples to network byte order
+static void swapSamples(const char* in, size_t bytes, unsigned int bytesPerSample, char* out) {
+  if (bytesPerSample == 2) {
+    for (size_t i = 0; i < bytes; i += 2) {
+      out[i] = in[i + 1];
+      out[i + 1] = in[i];
+    }
+  } else {
+    for (size_t i = 0; i < bytes; i += 3) {
+      out[i] = in[i + 2];
+      out[i + 1] = in[i + 1];
+      out[i + 2] = in[i];
+    }
+  }
+}
+
+RtpSender::~RtpSender() {
+  stop();
+}
+
+bool RtpSender::start(const char* host, uint16_t port, unsigned int numChannels, unsigned int bytesPerSample,
+  unsigned int sampleRate, unsigned int packetFrames, uint8_t payloadType, uint32_t ssrc, uint32_t bufferFrames) {
+  if (thread.joinable() || numChannels == 0 || (bytesPerSample != 2 && bytesPerSample != 3) || sampleRate == 0
+    || packetFrames == 0 || payloadType > 127 || bufferFrames < 2 * (uint64_t)packetFrames) {
+    return false;
+  }
+  frameSize = numChannels * bytesPerSample;
+  size_t maxPacketBytes = rtpHeaderBytes + (size_t)packetFrames * frameSize;
+  // largest UDP payload over IPv4
+  if (maxPacketBytes > 65507) {
+    return false;
+  }
+
+#ifdef _WIN32
+  WSADATA wsaData;
+  if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+    return false;
+  }
+#endif
+  networkStarted = true;
+  char service[8];
+  snprintf(service, sizeof(service), "%u", (unsigned int)port);
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_protocol = IPPROTO_UDP;
+  struct addrinfo* addresses = NULL;
+  if (getaddrinfo(host, service, &hints, &addresses) != 0) {
+    closeSocket();
+    return false;
+  }
+  // a connected socket sends without an address per packet and takes
+  // sendmmsg() without one per message
+  for (struct addrinfo* address = addresses; address != NULL; address = address->ai_next) {
+    socketHandle = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (socketHandle == noSocket) {
+      continue;
+    }
+    if (connect(socketHandle, address->ai_addr, (int)address->ai_addrlen) == 0) {
+      break;
+    }
+#ifdef _WIN32
+    closesocket(socketHandle);
+#else
+    close(socketHandle);
+#endif
+    socketHandle = noSocket;
+  }
+  freeaddrinfo(addresses);
+  if (socketHandle == noSocket) {
+    closeSocket();
+    return false;
+  }
+
+  this->numChannels = numChannels;
+  this->bytesPerSample = bytesPerSample;
+  this->sampleRate = sampleRate;
+  this->packetFrames = packetFrames;
+  this->payloadType = payloadType;
+  std::random_device random;
+  this->ssrc = ssrc != 0 ? ssrc : (uint32_t)random();
+  sequence = (uint16_t)random();
+  firstTimestamp = (uint32_t)random();
+
+  ring.allocate((size_t)bufferFrames * frameSize);
+  gapRing.allocate(gapRingEntries * sizeof(RtpGap));
+  packets.resize(maxBatchPackets * maxPacketBytes);
+  packetBytes.resize(maxBatchPackets);
+  packetPositions.resize(maxBatchPackets);
+  acceptedFrames = 0;
+  hasDevicePosition = false;
+  pendingGapFrames = 0;
+  sentFrames = 0;
+  skippedFrames = 0;
+  markerPending = true;
+  hasNextGap = false;
+  hasTransit = false;
+  jitter = 0;
+  packetCount.store(0);
+  byteCount.store(0);
+  sendCalls.store(0);
+  sendErrors.store(0);
+  droppedFrames.store(0);
+  gapFrames.store(0);
+  jitterMs.store(0);
+  maxLagMs.store(0);
+
+  if (wakeEvent == NULL) {
+    wakeEvent = createWakeEvent();
+  }
+  running.store(true);
+  thread = std::thread(&RtpSender::run, this);
+  return true;
+}
+
+void RtpSender::stop() {
+  running.store(false);
+  if (thread.joinable()) {
+    signalWakeEvent(wakeEvent);
+    thread.join();
+  }
+  closeSocket();
+  if (wakeEvent != NULL) {
+    closeWakeEvent(wakeEvent);
+    wakeEvent = NULL;
+  }
+}
+
+// also balances the WSAStartup() of start(), so only once per start()
+void RtpSender::closeSocket() {
+  if (!networkStarted) {
+    return;
+  }
+#ifdef _WIN32
+  if (socketHandle != noSocket) {
+    closesocket(socketHandle);
+  }
+  WSACleanup();
+#else
+  if (socketHandle != noSocket) {
+    close(socketHandle);
+  }
+#endif
+  socketHandle = noSocket;
+  networkStarted = false;
+}
+
+bool RtpSender::isSending() {
+  return running.load();
+}
+
+uint32_t RtpSender::getSsrc() {
+  return ssrc;
+}
+
+RtpSenderStats RtpSender::getStats() {
+  RtpSenderStats stats;
+  stats.packets = packetCount.load(std::memory_order_relaxed);
+  stats.bytes = byteCount.load(std::memory_order_relaxed);
+  stats.sendCalls = sendCalls.load(std::memory_order_relaxed);
+  stats.sendErrors = sendErrors.load(std::memory_order_relaxed);
+  stats.droppedFrames = droppedFrames.load(std::memory_order_relaxed);
+  stats.gapFrames = gapFrames.load(std::memory_order_relaxed);
+  stats.jitterMs = jitterMs.load(std::memory_order_relaxed);
+  stats.maxLagMs = maxLagMs.load(std::memory_order_relaxed);
+  return stats;
+}
+
+// capture thread. a gap that does not fit the gap ring is carried to the next
+// packet; the timestamps still advance, only a little late.
+void RtpSender::addGap(uint64_t frames) {
+  pendingGapFrames += frames;
+  if (pendingGapFrames > 0 && gapRing.writeAvailable() >= sizeof(RtpGap)) {
+    RtpGap gap;
+    gap.frame = acceptedFrames;
+    gap.frames = pendingGapFrames;
+    gapRing.write((const char*)&gap, sizeof(gap));
+    pendingGapFrames = 0;
+  }
+}
+
+void RtpSender::sendPacket(CapturePipeline* pipeline, uint64_t devicePosition, uint32_t deviceFrames) {
+  unsigned int deviceSampleRate = pipeline->getInputSampleRate();
+  if (hasDevicePosition && devicePosition > expectedDevicePosition && deviceSampleRate > 0) {
+    addGap((devicePosition - expectedDevicePosition) * sampleRate / deviceSampleRate);
+  }
+  expectedDevicePosition = devicePosition + deviceFrames;
+  hasDevicePosition = true;
+
+  uint32_t produced = pipeline->getLastPacketFrames();
+  if (produced == 0) {
+    return;
+  }
+  // the gap entry goes in before the frames after it, so the sender always
+  // sees it in time
+  uint32_t written = pipeline->writeLastPacket(&ring);
+  acceptedFrames += written;
+  if (written < produced) {
+    droppedFrames.fetch_add(produced - written, std::memory_order_relaxed);
+    addGap(produced - written);
+  }
+  signalWakeEvent(wakeEvent);
+}
+
+void RtpSender::run() {
+  for (;;) {
+    // read the flag before draining so the last pass sees everything the
+    // capture thread wrote before it stopped
+    bool stopping = !running.load();
+
+    size_t count;
+    while ((count = buildPackets(stopping)) > 0) {
+      sendPackets(count);
+    }
+
+    if (stopping) {
+      break;
+    }
+    waitWakeEvent(wakeEvent, 100);
+  }
+}
+
+// fills up to maxBatchPackets packets from the ring. a packet is cut short at
+// a gap, and at the end of the ring only if flush.
+size_t RtpSender::buildPackets(bool flush) {
+  size_t maxPacketBytes = rtpHeaderBytes + (size_t)packetFrames * frameSize;
+  size_t count = 0;
+  while (count < maxBatchPackets) {
+    // frames first, then gaps: a gap before any readable frame is visible
+    uint64_t available = ring.readAvailable() / frameSize;
+    for (;;) {
+      if (!hasNextGap && gapRing.readAvailable() >= sizeof(RtpGap)) {
+        gapRing.read((char*)&nextGap, sizeof(nextGap));
+        hasNextGap = true;
+      }
+      if (!hasNextGap || nextGap.frame > sentFrames) {
+        break;
+      }
+      skippedFrames += nextGap.frames;
+      gapFrames.fetch_add(nextGap.frames, std::memory_order_relaxed);
+      markerPending = true;
+      hasNextGap = false;
+    }
+
+    uint64_t frames = available < packetFrames ? available : packetFrames;
+    bool cut = false;
+    if (hasNextGap && nextGap.frame - sentFrames <= frames) {
+      frames = nextGap.frame - sentFrames;
+      cut = true;
+    }
+    if (frames == 0 || (frames < packetFrames && !cut && !flush)) {
+      break;
+    }
+
+    char* packet = packets.data() + count * maxPacketBytes;
+    uint64_t position = sentFrames + skippedFrames;
+    packet[0] = (char)0x80; // version 2, no padding, extension or CSRCs
+    packet[1] = (char)((markerPending ? 0x80 : 0) | payloadType);
+    putU16BigEndian(packet + 2, sequence);
+    putU32BigEndian(packet + 4, firstTimestamp + (uint32_t)position);
+    putU32BigEndian(packet + 8, ssrc);
+
+    size_t bytes = (size_t)frames * frameSize;
+    RingRegions regions;
+    ring.beginRead(bytes, &regions);
+    swapSamples(regions.first, regions.firstBytes, bytesPerSample, packet + rtpHeaderBytes);
+    if (regions.secondBytes > 0) {
+      swapSamples(regions.second, regions.secondBytes, bytesPerSample, packet + rtpHeaderBytes + regions.firstBytes);
+    }
+    ring.commitRead(bytes);
+
+    packetBytes[count] = rtpHeaderBytes + bytes;
+    packetPositions[count] = position;
+    count++;
+    sequence++;
+    sentFrames += frames;
+    markerPending = false;
+  }
+  return count;
+}
+
+void RtpSender::sendPackets(size_t count) {
+  size_t maxPacketBytes = rtpHeaderBytes + (size_t)packetFrames * frameSize;
+  size_t sent = 0;
+  uint64_t bytes = 0;
+#ifdef __linux__
+  struct mmsghdr messages[maxBatchPackets];
+  struct iovec vectors[maxBatchPackets];
+  memset(messages, 0, count * sizeof(struct mmsghdr));
+  for (size_t i = 0; i < count; i++) {
+    vectors[i].iov_base = packets.data() + i * maxPacketBytes;
+    vectors[i].iov_len = packetBytes[i];
+    messages[i].msg_hdr.msg_iov = &vectors[i];
+    messages[i].msg_hdr.msg_iovlen = 1;
+  }
+  size_t next = 0;
+  while (next < count) {
+    int result = sendmmsg(socketHandle, messages + next, (unsigned int)(count - next), 0);
+    sendCalls.fetch_add(1, std::memory_order_relaxed);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      // e.g. ECONNREFUSED while nobody listens: skip the packet it was for
+      sendErrors.fetch_add(1, std::memory_order_relaxed);
+      next++;
+      continue;
+    }
+    for (int i = 0; i < result; i++) {
+      bytes += packetBytes[next + i];
+    }
+    sent += result;
+    next += result;
+  }
+#else
+  for (size_t i = 0; i < count; i++) {
+    sendCalls.fetch_add(1, std::memory_order_relaxed);
+    if (send(socketHandle, packets.data() + i * maxPacketBytes, (int)packetBytes[i], 0) < 0) {
+      sendErrors.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    bytes += packetBytes[i];
+    sent++;
+  }
+#endif
+  packetCount.fetch_add(sent, std::memory_order_relaxed);
+  byteCount.fetch_add(bytes, std::memory_order_relaxed);
+
+  // RFC 3550 section 6.4.1 with the send time as the arrival time: transit
+  // is the send time minus the media time of the packet
+  double now = nowMs();
+  for (size_t i = 0; i < count; i++) {
+    double transit = now - packetPositions[i] * 1000.0 / sampleRate;
+    if (!hasTransit) {
+      hasTransit = true;
+      minTransitMs = transit;
+      lastTransitMs = transit;
+    }
+    double d = transit - lastTransitMs;
+    jitter += ((d < 0 ? -d : d) - jitter) / 16;
+    lastTransitMs = transit;
+    if (transit < minTransitMs) {
+      minTransitMs = transit;
+    }
+    if (transit - minTransitMs > maxLagMs.load(std::memory_order_relaxed)) {
+      maxLagMs.store(transit - minTransitMs, std::memory_order_relaxed);
+    }
+  }
+  jitterMs.store(jitter, std::memory_order_relaxed);
+}
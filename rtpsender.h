@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "capturepipeline.h"
+#include "ringbuffer.h"
+
+// streams the capture pipeline output over UDP as RTP (RFC 3550), L16 or L24
+// payload (RFC 3551: big-endian samples, interleaved), so audio can go to a
+// network service without passing through JS.
+//
+// the capture thread copies each packet into a ring like CaptureRecorder and
+// never waits on the network. a sender thread cuts the ring into packets of
+// packetFrames and sends everything that is ready in one go: sendmmsg() on
+// Linux, one send() per packet elsewhere.
+//
+// RTP timestamps follow the capture position: they advance by the frames sent
+// plus the frames that never reached the ring, whether the device skipped them
+// (a jump in device position) or the ring was full. the first packet after
+// such a gap has the marker bit set. sequence numbers, the first timestamp
+// and the SSRC start random as RFC 3550 asks.
+typedef struct RtpSenderStats {
+  uint64_t packets;
+  uint64_t bytes; // UDP payload bytes, RTP headers included
+  uint64_t sendCalls; // system calls; packets / sendCalls is the batch size
+  uint64_t sendErrors; // packets the socket refused
+  uint64_t droppedFrames; // frames that did not fit the ring
+  uint64_t gapFrames; // dropped frames plus frames the device skipped
+  // RFC 3550 jitter of the send times against the RTP timestamps, and the
+  // largest lag of a send behind the earliest one, in ms. jitter the sender
+  // adds before the network does.
+  double jitterMs;
+  double maxLagMs;
+} RtpSenderStats;
+
+class RtpSender {
+private:
+  typedef struct RtpGap {
+    uint64_t frame; // frames accepted into the ring before the gap
+    uint64_t frames;
+  } RtpGap;
+
+  std::thread thread;
+  std::atomic<bool> running{false};
+  // event (Windows) or semaphore (POSIX) the capture thread signals
+  void* wakeEvent = NULL;
+  bool networkStarted = false;
+#ifdef _WIN32
+  uintptr_t socketHandle = ~(uintptr_t)0;
+#else
+  int socketHandle = -1;
+#endif
+
+  unsigned int numChannels = 0;
+  unsigned int bytesPerSample = 0;
+  unsigned int frameSize = 0;
+  unsigned int sampleRate = 0;
+  unsigned int packetFrames = 0;
+  uint8_t payloadType = 0;
+  uint32_t ssrc = 0;
+  RingBuffer ring;
+  RingBuffer gapRing;
+
+  // capture thread side
+  uint64_t acceptedFrames = 0;
+  uint64_t expectedDevicePosition = 0;
+  bool hasDevicePosition = false;
+  uint64_t pendingGapFrames = 0;
+
+  // sender thread side
+  uint16_t sequence = 0;
+  uint32_t firstTimestamp = 0;
+  uint64_t sentFrames = 0;
+  uint64_t skippedFrames = 0;
+  bool markerPending = true;
+  RtpGap nextGap;
+  bool hasNextGap = false;
+  std::vector<char> packets;
+  std::vector<size_t> packetBytes;
+  // timestamp of each packet in frames since the first, for the jitter
+  std::vector<uint64_t> packetPositions;
+  bool hasTransit = false;
+  double minTransitMs = 0;
+  double lastTransitMs = 0;
+  double jitter = 0;
+
+  std::atomic<uint64_t> packetCount{0};
+  std::atomic<uint64_t> byteCount{0};
+  std::atomic<uint64_t> sendCalls{0};
+  std::atomic<uint64_t> sendErrors{0};
+  std::atomic<uint64_t> droppedFrames{0};
+  std::atomic<uint64_t> gapFrames{0};
+  std::atomic<double> jitterMs{0};
+  std::atomic<double> maxLagMs{0};
+
+  void addGap(uint64_t frames);
+  void run();
+  size_t buildPackets(bool flush);
+  void sendPackets(size_t count);
+  void closeSocket();
+
+public:
+  ~RtpSender();
+
+  // resolves host and connects a UDP socket to it, then starts the sender
+  // thread. bytesPerSample is 2 (L16) or 3 (L24); the pipeline output must be
+  // int16 or int24 of this size. payloadType is usually a dynamic type (96 to
+  // 127) agreed with the receiver; ssrc of 0 picks a random one. bufferFrames
+  // sizes the ring between the capture thread and the sender.
+  bool start(const char* host, uint16_t port, unsigned int numChannels, unsigned int bytesPerSample,
+    unsigned int sampleRate, unsigned int packetFrames, uint8_t payloadType, uint32_t ssrc, uint32_t bufferFrames);
+  // sends what is still buffered and closes the socket. the capture thread
+  // must not call sendPacket() any more.
+  void stop();
+  bool isSending();
+
+  // capture thread: send the output of the last pipeline->processPacket().
+  // devicePosition and deviceFrames are those of the device packet. never
+  // blocks.
+  void sendPacket(CapturePipeline* pipeline, uint64_t devicePosition, uint32_t deviceFrames);
+
+  uint32_t getSsrc();
+  RtpSenderStats getStats();
+};
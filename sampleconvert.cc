@@ -0,0 +1,390 @@
+#include "sampleconvert.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "simd.h"
+
+unsigned int getSampleFormatBytes(SampleFormat format) {
+  switch (format) {
+    case SAMPLE_FORMAT_INT16: return 2;
+    case SAMPLE_FORMAT_INT24: return 3;
+    default: return 4;
+  }
+}
+
+// ---------------------------------------------
+// scalar reference kernels
+
+static inline uint32_t xorshift32(uint32_t* state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+// uniform in [-0.5, 0.5): put 23 random bits in the mantissa of a float in [1, 2)
+static inline float ditherUniform(uint32_t* state) {
+  uint32_t bits = (xorshift32(state) >> 9) | 0x3f800000;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f - 1.5f;
+}
+
+// the comparisons are written so that NaN clips to the upper bound, which is
+// what the min/max instructions of the vector kernels do.
+static inline float clip(float x, float lo, float hi) {
+  x = x < hi ? x : hi;
+  return x > lo ? x : lo;
+}
+
+static void convertInt16Scalar(const float* in, size_t n, int16_t* out, uint32_t* state0, uint32_t* state1) {
+  for (size_t i = 0; i < n; i++) {
+    float x = in[i] * 32768.0f;
+    if (state0 != NULL) {
+      x += ditherUniform(state0) + ditherUniform(state1);
+    }
+    out[i] = (int16_t)lrintf(clip(x, -32768.0f, 32767.0f));
+  }
+}
+
+static inline void storeInt24(char* out, int32_t v) {
+  out[0] = (char)(v & 0xff);
+  out[1] = (char)((v >> 8) & 0xff);
+  out[2] = (char)((v >> 16) & 0xff);
+}
+
+static void convertInt24Scalar(const float* in, size_t n, char* out, uint32_t* state0, uint32_t* state1) {
+  for (size_t i = 0; i < n; i++) {
+    float x = in[i] * 8388608.0f;
+    if (state0 != NULL) {
+      x += ditherUniform(state0) + ditherUniform(state1);
+    }
+    storeInt24(out + i * 3, (int32_t)lrintf(clip(x, -8388608.0f, 8388607.0f)));
+  }
+}
+
+// ---------------------------------------------
+// x86 kernels. all conversions rely on the default MXCSR rounding mode
+// (round to nearest even), the same mode lrintf uses.
+
+#ifdef CAPTURE_SIMD_X86
+
+static inline __m128 ditherUniformSse2(__m128i* state) {
+  __m128i x = *state;
+  x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+  x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+  x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+  *state = x;
+  __m128i bits = _mm_or_si128(_mm_srli_epi32(x, 9), _mm_set1_epi32(0x3f800000));
+  return _mm_sub_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1.5f));
+}
+
+// returns the number of samples converted; the caller finishes the tail.
+static size_t convertInt16Sse2(const float* in, size_t n, int16_t* out, uint32_t* ditherState0, uint32_t* ditherState1) {
+  const __m128 scale = _mm_set1_ps(32768.0f);
+  const __m128 lo = _mm_set1_ps(-32768.0f);
+  const __m128 hi = _mm_set1_ps(32767.0f);
+  bool dither = ditherState0 != NULL;
+  __m128i s0 = _mm_setzero_si128(), s1 = _mm_setzero_si128();
+  if (dither) {
+    s0 = _mm_loadu_si128((const __m128i*)ditherState0);
+    s1 = _mm_loadu_si128((const __m128i*)ditherState1);
+  }
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128 a = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+    __m128 b = _mm_mul_ps(_mm_loadu_ps(in + i + 4), scale);
+    if (dither) {
+      a = _mm_add_ps(a, _mm_add_ps(ditherUniformSse2(&s0), ditherUniformSse2(&s1)));
+      b = _mm_add_ps(b, _mm_add_ps(ditherUniformSse2(&s0), ditherUniformSse2(&s1)));
+    }
+    a = _mm_max_ps(_mm_min_ps(a, hi), lo);
+    b = _mm_max_ps(_mm_min_ps(b, hi), lo);
+    __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+    _mm_storeu_si128((__m128i*)(out + i), packed);
+  }
+
+  if (dither) {
+    _mm_storeu_si128((__m128i*)ditherState0, s0);
+    _mm_storeu_si128((__m128i*)ditherState1, s1);
+  }
+  return i;
+}
+
+static size_t convertInt24Sse2(const float* in, size_t n, char* out, uint32_t* ditherState0, uint32_t* ditherState1) {
+  const __m128 scale = _mm_set1_ps(8388608.0f);
+  const __m128 lo = _mm_set1_ps(-8388608.0f);
+  const __m128 hi = _mm_set1_ps(8388607.0f);
+  bool dither = ditherState0 != NULL;
+  __m128i s0 = _mm_setzero_si128(), s1 = _mm_setzero_si128();
+  if (dither) {
+    s0 = _mm_loadu_si128((const __m128i*)ditherState0);
+    s1 = _mm_loadu_si128((const __m128i*)ditherState1);
+  }
+
+  // SSE2 has no byte shuffle, so the 4-to-3 byte packing is done per sample
+  // from a small stack buffer.
+  int32_t values[4];
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 a = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+    if (dither) {
+      a = _mm_add_ps(a, _mm_add_ps(ditherUniformSse2(&s0), ditherUniformSse2(&s1)));
+    }
+    a = _mm_max_ps(_mm_min_ps(a, hi), lo);
+    _mm_storeu_si128((__m128i*)values, _mm_cvtps_epi32(a));
+    char* o = out + i * 3;
+    storeInt24(o, values[0]);
+    storeInt24(o + 3, values[1]);
+    storeInt24(o + 6, values[2]);
+    storeInt24(o + 9, values[3]);
+  }
+
+  if (dither) {
+    _mm_storeu_si128((__m128i*)ditherState0, s0);
+    _mm_storeu_si128((__m128i*)ditherState1, s1);
+  }
+  return i;
+}
+
+CAPTURE_TARGET_AVX2
+static inline __m256 ditherUniformAvx2(__m256i* state) {
+  __m256i x = *state;
+  x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+  x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+  x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+  *state = x;
+  __m256i bits = _mm256_or_si256(_mm256_srli_epi32(x, 9), _mm256_set1_epi32(0x3f800000));
+  return _mm256_sub_ps(_mm256_castsi256_ps(bits), _mm256_set1_ps(1.5f));
+}
+
+CAPTURE_TARGET_AVX2
+static size_t convertInt16Avx2(const float* in, size_t n, int16_t* out, uint32_t* ditherState0, uint32_t* ditherState1) {
+  const __m256 scale = _mm256_set1_ps(32768.0f);
+  const __m256 lo = _mm256_set1_ps(-32768.0f);
+  const __m256 hi = _mm256_set1_ps(32767.0f);
+  bool dither = ditherState0 != NULL;
+  __m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256();
+  if (dither) {
+    s0 = _mm256_loadu_si256((const __m256i*)ditherState0);
+    s1 = _mm256_loadu_si256((const __m256i*)ditherState1);
+  }
+
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256 a = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+    __m256 b = _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale);
+    if (dither) {
+      a = _mm256_add_ps(a, _mm256_add_ps(ditherUniformAvx2(&s0), ditherUniformAvx2(&s1)));
+      b = _mm256_add_ps(b, _mm256_add_ps(ditherUniformAvx2(&s0), ditherUniformAvx2(&s1)));
+    }
+    a = _mm256_max_ps(_mm256_min_ps(a, hi), lo);
+    b = _mm256_max_ps(_mm256_min_ps(b, hi), lo);
+    // packs works within 128-bit lanes, so restore sample order afterwards
+    __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+    packed = _mm256_permute4x64_epi64(packed, 0xD8);
+    _mm256_storeu_si256((__m256i*)(out + i), packed);
+  }
+
+  if (dither) {
+    _mm256_storeu_si256((__m256i*)ditherState0, s0);
+    _mm256_storeu_si256((__m256i*)ditherState1, s1);
+  }
+  return i;
+}
+
+CAPTURE_TARGET_AVX2
+static size_t convertInt24Avx2(const float* in, size_t n, char* out, uint32_t* ditherState0, uint32_t* ditherState1) {
+  const __m256 scale = _mm256_set1_ps(8388608.0f);
+  const __m256 lo = _mm256_set1_ps(-8388608.0f);
+  const __m256 hi = _mm256_set1_ps(8388607.0f);
+  // per 128-bit lane: keep the low 3 bytes of each int32, zero the last 4 bytes
+  const __m256i pack = _mm256_setr_epi8(
+    0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+    0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+  bool dither = ditherState0 != NULL;
+  __m256i s0 = _mm256_setzero_si256(), s1 = _mm256_setzero_si256();
+  if (dither) {
+    s0 = _mm256_loadu_si256((const __m256i*)ditherState0);
+    s1 = _mm256_loadu_si256((const __m256i*)ditherState1);
+  }
+
+  // each 16-byte store writes 4 bytes past the 12 it means to. stopping while
+  // at least 8 more samples remain keeps those bytes inside the output, where
+  // the next iteration or the scalar tail overwrites them.
+  size_t i = 0;
+  for (; i + 16 <= n; i += 8) {
+    __m256 a = _mm256_mul_ps(_mm256_loadu_ps(in + i), scale);
+    if (dither) {
+      a = _mm256_add_ps(a, _mm256_add_ps(ditherUniformAvx2(&s0), ditherUniformAvx2(&s1)));
+    }
+    a = _mm256_max_ps(_mm256_min_ps(a, hi), lo);
+    __m256i packed = _mm256_shuffle_epi8(_mm256_cvtps_epi32(a), pack);
+    char* o = out + i * 3;
+    _mm_storeu_si128((__m128i*)o, _mm256_castsi256_si128(packed));
+    _mm_storeu_si128((__m128i*)(o + 12), _mm256_extracti128_si256(packed, 1));
+  }
+
+  if (dither) {
+    _mm256_storeu_si256((__m256i*)ditherState0, s0);
+    _mm256_storeu_si256((__m256i*)ditherState1, s1);
+  }
+  return i;
+}
+
+#endif
+
+// ---------------------------------------------
+// ARM64 kernels. vcvtnq rounds to nearest even like lrintf; vminnm/vmaxnm
+// return the number when one operand is NaN, which clips NaN to hi.
+
+#ifdef CAPTURE_SIMD_NEON
+
+static inline float32x4_t ditherUniformNeon(uint32x4_t* state) {
+  uint32x4_t x = *state;
+  x = veorq_u32(x, vshlq_n_u32(x, 13));
+  x = veorq_u32(x, vshrq_n_u32(x, 17));
+  x = veorq_u32(x, vshlq_n_u32(x, 5));
+  *state = x;
+  uint32x4_t bits = vorrq_u32(vshrq_n_u32(x, 9), vdupq_n_u32(0x3f800000));
+  return vsubq_f32(vreinterpretq_f32_u32(bits), vdupq_n_f32(1.5f));
+}
+
+static size_t convertInt16Neon(const float* in, size_t n, int16_t* out, uint32_t* ditherState0, uint32_t* ditherState1) {
+  const float32x4_t lo = vdupq_n_f32(-32768.0f);
+  const float32x4_t hi = vdupq_n_f32(32767.0f);
+  bool dither = ditherState0 != NULL;
+  uint32x4_t s0 = vdupq_n_u32(0), s1 = vdupq_n_u32(0);
+  if (dither) {
+    s0 = vld1q_u32(ditherState0);
+    s1 = vld1q_u32(ditherState1);
+  }
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    float32x4_t a = vmulq_n_f32(vld1q_f32(in + i), 32768.0f);
+    float32x4_t b = vmulq_n_f32(vld1q_f32(in + i + 4), 32768.0f);
+    if (dither) {
+      a = vaddq_f32(a, vaddq_f32(ditherUniformNeon(&s0), ditherUniformNeon(&s1)));
+      b = vaddq_f32(b, vaddq_f32(ditherUniformNeon(&s0), ditherUniformNeon(&s1)));
+    }
+    a = vmaxnmq_f32(vminnmq_f32(a, hi), lo);
+    b = vmaxnmq_f32(vminnmq_f32(b, hi), lo);
+    int16x8_t packed = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(a)), vqmovn_s32(vcvtnq_s32_f32(b)));
+    vst1q_s16(out + i, packed);
+  }
+
+  if (dither) {
+    vst1q_u32(ditherState0, s0);
+    vst1q_u32(ditherState1, s1);
+  }
+  return i;
+}
+
+static size_t convertInt24Neon(const float* in, size_t n, char* out, uint32_t* ditherState0, uint32_t* ditherState1) {
+  const float32x4_t lo = vdupq_n_f32(-8388608.0f);
+  const float32x4_t hi = vdupq_n_f32(8388607.0f);
+  bool dither = ditherState0 != NULL;
+  uint32x4_t s0 = vdupq_n_u32(0), s1 = vdupq_n_u32(0);
+  if (dither) {
+    s0 = vld1q_u32(ditherState0);
+    s1 = vld1q_u32(ditherState1);
+  }
+
+  int32_t values[4];
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t a = vmulq_n_f32(vld1q_f32(in + i), 8388608.0f);
+    if (dither) {
+      a = vaddq_f32(a, vaddq_f32(ditherUniformNeon(&s0), ditherUniformNeon(&s1)));
+    }
+    a = vmaxnmq_f32(vminnmq_f32(a, hi), lo);
+    vst1q_s32(values, vcvtnq_s32_f32(a));
+    char* o = out + i * 3;
+    storeInt24(o, values[0]);
+    storeInt24(o + 3, values[1]);
+    storeInt24(o + 6, values[2]);
+    storeInt24(o + 9, values[3]);
+  }
+
+  if (dither) {
+    vst1q_u32(ditherState0, s0);
+    vst1q_u32(ditherState1, s1);
+  }
+  return i;
+}
+
+#endif
+
+// ---------------------------------------------
+
+SampleConverter::SampleConverter() {
+  useAvx2 = cpuSupportsAvx2();
+  // any nonzero seeds will do; different per lane so lanes are uncorrelated
+  uint32_t seed = 0x9e3779b9;
+  for (int i = 0; i < 2; i++) {
+    for (int j = 0; j < 8; j++) {
+      seed = seed * 1664525 + 1013904223;
+      ditherState[i][j] = seed | 1;
+    }
+  }
+}
+
+void SampleConverter::setFormat(SampleFormat format, bool dither) {
+  this->format = format;
+  this->dither = dither;
+}
+
+SampleFormat SampleConverter::getFormat() {
+  return format;
+}
+
+void SampleConverter::setSimdEnabled(bool enabled) {
+  useSimd = enabled;
+}
+
+void SampleConverter::setAvx2Enabled(bool enabled) {
+  useAvx2 = enabled && cpuSupportsAvx2();
+}
+
+void SampleConverter::convert(const float* in, size_t samples, char* out) {
+  uint32_t* state0 = dither ? ditherState[0] : NULL;
+  uint32_t* state1 = dither ? ditherState[1] : NULL;
+  size_t done = 0;
+
+  switch (format) {
+    case SAMPLE_FORMAT_FLOAT32:
+      memcpy(out, in, samples * sizeof(float));
+      return;
+
+    case SAMPLE_FORMAT_INT16:
+      if (useSimd) {
+#if defined(CAPTURE_SIMD_X86)
+        done = useAvx2
+          ? convertInt16Avx2(in, samples, (int16_t*)out, state0, state1)
+          : convertInt16Sse2(in, samples, (int16_t*)out, state0, state1);
+#elif defined(CAPTURE_SIMD_NEON)
+        done = convertInt16Neon(in, samples, (int16_t*)out, state0, state1);
+#endif
+      }
+      convertInt16Scalar(in + done, samples - done, (int16_t*)out + done, state0, state1);
+      return;
+
+    case SAMPLE_FORMAT_INT24:
+      if (useSimd) {
+#if defined(CAPTURE_SIMD_X86)
+        done = useAvx2
+          ? convertInt24Avx2(in, samples, out, state0, state1)
+          : convertInt24Sse2(in, samples, out, state0, state1);
+#elif defined(CAPTURE_SIMD_NEON)
+        done = convertInt24Neon(in, samples, out, state0, state1);
+#endif
+      }
+      convertInt24Scalar(in + done, samples - done, out + done * 3, state0, state1);
+      return;
+  }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// sample formats the capture pipeline can deliver.
+typedef enum SampleFormat {
+  SAMPLE_FORMAT_FLOAT32 = 0,
+  SAMPLE_FORMAT_INT16 = 1,
+  SAMPLE_FORMAT_INT24 = 2, // packed, 3 bytes little-endian
+} SampleFormat;
+
+unsigned int getSampleFormatBytes(SampleFormat format);
+
+// converts interleaved float32 samples in [-1, 1) to int16 or packed int24,
+// rounding to nearest and clipping out-of-range samples. with dither enabled,
+// adds triangular (TPDF) noise of +/- 1 LSB before rounding.
+//
+// uses AVX2 or SSE2 on x86 and NEON on ARM64, picked once at construction;
+// the scalar kernels are the reference and handle the tails. without dither
+// all kernels produce bit-identical output.
+class SampleConverter {
+private:
+  SampleFormat format = SAMPLE_FORMAT_FLOAT32;
+  bool dither = false;
+  bool useAvx2 = false;
+  bool useSimd = true;
+
+  // xorshift32 state for the dither generator, one word per vector lane for
+  // each of the two uniform variables that make up one TPDF sample.
+  uint32_t ditherState[2][8];
+
+public:
+  SampleConverter();
+
+  void setFormat(SampleFormat format, bool dither);
+  SampleFormat getFormat();
+
+  // for comparing against the reference path. setAvx2Enabled(false) picks
+  // SSE2 on x86; true only takes effect if the CPU has AVX2.
+  void setSimdEnabled(bool enabled);
+  void setAvx2Enabled(bool enabled);
+
+  // convert `samples` samples (frames * channels) from in to out. out must
+  // hold samples * getSampleFormatBytes(format) bytes.
+  void convert(const float* in, size_t samples, char* out);
+};
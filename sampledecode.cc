@@ -0,0 +1,146 @@
+#include "sampledecode.h"
+
+#include <string.h>
+
+CaptureSampleType getCaptureSampleType(bool isFloat, unsigned int containerBits) {
+  if (isFloat) {
+    switch (containerBits) {
+      case 32: return CAPTURE_SAMPLE_FLOAT32;
+      case 64: return CAPTURE_SAMPLE_FLOAT64;
+      default: return CAPTURE_SAMPLE_UNKNOWN;
+    }
+  }
+  switch (containerBits) {
+    case 8: return CAPTURE_SAMPLE_UINT8;
+    case 16: return CAPTURE_SAMPLE_INT16;
+    case 24: return CAPTURE_SAMPLE_INT24;
+    case 32: return CAPTURE_SAMPLE_INT32;
+    default: return CAPTURE_SAMPLE_UNKNOWN;
+  }
+}
+
+unsigned int getCaptureSampleBytes(CaptureSampleType type) {
+  switch (type) {
+    case CAPTURE_SAMPLE_UINT8: return 1;
+    case CAPTURE_SAMPLE_INT16: return 2;
+    case CAPTURE_SAMPLE_INT24: return 3;
+    case CAPTURE_SAMPLE_FLOAT64: return 8;
+    case CAPTURE_SAMPLE_UNKNOWN: return 0;
+    default: return 4;
+  }
+}
+
+// ---------------------------------------------
+// one load per sample type. memcpy keeps unaligned loads legal and compiles
+// to a plain move.
+
+struct Float32Sample {
+  static const unsigned int bytes = 4;
+  static inline float load(const char* p) {
+    float v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+  }
+};
+
+struct Float64Sample {
+  static const unsigned int bytes = 8;
+  static inline float load(const char* p) {
+    double v;
+    memcpy(&v, p, sizeof(v));
+    return (float)v;
+  }
+};
+
+struct Uint8Sample {
+  static const unsigned int bytes = 1;
+  static inline float load(const char* p) {
+    return ((int)(unsigned char)*p - 128) * (1.0f / 128.0f);
+  }
+};
+
+struct Int16Sample {
+  static const unsigned int bytes = 2;
+  static inline float load(const char* p) {
+    int16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v * (1.0f / 32768.0f);
+  }
+};
+
+struct Int24Sample {
+  static const unsigned int bytes = 3;
+  static inline float load(const char* p) {
+    const unsigned char* b = (const unsigned char*)p;
+    // assemble in the top 24 bits so the arithmetic shift sign-extends
+    int32_t v = (int32_t)(((uint32_t)b[0] << 8) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 24)) >> 8;
+    return v * (1.0f / 8388608.0f);
+  }
+};
+
+struct Int32Sample {
+  static const unsigned int bytes = 4;
+  static inline float load(const char* p) {
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v * (1.0f / 2147483648.0f);
+  }
+};
+
+// Channels of 0 takes the count from numChannels. with a fixed count and
+// packed frames the stride and the inner loop are constants the compiler
+// unrolls and vectorizes.
+template <class Sample, unsigned int Channels, bool Packed>
+static void decodeFrames(const char* in, size_t nFrames, unsigned int numChannels, unsigned int frameSize, float* out) {
+  const unsigned int channels = Channels != 0 ? Channels : numChannels;
+  const size_t stride = Packed ? (size_t)Channels * Sample::bytes : frameSize;
+  for (size_t i = 0; i < nFrames; i++) {
+    const char* frame = in + i * stride;
+    for (unsigned int c = 0; c < channels; c++) {
+      out[c] = Sample::load(frame + c * Sample::bytes);
+    }
+    out += channels;
+  }
+}
+
+typedef void (*DecodeKernel)(const char* in, size_t nFrames, unsigned int numChannels, unsigned int frameSize, float* out);
+
+template <class Sample>
+static DecodeKernel selectKernel(unsigned int numChannels, unsigned int frameSize) {
+  if (frameSize == numChannels * Sample::bytes) {
+    switch (numChannels) {
+      case 1: return decodeFrames<Sample, 1, true>;
+      case 2: return decodeFrames<Sample, 2, true>;
+      case 4: return decodeFrames<Sample, 4, true>;
+      case 6: return decodeFrames<Sample, 6, true>;
+      case 8: return decodeFrames<Sample, 8, true>;
+      default: break;
+    }
+  }
+  return decodeFrames<Sample, 0, false>;
+}
+
+// ---------------------------------------------
+
+bool SampleDecoder::configure(CaptureSampleType type, unsigned int numChannels, unsigned int frameSize) {
+  unsigned int sampleBytes = getCaptureSampleBytes(type);
+  if (sampleBytes == 0 || numChannels == 0 || frameSize < numChannels * sampleBytes) {
+    kernel = NULL;
+    return false;
+  }
+  this->numChannels = numChannels;
+  this->frameSize = frameSize;
+  switch (type) {
+    case CAPTURE_SAMPLE_FLOAT32: kernel = selectKernel<Float32Sample>(numChannels, frameSize); break;
+    case CAPTURE_SAMPLE_FLOAT64: kernel = selectKernel<Float64Sample>(numChannels, frameSize); break;
+    case CAPTURE_SAMPLE_UINT8: kernel = selectKernel<Uint8Sample>(numChannels, frameSize); break;
+    case CAPTURE_SAMPLE_INT16: kernel = selectKernel<Int16Sample>(numChannels, frameSize); break;
+    case CAPTURE_SAMPLE_INT24: kernel = selectKernel<Int24Sample>(numChannels, frameSize); break;
+    default: kernel = selectKernel<Int32Sample>(numChannels, frameSize); break;
+  }
+  return true;
+}
+
+void SampleDecoder::decode(const char* in, size_t nFrames, float* out) {
+  kernel(in, nFrames, numChannels, frameSize, out);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// sample types a capture source can deliver. everything but
+// CAPTURE_SAMPLE_UNKNOWN is decoded to float32 by the pipeline.
+typedef enum CaptureSampleType {
+  CAPTURE_SAMPLE_UNKNOWN = 0,
+  CAPTURE_SAMPLE_FLOAT32 = 1,
+  CAPTURE_SAMPLE_FLOAT64 = 2,
+  // unsigned, 128 is silence
+  CAPTURE_SAMPLE_UINT8 = 3,
+  CAPTURE_SAMPLE_INT16 = 4,
+  // packed, 3 bytes little-endian
+  CAPTURE_SAMPLE_INT24 = 5,
+  // also 24 or 20 valid bits left-justified in a 32-bit container
+  CAPTURE_SAMPLE_INT32 = 6,
+} CaptureSampleType;
+
+// the sample type of a WAVE format: float or PCM (format tag or extensible
+// subformat) with containerBits bits per sample (block align / channels * 8,
+// not the valid bits).
+CaptureSampleType getCaptureSampleType(bool isFloat, unsigned int containerBits);
+unsigned int getCaptureSampleBytes(CaptureSampleType type);
+
+// converts interleaved frames of any CaptureSampleType to interleaved float32
+// in [-1, 1). the kernel is a template instance per sample type and, for 1, 2,
+// 4, 6 and 8 channels, per channel count, picked once by configure(), so
+// decode() runs a loop without branches on the format.
+class SampleDecoder {
+private:
+  unsigned int numChannels = 0;
+  unsigned int frameSize = 0;
+  void (*kernel)(const char* in, size_t nFrames, unsigned int numChannels, unsigned int frameSize, float* out) = NULL;
+
+public:
+  // frameSize may be larger than numChannels samples (padded frames). returns
+  // false for CAPTURE_SAMPLE_UNKNOWN or frames too small for the samples.
+  bool configure(CaptureSampleType type, unsigned int numChannels, unsigned int frameSize);
+
+  // out must hold nFrames * numChannels floats
+  void decode(const char* in, size_t nFrames, float* out);
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+#include "ringbuffer.h"
+
+// single-producer / single-consumer ring in memory the caller provides, laid
+// out so that a JavaScript consumer can read it from a SharedArrayBuffer with
+// Atomics, e.g. in a worker thread or an AudioWorklet (see sharedring.js).
+//
+// layout, all fields little-endian int32 so JS can use one Int32Array:
+//
+//   int32[0]   writeIndex     frame slot the producer writes next
+//   int32[1]   magic          sharedRingMagic once attached
+//   int32[2]   slots          frame slots in the data area
+//   int32[3]   frameSize      bytes per frame
+//   int32[4]   numChannels
+//   int32[5]   sampleRate
+//   int32[6]   sampleFormat   SampleFormat, or -1 for raw device bytes
+//   int32[7]   overflowFrames frames dropped because the ring was full,
+//                             counts up and wraps at 2^32
+//   int32[8]   state          SHARED_RING_xxx
+//   int32[9]   generation     incremented on every start
+//   int32[16]  readIndex      frame slot the consumer reads next
+//   byte 128   data           slots * frameSize bytes of interleaved frames
+//
+// both indices stay in [0, slots). the ring is empty when they are equal and
+// one slot is always left free, so slots - 1 frames fit. the producer only
+// stores writeIndex and the consumer only stores readIndex, after copying the
+// frames in between (release / Atomics.store) and before reading the other
+// side's index again (acquire / Atomics.load).
+//
+// format and indices are written by start(), before the state becomes
+// SHARED_RING_RUNNING; a consumer must not read while the state is anything
+// else, and starts over from readIndex when the generation changes.
+typedef enum SharedRingState {
+  SHARED_RING_IDLE = 0,
+  SHARED_RING_RUNNING = 1,
+  SHARED_RING_STOPPED = 2,
+} SharedRingState;
+
+static const int32_t sharedRingMagic = 0x53524e47; // "SRNG"
+static const size_t sharedRingHeaderBytes = 128;
+
+class SharedRing {
+private:
+  typedef std::atomic<int32_t> Field;
+  static_assert(sizeof(Field) == sizeof(int32_t), "header fields must be plain int32");
+
+  char* memory = NULL;
+  size_t memoryBytes = 0;
+  char* data = NULL;
+  uint32_t slots = 0;
+  unsigned int frameSize = 0;
+
+  Field* field(unsigned int index) {
+    return (Field*)(memory + index * sizeof(int32_t));
+  }
+
+public:
+  // memory must be 8-byte aligned and hold at least the header and two
+  // frames. it is not owned and must stay valid until detach().
+  bool attach(char* memory, size_t bytes) {
+    if (memory == NULL || ((uintptr_t)memory & 7) != 0 || bytes <= sharedRingHeaderBytes) {
+      return false;
+    }
+    this->memory = memory;
+    memoryBytes = bytes;
+    data = memory + sharedRingHeaderBytes;
+    memset(memory, 0, sharedRingHeaderBytes);
+    field(1)->store(sharedRingMagic, std::memory_order_release);
+    return true;
+  }
+
+  void detach() {
+    memory = NULL;
+    memoryBytes = 0;
+    data = NULL;
+    slots = 0;
+  }
+
+  bool isAttached() {
+    return memory != NULL;
+  }
+
+  // must not be called while the producer runs. returns false if not even
+  // one frame of this size fits.
+  bool start(unsigned int frameSize, unsigned int numChannels, unsigned int sampleRate, int32_t sampleFormat) {
+    if (memory == NULL || frameSize == 0) {
+      return false;
+    }
+    size_t dataSlots = (memoryBytes - sharedRingHeaderBytes) / frameSize;
+    if (dataSlots < 2) {
+      return false;
+    }
+    if (dataSlots > INT32_MAX) {
+      dataSlots = INT32_MAX;
+    }
+    this->frameSize = frameSize;
+    slots = (uint32_t)dataSlots;
+    field(8)->store(SHARED_RING_IDLE, std::memory_order_seq_cst);
+    field(0)->store(0, std::memory_order_relaxed);
+    field(16)->store(0, std::memory_order_relaxed);
+    field(2)->store((int32_t)slots, std::memory_order_relaxed);
+    field(3)->store((int32_t)frameSize, std::memory_order_relaxed);
+    field(4)->store((int32_t)numChannels, std::memory_order_relaxed);
+    field(5)->store((int32_t)sampleRate, std::memory_order_relaxed);
+    field(6)->store(sampleFormat, std::memory_order_relaxed);
+    field(7)->store(0, std::memory_order_relaxed);
+    field(9)->fetch_add(1, std::memory_order_relaxed);
+    field(8)->store(SHARED_RING_RUNNING, std::memory_order_seq_cst);
+    return true;
+  }
+
+  void stop() {
+    if (memory != NULL) {
+      field(8)->store(SHARED_RING_STOPPED, std::memory_order_seq_cst);
+    }
+  }
+
+  // bytes that the producer can write
+  size_t writeAvailable() {
+    uint32_t w = (uint32_t)field(0)->load(std::memory_order_relaxed);
+    uint32_t r = (uint32_t)field(16)->load(std::memory_order_acquire);
+    uint32_t used = w >= r ? w - r : w + slots - r;
+    return (size_t)(slots - 1 - used) * frameSize;
+  }
+
+  // producer side, like RingBuffer::beginWrite() / commitWrite(). bytes is
+  // a whole number of frames.
+  size_t beginWrite(size_t bytes, RingRegions* regions) {
+    size_t available = writeAvailable();
+    if (bytes > available) {
+      bytes = available;
+    }
+    uint32_t w = (uint32_t)field(0)->load(std::memory_order_relaxed);
+    size_t firstBytes = (size_t)(slots - w) * frameSize;
+    if (firstBytes > bytes) {
+      firstBytes = bytes;
+    }
+    regions->first = data + (size_t)w * frameSize;
+    regions->firstBytes = firstBytes;
+    regions->second = data;
+    regions->secondBytes = bytes - firstBytes;
+    return bytes;
+  }
+
+  void commitWrite(size_t bytes) {
+    uint32_t w = (uint32_t)field(0)->load(std::memory_order_relaxed);
+    w += (uint32_t)(bytes / frameSize);
+    if (w >= slots) {
+      w -= slots;
+    }
+    field(0)->store((int32_t)w, std::memory_order_release);
+  }
+
+  size_t write(const char* in, size_t bytes) {
+    RingRegions regions;
+    bytes = beginWrite(bytes, &regions);
+    memcpy(regions.first, in, regions.firstBytes);
+    if (regions.secondBytes > 0) {
+      memcpy(regions.second, in + regions.firstBytes, regions.secondBytes);
+    }
+    commitWrite(bytes);
+    return bytes;
+  }
+
+  void addOverflowFrames(uint32_t frames) {
+    field(7)->fetch_add((int32_t)frames, std::memory_order_relaxed);
+  }
+};
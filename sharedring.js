@@ -0,0 +1,149 @@
+// consumer side of the shared ring the capture thread writes to, see
+// sharedring.h for the layout. the reader only needs the SharedArrayBuffer,
+// not the addon, so it runs in a worker thread or an AudioWorklet as well:
+//
+//   // thread that owns the client
+//   const { createSharedRing } = require('./sharedring');
+//   let sab = createSharedRing(addon, c, 48000); // about 1 s at 48 kHz
+//   addon.StartCaptureThread(c);
+//   worker.postMessage(sab); // or audioWorkletNode.port.postMessage(sab)
+//
+//   // worker / worklet
+//   let reader = createSharedRingReader(sab);
+//   let frames = reader.read(out); // out: Float32Array for float32 output
+//
+// nothing is copied on the way in beyond the one copy out of the device
+// buffer, and there is no message per chunk: the reader polls, e.g. once per
+// AudioWorklet process() call or on a timer in a worker. the native side
+// cannot wake Atomics.wait(), so waiting on the write index only works with
+// a timeout.
+
+const headerBytes = 128;
+const magic = 0x53524e47;
+
+const WRITE_INDEX = 0;
+const MAGIC = 1;
+const SLOTS = 2;
+const FRAME_SIZE = 3;
+const NUM_CHANNELS = 4;
+const SAMPLE_RATE = 5;
+const SAMPLE_FORMAT = 6;
+const OVERFLOW_FRAMES = 7;
+const STATE = 8;
+const GENERATION = 9;
+const READ_INDEX = 16;
+
+const STATE_RUNNING = 1;
+
+// allocates a SharedArrayBuffer for ringFrames frames of the client's current
+// output format and attaches it. call after SetOutputFormat and before
+// StartCaptureThread / StartStreaming. returns the SharedArrayBuffer, or null
+// if the addon would not take it.
+let createSharedRing = (addon, client, ringFrames) => {
+    const format = addon.GetOutputFormat(client);
+    const frameSize = format[1];
+    // one slot stays free; round up to whole int32 fields
+    const bytes = headerBytes + Math.ceil((ringFrames + 1) * frameSize / 8) * 8;
+    const sab = new SharedArrayBuffer(bytes);
+    if(!addon.AttachSharedRing(client, new Int32Array(sab))) {
+        return null;
+    }
+    return sab;
+}
+
+let createSharedRingReader = (sab) => {
+    const header = new Int32Array(sab, 0, headerBytes / 4);
+    const data = new Uint8Array(sab, headerBytes);
+    let generation = -1;
+    let slots = 0;
+    let frameSize = 0;
+    let numChannels = 0;
+    let floatData = null;
+
+    // format fields are only valid while running; pick them up again after
+    // every restart
+    let sync = () => {
+        if(Atomics.load(header, MAGIC) != magic || Atomics.load(header, STATE) != STATE_RUNNING) {
+            return false;
+        }
+        const current = Atomics.load(header, GENERATION);
+        if(current != generation) {
+            generation = current;
+            slots = Atomics.load(header, SLOTS);
+            frameSize = Atomics.load(header, FRAME_SIZE);
+            numChannels = Atomics.load(header, NUM_CHANNELS);
+            floatData = Atomics.load(header, SAMPLE_FORMAT) == 0
+                ? new Float32Array(sab, headerBytes, slots * numChannels)
+                : null;
+        }
+        return true;
+    }
+
+    let available = () => {
+        if(!sync()) {
+            return 0;
+        }
+        const w = Atomics.load(header, WRITE_INDEX);
+        const r = Atomics.load(header, READ_INDEX);
+        return w >= r ? w - r : w + slots - r;
+    }
+
+    // copies up to out.byteLength / frameSize frames into out, any typed
+    // array. returns the number of frames read.
+    let read = (out) => {
+        const frames = Math.min(available(), Math.floor(out.byteLength / frameSize));
+        if(frames == 0) {
+            return 0;
+        }
+        const outBytes = new Uint8Array(out.buffer, out.byteOffset, frames * frameSize);
+        const r = Atomics.load(header, READ_INDEX);
+        const first = Math.min(frames, slots - r);
+        outBytes.set(data.subarray(r * frameSize, (r + first) * frameSize), 0);
+        if(first < frames) {
+            outBytes.set(data.subarray(0, (frames - first) * frameSize), first * frameSize);
+        }
+        Atomics.store(header, READ_INDEX, (r + frames) % slots);
+        return frames;
+    }
+
+    // float32 output only: deinterleaves up to channels[0].length frames into
+    // one Float32Array per channel, e.g. the outputs of AudioWorklet process().
+    // channels beyond the ring's are left alone. returns the number of frames.
+    let readPlanar = (channels) => {
+        const frames = Math.min(available(), channels[0].length);
+        if(frames == 0 || floatData == null) {
+            return 0;
+        }
+        const r = Atomics.load(header, READ_INDEX);
+        const count = Math.min(channels.length, numChannels);
+        for(let i = 0, slot = r; i < frames; i++) {
+            const base = slot * numChannels;
+            for(let c = 0; c < count; c++) {
+                channels[c][i] = floatData[base + c];
+            }
+            slot = slot + 1 == slots ? 0 : slot + 1;
+        }
+        Atomics.store(header, READ_INDEX, (r + frames) % slots);
+        return frames;
+    }
+
+    let getFormat = () => sync()
+        ? { frameSize: frameSize, numChannels: numChannels, sampleRate: Atomics.load(header, SAMPLE_RATE), sampleFormat: Atomics.load(header, SAMPLE_FORMAT) }
+        : null;
+
+    return {
+        available: available,
+        read: read,
+        readPlanar: readPlanar,
+        getFormat: getFormat,
+        // frames dropped because the reader fell a whole ring behind
+        getOverflowFrames: () => Atomics.load(header, OVERFLOW_FRAMES) >>> 0,
+        isRunning: () => Atomics.load(header, STATE) == STATE_RUNNING,
+    };
+}
+
+// AudioWorkletGlobalScope has no module object; there the functions are
+// plain globals of the worklet module
+if(typeof module !== 'undefined') {
+    module.exports = { createSharedRing, createSharedRingReader };
+}
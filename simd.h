@@ -0,0 +1,44 @@
+#pragma once
+
+// compile-time and run-time detection of the vector instruction sets used by
+// the sample-processing kernels. x86 builds always have SSE2 (x64 baseline);
+// AVX2 kernels are compiled with a per-function target attribute and only
+// called after cpuSupportsAvx2() says so. ARM64 builds always have NEON.
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define CAPTURE_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CAPTURE_TARGET_AVX2
+#else
+#define CAPTURE_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define CAPTURE_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+#ifdef CAPTURE_SIMD_X86
+inline bool cpuSupportsAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7) return false;
+  __cpuid(info, 1);
+  bool osxsave = (info[2] & (1 << 27)) != 0;
+  bool fma = (info[2] & (1 << 12)) != 0;
+  if (!osxsave || !fma) return false;
+  if ((_xgetbv(0) & 6) != 6) return false; // OS saves xmm and ymm state
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+#else
+inline bool cpuSupportsAvx2() {
+  return false;
+}
+#endif
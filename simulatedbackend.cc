@@ -0,0 +1,456 @@
+#include "simulatedbackend.h"
+
+#include <math.h>
+#include <string.h>
+#include <thread>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+// in fast mode packets come in bursts of this many, with one empty poll in
+// between, so readers that drain until no packet is left get to return
+static const uint32_t fastBurstPackets = 16;
+
+// smallest period a simulated device supports, like typical hardware at 48 kHz
+static const uint32_t minPeriodFrames = 128;
+static const uint32_t defaultBufferDuration = 10000000;
+
+static const double pi = 3.14159265358979323846;
+
+static uint32_t nextRandom(uint32_t* state) {
+  // xorshift32
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
+
+void SimulatedBackend::setOptions(const SimulationOptions& options) {
+  this->options = options;
+}
+
+bool SimulatedBackend::setBufferOptions(const CaptureBufferOptions& options) {
+  bufferOptions = options;
+  return true;
+}
+
+uint32_t SimulatedBackend::getMinPeriodFrames() {
+  // packetMs below the simulated hardware minimum stays possible
+  return defaultPacketFrames < minPeriodFrames ? defaultPacketFrames : minPeriodFrames;
+}
+
+bool SimulatedBackend::open() {
+  if (opened) {
+    return false;
+  }
+  setError(0, NULL);
+  if (!openSource(&format)) {
+    if (lastError.step == NULL) {
+      setError(0, "open source");
+    }
+    return false;
+  }
+  if (format.frameSize == 0 || format.sampleRate == 0) {
+    closeSource();
+    setError(0, "source format");
+    return false;
+  }
+  opened = true;
+  defaultPacketFrames = (uint32_t)(options.packetMs * format.sampleRate / 1000.0 + 0.5);
+  if (defaultPacketFrames == 0) {
+    defaultPacketFrames = 1;
+  }
+  // a period set by the buffer options replaces packetMs, like a device period
+  uint32_t minFrames = getMinPeriodFrames();
+  packetFrames = defaultPacketFrames;
+  if (bufferOptions.lowLatency) {
+    packetFrames = minFrames;
+  } else if (bufferOptions.period != 0) {
+    packetFrames = (uint32_t)((uint64_t)bufferOptions.period * format.sampleRate / 10000000);
+    if (packetFrames < minFrames) {
+      packetFrames = minFrames;
+    }
+  }
+  gapFrames = options.gapMs > 0.0 ? (uint32_t)(options.gapMs * format.sampleRate / 1000.0 + 0.5) : 0;
+  ended = false;
+  nextPacketFrames = 0;
+  nextPacketFlags = 0;
+  acquiredFrames = 0;
+  burstPackets = 0;
+  devicePosition = 0;
+  randomState = options.seed != 0 ? options.seed : 1;
+  ticksPerFrame = 10000000.0 / (format.sampleRate * (1.0 + options.driftPpm / 1000000.0));
+  startTime = std::chrono::steady_clock::now();
+  startTimestamp = (uint64_t)(std::chrono::duration_cast<std::chrono::nanoseconds>(startTime.time_since_epoch()).count() / 100);
+  return true;
+}
+
+void SimulatedBackend::close() {
+  if (opened) {
+    closeSource();
+    opened = false;
+  }
+}
+
+CaptureBufferInfo SimulatedBackend::getBufferInfo() {
+  CaptureBufferInfo info = {};
+  if (!opened) {
+    return info;
+  }
+  uint32_t bufferDuration = bufferOptions.bufferDuration != 0 ? bufferOptions.bufferDuration : defaultBufferDuration;
+  info.bufferFrames = (uint32_t)((uint64_t)bufferDuration * format.sampleRate / 10000000);
+  if (info.bufferFrames < 2 * packetFrames) {
+    info.bufferFrames = 2 * packetFrames;
+  }
+  info.periodFrames = packetFrames;
+  info.defaultPeriodFrames = defaultPacketFrames;
+  info.minPeriodFrames = getMinPeriodFrames();
+  info.streamLatency = 0;
+  info.lowLatency = packetFrames < defaultPacketFrames;
+  return info;
+}
+
+CaptureFormat SimulatedBackend::getFormat() {
+  return format;
+}
+
+// uniform in [0, 1)
+double SimulatedBackend::random() {
+  return (nextRandom(&randomState) >> 8) / 16777216.0;
+}
+
+// decides size and flags of the next packet and generates its frames
+void SimulatedBackend::preparePacket() {
+  if (nextPacketFrames != 0 || ended) {
+    return;
+  }
+  double scale = 1.0 + options.jitter * (2.0 * random() - 1.0);
+  uint32_t frames = (uint32_t)(packetFrames * scale + 0.5);
+  if (frames == 0) {
+    frames = 1;
+  }
+  uint32_t flags = 0;
+  // one draw per kind of glitch, so a rate of 0 does not change the others
+  bool gap = random() < options.discontinuityRate;
+  if (random() < options.silentRate) {
+    flags |= CAPTURE_PACKET_SILENT;
+  }
+  if (random() < options.timestampErrorRate) {
+    flags |= CAPTURE_PACKET_TIMESTAMP_ERROR;
+  }
+
+  if (gap && gapFrames > 0) {
+    // the lost frames are gone from the source too
+    packet.resize((size_t)gapFrames * format.frameSize);
+    uint32_t skipped = generate(packet.data(), gapFrames);
+    devicePosition += skipped;
+    flags |= CAPTURE_PACKET_DISCONTINUITY;
+  }
+
+  packet.resize((size_t)frames * format.frameSize);
+  uint32_t generated = generate(packet.data(), frames);
+  if (generated == 0) {
+    ended = true;
+    return;
+  }
+  if (flags & CAPTURE_PACKET_SILENT) {
+    // content is undefined for silent packets, like with WASAPI. 0xff makes
+    // float samples NaN, so readers that ignore the flag stand out.
+    memset(packet.data(), 0xff, (size_t)generated * format.frameSize);
+  }
+  nextPacketFrames = generated;
+  nextPacketFlags = flags;
+}
+
+// when the last frame of the next packet has been captured
+std::chrono::steady_clock::time_point SimulatedBackend::getDueTime() {
+  double ticks = (devicePosition + nextPacketFrames) * ticksPerFrame;
+  return startTime + std::chrono::nanoseconds((int64_t)(ticks * 100.0));
+}
+
+bool SimulatedBackend::waitForPacket(unsigned int timeoutMs) {
+  preparePacket();
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  if (!opened || ended) {
+    std::this_thread::sleep_until(deadline);
+    return false;
+  }
+  if (!options.realtime) {
+    return true;
+  }
+  std::chrono::steady_clock::time_point due = getDueTime();
+  if (due > deadline) {
+    std::this_thread::sleep_until(deadline);
+    return false;
+  }
+  std::this_thread::sleep_until(due);
+  return true;
+}
+
+uint32_t SimulatedBackend::getNextPacketSize() {
+  if (!opened) {
+    return 0;
+  }
+  preparePacket();
+  if (ended) {
+    return 0;
+  }
+  if (options.realtime) {
+    if (std::chrono::steady_clock::now() < getDueTime()) {
+      return 0;
+    }
+  } else if (burstPackets == fastBurstPackets) {
+    burstPackets = 0;
+    return 0;
+  }
+  return nextPacketFrames;
+}
+
+uint32_t SimulatedBackend::acquirePacket(const char** data, uint32_t* flags, uint64_t* devicePosition, uint64_t* timestamp) {
+  uint32_t frames = getNextPacketSize();
+  *data = frames > 0 ? packet.data() : NULL;
+  *flags = frames > 0 ? nextPacketFlags : 0;
+  *devicePosition = this->devicePosition;
+  *timestamp = startTimestamp + (uint64_t)(this->devicePosition * ticksPerFrame);
+  acquiredFrames = frames;
+  return frames;
+}
+
+void SimulatedBackend::releasePacket(uint32_t nFrames) {
+  // like IAudioCaptureClient::ReleaseBuffer: 0 keeps the packet for the next
+  // acquirePacket(), anything else releases all of it
+  if (acquiredFrames == 0 || nFrames == 0) {
+    acquiredFrames = 0;
+    return;
+  }
+  devicePosition += acquiredFrames;
+  acquiredFrames = 0;
+  nextPacketFrames = 0;
+  burstPackets++;
+}
+
+unsigned int SimulatedBackend::getFrameSize() {
+  return format.frameSize;
+}
+
+// ---------------------------------------------
+// signal generator
+
+void SignalBackend::setSignal(SignalWaveform waveform, double frequency, float amplitude, unsigned int numChannels, unsigned int sampleRate) {
+  this->waveform = waveform;
+  this->frequency = frequency;
+  this->amplitude = amplitude;
+  this->numChannels = numChannels;
+  this->sampleRate = sampleRate;
+}
+
+bool SignalBackend::openSource(CaptureFormat* format) {
+  if (numChannels == 0 || sampleRate == 0) {
+    return false;
+  }
+  format->frameSize = numChannels * sizeof(float);
+  format->numChannels = numChannels;
+  format->bitsPerSample = 32;
+  format->sampleRate = sampleRate;
+  format->sampleType = CAPTURE_SAMPLE_FLOAT32;
+  phaseCos = 1.0;
+  phaseSin = 0.0;
+  stepCos = cos(2.0 * pi * frequency / sampleRate);
+  stepSin = sin(2.0 * pi * frequency / sampleRate);
+  noiseState = 0x9e3779b9;
+  return true;
+}
+
+uint32_t SignalBackend::generate(char* out, uint32_t frames) {
+  if (waveform == SIGNAL_ZERO) {
+    memset(out, 0, (size_t)frames * numChannels * sizeof(float));
+    return frames;
+  }
+  float* samples = (float*)out;
+  for (uint32_t i = 0; i < frames; i++) {
+    float value;
+    switch (waveform) {
+      case SIGNAL_SINE: value = amplitude * (float)phaseSin; break;
+      case SIGNAL_SQUARE: value = phaseSin >= 0.0 ? amplitude : -amplitude; break;
+      default: value = 0.0f; break;
+    }
+    for (unsigned int c = 0; c < numChannels; c++) {
+      if (waveform == SIGNAL_NOISE) {
+        value = amplitude * ((nextRandom(&noiseState) >> 8) / 8388608.0f - 1.0f);
+      }
+      samples[i * numChannels + c] = value;
+    }
+    double nextCos = phaseCos * stepCos - phaseSin * stepSin;
+    phaseSin = phaseSin * stepCos + phaseCos * stepSin;
+    phaseCos = nextCos;
+  }
+  // keep rounding errors from growing the phasor
+  double norm = 1.0 / sqrt(phaseCos * phaseCos + phaseSin * phaseSin);
+  phaseCos *= norm;
+  phaseSin *= norm;
+  return frames;
+}
+
+// ---------------------------------------------
+// file replay
+
+static FILE* openFile(const std::string& path) {
+#ifdef _WIN32
+  int length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, NULL, 0);
+  if (length <= 0) {
+    return NULL;
+  }
+  std::wstring wide(length, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wide[0], length);
+  return _wfopen(wide.c_str(), L"rb");
+#else
+  return fopen(path.c_str(), "rb");
+#endif
+}
+
+static uint16_t getU16(const unsigned char* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t getU32(const unsigned char* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t getU64(const unsigned char* p) {
+  return (uint64_t)getU32(p) | ((uint64_t)getU32(p + 4) << 32);
+}
+
+FileBackend::~FileBackend() {
+  closeSource();
+}
+
+void FileBackend::setWavFile(const char* path, bool loop) {
+  this->path = path;
+  this->loop = loop;
+  rawFormat = CaptureFormat();
+}
+
+void FileBackend::setRawFile(const char* path, bool loop, const CaptureFormat& format) {
+  this->path = path;
+  this->loop = loop;
+  rawFormat = format;
+}
+
+bool FileBackend::readWavHeader(CaptureFormat* format) {
+  unsigned char header[12];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header)
+    || (memcmp(header, "RIFF", 4) != 0 && memcmp(header, "RF64", 4) != 0)
+    || memcmp(header + 8, "WAVE", 4) != 0) {
+    return false;
+  }
+  bool hasFormat = false;
+  uint64_t ds64DataBytes = UINT64_MAX;
+  for (;;) {
+    unsigned char chunk[8];
+    if (fread(chunk, 1, sizeof(chunk), file) != sizeof(chunk)) {
+      return false;
+    }
+    uint32_t chunkBytes = getU32(chunk + 4);
+    if (memcmp(chunk, "data", 4) == 0) {
+      if (!hasFormat) {
+        return false;
+      }
+      dataOffset = (uint64_t)ftell(file);
+      // 0xffffffff: RF64 size in ds64, or a segment still being written
+      dataBytes = chunkBytes == 0xFFFFFFFF ? ds64DataBytes : chunkBytes;
+      return true;
+    }
+    if (memcmp(chunk, "fmt ", 4) == 0 && chunkBytes >= 16) {
+      unsigned char fmt[40];
+      size_t fmtBytes = chunkBytes < sizeof(fmt) ? chunkBytes : sizeof(fmt);
+      if (fread(fmt, 1, fmtBytes, file) != fmtBytes) {
+        return false;
+      }
+      uint16_t formatTag = getU16(fmt);
+      if (formatTag == 0xFFFE && fmtBytes >= 26) {
+        // WAVE_FORMAT_EXTENSIBLE: the subformat GUID starts with the tag
+        formatTag = getU16(fmt + 24);
+      }
+      format->numChannels = getU16(fmt + 2);
+      format->sampleRate = getU32(fmt + 4);
+      format->frameSize = getU16(fmt + 12);
+      format->bitsPerSample = getU16(fmt + 14);
+      // WAVE_FORMAT_IEEE_FLOAT or WAVE_FORMAT_PCM
+      if ((formatTag == 3 || formatTag == 1) && format->numChannels != 0) {
+        format->sampleType = getCaptureSampleType(formatTag == 3, format->frameSize / format->numChannels * 8);
+      } else {
+        format->sampleType = CAPTURE_SAMPLE_UNKNOWN;
+      }
+      hasFormat = true;
+      chunkBytes -= (uint32_t)fmtBytes;
+    } else if (memcmp(chunk, "ds64", 4) == 0 && chunkBytes >= 16) {
+      unsigned char ds64[16];
+      if (fread(ds64, 1, sizeof(ds64), file) != sizeof(ds64)) {
+        return false;
+      }
+      ds64DataBytes = getU64(ds64 + 8);
+      chunkBytes -= sizeof(ds64);
+    }
+    // chunks are padded to an even size
+    if (fseek(file, (long)(chunkBytes + (getU32(chunk + 4) & 1)), SEEK_CUR) != 0) {
+      return false;
+    }
+  }
+}
+
+bool FileBackend::openSource(CaptureFormat* format) {
+  closeSource();
+  file = openFile(path);
+  if (file == NULL) {
+    setError(0, "open file");
+    return false;
+  }
+  if (rawFormat.frameSize != 0) {
+    *format = rawFormat;
+    dataOffset = 0;
+    dataBytes = UINT64_MAX;
+  } else if (!readWavHeader(format)) {
+    closeSource();
+    setError(0, "read WAV header");
+    return false;
+  }
+  frameSize = format->frameSize;
+  dataRead = 0;
+  return true;
+}
+
+void FileBackend::closeSource() {
+  if (file != NULL) {
+    fclose(file);
+    file = NULL;
+  }
+}
+
+bool FileBackend::rewind() {
+  dataRead = 0;
+  return fseek(file, (long)dataOffset, SEEK_SET) == 0;
+}
+
+uint32_t FileBackend::generate(char* out, uint32_t frames) {
+  size_t wanted = (size_t)frames * frameSize;
+  size_t got = 0;
+  while (got < wanted) {
+    uint64_t left = dataBytes - dataRead;
+    size_t bytes = wanted - got < left ? wanted - got : (size_t)left;
+    size_t read = bytes > 0 ? fread(out + got, 1, bytes, file) : 0;
+    got += read;
+    dataRead += read;
+    if (read < bytes || dataRead == dataBytes || bytes == 0) {
+      // end of the data: a trailing partial frame is dropped, and an empty
+      // file is not looped forever
+      got -= (size_t)(dataRead % frameSize);
+      if (!loop || dataRead == 0 || !rewind()) {
+        break;
+      }
+    }
+  }
+  return (uint32_t)(got / frameSize);
+}
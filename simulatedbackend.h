@@ -0,0 +1,163 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "capturebackend.h"
+
+// how a simulated backend paces its packets and which glitches it injects.
+// injection is driven by a seeded generator, so a run can be repeated.
+typedef struct SimulationOptions {
+  // deliver packets at the stream rate, like a device, or as fast as they
+  // are read
+  bool realtime = true;
+  // nominal packet length
+  double packetMs = 10.0;
+  // each packet is packetMs * (1 +/- jitter), uniformly distributed
+  double jitter = 0.0;
+  // chance per packet that the frames before it were lost: the device
+  // position skips gapMs and the packet is flagged as a discontinuity
+  double discontinuityRate = 0.0;
+  double gapMs = 10.0;
+  // chance per packet that it is flagged silent
+  double silentRate = 0.0;
+  // chance per packet that it is flagged with a timestamp error
+  double timestampErrorRate = 0.0;
+  // how much faster than nominal the simulated device clock runs. shows in
+  // the pacing and the timestamps, like a real crystal.
+  double driftPpm = 0.0;
+  uint32_t seed = 1;
+} SimulationOptions;
+
+// base of the simulated backends: turns a stream of frames from generate()
+// into device-like packets with positions, timestamps and flags.
+class SimulatedBackend : public CaptureBackend {
+private:
+  SimulationOptions options;
+  CaptureFormat format = {};
+  bool opened = false;
+
+  CaptureBufferOptions bufferOptions = {};
+
+  // options in frames of the opened format. packetFrames differs from
+  // defaultPacketFrames if the buffer options set a period.
+  uint32_t packetFrames = 0;
+  uint32_t defaultPacketFrames = 0;
+  uint32_t gapFrames = 0;
+
+  std::vector<char> packet;
+  // frames in the next packet, 0 until it is decided
+  uint32_t nextPacketFrames = 0;
+  uint32_t nextPacketFlags = 0;
+  uint32_t acquiredFrames = 0;
+  // packets since the last empty poll, fast mode only
+  uint32_t burstPackets = 0;
+  bool ended = false;
+
+  uint64_t devicePosition = 0;
+  std::chrono::steady_clock::time_point startTime;
+  uint64_t startTimestamp = 0;
+  double ticksPerFrame = 0.0;
+  uint32_t randomState = 1;
+
+  double random();
+  uint32_t getMinPeriodFrames();
+  void preparePacket();
+  std::chrono::steady_clock::time_point getDueTime();
+
+protected:
+  // opens the underlying source and sets *format
+  virtual bool openSource(CaptureFormat* format) = 0;
+  virtual void closeSource() {}
+  // writes up to frames frames to out and returns how many were written, less
+  // only at the end of the source
+  virtual uint32_t generate(char* out, uint32_t frames) = 0;
+
+public:
+  void setOptions(const SimulationOptions& options);
+
+  // CaptureBackend
+  bool setBufferOptions(const CaptureBufferOptions& options);
+  bool open();
+  void close();
+  CaptureFormat getFormat();
+  CaptureBufferInfo getBufferInfo();
+
+  // CaptureSource
+  bool waitForPacket(unsigned int timeoutMs);
+  uint32_t getNextPacketSize();
+  uint32_t acquirePacket(const char** data, uint32_t* flags, uint64_t* devicePosition, uint64_t* timestamp);
+  void releasePacket(uint32_t nFrames);
+  unsigned int getFrameSize();
+};
+
+typedef enum SignalWaveform {
+  SIGNAL_SINE = 0,
+  SIGNAL_SQUARE = 1,
+  // uniform white noise, independent per channel
+  SIGNAL_NOISE = 2,
+  // digital zero, without the silent flag
+  SIGNAL_ZERO = 3,
+} SignalWaveform;
+
+// deterministic float32 test signal, the same on every channel except noise.
+class SignalBackend : public SimulatedBackend {
+private:
+  SignalWaveform waveform = SIGNAL_SINE;
+  double frequency = 440.0;
+  float amplitude = 0.5f;
+  unsigned int numChannels = 2;
+  unsigned int sampleRate = 48000;
+
+  // oscillator as a rotating phasor, renormalized once per packet
+  double phaseCos = 1.0;
+  double phaseSin = 0.0;
+  double stepCos = 1.0;
+  double stepSin = 0.0;
+  uint32_t noiseState = 1;
+
+protected:
+  bool openSource(CaptureFormat* format);
+  uint32_t generate(char* out, uint32_t frames);
+
+public:
+  void setSignal(SignalWaveform waveform, double frequency, float amplitude, unsigned int numChannels, unsigned int sampleRate);
+};
+
+// replays a WAV file (PCM, float or extensible, including RF64 segments
+// written by CaptureRecorder) or a headerless raw file. float32 data is
+// processed like a float mix format; anything else is passed through as raw
+// bytes, like a device with an integer format.
+class FileBackend : public SimulatedBackend {
+private:
+  std::string path;
+  bool loop = false;
+  // used for raw files; frameSize of 0 means the file is a WAV file
+  CaptureFormat rawFormat = {};
+
+  FILE* file = NULL;
+  uint64_t dataOffset = 0;
+  // bytes of audio data, or UINT64_MAX to read to the end of the file
+  uint64_t dataBytes = 0;
+  uint64_t dataRead = 0;
+  unsigned int frameSize = 0;
+
+  bool readWavHeader(CaptureFormat* format);
+  bool rewind();
+
+protected:
+  bool openSource(CaptureFormat* format);
+  void closeSource();
+  uint32_t generate(char* out, uint32_t frames);
+
+public:
+  ~FileBackend();
+
+  // path is UTF-8. at the end of the file, playback starts over if loop is
+  // set and stops otherwise.
+  void setWavFile(const char* path, bool loop);
+  void setRawFile(const char* path, bool loop, const CaptureFormat& format);
+};
@@ -0,0 +1,197 @@
+// unit tests of the native stages, without N-API or an audio device: packets
+// come from the simulated backends (see simulatedbackend.h), so the tests run
+// on any platform.
+//
+//   capture-test [filter]
+//
+// runs every test whose name contains filter, all of them by default, and
+// prints one line per test. exits with 1 if any check failed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <vector>
+
+#include "test.h"
+
+typedef struct RegisteredTest {
+  const char* name;
+  TestFunction function;
+} RegisteredTest;
+
+// a function-local static, so registrations from other files' static
+// initializers find it constructed
+static std::vector<RegisteredTest>& getTests() {
+  static std::vector<RegisteredTest> tests;
+  return tests;
+}
+
+static unsigned int failedChecks = 0;
+
+TestRegistration::TestRegistration(const char* name, TestFunction function) {
+  RegisteredTest test = { name, function };
+  getTests().push_back(test);
+}
+
+void checkCondition(bool condition, const char* text, const char* file, int line) {
+  if (!condition) {
+    failedChecks++;
+    fprintf(stderr, "  %s:%d: CHECK(%s) failed\n", file, line, text);
+  }
+}
+
+// ---------------------------------------------
+// allocation counting. every form of operator new and delete is replaced, so
+// each pair stays matched; they allocate like the library's own (malloc, and
+// the new handler when that fails) and only count while a counter is alive.
+
+static thread_local unsigned int activeCounters = 0;
+static thread_local unsigned int allocationCount = 0;
+
+AllocationCounter::AllocationCounter() {
+  activeCounters++;
+  start = allocationCount;
+}
+
+AllocationCounter::~AllocationCounter() {
+  activeCounters--;
+}
+
+unsigned int AllocationCounter::getCount() {
+  return allocationCount - start;
+}
+
+static void* allocate(size_t size, size_t alignment) {
+  if (activeCounters > 0) {
+    allocationCount++;
+  }
+  if (size == 0) {
+    size = 1;
+  }
+  for (;;) {
+    void* p = alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__
+      ? aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+      : malloc(size);
+    if (p != NULL) {
+      return p;
+    }
+    std::new_handler handler = std::get_new_handler();
+    if (handler == NULL) {
+      return NULL;
+    }
+    handler();
+  }
+}
+
+static void* allocateOrThrow(size_t size, size_t alignment) {
+  void* p = allocate(size, alignment);
+  if (p == NULL) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new(size_t size) {
+  return allocateOrThrow(size, 0);
+}
+
+void* operator new[](size_t size) {
+  return allocateOrThrow(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  return allocateOrThrow(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return allocateOrThrow(size, (size_t)alignment);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size, 0);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size, 0);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+  return allocate(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+  return allocate(size, (size_t)alignment);
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+  free(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+  free(p);
+}
+
+// ---------------------------------------------
+
+int main(int argc, char** argv) {
+  const char* filter = argc > 1 ? argv[1] : "";
+  unsigned int run = 0;
+  unsigned int failed = 0;
+  for (const RegisteredTest& test : getTests()) {
+    if (strstr(test.name, filter) == NULL) {
+      continue;
+    }
+    unsigned int before = failedChecks;
+    test.function();
+    run++;
+    bool ok = failedChecks == before;
+    if (!ok) {
+      failed++;
+    }
+    printf("%s %s\n", ok ? "ok" : "FAILED", test.name);
+    fflush(stdout);
+  }
+  printf("%u of %u tests passed\n", run - failed, run);
+  return failed > 0 ? 1 : 0;
+}
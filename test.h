@@ -0,0 +1,41 @@
+#pragma once
+
+// minimal test harness for capture-test, without dependencies. a test is a
+// function declared with TEST(name); CHECK() records a failure and carries
+// on, so one run reports every broken expectation.
+//
+//   TEST(resamplerKeepsLength) {
+//     CHECK(out.size() == expected);
+//   }
+
+typedef void (*TestFunction)();
+
+class TestRegistration {
+public:
+  TestRegistration(const char* name, TestFunction function);
+};
+
+void checkCondition(bool condition, const char* text, const char* file, int line);
+
+#define TEST(name) \
+  static void name(); \
+  static TestRegistration name##Registration(#name, name); \
+  static void name()
+
+#define CHECK(condition) checkCondition((condition), #condition, __FILE__, __LINE__)
+
+// counts the heap allocations (operator new) the calling thread makes while
+// the counter exists, for checking that a path allocates nothing:
+//
+//   AllocationCounter allocations;
+//   pipeline.processPacket(...);
+//   CHECK(allocations.getCount() == 0);
+class AllocationCounter {
+private:
+  unsigned int start;
+
+public:
+  AllocationCounter();
+  ~AllocationCounter();
+  unsigned int getCount();
+};
@@ -0,0 +1,233 @@
+// BroadcastRing readers that fall behind under each overflow policy, reads
+// the writer overtakes while they copy, and BroadcastSubscriber conversion
+// against the scalar reference.
+
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "broadcastring.h"
+#include "test.h"
+
+static const size_t capacity = 64;
+
+// stereo frames that carry their own index: (index >> 12, index & 4095),
+// both exact in float
+static std::vector<float> makeFrames(uint64_t first, size_t count) {
+  std::vector<float> frames(count * 2);
+  for (size_t i = 0; i < count; i++) {
+    frames[i * 2] = (float)((first + i) >> 12);
+    frames[i * 2 + 1] = (float)((first + i) & 4095);
+  }
+  return frames;
+}
+
+static uint64_t frameIndex(const float* frame) {
+  return ((uint64_t)frame[0] << 12) + (uint64_t)frame[1];
+}
+
+// true if the count frames in out are first, first + 1, ...
+static bool isSequence(const std::vector<float>& out, size_t count, uint64_t first) {
+  for (size_t i = 0; i < count; i++) {
+    if (frameIndex(&out[i * 2]) != first + i) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void writeFrames(BroadcastRing* ring, uint64_t first, size_t count) {
+  std::vector<float> frames = makeFrames(first, count);
+  CHECK(ring->write(frames.data(), count) == count);
+}
+
+TEST(broadcastRingDropOldestKeepsNewestRing) {
+  BroadcastRing ring;
+  ring.allocate(capacity, 2);
+  int reader = ring.addReader(OVERFLOW_DROP_OLDEST);
+  CHECK(reader >= 0);
+
+  // lapped by 36 frames, written in pieces that wrap the storage
+  writeFrames(&ring, 0, 50);
+  writeFrames(&ring, 50, 50);
+  CHECK(ring.getAvailable(reader) == capacity);
+
+  std::vector<float> out(200 * 2);
+  size_t frames = ring.read(reader, out.data(), 200);
+  CHECK(frames == capacity);
+  CHECK(isSequence(out, frames, 100 - capacity));
+  CHECK(ring.getDroppedFrames(reader) == 100 - capacity);
+
+  // and goes on from there
+  writeFrames(&ring, 100, 10);
+  CHECK(ring.read(reader, out.data(), 200) == 10);
+  CHECK(isSequence(out, 10, 100));
+  CHECK(ring.getDroppedFrames(reader) == 100 - capacity);
+}
+
+TEST(broadcastRingSkipToLiveDropsEverythingUnread) {
+  BroadcastRing ring;
+  ring.allocate(capacity, 2);
+  int reader = ring.addReader(OVERFLOW_SKIP_TO_LIVE);
+
+  writeFrames(&ring, 0, 30);
+  std::vector<float> out(200 * 2);
+  CHECK(ring.read(reader, out.data(), 10) == 10);
+  CHECK(isSequence(out, 10, 0));
+
+  // 90 frames unread of a ring of 64: all of them are gone
+  writeFrames(&ring, 30, 35);
+  writeFrames(&ring, 65, 35);
+  CHECK(ring.read(reader, out.data(), 200) == 0);
+  CHECK(ring.getDroppedFrames(reader) == 90);
+
+  writeFrames(&ring, 100, 10);
+  CHECK(ring.read(reader, out.data(), 200) == 10);
+  CHECK(isSequence(out, 10, 100));
+
+  // a reader that is behind but not lapped loses nothing
+  writeFrames(&ring, 110, capacity);
+  CHECK(ring.read(reader, out.data(), 200) == capacity);
+  CHECK(isSequence(out, capacity, 110));
+  CHECK(ring.getDroppedFrames(reader) == 90);
+}
+
+TEST(broadcastRingProtectBlocksWriter) {
+  BroadcastRing ring;
+  ring.allocate(capacity, 2);
+  int protect = ring.addReader(OVERFLOW_PROTECT);
+  int other = ring.addReader(OVERFLOW_DROP_OLDEST);
+
+  // the frames that do not fit are dropped for every reader
+  std::vector<float> frames = makeFrames(0, 100);
+  CHECK(ring.write(frames.data(), 100) == capacity);
+  CHECK(ring.getBlockedFrames() == 100 - capacity);
+  frames = makeFrames(capacity, 10);
+  CHECK(ring.write(frames.data(), 10) == 0);
+  CHECK(ring.getBlockedFrames() == 100 - capacity + 10);
+
+  std::vector<float> out(200 * 2);
+  CHECK(ring.read(other, out.data(), 200) == capacity);
+  CHECK(isSequence(out, capacity, 0));
+  CHECK(ring.getDroppedFrames(other) == 0);
+
+  // reading half of the ring frees half of it
+  CHECK(ring.read(protect, out.data(), capacity / 2) == capacity / 2);
+  CHECK(isSequence(out, capacity / 2, 0));
+  frames = makeFrames(capacity, 50);
+  CHECK(ring.write(frames.data(), 50) == capacity / 2);
+  CHECK(ring.getBlockedFrames() == 100 - capacity + 10 + 50 - capacity / 2);
+
+  CHECK(ring.read(protect, out.data(), 200) == capacity);
+  CHECK(isSequence(out, capacity, capacity / 2));
+  CHECK(ring.getDroppedFrames(protect) == 0);
+
+  // without the protected reader nothing is blocked
+  ring.removeReader(protect);
+  uint64_t blocked = ring.getBlockedFrames();
+  frames = makeFrames(capacity + capacity / 2, capacity);
+  CHECK(ring.write(frames.data(), capacity) == capacity);
+  CHECK(ring.getBlockedFrames() == blocked);
+}
+
+// a writer that keeps lapping a reader while it copies: every frame a read
+// returns must be the one at its index, never one from a later lap. the ring
+// is large so that a copy takes long enough for the writer to get in, also
+// on a single core.
+TEST(broadcastRingTrimsTornReads) {
+  const size_t ringFrames = 1 << 20;
+  const size_t chunkFrames = 4096;
+  BroadcastRing ring;
+  ring.allocate(ringFrames, 2);
+  int reader = ring.addReader(OVERFLOW_DROP_OLDEST);
+
+  std::atomic<bool> done{false};
+  std::thread writer([&]() {
+    uint64_t next = 0;
+    while (!done.load(std::memory_order_relaxed)) {
+      std::vector<float> frames = makeFrames(next, chunkFrames);
+      ring.write(frames.data(), chunkFrames);
+      next += chunkFrames;
+    }
+  });
+
+  std::vector<float> out(ringFrames * 2);
+  uint64_t expected = 0;
+  unsigned int badReads = 0;
+  unsigned int tornReads = 0;
+  for (int i = 0; i < 100; i++) {
+    // start each read a whole ring behind, where the writer overwrites the
+    // oldest frames next
+    while (ring.getAvailable(reader) < ringFrames) {
+      std::this_thread::yield();
+    }
+    uint64_t droppedBefore = ring.getDroppedFrames(reader);
+    size_t count = ring.read(reader, out.data(), ringFrames);
+    uint64_t dropped = ring.getDroppedFrames(reader) - droppedBefore;
+    // the frames read follow on from the last read, after the ones dropped
+    if (!isSequence(out, count, expected + dropped)) {
+      badReads++;
+    }
+    // a full ring was there to read, so only trimming makes it less
+    if (count < ringFrames) {
+      tornReads++;
+    }
+    expected += dropped + count;
+  }
+  done.store(true);
+  writer.join();
+
+  CHECK(badReads == 0);
+  CHECK(tornReads > 0);
+}
+
+// int16 downmix to mono: the standard stereo downmix halves each channel,
+// which the scalar reference does exactly
+TEST(broadcastSubscriberMatchesScalarReference) {
+  BroadcastRing ring;
+  const size_t ringFrames = 8192;
+  ring.allocate(ringFrames, 2);
+
+  BroadcastSubscriber subscriber;
+  CHECK(subscriber.open(&ring, OVERFLOW_DROP_OLDEST, SAMPLE_FORMAT_INT16, false, 1, NULL, 2));
+  CHECK(subscriber.getNumChannels() == 1);
+  CHECK(subscriber.getFrameSize() == 2);
+
+  const size_t frames = 5000;
+  std::vector<float> stereo(frames * 2);
+  for (size_t i = 0; i < frames; i++) {
+    stereo[i * 2] = 0.9f * sinf(0.013f * i);
+    // past full scale now and then, to clip
+    stereo[i * 2 + 1] = 1.3f * sinf(0.0071f * i + 1.0f);
+  }
+  CHECK(ring.write(stereo.data(), frames) == frames);
+
+  std::vector<float> mono(frames);
+  for (size_t i = 0; i < frames; i++) {
+    mono[i] = 0.5f * stereo[i * 2] + 0.5f * stereo[i * 2 + 1];
+  }
+  SampleConverter reference;
+  reference.setSimdEnabled(false);
+  reference.setFormat(SAMPLE_FORMAT_INT16, false);
+  std::vector<int16_t> expected(frames);
+  reference.convert(mono.data(), frames, (char*)expected.data());
+
+  // one read of more frames than the subscriber converts at a time, then
+  // the rest in small ones, without allocating
+  std::vector<int16_t> out(frames);
+  AllocationCounter allocations;
+  size_t read = subscriber.read((char*)out.data(), 3000);
+  CHECK(read == 3000);
+  while (read < frames) {
+    size_t n = subscriber.read((char*)(out.data() + read), 333);
+    if (n == 0) {
+      break;
+    }
+    read += n;
+  }
+  CHECK(allocations.getCount() == 0);
+  CHECK(read == frames);
+  CHECK(out == expected);
+  CHECK(subscriber.getDroppedFrames() == 0);
+}
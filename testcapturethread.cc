@@ -0,0 +1,261 @@
+// CaptureThread draining a simulated device: what lands in the ring, when the
+// notify callback runs, and that stop() joins a thread that is waiting for a
+// packet.
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "capturethread.h"
+#include "sharedring.h"
+#include "simulatedbackend.h"
+#include "test.h"
+
+static const unsigned int sampleRate = 48000;
+static const unsigned int numChannels = 2;
+static const uint32_t packetFrames = 480;
+
+// a signal backend, counting the calls the capture thread makes
+class CountingSource : public CaptureSource {
+public:
+  SignalBackend backend;
+  std::atomic<unsigned int> starts{0};
+  std::atomic<unsigned int> stops{0};
+  std::atomic<unsigned int> waits{0};
+
+  CountingSource(bool realtime) {
+    SimulationOptions options;
+    options.realtime = realtime;
+    options.packetMs = 10.0;
+    backend.setOptions(options);
+    backend.setSignal(SIGNAL_SINE, 1000.0, 0.5f, numChannels, sampleRate);
+  }
+
+  void onCaptureThreadStart() {
+    starts++;
+  }
+  void onCaptureThreadStop() {
+    stops++;
+  }
+  bool waitForPacket(unsigned int timeoutMs) {
+    waits++;
+    return backend.waitForPacket(timeoutMs);
+  }
+  uint32_t getNextPacketSize() {
+    return backend.getNextPacketSize();
+  }
+  uint32_t acquirePacket(const char** data, uint32_t* flags, uint64_t* devicePosition, uint64_t* timestamp) {
+    return backend.acquirePacket(data, flags, devicePosition, timestamp);
+  }
+  void releasePacket(uint32_t nFrames) {
+    backend.releasePacket(nFrames);
+  }
+  unsigned int getFrameSize() {
+    return backend.getFrameSize();
+  }
+};
+
+static void preparePipeline(CapturePipeline* pipeline, CountingSource* source) {
+  CaptureFormat format = source->backend.getFormat();
+  pipeline->setInputFormat(format.frameSize, format.numChannels, format.sampleRate, format.sampleType);
+  pipeline->setMaxPacketFrames(source->backend.getBufferInfo().bufferFrames);
+  CHECK(pipeline->prepare());
+}
+
+// ring write position at every notification, recorded on the capture thread
+typedef struct NotifyLog {
+  RingBuffer* ring;
+  uint64_t positions[1024];
+  std::atomic<unsigned int> count{0};
+} NotifyLog;
+
+static void logNotify(void* context) {
+  NotifyLog* log = (NotifyLog*)context;
+  unsigned int i = log->count.load();
+  if (i < 1024) {
+    log->positions[i] = log->ring->writePosition() / (numChannels * sizeof(float));
+  }
+  log->count.store(i + 1);
+}
+
+TEST(captureThreadDeliversPacketsInOrder) {
+  CountingSource source(false);
+  CHECK(source.backend.open());
+  CapturePipeline pipeline;
+  preparePipeline(&pipeline, &source);
+  RingBuffer ring;
+  const size_t frames = sampleRate;
+  ring.allocate(frames * pipeline.getOutputFrameSize());
+
+  CaptureThread thread;
+  CHECK(thread.start(&source, &pipeline, &ring, 10));
+  CHECK(thread.isRunning());
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (ring.readAvailable() < ring.capacity() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  thread.stop();
+  CHECK(!thread.isRunning());
+  CHECK(source.starts.load() == 1);
+  CHECK(source.stops.load() == 1);
+
+  // a full ring keeps the oldest audio: the first second of the signal, the
+  // same as a second backend gives packet by packet
+  std::vector<float> captured(frames * numChannels);
+  CHECK(ring.read((char*)captured.data(), captured.size() * sizeof(float)) == captured.size() * sizeof(float));
+  CHECK(thread.getOverflowFrames() > 0);
+
+  CountingSource reference(false);
+  CHECK(reference.backend.open());
+  std::vector<float> expected;
+  while (expected.size() < captured.size()) {
+    const char* data;
+    uint32_t flags;
+    uint64_t position;
+    uint64_t timestamp;
+    uint32_t n = reference.acquirePacket(&data, &flags, &position, &timestamp);
+    expected.insert(expected.end(), (const float*)data, (const float*)data + n * numChannels);
+    reference.releasePacket(n);
+  }
+  expected.resize(captured.size());
+  CHECK(captured == expected);
+
+  // timing of the first packet, and of one in the middle
+  ChunkTiming timing = {};
+  CHECK(thread.getChunkTiming(0, packetFrames, &timing));
+  CHECK(timing.devicePosition == 0);
+  CHECK(thread.getChunkTiming(10 * packetFrames, 11 * packetFrames, &timing));
+  CHECK(timing.devicePosition == 10 * packetFrames);
+
+  source.backend.close();
+}
+
+// runs a real-time source for runMs with the given batching and returns the
+// frames between consecutive notifications
+static std::vector<uint64_t> runBatches(uint32_t batchFrames, unsigned int batchMs, unsigned int runMs) {
+  CountingSource source(true);
+  CHECK(source.backend.open());
+  CapturePipeline pipeline;
+  preparePipeline(&pipeline, &source);
+  RingBuffer ring;
+  ring.allocate(2 * sampleRate * pipeline.getOutputFrameSize());
+
+  NotifyLog* log = new NotifyLog();
+  log->ring = &ring;
+  CaptureThread thread;
+  thread.setNotify(logNotify, log, batchFrames, batchMs);
+  CHECK(thread.start(&source, &pipeline, &ring, 10));
+  std::this_thread::sleep_for(std::chrono::milliseconds(runMs));
+  thread.stop();
+  source.backend.close();
+
+  // nothing runs after stop() returned
+  unsigned int count = log->count.load();
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  CHECK(log->count.load() == count);
+
+  std::vector<uint64_t> batches;
+  uint64_t previous = 0;
+  for (unsigned int i = 0; i < count && i < 1024; i++) {
+    batches.push_back(log->positions[i] - previous);
+    previous = log->positions[i];
+  }
+  delete log;
+  return batches;
+}
+
+TEST(captureThreadNotifiesEveryPacketWithoutBatching) {
+  std::vector<uint64_t> batches = runBatches(0, 0, 300);
+  CHECK(batches.size() >= 10);
+  for (size_t i = 0; i < batches.size(); i++) {
+    // a late wakeup can find two packets waiting
+    CHECK(batches[i] > 0 && batches[i] % packetFrames == 0);
+  }
+}
+
+TEST(captureThreadBatchesByFrames) {
+  std::vector<uint64_t> batches = runBatches(4 * packetFrames, 10000, 500);
+  CHECK(batches.size() >= 5);
+  for (size_t i = 0; i < batches.size(); i++) {
+    // the packet that reaches batchFrames ends the batch
+    CHECK(batches[i] >= 4 * packetFrames);
+    CHECK(batches[i] < 5 * packetFrames + packetFrames);
+  }
+}
+
+TEST(captureThreadBatchesByTime) {
+  // 35 ms after the first frame of a batch: usually four 10 ms packets
+  std::vector<uint64_t> batches = runBatches(sampleRate * 10, 35, 600);
+  CHECK(batches.size() >= 5);
+  uint64_t total = 0;
+  for (size_t i = 0; i < batches.size(); i++) {
+    CHECK(batches[i] > 0 && batches[i] < sampleRate / 10);
+    total += batches[i];
+  }
+  double mean = batches.empty() ? 0.0 : (double)total / batches.size();
+  CHECK(mean >= 3 * packetFrames && mean <= 6 * packetFrames);
+}
+
+TEST(captureThreadStopsWhileWaiting) {
+  // a source that never has a packet: the thread only ever waits
+  CountingSource source(true);
+  CHECK(source.backend.open());
+  source.backend.close();
+  CapturePipeline pipeline;
+  pipeline.setInputFormat(numChannels * sizeof(float), numChannels, sampleRate, CAPTURE_SAMPLE_FLOAT32);
+  CHECK(pipeline.prepare());
+  RingBuffer ring;
+  ring.allocate(sampleRate * pipeline.getOutputFrameSize());
+
+  CaptureThread thread;
+  CHECK(thread.start(&source, &pipeline, &ring, 20));
+  // a second start while running is refused
+  CHECK(!thread.start(&source, &pipeline, &ring, 20));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  std::chrono::steady_clock::time_point stopStart = std::chrono::steady_clock::now();
+  thread.stop();
+  double stopMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stopStart).count();
+  CHECK(stopMs < 200.0);
+  CHECK(!thread.isRunning());
+  CHECK(source.waits.load() >= 2);
+  CHECK(source.starts.load() == 1);
+  CHECK(source.stops.load() == 1);
+  CHECK(ring.readAvailable() == 0);
+
+  // and it can run again
+  CHECK(thread.start(&source, &pipeline, &ring, 20));
+  thread.stop();
+  CHECK(source.starts.load() == 2);
+  CHECK(source.stops.load() == 2);
+}
+
+TEST(captureThreadDoesNotTimeSharedRingFrames) {
+  CountingSource source(false);
+  CHECK(source.backend.open());
+  CapturePipeline pipeline;
+  preparePipeline(&pipeline, &source);
+  std::vector<uint64_t> memory((sharedRingHeaderBytes + sampleRate * pipeline.getOutputFrameSize()) / sizeof(uint64_t));
+  SharedRing sharedRing;
+  CHECK(sharedRing.attach((char*)memory.data(), memory.size() * sizeof(uint64_t)));
+  CHECK(sharedRing.start(pipeline.getOutputFrameSize(), numChannels, sampleRate, SAMPLE_FORMAT_FLOAT32));
+  pipeline.setSharedRing(&sharedRing);
+  RingBuffer ring;
+  ring.allocate(sampleRate * pipeline.getOutputFrameSize());
+
+  CaptureThread thread;
+  CHECK(thread.start(&source, &pipeline, &ring, 10));
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (sharedRing.writeAvailable() > 0 && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  thread.stop();
+  source.backend.close();
+
+  // the audio went to the shared ring, and the ring's position 0 does not
+  // claim the timing of every packet
+  CHECK(sharedRing.writeAvailable() == 0);
+  CHECK(ring.readAvailable() == 0);
+  ChunkTiming timing = {};
+  CHECK(!thread.getChunkTiming(0, packetFrames, &timing));
+}
@@ -0,0 +1,158 @@
+// DeviceMixer following two simulated devices whose clocks disagree, the way
+// two USB interfaces with their own crystals do.
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "devicemixer.h"
+#include "simulatedbackend.h"
+#include "test.h"
+
+static const unsigned int sampleRate = 48000;
+static const unsigned int numChannels = 2;
+
+// a SimulatedBackend as a mixer source. the backend runs in fast mode and a
+// packet is only handed out once a virtual clock, advanced by the test, has
+// passed the capture time of its last frame, so hours of audio take seconds
+// while both devices still deliver at their own rate.
+class SimulatedMixerSource : public MixerSource {
+private:
+  SignalBackend backend;
+  double ticksPerFrame;
+
+public:
+  uint64_t now = 0;
+
+  SimulatedMixerSource(double driftPpm, double packetMs, double frequency) {
+    SimulationOptions options;
+    options.realtime = false;
+    options.packetMs = packetMs;
+    options.driftPpm = driftPpm;
+    backend.setOptions(options);
+    backend.setSignal(SIGNAL_SINE, frequency, 0.5f, numChannels, sampleRate);
+    ticksPerFrame = 10000000.0 / (sampleRate * (1.0 + driftPpm / 1000000.0));
+  }
+
+  bool open() {
+    return backend.open();
+  }
+
+  // capture time of the first frame
+  uint64_t getStartTimestamp() {
+    const char* data;
+    uint32_t flags;
+    uint64_t position;
+    uint64_t timestamp;
+    backend.acquirePacket(&data, &flags, &position, &timestamp);
+    backend.releasePacket(0);
+    return timestamp;
+  }
+
+  unsigned int getSourceChannels() {
+    return numChannels;
+  }
+
+  size_t readSourceFrames(float* out, size_t maxFrames, ChunkTiming* timing) {
+    size_t frames = 0;
+    for (;;) {
+      const char* data;
+      uint32_t flags;
+      uint64_t position;
+      uint64_t timestamp;
+      uint32_t n = backend.acquirePacket(&data, &flags, &position, &timestamp);
+      if (n == 0) {
+        // the pause between bursts of fast mode
+        n = backend.acquirePacket(&data, &flags, &position, &timestamp);
+      }
+      if (n == 0 || frames + n > maxFrames || timestamp + (uint64_t)(n * ticksPerFrame) > now) {
+        backend.releasePacket(0);
+        return frames;
+      }
+      if (frames == 0) {
+        timing->devicePosition = position;
+        timing->timestamp = timestamp;
+        timing->flags = flags;
+      }
+      memcpy(out + frames * numChannels, data, (size_t)n * numChannels * sizeof(float));
+      backend.releasePacket(n);
+      frames += n;
+    }
+  }
+};
+
+// runs the mixer the way its thread does, every 5 ms of virtual time, for
+// seconds of audio from a master at 48000 Hz and a second source at
+// secondRate. checks the queues once the controller has settled.
+static void checkMixerFollowsClock(double secondRate, double seconds) {
+  double driftPpm = (secondRate / sampleRate - 1.0) * 1000000.0;
+  SimulatedMixerSource master(0.0, 10.0, 440.0);
+  SimulatedMixerSource second(driftPpm, 7.0, 660.0);
+  CHECK(master.open());
+  CHECK(second.open());
+  uint64_t start = master.getStartTimestamp();
+  if (second.getStartTimestamp() > start) {
+    start = second.getStartTimestamp();
+  }
+
+  DeviceMixer mixer;
+  std::vector<MixerSource*> sources;
+  sources.push_back(&master);
+  sources.push_back(&second);
+  std::vector<float> gains(2, 0.5f);
+  CHECK(mixer.configure(sources, gains, MIXER_MODE_TRACKS, sampleRate, sampleRate));
+
+  const uint64_t periodTicks = 50000;
+  const double settleSeconds = 20.0;
+  uint64_t rounds = (uint64_t)(seconds * 10000000.0 / periodTicks);
+  std::vector<float> out(sampleRate * 2 * numChannels);
+  uint64_t mixedFrames = 0;
+  uint64_t maxBuffered[2] = { 0, 0 };
+  double maxOffsetMs = 0.0;
+  bool stalled = false;
+  MixerSourceStats stats = {};
+  for (uint64_t round = 1; round <= rounds; round++) {
+    master.now = start + round * periodTicks;
+    second.now = master.now;
+    mixer.process();
+    mixedFrames += mixer.readFrames(out.data(), out.size() / (2 * numChannels));
+    if (round * periodTicks < settleSeconds * 10000000.0) {
+      continue;
+    }
+    for (unsigned int i = 0; i < 2; i++) {
+      CHECK(mixer.getSourceStats(i, &stats));
+      if (stats.bufferedFrames > maxBuffered[i]) {
+        maxBuffered[i] = stats.bufferedFrames;
+      }
+      stalled = stalled || stats.stalled;
+    }
+    if (fabs(stats.offsetMs) > maxOffsetMs) {
+      maxOffsetMs = fabs(stats.offsetMs);
+    }
+  }
+
+  // without rate control the second queue would grow by 5 frames per second
+  // (or drift into a realign) over the run; with it the queues stay within
+  // about a packet of the master's plus what one round leaves unmixed
+  CHECK(!stalled);
+  CHECK(maxBuffered[0] < 512);
+  CHECK(maxBuffered[1] < 512);
+  CHECK(maxOffsetMs < 0.5);
+  CHECK(fabs(stats.driftPpm - driftPpm) < 5.0);
+  CHECK(mixer.getOverflowFrames() == 0);
+  // the output runs on the master clock
+  CHECK(fabs((double)mixedFrames - seconds * sampleRate) < sampleRate * 0.05);
+}
+
+TEST(deviceMixerFollowsFasterClock) {
+  checkMixerFollowsClock(48005.0, 600.0);
+}
+
+TEST(deviceMixerFollowsSlowerClock) {
+  checkMixerFollowsClock(47995.0, 600.0);
+}
+
+TEST(deviceMixerFollowsFarOffClock) {
+  // 1500 ppm, near the limit of the rate control
+  checkMixerFollowsClock(48072.0, 120.0);
+}
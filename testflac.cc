@@ -0,0 +1,521 @@
+// FlacRecorder output decoded by a reference decoder written from the FLAC
+// format specification, compared bit-exactly with the same audio written by
+// writeWavFile(). the decoder checks every frame's CRC-8 and CRC-16 and
+// handles every subframe type, residual coding and stereo decorrelation the
+// format has, not only the ones FlacEncoder picks today.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "capturepipeline.h"
+#include "recorder.h"
+#include "ringbuffer.h"
+#include "test.h"
+
+static const double pi = 3.14159265358979323846;
+
+// ---------------------------------------------
+// reference decoder
+
+class FlacBitReader {
+private:
+  const uint8_t* data;
+  size_t size;
+  size_t bitPosition = 0;
+
+public:
+  bool overrun = false;
+
+  FlacBitReader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+  uint32_t read(unsigned int n) {
+    uint32_t value = 0;
+    for (unsigned int i = 0; i < n; i++) {
+      size_t byte = bitPosition >> 3;
+      if (byte >= size) {
+        overrun = true;
+        return 0;
+      }
+      value = (value << 1) | ((data[byte] >> (7 - (bitPosition & 7))) & 1);
+      bitPosition++;
+    }
+    return value;
+  }
+
+  uint64_t read64(unsigned int n) {
+    uint64_t high = n > 32 ? read(n - 32) : 0;
+    return (high << (n > 32 ? 32 : n)) | read(n > 32 ? 32 : n);
+  }
+
+  int32_t readSigned(unsigned int n) {
+    if (n == 0) {
+      return 0;
+    }
+    uint32_t value = read(n);
+    if (n < 32 && (value & (1u << (n - 1)))) {
+      value |= ~0u << n;
+    }
+    return (int32_t)value;
+  }
+
+  uint32_t readUnary() {
+    uint32_t zeros = 0;
+    while (!overrun && read(1) == 0) {
+      zeros++;
+    }
+    return zeros;
+  }
+
+  void alignToByte() {
+    bitPosition = (bitPosition + 7) & ~(size_t)7;
+  }
+
+  size_t getBytePosition() {
+    return bitPosition >> 3;
+  }
+};
+
+static uint8_t crc8(const uint8_t* data, size_t n) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < n; i++) {
+    crc ^= data[i];
+    for (int b = 0; b < 8; b++) {
+      crc = (uint8_t)(crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1);
+    }
+  }
+  return crc;
+}
+
+static uint16_t crc16(const uint8_t* data, size_t n) {
+  uint16_t crc = 0;
+  for (size_t i = 0; i < n; i++) {
+    crc ^= (uint16_t)(data[i] << 8);
+    for (int b = 0; b < 8; b++) {
+      crc = (uint16_t)(crc & 0x8000 ? (crc << 1) ^ 0x8005 : crc << 1);
+    }
+  }
+  return crc;
+}
+
+typedef struct FlacStream {
+  unsigned int numChannels;
+  unsigned int bitsPerSample;
+  unsigned int sampleRate;
+  uint64_t totalFrames;
+  unsigned int maxBlockFrames;
+  unsigned int frames; // decoded frames (FLAC frames, not sample frames)
+  unsigned int lastBlockFrames;
+  unsigned int assignments[16]; // frames per channel assignment
+  std::vector<int32_t> samples; // interleaved
+} FlacStream;
+
+static bool decodeResidual(FlacBitReader& reader, size_t blockFrames, unsigned int order, int64_t* out) {
+  unsigned int method = reader.read(2);
+  if (method > 1) {
+    return false;
+  }
+  unsigned int parameterBits = method == 0 ? 4 : 5;
+  unsigned int escape = method == 0 ? 15 : 31;
+  unsigned int partitionOrder = reader.read(4);
+  size_t partitions = (size_t)1 << partitionOrder;
+  if ((blockFrames >> partitionOrder) < order || (blockFrames % partitions) != 0) {
+    return false;
+  }
+  size_t i = order;
+  for (size_t p = 0; p < partitions; p++) {
+    size_t n = (blockFrames >> partitionOrder) - (p == 0 ? order : 0);
+    unsigned int parameter = reader.read(parameterBits);
+    if (parameter == escape) {
+      unsigned int bits = reader.read(5);
+      for (size_t j = 0; j < n; j++) {
+        out[i++] = reader.readSigned(bits);
+      }
+    } else {
+      for (size_t j = 0; j < n; j++) {
+        uint32_t u = (reader.readUnary() << parameter) | reader.read(parameter);
+        out[i++] = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+      }
+    }
+  }
+  return !reader.overrun;
+}
+
+static bool decodeSubframe(FlacBitReader& reader, size_t blockFrames, unsigned int bps, int64_t* out) {
+  if (reader.read(1) != 0) {
+    return false;
+  }
+  unsigned int type = reader.read(6);
+  unsigned int wasted = 0;
+  if (reader.read(1)) {
+    wasted = reader.readUnary() + 1;
+  }
+  bps -= wasted;
+
+  if (type == 0) {
+    int32_t value = reader.readSigned(bps);
+    for (size_t i = 0; i < blockFrames; i++) {
+      out[i] = value;
+    }
+  } else if (type == 1) {
+    for (size_t i = 0; i < blockFrames; i++) {
+      out[i] = reader.readSigned(bps);
+    }
+  } else if (type >= 8 && type <= 12) {
+    unsigned int order = type & 7;
+    static const int fixed[5][4] = { { 0 }, { 1 }, { 2, -1 }, { 3, -3, 1 }, { 4, -6, 4, -1 } };
+    for (unsigned int i = 0; i < order; i++) {
+      out[i] = reader.readSigned(bps);
+    }
+    if (!decodeResidual(reader, blockFrames, order, out)) {
+      return false;
+    }
+    for (size_t i = order; i < blockFrames; i++) {
+      int64_t prediction = 0;
+      for (unsigned int j = 0; j < order; j++) {
+        prediction += (int64_t)fixed[order][j] * out[i - 1 - j];
+      }
+      out[i] += prediction;
+    }
+  } else if (type >= 32) {
+    unsigned int order = (type & 31) + 1;
+    for (unsigned int i = 0; i < order; i++) {
+      out[i] = reader.readSigned(bps);
+    }
+    unsigned int precision = reader.read(4) + 1;
+    int shift = reader.readSigned(5);
+    if (precision == 16 || shift < 0) {
+      return false;
+    }
+    int32_t coefficients[32];
+    for (unsigned int j = 0; j < order; j++) {
+      coefficients[j] = reader.readSigned(precision);
+    }
+    if (!decodeResidual(reader, blockFrames, order, out)) {
+      return false;
+    }
+    for (size_t i = order; i < blockFrames; i++) {
+      int64_t prediction = 0;
+      for (unsigned int j = 0; j < order; j++) {
+        prediction += (int64_t)coefficients[j] * out[i - 1 - j];
+      }
+      out[i] += prediction >> shift;
+    }
+  } else {
+    return false;
+  }
+  for (size_t i = 0; i < blockFrames; i++) {
+    out[i] = (int64_t)((uint64_t)out[i] << wasted);
+  }
+  return !reader.overrun;
+}
+
+static bool decodeFrame(const uint8_t* data, size_t size, FlacStream* stream, size_t* frameBytes) {
+  FlacBitReader reader(data, size);
+  if (reader.read(15) != 0x7ffc) {
+    return false;
+  }
+  reader.read(1); // blocking strategy
+  unsigned int blockCode = reader.read(4);
+  unsigned int rateCode = reader.read(4);
+  unsigned int assignment = reader.read(4);
+  unsigned int sizeCode = reader.read(3);
+  reader.read(1);
+  // frame or sample number, "UTF-8" coded
+  uint32_t first = reader.read(8);
+  unsigned int extraBytes = 0;
+  while (first & (0x80 >> extraBytes)) {
+    extraBytes++;
+  }
+  for (unsigned int i = 1; i < extraBytes; i++) {
+    reader.read(8);
+  }
+
+  size_t blockFrames = 0;
+  static const unsigned int blockSizes[16] = { 0, 192, 576, 1152, 2304, 4608, 0, 0, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768 };
+  if (blockCode == 6) {
+    blockFrames = reader.read(8) + 1;
+  } else if (blockCode == 7) {
+    blockFrames = reader.read(16) + 1;
+  } else {
+    blockFrames = blockSizes[blockCode];
+  }
+  if (rateCode == 12) {
+    reader.read(8);
+  } else if (rateCode == 13 || rateCode == 14) {
+    reader.read(16);
+  }
+  static const unsigned int sampleSizes[8] = { 0, 8, 12, 0, 16, 20, 24, 32 };
+  unsigned int bps = sizeCode == 0 ? stream->bitsPerSample : sampleSizes[sizeCode];
+  size_t headerBytes = reader.getBytePosition();
+  if (blockFrames == 0 || bps != stream->bitsPerSample || crc8(data, headerBytes) != reader.read(8)) {
+    return false;
+  }
+
+  unsigned int numChannels = assignment < 8 ? assignment + 1 : 2;
+  if (numChannels != stream->numChannels || assignment > 10) {
+    return false;
+  }
+  std::vector<int64_t> channels[8];
+  for (unsigned int c = 0; c < numChannels; c++) {
+    channels[c].resize(blockFrames);
+    // the side channel has one bit more
+    bool side = (assignment == 8 && c == 1) || (assignment == 9 && c == 0) || (assignment == 10 && c == 1);
+    if (!decodeSubframe(reader, blockFrames, bps + (side ? 1 : 0), channels[c].data())) {
+      return false;
+    }
+  }
+  reader.alignToByte();
+  size_t bodyBytes = reader.getBytePosition();
+  if (reader.overrun || crc16(data, bodyBytes) != reader.read(16)) {
+    return false;
+  }
+  *frameBytes = bodyBytes + 2;
+
+  for (size_t i = 0; i < blockFrames; i++) {
+    int64_t a = channels[0][i];
+    int64_t b = numChannels > 1 ? channels[1][i] : 0;
+    if (assignment == 8) {
+      b = a - b;
+    } else if (assignment == 9) {
+      a = a + b;
+    } else if (assignment == 10) {
+      int64_t mid = a * 2 + (b & 1);
+      a = (mid + b) >> 1;
+      b = (mid - b) >> 1;
+    }
+    for (unsigned int c = 0; c < numChannels; c++) {
+      int64_t value = c == 0 ? a : c == 1 ? b : channels[c][i];
+      stream->samples.push_back((int32_t)value);
+    }
+  }
+  stream->frames++;
+  stream->assignments[assignment]++;
+  stream->lastBlockFrames = (unsigned int)blockFrames;
+  return true;
+}
+
+static bool decodeFlacFile(const char* path, FlacStream* stream) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.insert(data.end(), buffer, buffer + n);
+  }
+  fclose(file);
+
+  if (data.size() < 42 || memcmp(data.data(), "fLaC", 4) != 0) {
+    return false;
+  }
+  size_t position = 4;
+  bool last = false;
+  bool hasStreamInfo = false;
+  while (!last) {
+    if (position + 4 > data.size()) {
+      return false;
+    }
+    last = (data[position] & 0x80) != 0;
+    unsigned int type = data[position] & 0x7f;
+    size_t length = (size_t)data[position + 1] << 16 | (size_t)data[position + 2] << 8 | data[position + 3];
+    position += 4;
+    if (position + length > data.size()) {
+      return false;
+    }
+    if (type == 0) {
+      FlacBitReader reader(data.data() + position, length);
+      reader.read(16);
+      stream->maxBlockFrames = reader.read(16);
+      reader.read(24);
+      reader.read(24);
+      stream->sampleRate = reader.read(20);
+      stream->numChannels = reader.read(3) + 1;
+      stream->bitsPerSample = reader.read(5) + 1;
+      stream->totalFrames = reader.read64(36);
+      hasStreamInfo = true;
+    }
+    position += length;
+  }
+  if (!hasStreamInfo) {
+    return false;
+  }
+  stream->frames = 0;
+  while (position < data.size()) {
+    size_t frameBytes;
+    if (!decodeFrame(data.data() + position, data.size() - position, stream, &frameBytes)) {
+      return false;
+    }
+    position += frameBytes;
+  }
+  return true;
+}
+
+// ---------------------------------------------
+
+static std::vector<int32_t> readWavSamples(const char* path, unsigned int bitsPerSample) {
+  std::vector<int32_t> samples;
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return samples;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    data.insert(data.end(), buffer, buffer + n);
+  }
+  fclose(file);
+
+  // chunks after "WAVE"
+  size_t position = 12;
+  while (position + 8 <= data.size()) {
+    uint32_t length = data[position + 4] | data[position + 5] << 8 | data[position + 6] << 16 | (uint32_t)data[position + 7] << 24;
+    if (memcmp(data.data() + position, "data", 4) == 0) {
+      unsigned int bytes = bitsPerSample / 8;
+      const uint8_t* p = data.data() + position + 8;
+      for (size_t i = 0; i + bytes <= length && position + 8 + i + bytes <= data.size(); i += bytes) {
+        uint32_t value = 0;
+        for (unsigned int b = 0; b < bytes; b++) {
+          value |= (uint32_t)p[i + b] << (8 * b + 32 - bitsPerSample);
+        }
+        samples.push_back((int32_t)value >> (32 - bitsPerSample));
+      }
+      break;
+    }
+    position += 8 + length + (length & 1);
+  }
+  return samples;
+}
+
+// numChannels of test signal: tones, noise, a silent stretch and full-scale
+// clipping. every 16384 frames the second channel changes its relation to the
+// first (louder, inverted, quieter, unrelated), so that each of the stereo
+// decorrelation modes is the cheapest somewhere
+static std::vector<float> makeSignal(size_t frames, unsigned int numChannels, unsigned int sampleRate) {
+  std::vector<float> samples(frames * numChannels);
+  uint32_t noise = 0x2468ace1;
+  for (size_t f = 0; f < frames; f++) {
+    double t = (double)f / sampleRate;
+    bool silent = f >= frames / 3 && f < frames / 3 + 5000;
+    for (unsigned int c = 0; c < numChannels; c++) {
+      noise ^= noise << 13;
+      noise ^= noise >> 17;
+      noise ^= noise << 5;
+      float hiss = ((float)(noise >> 8) / 8388608.0f - 1.0f) * 0.01f;
+      float value;
+      if (silent) {
+        value = 0.0f;
+      } else if (c == 1) {
+        float first = samples[f * numChannels];
+        switch ((f / 16384) % 4) {
+          case 0: value = first * 1.35f; break;
+          case 1: value = -first + hiss * 0.1f; break;
+          case 2: value = first * 0.3f; break;
+          default: value = (float)(0.4 * sin(2.0 * pi * 1234.0 * t)) + hiss * 5.0f; break;
+        }
+      } else if (c == 2) {
+        value = (float)(1.3 * sin(2.0 * pi * 50.0 * t));
+      } else {
+        value = (float)(0.5 * sin(2.0 * pi * (220.0 + 110.0 * c) * t) + 0.2 * sin(2.0 * pi * 3150.0 * t)) + hiss;
+      }
+      samples[f * numChannels + c] = value;
+    }
+  }
+  return samples;
+}
+
+// the pipeline converts float input to PCM; both the recorder and the WAV
+// reference get its output
+static void checkFlacRoundTrip(unsigned int numChannels, unsigned int bitsPerSample, unsigned int sampleRate,
+    unsigned int blockFrames, unsigned int threads, size_t frames) {
+  const char* flacPath = "capture-test-flac.flac";
+  const char* wavPath = "capture-test-flac.wav";
+  std::vector<float> input = makeSignal(frames, numChannels, sampleRate);
+
+  CapturePipeline pipeline;
+  pipeline.setInputFormat(numChannels * sizeof(float), numChannels, sampleRate, CAPTURE_SAMPLE_FLOAT32);
+  pipeline.setOutputSampleFormat(bitsPerSample == 16 ? SAMPLE_FORMAT_INT16 : SAMPLE_FORMAT_INT24, false);
+  CHECK(pipeline.prepare());
+  unsigned int frameSize = pipeline.getOutputFrameSize();
+  CHECK(frameSize == numChannels * bitsPerSample / 8);
+
+  RingBuffer ring;
+  ring.allocate(frames * frameSize);
+  FlacRecorder recorder;
+  CHECK(recorder.start(flacPath, numChannels, bitsPerSample, sampleRate, blockFrames, threads,
+    (uint32_t)(frames + blockFrames)));
+
+  // packets of varying size, as a device delivers them
+  static const size_t packetSizes[] = { 480, 441, 1024, 7, 4096, 333 };
+  size_t position = 0;
+  for (unsigned int p = 0; position < frames; p++) {
+    size_t n = packetSizes[p % 6];
+    if (n > frames - position) {
+      n = frames - position;
+    }
+    uint32_t written;
+    pipeline.processPacket((const char*)(input.data() + position * numChannels), (uint32_t)n, 0, &ring, &written);
+    recorder.recordPacket(&pipeline);
+    position += n;
+  }
+  recorder.stop();
+  CHECK(!recorder.hasFailed());
+  CHECK(recorder.getDroppedFrames() == 0);
+  CHECK(recorder.getRecordedFrames() == frames);
+
+  std::vector<char> pcm(ring.readAvailable());
+  ring.read(pcm.data(), pcm.size());
+  CHECK(pcm.size() == frames * frameSize);
+  RecordingFormat format = {};
+  format.formatTag = RECORDING_FORMAT_PCM;
+  format.numChannels = (uint16_t)numChannels;
+  format.bitsPerSample = (uint16_t)bitsPerSample;
+  format.frameSize = (uint16_t)frameSize;
+  format.sampleRate = sampleRate;
+  format.deviceSampleRate = sampleRate;
+  CHECK(writeWavFile(wavPath, format, pcm.data(), pcm.size()));
+
+  std::vector<int32_t> expected = readWavSamples(wavPath, bitsPerSample);
+  FlacStream stream = {};
+  bool decoded = decodeFlacFile(flacPath, &stream);
+  CHECK(decoded);
+  CHECK(stream.numChannels == numChannels);
+  CHECK(stream.bitsPerSample == bitsPerSample);
+  CHECK(stream.sampleRate == sampleRate);
+  CHECK(stream.totalFrames == frames);
+  CHECK(stream.maxBlockFrames == blockFrames);
+  // the last block is a partial one
+  CHECK(stream.lastBlockFrames == frames % blockFrames);
+  CHECK(expected.size() == frames * numChannels);
+  CHECK(stream.samples == expected);
+  if (numChannels == 2) {
+    CHECK(stream.assignments[1] > 0);
+    CHECK(stream.assignments[8] > 0);
+    CHECK(stream.assignments[9] > 0);
+    CHECK(stream.assignments[10] > 0);
+  }
+
+  remove(flacPath);
+  remove(wavPath);
+}
+
+TEST(flacRecorderStereo16BitIsBitExact) {
+  checkFlacRoundTrip(2, 16, 48000, 4096, 2, 48000 * 2 + 1234);
+}
+
+TEST(flacRecorderMultichannel24BitIsBitExact) {
+  checkFlacRoundTrip(6, 24, 44100, 1152, 3, 44100 + 777);
+}
+
+TEST(flacRecorderMono16BitSmallBlocksIsBitExact) {
+  checkFlacRoundTrip(1, 16, 16000, 192, 1, 16000 + 100);
+}
+
+TEST(flacRecorderStereo24BitIsBitExact) {
+  checkFlacRoundTrip(2, 24, 96000, 4608, 4, 96000 + 4607);
+}
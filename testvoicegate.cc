@@ -0,0 +1,102 @@
+// the voice gate against stationary noise, which must be gated within about
+// a second wherever the noise floor started, and voiced sound over it, which
+// must pass.
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+#include "test.h"
+#include "voicegate.h"
+
+static const unsigned int gateRate = 48000;
+static const unsigned int gateChannels = 2;
+static const double pi = 3.14159265358979323846;
+
+typedef struct GateInput {
+  uint32_t noiseState = 0x12345678;
+  double phase = 0.0;
+} GateInput;
+
+// frames of uniform white noise of the given peak amplitude, plus a sine of
+// toneAmplitude at 200 Hz
+static std::vector<float> makeInput(GateInput* input, size_t frames, float noiseAmplitude, float toneAmplitude) {
+  std::vector<float> samples(frames * gateChannels);
+  for (size_t f = 0; f < frames; f++) {
+    float tone = toneAmplitude * (float)sin(input->phase);
+    input->phase += 2.0 * pi * 200.0 / gateRate;
+    for (unsigned int c = 0; c < gateChannels; c++) {
+      uint32_t& s = input->noiseState;
+      s ^= s << 13;
+      s ^= s >> 17;
+      s ^= s << 5;
+      float noise = noiseAmplitude * ((float)(s >> 8) / 8388608.0f - 1.0f);
+      samples[f * gateChannels + c] = tone + noise;
+    }
+  }
+  return samples;
+}
+
+// feeds seconds of input in 10 ms packets and returns the frames that passed
+// in its last second
+static size_t runGate(VoiceGate* gate, GateInput* input, double seconds, float noiseAmplitude, float toneAmplitude) {
+  size_t packetFrames = gateRate / 100;
+  size_t packets = (size_t)(seconds * 100);
+  std::vector<float> out(gate->getMaxOutputFrames(packetFrames) * gateChannels);
+  size_t lastSecond = 0;
+  for (size_t p = 0; p < packets; p++) {
+    std::vector<float> in = makeInput(input, packetFrames, noiseAmplitude, toneAmplitude);
+    size_t produced = gate->process(in.data(), packetFrames, out.data());
+    if (p + 100 >= packets) {
+      lastSecond += produced;
+    }
+  }
+  return lastSecond;
+}
+
+TEST(voiceGateClosesOnStationaryNoise) {
+  VoiceGate gate;
+  CHECK(gate.configure(GATE_MODE_VOICE, gateChannels, gateRate, getGateDefaultThreshold(GATE_MODE_VOICE), 200));
+  GateInput input;
+  // 0.05 hiss from the start: the floor is seeded from it
+  runGate(&gate, &input, 1.0, 0.05f, 0.0f);
+  CHECK(runGate(&gate, &input, 2.0, 0.05f, 0.0f) == 0);
+  CHECK(!gate.isOpen());
+}
+
+TEST(voiceGateClosesOnNoiseAfterDigitalSilence) {
+  VoiceGate gate;
+  CHECK(gate.configure(GATE_MODE_VOICE, gateChannels, gateRate, getGateDefaultThreshold(GATE_MODE_VOICE), 200));
+  GateInput input;
+  CHECK(runGate(&gate, &input, 5.0, 0.0f, 0.0f) == 0);
+  // the floor rises to the hiss within the first second
+  runGate(&gate, &input, 1.0, 0.05f, 0.0f);
+  CHECK(runGate(&gate, &input, 2.0, 0.05f, 0.0f) == 0);
+  // and also to louder hiss
+  runGate(&gate, &input, 1.0, 0.3f, 0.0f);
+  CHECK(runGate(&gate, &input, 2.0, 0.3f, 0.0f) == 0);
+}
+
+TEST(voiceGatePassesVoicedSoundOverNoise) {
+  VoiceGate gate;
+  CHECK(gate.configure(GATE_MODE_VOICE, gateChannels, gateRate, getGateDefaultThreshold(GATE_MODE_VOICE), 200));
+  GateInput input;
+  runGate(&gate, &input, 2.0, 0.05f, 0.0f);
+  // a 200 Hz tone 15 dB above the hiss passes for all of several seconds
+  CHECK(runGate(&gate, &input, 3.0, 0.05f, 0.3f) == gateRate);
+  CHECK(gate.isOpen());
+  // and the gate closes again after it
+  runGate(&gate, &input, 1.0, 0.05f, 0.0f);
+  CHECK(runGate(&gate, &input, 1.0, 0.05f, 0.0f) == 0);
+}
+
+TEST(voiceGateKeepsQuietSoundBelowThresholdOut) {
+  VoiceGate gate;
+  CHECK(gate.configure(GATE_MODE_VOICE, gateChannels, gateRate, getGateDefaultThreshold(GATE_MODE_VOICE), 200));
+  GateInput input;
+  runGate(&gate, &input, 1.0, 0.0f, 0.0f);
+  // a -66 dBFS tone in digital silence is below the -50 dB threshold
+  CHECK(runGate(&gate, &input, 2.0, 0.0f, 0.0007f) == 0);
+  // a -23 dBFS one is voice
+  CHECK(runGate(&gate, &input, 2.0, 0.0f, 0.1f) == gateRate);
+}
@@ -0,0 +1,167 @@
+#include "voicegate.h"
+
+#include <math.h>
+#include <string.h>
+
+static const unsigned int blockMs = 10;
+
+// a voiced block must stand this far above the noise floor
+static const float voiceMarginDb = 6.0f;
+// blocks this far above the floor, or the threshold if that is higher, count
+// as active whatever their zero crossings, e.g. loud fricatives
+static const float loudMarginDb = 20.0f;
+// voiced sound has its energy below ~3 kHz, so it crosses zero less often
+// than hiss
+static const float maxVoiceCrossingsPerSecond = 6000.0f;
+// the floor starts at the quietest of the first blocks after reset()
+static const unsigned int seedBlocks = 10;
+// how far the floor may rise per block: quickly towards noise-like blocks
+// (too many zero crossings for voice), slowly during anything that could be
+// voice, so speech does not lift it. it falls to any quieter block at once.
+static const float noiseFloorRiseDb = 0.5f;
+static const float voicedFloorRiseDb = 0.05f;
+
+float getGateDefaultThreshold(GateMode mode) {
+  return mode == GATE_MODE_VOICE ? -50.0f : -90.0f;
+}
+
+bool VoiceGate::configure(GateMode mode, unsigned int numChannels, unsigned int sampleRate, float thresholdDb, unsigned int hangoverMs) {
+  if (numChannels == 0 || sampleRate == 0) {
+    return false;
+  }
+  this->mode = mode;
+  this->numChannels = numChannels;
+  this->sampleRate = sampleRate;
+  this->thresholdDb = thresholdDb;
+  blockFrames = (size_t)sampleRate * blockMs / 1000;
+  if (blockFrames == 0) {
+    blockFrames = 1;
+  }
+  hangoverBlocks = (hangoverMs + blockMs - 1) / blockMs;
+  // digital silence must not drag the floor below where the threshold
+  // decides anyway
+  minNoiseFloorDb = thresholdDb - voiceMarginDb;
+  pending.assign(blockFrames * numChannels, 0.0f);
+  gatedFrames.store(0);
+  reset();
+  return true;
+}
+
+void VoiceGate::reset() {
+  pendingFrames = 0;
+  holdBlocks = 0;
+  floorBlocks = 0;
+  noiseFloorDb = minNoiseFloorDb;
+  open.store(false);
+}
+
+GateMode VoiceGate::getMode() {
+  return mode;
+}
+
+size_t VoiceGate::getMaxOutputFrames(size_t inputFrames) {
+  return inputFrames + blockFrames;
+}
+
+bool VoiceGate::isOpen() {
+  return open.load(std::memory_order_relaxed);
+}
+
+uint64_t VoiceGate::getGatedFrames() {
+  return gatedFrames.load(std::memory_order_relaxed);
+}
+
+// peak over all samples, energy and zero crossings of the channel average
+bool VoiceGate::isActive(const float* block) {
+  float peak = 0.0f;
+  double sumSquares = 0.0;
+  unsigned int crossings = 0;
+  bool wasNegative = false;
+  float scale = 1.0f / numChannels;
+  for (size_t f = 0; f < blockFrames; f++) {
+    const float* frame = block + f * numChannels;
+    float sum = 0.0f;
+    for (unsigned int c = 0; c < numChannels; c++) {
+      float a = fabsf(frame[c]);
+      if (a > peak) {
+        peak = a;
+      }
+      sum += frame[c];
+    }
+    float mono = sum * scale;
+    sumSquares += (double)mono * mono;
+    bool negative = mono < 0.0f;
+    if (f > 0 && negative != wasNegative) {
+      crossings++;
+    }
+    wasNegative = negative;
+  }
+
+  if (mode == GATE_MODE_SILENCE) {
+    return 20.0f * log10f(peak + 1e-12f) > thresholdDb;
+  }
+
+  float energyDb = 10.0f * (float)log10(sumSquares / blockFrames + 1e-20);
+  float crossingsPerSecond = (float)crossings * sampleRate / blockFrames;
+  bool voiced = crossingsPerSecond < maxVoiceCrossingsPerSecond;
+  if (floorBlocks < seedBlocks) {
+    noiseFloorDb = floorBlocks == 0 || energyDb < noiseFloorDb ? energyDb : noiseFloorDb;
+    floorBlocks++;
+  } else if (energyDb < noiseFloorDb) {
+    noiseFloorDb = energyDb;
+  } else {
+    float risen = noiseFloorDb + (voiced ? voicedFloorRiseDb : noiseFloorRiseDb);
+    noiseFloorDb = risen < energyDb ? risen : energyDb;
+  }
+  if (noiseFloorDb < minNoiseFloorDb) {
+    noiseFloorDb = minNoiseFloorDb;
+  }
+
+  if (energyDb <= thresholdDb || energyDb <= noiseFloorDb + voiceMarginDb) {
+    return false;
+  }
+  float loudDb = (noiseFloorDb > thresholdDb ? noiseFloorDb : thresholdDb) + loudMarginDb;
+  return voiced || energyDb > loudDb;
+}
+
+size_t VoiceGate::process(const float* in, size_t frames, float* out) {
+  size_t produced = 0;
+  while (frames > 0) {
+    // judge whole blocks straight from the input, buffer partial ones
+    const float* block;
+    size_t take = blockFrames - pendingFrames;
+    if (take > frames) {
+      take = frames;
+    }
+    if (pendingFrames == 0 && take == blockFrames) {
+      block = in;
+    } else {
+      memcpy(pending.data() + pendingFrames * numChannels, in, take * numChannels * sizeof(float));
+      pendingFrames += take;
+      block = pending.data();
+    }
+    in += take * numChannels;
+    frames -= take;
+    if (block == pending.data() && pendingFrames < blockFrames) {
+      break;
+    }
+    pendingFrames = 0;
+
+    bool active = isActive(block);
+    if (active) {
+      holdBlocks = hangoverBlocks;
+    } else if (holdBlocks > 0) {
+      holdBlocks--;
+      active = true;
+    }
+    open.store(active, std::memory_order_relaxed);
+
+    if (active) {
+      memcpy(out + produced * numChannels, block, blockFrames * numChannels * sizeof(float));
+      produced += blockFrames;
+    } else {
+      gatedFrames.fetch_add(blockFrames, std::memory_order_relaxed);
+    }
+  }
+  return produced;
+}
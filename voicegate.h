@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+typedef enum GateMode {
+  GATE_MODE_OFF = 0,
+  // drop spans whose peak stays below the threshold (default -90 dBFS)
+  GATE_MODE_SILENCE = 1,
+  // drop spans without voice activity: energy above the threshold (default
+  // -50 dBFS) and above the tracked noise floor, with a zero-crossing rate
+  // low enough for voiced sound
+  GATE_MODE_VOICE = 2,
+} GateMode;
+
+// suppresses delivery of silent or inactive spans of interleaved float32
+// frames. the input is judged in blocks of 10 ms; a block that passes is
+// copied to the output, a block that does not is dropped. the gate stays open
+// for hangoverMs after the last active block so word endings and short pauses
+// are not cut. deciding per whole block delays the output by up to one block.
+class VoiceGate {
+private:
+  GateMode mode = GATE_MODE_OFF;
+  unsigned int numChannels = 0;
+  unsigned int sampleRate = 0;
+  size_t blockFrames = 0;
+  float thresholdDb = 0.0f;
+  unsigned int hangoverBlocks = 0;
+
+  unsigned int holdBlocks = 0;
+  // energy of the background in dBFS, and blocks judged since reset()
+  float noiseFloorDb = 0.0f;
+  float minNoiseFloorDb = 0.0f;
+  unsigned int floorBlocks = 0;
+
+  std::vector<float> pending;
+  size_t pendingFrames = 0;
+
+  std::atomic<bool> open{false};
+  std::atomic<uint64_t> gatedFrames{0};
+
+  bool isActive(const float* block);
+
+public:
+  bool configure(GateMode mode, unsigned int numChannels, unsigned int sampleRate, float thresholdDb, unsigned int hangoverMs);
+  void reset();
+
+  GateMode getMode();
+  size_t getMaxOutputFrames(size_t inputFrames);
+
+  // returns the number of frames written to out.
+  size_t process(const float* in, size_t frames, float* out);
+
+  // safe to call from any thread
+  bool isOpen();
+  uint64_t getGatedFrames();
+};
+
+// default threshold of a mode in dBFS
+float getGateDefaultThreshold(GateMode mode);
@@ -0,0 +1,60 @@
+#include "wakeevent.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <semaphore.h>
+#include <time.h>
+#endif
+
+#ifdef _WIN32
+void* createWakeEvent() {
+  return CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+void signalWakeEvent(void* event) {
+  SetEvent(event);
+}
+
+void waitWakeEvent(void* event, unsigned int timeoutMs) {
+  WaitForSingleObject(event, timeoutMs);
+}
+
+void closeWakeEvent(void* event) {
+  CloseHandle(event);
+}
+#else
+void* createWakeEvent() {
+  sem_t* semaphore = new sem_t;
+  if (sem_init(semaphore, 0, 0) != 0) {
+    delete semaphore;
+    return NULL;
+  }
+  return semaphore;
+}
+
+// a semaphore counts every signal where an auto-reset event collapses them,
+// so the waiting thread may wake up with nothing to do. harmless.
+void signalWakeEvent(void* event) {
+  sem_post((sem_t*)event);
+}
+
+void waitWakeEvent(void* event, unsigned int timeoutMs) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += timeoutMs / 1000;
+  deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  while (sem_timedwait((sem_t*)event, &deadline) != 0 && errno == EINTR) {
+  }
+}
+
+void closeWakeEvent(void* event) {
+  sem_destroy((sem_t*)event);
+  delete (sem_t*)event;
+}
+#endif
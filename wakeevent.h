@@ -0,0 +1,10 @@
+#pragma once
+
+// auto-reset event (Windows) or semaphore (POSIX) a real-time thread signals
+// to wake a background thread without taking a lock. the capture thread
+// signals these after every packet it hands to a recorder or sender.
+void* createWakeEvent();
+void signalWakeEvent(void* event);
+// returns after a signal or timeoutMs, whichever comes first
+void waitWakeEvent(void* event, unsigned int timeoutMs);
+void closeWakeEvent(void* event);
@@ -0,0 +1,597 @@
+#include "wasapibackend.h"
+#include <avrt.h>
+#include <functiondiscoverykeys_devpkey.h>
+
+// see https://learn.microsoft.com/en-us/windows/win32/coreaudio/capturing-a-stream
+// https://github.com/microsoft/Windows-classic-samples/blob/main/Samples/ApplicationLoopback/cpp/LoopbackCapture.cpp
+// https://learn.microsoft.com/en-us/answers/questions/786447/recording-desktop-audio?orderBy=Helpful
+// https://github.com/microsoft/windows-classic-samples/tree/main/Samples/ApplicationLoopback#application-loopback-api-capture-sample
+
+WasapiBackend::~WasapiBackend() {
+  releaseStream();
+  if (enumerator != NULL) {
+    enumerator->Release();
+  }
+  if (packetEvent != NULL) {
+    CloseHandle(packetEvent);
+  }
+}
+
+HRESULT WasapiBackend::initializeCom() {
+    // RPC_E_CHANGED_MODE if the thread is already in a single-threaded
+    // apartment
+    return CoInitializeEx(NULL, COINIT_MULTITHREADED);
+}
+
+void WasapiBackend::uninitializeCom() {
+    CoUninitialize();
+    //std::cerr << "C++ uninitialized COM" << std::endl;
+}
+
+static std::wstring toWide(const char* text) {
+  int length = MultiByteToWideChar(CP_UTF8, 0, text, -1, NULL, 0);
+  if (length <= 1) {
+    return std::wstring();
+  }
+  std::wstring returnValue(length - 1, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, text, -1, &returnValue[0], length);
+  return returnValue;
+}
+
+static std::string toUtf8(LPCWSTR text) {
+  int length = WideCharToMultiByte(CP_UTF8, 0, text, -1, NULL, 0, NULL, NULL);
+  if (length <= 1) {
+    return std::string();
+  }
+  std::string returnValue(length - 1, '\0');
+  WideCharToMultiByte(CP_UTF8, 0, text, -1, &returnValue[0], length, NULL, NULL);
+  return returnValue;
+}
+
+static IMMDeviceEnumerator* createDeviceEnumerator() {
+  IMMDeviceEnumerator* deviceEnumerator = NULL;
+  HRESULT enumeratorHr = CoCreateInstance(
+      __uuidof(MMDeviceEnumerator), NULL, CLSCTX_ALL,
+      __uuidof(IMMDeviceEnumerator), (void**)&deviceEnumerator);
+  return SUCCEEDED(enumeratorHr) ? deviceEnumerator : NULL;
+}
+
+static std::string getDefaultDeviceId(IMMDeviceEnumerator* deviceEnumerator, EDataFlow dataFlow) {
+  IMMDevice* device = NULL;
+  std::string returnValue;
+  if (SUCCEEDED(deviceEnumerator->GetDefaultAudioEndpoint(dataFlow, eConsole, &device))) {
+    LPWSTR id = NULL;
+    if (SUCCEEDED(device->GetId(&id))) {
+      returnValue = toUtf8(id);
+      CoTaskMemFree(id);
+    }
+    device->Release();
+  }
+  return returnValue;
+}
+
+static bool getDataFlow(IMMDevice* device, EDataFlow* dataFlow) {
+  IMMEndpoint* endpoint = NULL;
+  if (FAILED(device->QueryInterface(__uuidof(IMMEndpoint), (void**)&endpoint))) {
+    return false;
+  }
+  HRESULT flowHr = endpoint->GetDataFlow(dataFlow);
+  endpoint->Release();
+  return SUCCEEDED(flowHr);
+}
+
+bool WasapiBackend::enumerateDevices(std::vector<AudioDeviceInfo>* devices) {
+  devices->clear();
+  IMMDeviceEnumerator* deviceEnumerator = createDeviceEnumerator();
+  if (deviceEnumerator == NULL) {
+    return false;
+  }
+  IMMDeviceCollection* collection = NULL;
+  if (FAILED(deviceEnumerator->EnumAudioEndpoints(eAll, DEVICE_STATE_ACTIVE, &collection))) {
+    deviceEnumerator->Release();
+    return false;
+  }
+  std::string defaultRender = getDefaultDeviceId(deviceEnumerator, eRender);
+  std::string defaultCapture = getDefaultDeviceId(deviceEnumerator, eCapture);
+
+  UINT count = 0;
+  collection->GetCount(&count);
+  for (UINT i = 0; i < count; i++) {
+    IMMDevice* device = NULL;
+    if (FAILED(collection->Item(i, &device))) {
+      continue;
+    }
+    AudioDeviceInfo info;
+    LPWSTR id = NULL;
+    EDataFlow dataFlow;
+    if (SUCCEEDED(device->GetId(&id)) && getDataFlow(device, &dataFlow)) {
+      info.id = toUtf8(id);
+      info.isCapture = dataFlow == eCapture;
+      info.isDefault = info.id == (info.isCapture ? defaultCapture : defaultRender);
+      IPropertyStore* properties = NULL;
+      if (SUCCEEDED(device->OpenPropertyStore(STGM_READ, &properties))) {
+        PROPVARIANT name;
+        PropVariantInit(&name);
+        if (SUCCEEDED(properties->GetValue(PKEY_Device_FriendlyName, &name)) && name.vt == VT_LPWSTR) {
+          info.name = toUtf8(name.pwszVal);
+        }
+        PropVariantClear(&name);
+        properties->Release();
+      }
+      devices->push_back(info);
+    }
+    if (id != NULL) {
+      CoTaskMemFree(id);
+    }
+    device->Release();
+  }
+  collection->Release();
+  deviceEnumerator->Release();
+  return true;
+}
+
+bool WasapiBackend::setDevice(const char* id) {
+  // a warm stream belongs to the previous endpoint
+  if (!started) {
+    releaseStream();
+  }
+  if (id == NULL || id[0] == '\0') {
+    deviceId.clear();
+    return true;
+  }
+  std::wstring wideId = toWide(id);
+  IMMDeviceEnumerator* deviceEnumerator = createDeviceEnumerator();
+  if (deviceEnumerator == NULL) {
+    return false;
+  }
+  IMMDevice* device = NULL;
+  bool found = SUCCEEDED(deviceEnumerator->GetDevice(wideId.c_str(), &device));
+  if (found) {
+    device->Release();
+    deviceId = wideId;
+  }
+  deviceEnumerator->Release();
+  return found;
+}
+
+/* for debugging
+
+std::string ToString(GUID *guid) {
+    char guid_string[37]; // 32 hex chars + 4 hyphens + null terminator
+    snprintf(
+          guid_string, sizeof(guid_string),
+          "%08x-%04x-%04x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+          guid->Data1, guid->Data2, guid->Data3,
+          guid->Data4[0], guid->Data4[1], guid->Data4[2],
+          guid->Data4[3], guid->Data4[4], guid->Data4[5],
+          guid->Data4[6], guid->Data4[7]);
+    return guid_string;
+}
+*/
+
+bool WasapiBackend::setBufferOptions(const CaptureBufferOptions& options) {
+  bufferOptions = options;
+  // a warm stream was initialized with the old options
+  if (!started) {
+    releaseStream();
+  }
+  return true;
+}
+
+// shared mode streams run at the engine period unless IAudioClient3 sets a
+// smaller one (Windows 10 and later, and not for loopback streams). returns
+// false if the stream still needs to be initialized the regular way.
+bool WasapiBackend::initializeLowLatency(DWORD streamFlags) {
+    IAudioClient3* client3 = NULL;
+    hr = recorderClient->QueryInterface(__uuidof(IAudioClient3), (void**)&client3);
+    if (FAILED(hr)) {
+      return false;
+    }
+    UINT32 defaultPeriod, fundamentalPeriod, minPeriod, maxPeriod;
+    hr = client3->GetSharedModeEnginePeriod(format, &defaultPeriod, &fundamentalPeriod, &minPeriod, &maxPeriod);
+    if (FAILED(hr)) {
+      client3->Release();
+      return false;
+    }
+
+    UINT32 period = minPeriod;
+    if (!bufferOptions.lowLatency) {
+      // closest multiple of the fundamental period within the supported range
+      period = (UINT32)((UINT64)bufferOptions.period * format->nSamplesPerSec / 10000000);
+      period = (period + fundamentalPeriod / 2) / fundamentalPeriod * fundamentalPeriod;
+      period = period < minPeriod ? minPeriod : (period > maxPeriod ? maxPeriod : period);
+    }
+    if (period >= defaultPeriod) {
+      client3->Release();
+      return false;
+    }
+
+    hr = client3->InitializeSharedAudioStream(streamFlags, period, format, NULL);
+    client3->Release();
+    if (SUCCEEDED(hr)) {
+      return true;
+    }
+
+    // a client that failed to initialize can't be initialized again. NULL if
+    // a new one can't be activated either.
+    recorderClient->Release();
+    hr = recorder->Activate(
+        __uuidof(IAudioClient), /* IID_IAudioClient, */
+        CLSCTX_ALL, NULL, (void**)&recorderClient);
+    if (FAILED(hr)) {
+      recorderClient = NULL;
+    }
+    return false;
+}
+
+// WASAPI objects created on a worker thread belong to the multithreaded
+// apartment. it must outlive the worker's CoUninitialize(), so it is kept
+// alive for the life of the process. a function-local static is initialized
+// exactly once, also when several clients open on different threads at once.
+static void keepMtaAlive() {
+  static const bool kept = []() {
+    CO_MTA_USAGE_COOKIE cookie;
+    return SUCCEEDED(CoIncrementMTAUsage(&cookie));
+  }();
+  (void)kept;
+}
+
+bool WasapiBackend::prepare() {
+    if (prepared) {
+      return true;
+    }
+    setError(0, NULL);
+    keepMtaAlive();
+
+    if (enumerator == NULL) {
+      // see https://stackoverflow.com/questions/12844431/linking-wasapi-in-vs-2010
+      // for some reason using CLSID_MMDeviceEnumerator and IID_IMMDeviceEnumerator
+      // leads to link error when compiling with MS visual studio. instead we have to
+      // use __uuidof(xxx) as below to fix the link eror.
+      hr = CoCreateInstance(
+          __uuidof(MMDeviceEnumerator), /* CLSID_MMDeviceEnumerator, */
+          NULL,
+          CLSCTX_ALL,
+          __uuidof(IMMDeviceEnumerator), /* IID_IMMDeviceEnumerator, */
+          (void**)&enumerator
+      );
+      if (FAILED(hr)) {
+        enumerator = NULL;
+        setError(hr, "CoCreateInstance(MMDeviceEnumerator)");
+        return false;
+      }
+    }
+
+    if (deviceId.empty()) {
+      hr = enumerator->GetDefaultAudioEndpoint(eRender, eConsole, &recorder);
+    } else {
+      hr = enumerator->GetDevice(deviceId.c_str(), &recorder);
+    }
+    // a warm backend keeps the enumerator for the next start
+    if (!keepWarm) {
+      enumerator->Release();
+      enumerator = NULL;
+    }
+    if (FAILED(hr)) {
+      recorder = NULL;
+      setError(hr, deviceId.empty() ? "GetDefaultAudioEndpoint" : "GetDevice");
+      return false;
+    }
+
+    // render endpoints are captured in loopback mode, capture endpoints as is
+    EDataFlow dataFlow = eRender;
+    getDataFlow(recorder, &dataFlow);
+    DWORD streamFlags = AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
+    if (dataFlow == eRender) {
+      streamFlags |= AUDCLNT_STREAMFLAGS_LOOPBACK;
+    }
+
+    hr = recorder->Activate(
+        __uuidof(IAudioClient), /* IID_IAudioClient, */
+        CLSCTX_ALL, NULL, (void**)&recorderClient);
+    if (FAILED(hr)) {
+      recorderClient = NULL;
+      setError(hr, "Activate(IAudioClient)");
+      releaseStream();
+      return false;
+    }
+
+    hr = recorderClient->GetMixFormat(&format);
+    if (FAILED(hr)) {
+      format = NULL;
+      setError(hr, "GetMixFormat");
+      releaseStream();
+      return false;
+    }
+
+    /*
+    printf("Mix format:\n");
+    printf("  Frame size     : %d\n", format->nBlockAlign);
+    printf("  Channels       : %d\n", format->nChannels);
+    printf("  Bits per second: %d\n", format->wBitsPerSample);
+    printf("  Sample rate:   : %d\n", format->nSamplesPerSec);
+    printf("  wFormatTag:   : %d\n", format->wFormatTag);
+    printf("  cbSize:   : %d\n", format->cbSize);
+    */
+
+    // NOTE: for audio capture, format seems to be WAVE_FORMAT_EXTENSIBLE
+    // and WAVEFORMATEXTENSIBLE.SubType is expected to be KSDATAFORMAT_SUBTYPE_IEEE_FLOAT
+    // see https://stackoverflow.com/questions/41876857/interpreting-waveformatextensible-from-iaudioclientgetmixformat
+    // https://learn.microsoft.com/en-us/windows/win32/api/mmreg/ns-mmreg-waveformatextensible?redirectedfrom=MSDN
+    // https://stackoverflow.com/questions/30692623/wasapi-loopback-save-wave-file
+
+    // event callback lets the capture thread sleep until a packet is ready
+    // instead of polling. polling via getNextPacketSize() keeps working as before.
+    lowLatencyStream = false;
+    if (bufferOptions.lowLatency || bufferOptions.period != 0) {
+      lowLatencyStream = initializeLowLatency(streamFlags);
+      if (recorderClient == NULL) {
+        setError(hr, "Activate(IAudioClient)");
+        releaseStream();
+        return false;
+      }
+    }
+    if (!lowLatencyStream) {
+      hr = recorderClient->Initialize(AUDCLNT_SHAREMODE_SHARED,  
+        streamFlags, 
+        bufferOptions.bufferDuration != 0 ? bufferOptions.bufferDuration : 10000000, 
+        0, 
+        format, 
+        NULL);
+      if (FAILED(hr)) {
+        setError(hr, "Initialize");
+        releaseStream();
+        return false;
+      }
+    }
+
+    if (packetEvent == NULL) {
+      packetEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+      if (packetEvent == NULL) {
+        setError(HRESULT_FROM_WIN32(GetLastError()), "CreateEvent");
+        releaseStream();
+        return false;
+      }
+    }
+    hr = recorderClient->SetEventHandle(packetEvent);
+    if (FAILED(hr)) {
+      setError(hr, "SetEventHandle");
+      releaseStream();
+      return false;
+    }
+
+    hr = recorderClient->GetService(
+        __uuidof(IAudioCaptureClient), /* IID_IAudioCaptureClient, */
+        (void**)&captureService);
+    if (FAILED(hr)) {
+      captureService = NULL;
+      setError(hr, "GetService(IAudioCaptureClient)");
+      releaseStream();
+      return false;
+    }
+
+    prepared = true;
+    return true;
+}
+
+bool WasapiBackend::open() {
+    bool wasWarm = prepared;
+    if (!prepare()) {
+      return false;
+    }
+    hr = recorderClient->Start();
+    if (FAILED(hr) && wasWarm) {
+      // the device may have changed since the stream was prepared
+      // (AUDCLNT_E_DEVICE_INVALIDATED); prepare it once more
+      releaseStream();
+      if (!prepare()) {
+        return false;
+      }
+      hr = recorderClient->Start();
+    }
+    if (FAILED(hr)) {
+      setError(hr, "Start");
+      releaseStream();
+      return false;
+    }
+    started = true;
+    return true;
+}
+
+void WasapiBackend::close() {
+    if (!started) {
+      return;
+    }
+    started = false;
+    recorderClient->Stop();
+    // a warm stream stays initialized. Reset() drops what is left in the
+    // buffer so the next run starts with fresh packets.
+    if (keepWarm && SUCCEEDED(recorderClient->Reset())) {
+      return;
+    }
+    releaseStream();
+}
+
+// releases everything prepare() set up, except a cached enumerator
+void WasapiBackend::releaseStream() {
+    if (captureService != NULL) {
+      captureService->Release();
+      captureService = NULL;
+    }
+    if (recorderClient != NULL) {
+      recorderClient->Release();
+      recorderClient = NULL;
+    }
+    if (recorder != NULL) {
+      recorder->Release();
+      recorder = NULL;
+    }
+    if (format != NULL) {
+      CoTaskMemFree(format);
+      format = NULL;
+    }
+    prepared = false;
+}
+
+void WasapiBackend::setKeepWarm(bool keepWarm) {
+  this->keepWarm = keepWarm;
+  if (!keepWarm && !started) {
+    releaseStream();
+  }
+  if (!keepWarm && enumerator != NULL) {
+    enumerator->Release();
+    enumerator = NULL;
+  }
+}
+
+CaptureFormat WasapiBackend::getFormat() {
+  if (format == NULL) {
+    // not prepared
+    CaptureFormat none = { 0, 0, 0, 0, CAPTURE_SAMPLE_UNKNOWN };
+    return none;
+  }
+  // the mix format is usually WAVE_FORMAT_EXTENSIBLE with subformat
+  // KSDATAFORMAT_SUBTYPE_IEEE_FLOAT, but some drivers report plain
+  // WAVE_FORMAT_IEEE_FLOAT or 16/24/32-bit PCM. the sample type goes by the
+  // container size; e.g. 24 valid bits in 32 decode like 32-bit PCM.
+  bool isFloat = format->wFormatTag == WAVE_FORMAT_IEEE_FLOAT;
+  bool isPcm = format->wFormatTag == WAVE_FORMAT_PCM;
+  if (format->wFormatTag == WAVE_FORMAT_EXTENSIBLE) {
+    const GUID& subFormat = ((WAVEFORMATEXTENSIBLE*)format)->SubFormat;
+    isFloat = IsEqualGUID(subFormat, KSDATAFORMAT_SUBTYPE_IEEE_FLOAT);
+    isPcm = IsEqualGUID(subFormat, KSDATAFORMAT_SUBTYPE_PCM);
+  }
+  CaptureSampleType sampleType = CAPTURE_SAMPLE_UNKNOWN;
+  if ((isFloat || isPcm) && format->nChannels != 0) {
+    sampleType = getCaptureSampleType(isFloat, format->nBlockAlign / format->nChannels * 8);
+  }
+  CaptureFormat returnValue = {
+    format->nBlockAlign,
+    format->nChannels,
+    format->wBitsPerSample,
+    format->nSamplesPerSec,
+    sampleType
+  };
+  return returnValue;
+}
+
+CaptureBufferInfo WasapiBackend::getBufferInfo() {
+  CaptureBufferInfo info = {};
+  if (format == NULL) {
+    return info;
+  }
+  unsigned int sampleRate = format->nSamplesPerSec;
+  UINT32 bufferFrames = 0;
+  recorderClient->GetBufferSize(&bufferFrames);
+  info.bufferFrames = bufferFrames;
+  REFERENCE_TIME streamLatency = 0;
+  recorderClient->GetStreamLatency(&streamLatency);
+  info.streamLatency = (uint64_t)streamLatency;
+
+  // without IAudioClient3 shared mode streams run at the default period
+  REFERENCE_TIME defaultPeriod = 0;
+  REFERENCE_TIME minPeriod = 0;
+  recorderClient->GetDevicePeriod(&defaultPeriod, &minPeriod);
+  info.defaultPeriodFrames = (uint32_t)((uint64_t)defaultPeriod * sampleRate / 10000000);
+  info.minPeriodFrames = info.defaultPeriodFrames;
+  info.periodFrames = info.defaultPeriodFrames;
+
+  IAudioClient3* client3 = NULL;
+  if (SUCCEEDED(recorderClient->QueryInterface(__uuidof(IAudioClient3), (void**)&client3))) {
+    UINT32 defaultFrames, fundamentalFrames, minFrames, maxFrames;
+    if (SUCCEEDED(client3->GetSharedModeEnginePeriod(format, &defaultFrames, &fundamentalFrames, &minFrames, &maxFrames))) {
+      info.defaultPeriodFrames = defaultFrames;
+      info.minPeriodFrames = minFrames;
+    }
+    WAVEFORMATEX* engineFormat = NULL;
+    UINT32 periodFrames = 0;
+    if (SUCCEEDED(client3->GetCurrentSharedModeEnginePeriod(&engineFormat, &periodFrames))) {
+      info.periodFrames = periodFrames;
+      CoTaskMemFree(engineFormat);
+    }
+    client3->Release();
+  }
+  info.lowLatency = lowLatencyStream;
+  return info;
+}
+
+uint64_t WasapiBackend::getCurrentTimestamp() {
+  // packet timestamps are QueryPerformanceCounter() in 100 ns units
+  LARGE_INTEGER counter;
+  LARGE_INTEGER frequency;
+  QueryPerformanceCounter(&counter);
+  QueryPerformanceFrequency(&frequency);
+  uint64_t count = (uint64_t)counter.QuadPart;
+  uint64_t perSecond = (uint64_t)frequency.QuadPart;
+  return count / perSecond * 10000000 + count % perSecond * 10000000 / perSecond;
+}
+
+void WasapiBackend::onCaptureThreadStart() {
+  // the WASAPI interfaces are free-threaded, but the thread still needs COM.
+  HRESULT threadHr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+  threadComInitialized = SUCCEEDED(threadHr);
+  if (!threadComInitialized) {
+    // the process-wide MTA (see keepMtaAlive()) still serves the calls
+    setError(threadHr, "CoInitializeEx");
+  }
+  DWORD taskIndex = 0;
+  mmcssTask = AvSetMmThreadCharacteristicsW(L"Audio", &taskIndex);
+}
+
+void WasapiBackend::onCaptureThreadStop() {
+  if (mmcssTask != NULL) {
+    AvRevertMmThreadCharacteristics(mmcssTask);
+    mmcssTask = NULL;
+  }
+  if (threadComInitialized) {
+    CoUninitialize();
+    threadComInitialized = false;
+  }
+}
+
+bool WasapiBackend::waitForPacket(unsigned int timeoutMs) {
+  return WaitForSingleObject(packetEvent, timeoutMs) == WAIT_OBJECT_0;
+}
+
+uint32_t WasapiBackend::getNextPacketSize() {
+  UINT32 framesAvailable;
+  HRESULT packetHr = captureService->GetNextPacketSize(&framesAvailable);
+  //printf("C++: %d frames available\n", framesAvailable);
+  // e.g. AUDCLNT_E_DEVICE_INVALIDATED when the device goes away. the stream
+  // then looks empty.
+  if (FAILED(packetHr)) {
+    setError(packetHr, "GetNextPacketSize");
+    return 0;
+  }
+  return(framesAvailable);
+}
+
+uint32_t WasapiBackend::acquirePacket(const char** data, uint32_t* flags, uint64_t* devicePosition, uint64_t* timestamp) {
+  UINT32 frames;
+  DWORD packetFlags;
+  UINT64 packetPosition;
+  UINT64 packetTimestamp;
+  HRESULT packetHr = captureService->GetBuffer(&captureBuffer, &frames, &packetFlags, &packetPosition, &packetTimestamp);
+  if (FAILED(packetHr)) {
+    setError(packetHr, "GetBuffer");
+    frames = 0;
+    packetFlags = 0;
+    packetPosition = 0;
+    packetTimestamp = 0;
+    captureBuffer = NULL;
+  }
+  *data = (const char*)captureBuffer;
+  *flags = packetFlags;
+  *devicePosition = packetPosition;
+  *timestamp = packetTimestamp;
+  return frames;
+}
+
+void WasapiBackend::releasePacket(uint32_t nFrames) {
+  // fails only after GetBuffer() did, which has already been recorded
+  captureService->ReleaseBuffer(nFrames);
+}
+
+unsigned int WasapiBackend::getFrameSize() {
+  return format->nBlockAlign;
+}
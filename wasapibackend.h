@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdio.h>
+#include <Windows.h>
+extern "C" {
+#include <initguid.h>
+#include <mmdeviceapi.h>
+}
+#include <Audioclient.h>
+
+#include <string>
+#include <vector>
+
+#include "capturebackend.h"
+
+// shared mode WASAPI stream of one endpoint: render endpoints in loopback
+// mode, capture endpoints as is. packets are signaled by an event
+// (AUDCLNT_STREAMFLAGS_EVENTCALLBACK).
+class WasapiBackend : public CaptureBackend {
+private:
+    HRESULT hr;
+    IMMDeviceEnumerator* enumerator = NULL;
+    IMMDevice* recorder = NULL;
+    IAudioClient* recorderClient = NULL;
+    IAudioCaptureClient* captureService = NULL;
+    WAVEFORMATEX* format = NULL;
+    BYTE* captureBuffer;
+
+    // endpoint open() opens; empty for the default render endpoint
+    std::wstring deviceId;
+
+    HANDLE packetEvent = NULL;
+    HANDLE mmcssTask = NULL;
+    // whether onCaptureThreadStart() initialized COM on the capture thread
+    bool threadComInitialized = false;
+
+    CaptureBufferOptions bufferOptions = {};
+    // whether open() got a period below the default
+    bool lowLatencyStream = false;
+
+    // prepared: the stream is initialized but not necessarily started.
+    // keepWarm keeps it that way, and the enumerator around, after close().
+    bool prepared = false;
+    bool started = false;
+    bool keepWarm = false;
+
+    bool initializeLowLatency(DWORD streamFlags);
+    void releaseStream();
+
+public:
+    ~WasapiBackend();
+
+    // returns the HRESULT of CoInitializeEx
+    static HRESULT initializeCom();
+    static void uninitializeCom();
+    // active render and capture endpoints. COM must be initialized.
+    static bool enumerateDevices(std::vector<AudioDeviceInfo>* devices);
+
+    // CaptureBackend
+    bool setDevice(const char* id);
+    bool setBufferOptions(const CaptureBufferOptions& options);
+    bool prepare();
+    bool open();
+    void close();
+    void setKeepWarm(bool keepWarm);
+    CaptureFormat getFormat();
+    CaptureBufferInfo getBufferInfo();
+    uint64_t getCurrentTimestamp();
+
+    // CaptureSource
+    void onCaptureThreadStart();
+    void onCaptureThreadStop();
+    bool waitForPacket(unsigned int timeoutMs);
+    uint32_t getNextPacketSize();
+    uint32_t acquirePacket(const char** data, uint32_t* flags, uint64_t* devicePosition, uint64_t* timestamp);
+    void releasePacket(uint32_t nFrames);
+    unsigned int getFrameSize();
+};